@@ -10,6 +10,21 @@
  * This file contains the device support code for TCP/IP communications
  * with the Attocube ANC350 Piezo Motion Controller.  This device support
  * requires the asyn module to establish communications.
+ *
+ * On a port that can block, a record's request is written and the port
+ * released without waiting; the record completes when its ack arrives or
+ * devAnc350AckTimeout passes (see pipeSend).  The driver of a motor on the
+ * same port flushes the port before its own reads and may discard such an
+ * ack, so records on a port that anc350AsynMotorCreate also uses always
+ * wait for their ack in the port thread.  Give the records a connection of
+ * their own to have them pipelined.  Message IDs come from the motor
+ * driver's counter when it is loaded, so the acks of the two never match
+ * each other's requests.
+ *
+ * With devAnc350DemandScan set, periodic longin reads that nobody watches
+ * are skipped (see demandWanted).  A skipped scan still processes the
+ * record but keeps the value and the time stamp of the last real read, so
+ * TIME shows how old an unwatched value is.
  */
 #include <stdlib.h>
 #include <stddef.h>
@@ -22,14 +37,18 @@
 #include <recGbl.h>
 #include <dbAccess.h>
 #include <dbDefs.h>
+#include <dbStaticLib.h>
 #include <link.h>
 #include <epicsPrint.h>
 #include <epicsMutex.h>
 #include <epicsString.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
 #include <cantProceed.h>
 #include <dbCommon.h>
 #include <dbScan.h>
 #include <callback.h>
+#include <registryFunction.h>
 #include <stringinRecord.h>
 #include <stringoutRecord.h>
 #include <longinRecord.h>
@@ -44,6 +63,7 @@
 #include <menuFtype.h>
 #include <recSup.h>
 #include <devSup.h>
+#include <menuScan.h>
 
 #include <epicsExport.h>
 #include "asynDriver.h"
@@ -69,16 +89,69 @@ static void callbackLiRead(asynUser *pasynUser);
 static long initLoWrite(longoutRecord *plo);
 static void callbackLoWrite(asynUser *pasynUser);
 
+/* Pipelined transactions, see pipeSend */
+static struct devAnc350Pipe *pipeFind(devPvt *pdevPvt);
+static void pipeSend(devPvt *pdevPvt, const char *request, size_t nbytes, int localMid);
+static void pipeRead(asynUser *pasynUser);
+static void pipeReadDelayed(CALLBACK *pcallback);
+static int nextMid(asynUser *pasynUser);
+
+/* Demand-driven scanning of longin reads, see demandWanted */
+static int demandWanted(dbCommon *precord);
+static void demandIdleSet(dbCommon *precord, int idle);
+static void demandLinks(void *arg);
+static epicsThreadOnceId demandOnceId = EPICS_THREAD_ONCE_INIT;
+
+/* Set non-zero to skip periodic reads that nobody is watching */
+int devAnc350DemandScan = 0;
+/* Seconds a read keeps being scanned after the last sign of interest */
+double devAnc350DemandGrace = 10.0;
+/* Set to zero before iocInit to wait for each ack in the port thread */
+int devAnc350Pipeline = 1;
+/* Seconds a pipelined transaction waits for its ack */
+double devAnc350AckTimeout = 0.5;
+
+/* Interval between the reads of the acks while transactions are waiting */
+#define PIPE_READ_PERIOD 0.01
+
+/*
+ * In-flight transactions of one port.  Only used in the port thread: by
+ * the record callbacks that send the requests and by pipeRead, which is
+ * queued at low priority while any transaction is waiting for its ack.
+ */
+typedef struct devAnc350Pipe
+{
+  struct devAnc350Pipe *pnext;
+  char                 *portName;
+  asynUser             *pasynUser;
+  asynOctet            *poctet;
+  void                 *octetPvt;
+  devPvt               *pending;
+  int                  readQueued;     /* pipeRead queued or waiting for readCallback */
+  CALLBACK             readCallback;
+  char                 in[UC_MAXSIZE * 4];
+  size_t               fill;
+} devAnc350Pipe;
+
+static devAnc350Pipe *pipes = NULL;
+
 /* Simple static counter for message identification */
 static int mid = 0;
 /* Mutex for protecting message ID increments */
 static epicsMutexId midMutexId = NULL;
+/* Message ID counter and port check of the motor driver, if it is loaded */
+static int (*sharedNextMid)(void) = NULL;
+static int (*sharedPortDriven)(const char *port) = NULL;
 
 commonDset asynLiAnc350Read        = {5, 0, 0, initLiRead,      0, processCommon};
 commonDset asynLoAnc350Write       = {5, 0, 0, initLoWrite,     0, processCommon};
 
 epicsExportAddress(dset, asynLiAnc350Read);
 epicsExportAddress(dset, asynLoAnc350Write);
+epicsExportAddress(int, devAnc350DemandScan);
+epicsExportAddress(double, devAnc350DemandGrace);
+epicsExportAddress(int, devAnc350Pipeline);
+epicsExportAddress(double, devAnc350AckTimeout);
 
 /*
  * Function: writeIt
@@ -196,6 +269,288 @@ static void finish(dbCommon *pr)
   if(pr->pact) callbackRequestProcessCallback(&pPvt->callback,pr->prio,pr);
 }
 
+/*
+ * Function: nextMid
+ *
+ * Parameters: pasynUser - Pointer to the asynUser structure
+ *
+ * Returns: Next message ID
+ * 
+ * Description:
+ *
+ * Takes the message ID from the motor driver's counter when the motor
+ * driver is loaded, so that the IDs of records and motors on the same
+ * port never collide.  Otherwise increments the counter of this file
+ * under the mid mutex.  Both wrap at 10000.
+ */
+static int nextMid(asynUser *pasynUser)
+{
+  int localMid = 1;
+
+  if (sharedNextMid) return sharedNextMid();
+
+	/* Lock the mid mutex and increment */
+  if (epicsMutexLock(midMutexId) == epicsMutexLockOK) {
+	  mid++;
+  	if (mid > 10000){
+  	  mid = 1;  
+  	}
+		localMid = mid;
+    epicsMutexUnlock(midMutexId);
+  } else {
+    asynPrint(pasynUser,ASYN_TRACE_ERROR, "nextMid: Failed to get midMutexId lock.\n");
+  }
+  return localMid;
+}
+
+/*
+ * Function: pipeFind
+ *
+ * Parameters: pdevPvt - Pointer to the device structure of a record
+ *
+ * Returns: Pointer to the pipe of the record's port, NULL on failure
+ * 
+ * Description:
+ *
+ * Finds the pipe of the port, creating it for the first record of the
+ * port.  Called at record initialisation only.
+ */
+static devAnc350Pipe *pipeFind(devPvt *pdevPvt)
+{
+  devAnc350Pipe *pipe;
+
+  for (pipe = pipes; pipe; pipe = pipe->pnext){
+    if (strcmp(pipe->portName, pdevPvt->portName) == 0) return pipe;
+  }
+
+  pipe = callocMustSucceed(1, sizeof(*pipe), "devAnc350 pipeFind");
+  pipe->portName = epicsStrDup(pdevPvt->portName);
+  pipe->poctet = pdevPvt->poctet;
+  pipe->octetPvt = pdevPvt->interfacePvt;
+  pipe->pasynUser = pasynManager->createAsynUser(pipeRead, 0);
+  pipe->pasynUser->userPvt = pipe;
+  callbackSetCallback(pipeReadDelayed, &pipe->readCallback);
+  callbackSetPriority(priorityLow, &pipe->readCallback);
+  callbackSetUser(pipe, &pipe->readCallback);
+  if (pasynManager->connectDevice(pipe->pasynUser, pipe->portName, pdevPvt->addr) != asynSuccess){
+    asynPrint(pdevPvt->pasynUser,ASYN_TRACE_ERROR,
+	      "%s devAnc350 cannot connect the ack reader, acks are waited for\n",
+	      pdevPvt->precord->name);
+    pasynManager->freeAsynUser(pipe->pasynUser);
+    free(pipe->portName);
+    free(pipe);
+    return NULL;
+  }
+  pipe->pnext = pipes;
+  pipes = pipe;
+  return pipe;
+}
+
+/*
+ * Function: pipeComplete
+ *
+ * Parameters: pdevPvt - Pointer to the device structure of a record
+ *
+ * Returns: void
+ * 
+ * Description:
+ *
+ * Applies the outcome of a pipelined transaction and completes the record.
+ */
+static void pipeComplete(devPvt *pdevPvt)
+{
+  dbCommon *precord = pdevPvt->precord;
+  int      read = (precord->dset == (struct dset *)&asynLiAnc350Read);
+
+  if (pdevPvt->pipeStatus == asynSuccess){
+    precord->udf = 0;
+    if (read) ((longinRecord *)precord)->val = pdevPvt->pipeValue;
+    asynPrint(pdevPvt->pasynUser,ASYN_TRACEIO_FILTER,"%s raw value read: %d\n",precord->name,pdevPvt->pipeValue);
+  } else {
+    asynPrint(pdevPvt->pasynUser,ASYN_TRACE_ERROR,"%s devAnc350 message ID %d %s\n",precord->name,pdevPvt->pipeMid,
+	      (pdevPvt->pipeStatus == asynTimeout) ? "not acknowledged" : "refused");
+    recGblSetSevr(precord, read ? READ_ALARM : WRITE_ALARM, INVALID_ALARM);
+  }
+  finish(precord);
+}
+
+/*
+ * Function: pipeQueueRead
+ *
+ * Parameters: pipe - Pointer to the pipe of a port
+ *
+ * Returns: void
+ * 
+ * Description:
+ *
+ * Queues pipeRead if transactions are waiting and it is not queued yet.
+ * If it cannot be queued every waiting transaction fails.
+ */
+static void pipeQueueRead(devAnc350Pipe *pipe)
+{
+  devPvt *pdevPvt;
+
+  if (pipe->readQueued || !pipe->pending) return;
+  if (pasynManager->queueRequest(pipe->pasynUser, asynQueuePriorityLow, 0.0) == asynSuccess){
+    pipe->readQueued = 1;
+    return;
+  }
+  while ((pdevPvt = pipe->pending) != NULL){
+    pipe->pending = pdevPvt->pipeNext;
+    pdevPvt->pipeStatus = asynError;
+    pipeComplete(pdevPvt);
+  }
+  pipe->fill = 0;
+}
+
+/*
+ * Function: pipeReadDelayed
+ *
+ * Parameters: pcallback - Pointer to the read callback of a pipe
+ *
+ * Returns: void
+ * 
+ * Description:
+ *
+ * Queues pipeRead again PIPE_READ_PERIOD after a read that left
+ * transactions waiting, so the port is free for other requests in
+ * between.  readQueued stays set meanwhile.  Should the queueing fail,
+ * it is tried again after another period.
+ */
+static void pipeReadDelayed(CALLBACK *pcallback)
+{
+  devAnc350Pipe *pipe;
+
+  callbackGetUser(pipe, pcallback);
+  if (pasynManager->queueRequest(pipe->pasynUser, asynQueuePriorityLow, 0.0) != asynSuccess){
+    callbackRequestDelayed(&pipe->readCallback, PIPE_READ_PERIOD);
+  }
+}
+
+/*
+ * Function: pipeSend
+ *
+ * Parameters: pdevPvt  - Pointer to the device structure of a record
+ *             request  - Telegram to send
+ *             nbytes   - Size of the telegram
+ *             localMid - Message ID of the telegram
+ *
+ * Returns: void
+ * 
+ * Description:
+ *
+ * Called in the port thread in place of the blocking write and reads.
+ * The telegram is written without a flush, which would discard the acks
+ * of the other transactions in flight, and the port is released at
+ * once.  The record stays active until pipeRead finds its ack or its
+ * deadline passes, so as many transactions as there are records can be
+ * in flight on a port.
+ */
+static void pipeSend(devPvt *pdevPvt, const char *request, size_t nbytes, int localMid)
+{
+  devAnc350Pipe *pipe = pdevPvt->pipe;
+
+  if (writeIt(pdevPvt->pasynUser, request, nbytes) != asynSuccess){
+    finish(pdevPvt->precord);
+    return;
+  }
+  pdevPvt->pipeMid = localMid;
+  epicsTimeGetCurrent(&pdevPvt->pipeDeadline);
+  epicsTimeAddSeconds(&pdevPvt->pipeDeadline, devAnc350AckTimeout);
+  pdevPvt->pipeNext = pipe->pending;
+  pipe->pending = pdevPvt;
+  pipeQueueRead(pipe);
+}
+
+/*
+ * Function: pipeRead
+ *
+ * Parameters: pasynUser - Pointer to the asynUser of a pipe
+ *
+ * Returns: void
+ * 
+ * Description:
+ *
+ * Queued callback of a pipe.  Reads whatever has arrived without
+ * waiting, completes the records whose acks are complete, fails those
+ * past their deadline and, while transactions are waiting, queues itself
+ * again PIPE_READ_PERIOD later.  Being queued at low priority, it lets
+ * the requests of other records go first.  Tell telegrams and acks that
+ * match no waiting record are dropped.
+ */
+static void pipeRead(asynUser *pasynUser)
+{
+  devAnc350Pipe  *pipe = (devAnc350Pipe *)pasynUser->userPvt;
+  devPvt         *done = NULL;
+  devPvt         *pdevPvt;
+  devPvt         **pprev;
+  epicsTimeStamp now;
+  size_t         nBytesRead = 0;
+  size_t         pos = 0;
+  int            eomReason;
+  asynStatus     status;
+
+  pasynUser->timeout = 0.0;
+  status = pipe->poctet->read(pipe->octetPvt, pasynUser, pipe->in + pipe->fill,
+                              sizeof(pipe->in) - pipe->fill, &nBytesRead, &eomReason);
+  if (status == asynSuccess || status == asynTimeout) pipe->fill += nBytesRead;
+
+  while (pipe->fill - pos >= sizeof(Int32)){
+    UcAckTelegram ack;
+    Int32         length;
+
+    memcpy(&length, pipe->in + pos, sizeof(Int32));
+    if (length < 0 || length > UC_MAXSIZE){
+      /* Out of step with the telegrams, start again from the next read */
+      pos = pipe->fill;
+      break;
+    }
+    if (pipe->fill - pos < sizeof(Int32) + (size_t)length) break;
+    memset(&ack, 0, sizeof(ack));
+    memcpy(&ack, pipe->in + pos, (sizeof(ack) < sizeof(Int32) + (size_t)length) ? sizeof(ack) : sizeof(Int32) + (size_t)length);
+    pos += sizeof(Int32) + (size_t)length;
+    if (ack.hdr.opcode != UC_ACK) continue;
+
+    for (pprev = &pipe->pending; *pprev; pprev = &(*pprev)->pipeNext){
+      pdevPvt = *pprev;
+      if (pdevPvt->pipeMid != ack.hdr.correlationNumber) continue;
+      *pprev = pdevPvt->pipeNext;
+      pdevPvt->pipeStatus = (ack.reason == UC_REASON_OK) ? asynSuccess : asynError;
+      pdevPvt->pipeValue = (epicsInt32)ack.data[0];
+      pdevPvt->pipeNext = done;
+      done = pdevPvt;
+      break;
+    }
+  }
+  memmove(pipe->in, pipe->in + pos, pipe->fill - pos);
+  pipe->fill -= pos;
+
+  epicsTimeGetCurrent(&now);
+  for (pprev = &pipe->pending; *pprev; ){
+    pdevPvt = *pprev;
+    if (epicsTimeDiffInSeconds(&now, &pdevPvt->pipeDeadline) < 0.0){
+      pprev = &pdevPvt->pipeNext;
+      continue;
+    }
+    *pprev = pdevPvt->pipeNext;
+    pdevPvt->pipeStatus = asynTimeout;
+    pdevPvt->pipeNext = done;
+    done = pdevPvt;
+  }
+  /* Nothing left to match a partial telegram against */
+  if (!pipe->pending) pipe->fill = 0;
+
+  while ((pdevPvt = done) != NULL){
+    done = pdevPvt->pipeNext;
+    pipeComplete(pdevPvt);
+  }
+  if (pipe->pending){
+    callbackRequestDelayed(&pipe->readCallback, PIPE_READ_PERIOD);
+  } else {
+    pipe->readQueued = 0;
+  }
+}
+
 /*
  * Function: initLiRead
  *
@@ -216,6 +571,8 @@ static long initLiRead(longinRecord *pli)
   status = initCommon((dbCommon *)pli,&pli->inp,callbackLiRead,asynOctetType);
   if(status!=asynSuccess) return 0;
   pdevPvt = (devPvt *)pli->dpvt;
+  pdevPvt->demand = 1;
+  epicsTimeGetCurrent(&pdevPvt->demandTime);
   initDbAddr(pdevPvt);
   initDrvUser(pdevPvt);
   return 0;
@@ -262,17 +619,8 @@ static void callbackLiRead(asynUser *pasynUser)
     UcAckTelegram ack;
   } tel;
 
-	/* Lock the mid mutex and increment */
-  if (epicsMutexLock(midMutexId) == epicsMutexLockOK) {
-	  mid++;
-  	if (mid > 10000){
-  	  mid = 1;  
-  	}
-		localMid = mid;
-  } else {
-    asynPrint(pasynUser,ASYN_TRACE_ERROR, "callbackLiRead: Failed to get midMutexId lock.\n");
-  }
-  epicsMutexUnlock(midMutexId);
+	/* Take the next message ID */
+  localMid = nextMid(pasynUser);
 	asynPrint(pasynUser,ASYN_TRACEIO_FILTER,"%s sending messge ID: %d\n",pli->name,localMid);
 
 	/* Check the INP field is not empty */
@@ -297,6 +645,12 @@ static void callbackLiRead(asynUser *pasynUser)
 		/* Set the message ID to the incremented value */
 		request.hdr.correlationNumber = localMid;
 
+		/* Release the port at once, the ack completes the record */
+		if (pdevPvt->pipe){
+			pipeSend(pdevPvt,(char *)&request,sizeof( UcGetTelegram ),localMid);
+			return;
+		}
+
 		/* Flush the connection to remove any stale data */
 		status = flushIt(pasynUser);
 
@@ -424,17 +778,8 @@ static void callbackLoWrite(asynUser *pasynUser)
     UcAckTelegram ack;
   } tel;
 
-	/* Lock the mid mutex and increment */
-  if (epicsMutexLock(midMutexId) == epicsMutexLockOK) {
-	  mid++;
-  	if (mid > 10000){
-  	  mid = 1;  
-  	}
-		localMid = mid;
-  } else {
-    asynPrint(pasynUser,ASYN_TRACE_ERROR, "callbackLiRead: Failed to get midMutexId lock.\n");
-  }
-  epicsMutexUnlock(midMutexId);
+	/* Take the next message ID */
+  localMid = nextMid(pasynUser);
 	asynPrint(pasynUser,ASYN_TRACEIO_FILTER,"%s sending messge ID: %d\n",plo->name,localMid);
 
 	/* Check the INP field is not empty */
@@ -458,6 +803,12 @@ static void callbackLoWrite(asynUser *pasynUser)
 		/* Set the message ID to the incremented value */
 		request.hdr.correlationNumber = localMid;
 
+		/* Release the port at once, the ack completes the record */
+		if (pdevPvt->pipe){
+			pipeSend(pdevPvt,(char *)&request,sizeof( UcSetTelegram ),localMid);
+			return;
+		}
+
 		/* Flush the connection to remove any stale data */
 	  status = flushIt(pasynUser);
 
@@ -555,6 +906,9 @@ long initCommon(dbCommon *precord,
     if ((midMutexId = epicsMutexCreate()) == NULL) {
 	    asynPrint(pasynUser,ASYN_TRACE_ERROR, "initCommon: Could not create midMutexId.\n");
     }
+    /* Registered by the motor driver, see drvAnc350RegisterShared */
+    sharedNextMid = (int (*)(void))registryFunctionFind("drvAnc350NextMid");
+    sharedPortDriven = (int (*)(const char *))registryFunctionFind("drvAnc350PortDriven");
 	}
 
   /*
@@ -610,6 +964,17 @@ long initCommon(dbCommon *precord,
 
   /* Determine if device can block */
   pasynManager->canBlock(pasynUser, &pdevPvt->canBlock);
+
+  /* Records of a port that can block share the in-flight transactions of the port */
+  if (devAnc350Pipeline && pdevPvt->poctet && pdevPvt->canBlock){
+    if (sharedPortDriven && sharedPortDriven(pdevPvt->portName)){
+      asynPrint(pasynUser,ASYN_TRACE_FLOW,
+		"%s port %s is shared with the motor driver, acks are waited for\n",
+		precord->name, pdevPvt->portName);
+    } else {
+      pdevPvt->pipe = pipeFind(pdevPvt);
+    }
+  }
   if (pdset->get_ioint_info){
     scanIoInit(&pdevPvt->ioScanPvt);
   }
@@ -684,6 +1049,122 @@ void initDbAddr(devPvt *pdevPvt)
   }
 }
 
+/*
+ * Function: demandLinks
+ *
+ * Parameters: arg - Unused
+ *
+ * Returns: void
+ * 
+ * Description:
+ *
+ * Walks the link fields of every record in the database once and marks
+ * each longin read named by a link as linked, so that it is always
+ * scanned.  Run on the first demand check, after the database is loaded.
+ */
+static void demandLinks(void *arg)
+{
+  DBENTRY  dbEntry;
+  DBADDR   dbAddr;
+  long     status;
+  char     name[PVNAME_STRINGSZ];
+  char     *pstr;
+  size_t   len;
+
+  dbInitEntry(pdbbase, &dbEntry);
+  for (status = dbFirstRecordType(&dbEntry); !status; status = dbNextRecordType(&dbEntry)){
+    for (status = dbFirstRecord(&dbEntry); !status; status = dbNextRecord(&dbEntry)){
+      for (status = dbFirstField(&dbEntry, 0); !status; status = dbNextField(&dbEntry, 0)){
+        if (dbEntry.pflddes->field_type != DBF_INLINK &&
+            dbEntry.pflddes->field_type != DBF_OUTLINK &&
+            dbEntry.pflddes->field_type != DBF_FWDLINK) continue;
+        pstr = dbGetString(&dbEntry);
+        if (!pstr || !*pstr || *pstr == '@') continue;
+        /* The record name runs up to the field or the link options */
+        len = strcspn(pstr, ". \t");
+        if (len >= sizeof(name)) continue;
+        strncpy(name, pstr, len);
+        name[len] = 0;
+        if (dbNameToAddr(name, &dbAddr)) continue;
+        if (dbAddr.precord->dset != (struct dset *)&asynLiAnc350Read || !dbAddr.precord->dpvt) continue;
+        ((devPvt *)dbAddr.precord->dpvt)->demandLinked = 1;
+      }
+    }
+  }
+  dbFinishEntry(&dbEntry);
+}
+
+/*
+ * Function: demandWanted
+ *
+ * Parameters: precord - Pointer to a record structure
+ *
+ * Returns: Non-zero if the record should be read from the controller
+ * 
+ * Description:
+ *
+ * With devAnc350DemandScan set, a periodically scanned longin is only
+ * read while someone is interested in it: it has CA monitors, another
+ * record links to it, or it was processed on request (a put to the
+ * record or its PROC field) within the last devAnc350DemandGrace
+ * seconds.  Monitors are checked on every scan, so reading starts again
+ * on the first scan after a client subscribes.  Skipped scans leave the
+ * last value and its time stamp in place, see demandIdleSet.  Writes and
+ * records that are not periodically scanned are never skipped.
+ */
+static int demandWanted(dbCommon *precord)
+{
+  devPvt         *pdevPvt = (devPvt *)precord->dpvt;
+  epicsTimeStamp now;
+  int            wanted;
+
+  if (!devAnc350DemandScan || !pdevPvt->demand || precord->scan < SCAN_1ST_PERIODIC){
+    if (pdevPvt->demandIdle) demandIdleSet(precord, 0);
+    return 1;
+  }
+
+  epicsThreadOnce(&demandOnceId, demandLinks, NULL);
+  epicsTimeGetCurrent(&now);
+  if (pdevPvt->demandLinked || precord->putf || ellCount(&precord->mlis) > 0){
+    pdevPvt->demandTime = now;
+  }
+  wanted = (epicsTimeDiffInSeconds(&now, &pdevPvt->demandTime) <= devAnc350DemandGrace);
+
+  if (wanted == pdevPvt->demandIdle) demandIdleSet(precord, !wanted);
+  return wanted;
+}
+
+/*
+ * Function: demandIdleSet
+ *
+ * Parameters: precord - Pointer to a record structure
+ *             idle    - Non-zero if the periodic reads are being skipped
+ *
+ * Returns: void
+ * 
+ * Description:
+ *
+ * While the reads are skipped TSE is set to epicsTimeEventDeviceTime, so
+ * the record support leaves TIME at the time of the last real read
+ * instead of stamping the old value as current.  The record's own TSE is
+ * put back when reading resumes.
+ */
+static void demandIdleSet(dbCommon *precord, int idle)
+{
+  devPvt *pdevPvt = (devPvt *)precord->dpvt;
+
+  asynPrint(pdevPvt->pasynUser, ASYN_TRACE_FLOW,
+	    "%s devAnc350 %s reading\n",
+	    precord->name, idle ? "stopped" : "resumed");
+  if (idle){
+    pdevPvt->demandTse = precord->tse;
+    precord->tse = epicsTimeEventDeviceTime;
+  } else {
+    precord->tse = pdevPvt->demandTse;
+  }
+  pdevPvt->demandIdle = idle;
+}
+
 /*
  * Function: processCommon
  *
@@ -703,6 +1184,7 @@ long processCommon(dbCommon *precord)
   asynStatus status;
 
   if (!pdevPvt->gotValue && precord->pact == 0){
+    if (!demandWanted(precord)) goto skip;
     if (pdevPvt->canBlock) precord->pact = 1;
     /* Request the callback be put on the queue */
     status = pasynManager->queueRequest(pdevPvt->pasynUser,
@@ -719,6 +1201,7 @@ long processCommon(dbCommon *precord)
       recGblSetSevr(precord, READ_ALARM, INVALID_ALARM);
     }
   }  
+ skip:
   if (!strcmp("ai", precord->rdes->name)){
     return 2;
   }
@@ -14,6 +14,7 @@
 #include <epicsMutex.h>
 #include <epicsString.h>
 #include <cantProceed.h>
+#include <epicsTime.h>
 #include <dbCommon.h>
 #include <dbScan.h>
 #include <callback.h>
@@ -55,6 +56,17 @@ typedef struct devPvt
   interruptCallbackOctet   octetCallback;
   interruptCallbackInt32   int32Callback;
   interruptCallbackFloat64 float64Callback;
+  int                      demand;
+  int                      demandLinked;
+  int                      demandIdle;
+  short                    demandTse;
+  epicsTimeStamp           demandTime;
+  struct devAnc350Pipe     *pipe;
+  struct devPvt            *pipeNext;
+  int                      pipeMid;
+  epicsTimeStamp           pipeDeadline;
+  asynStatus               pipeStatus;
+  epicsInt32               pipeValue;
 } devPvt;
 
 typedef struct commonDset
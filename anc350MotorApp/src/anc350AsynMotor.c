@@ -28,11 +28,14 @@
 #include "paramLib.h"
 
 #include "epicsFindSymbol.h"
+#include "registryFunction.h"
 #include "epicsTime.h"
 #include "epicsThread.h"
 #include "epicsEvent.h"
 #include "epicsMutex.h"
+#include "epicsAtomic.h"
 #include "ellLib.h"
+#include "epicsString.h"
 
 #include "drvSup.h"
 #include "epicsExport.h"
@@ -42,6 +45,7 @@
 #include "asynOctetSyncIO.h"
 #include "ucprotocol.h"
 #include "anc350.h"
+#include "drvAnc350.h"
 
 motorAxisDrvSET_t anc350AsynMotor =
   {
@@ -65,49 +69,13 @@ motorAxisDrvSET_t anc350AsynMotor =
 
 epicsExportAddress(drvet, anc350AsynMotor);
 
-typedef struct drvAnc350 * ANC350DRV_ID;
-typedef struct drvAnc350
-{
-    ANC350DRV_ID pNext;
-    asynUser * pasynUser;
-    int card;
-    int nAxes;
-    AXIS_HDL axis;
-    epicsThreadId motorThread;
-    epicsTimeStamp now;
-    int movesDeferred;
-    double movingPollPeriod;
-    double idlePollPeriod;
-    epicsEventId pollEventId;
-    epicsMutexId controllerMutexId;
-} drvAnc350_t;
-
-/* Default polling periods (in milliseconds). */
-static const int defaultMovingPollPeriod = 500;
-static const int defaultIdlePollPeriod = 1000;
-
 /* Message ID counter for matching replies */
 static int mid = 0;
-/* Mutex for protecting message ID increments */
-static epicsMutexId midMutexId = NULL;
-static int comms = 0;
+/* Mutex for protecting message ID increments */
+static epicsMutexId midMutexId = NULL;
+static epicsThreadOnceId midOnceId = EPICS_THREAD_ONCE_INIT;
 
-typedef struct motorAxisHandle
-{
-    ANC350DRV_ID pDrv;
-    int axis;
-    asynUser * pasynUser;
-    PARAMS params;
-    motorAxisLogFunc print;
-    void * logParam;
-    epicsMutexId axisMutex;
-    int scale;
-    double previous_position;
-    double previous_direction;
-    double reference_position;
-    int reference_search;
-    double amplitude;
-} motorAxis;
+/* The poll periods, timeouts and thresholds are set at runtime, see anc350Tune.c. */
 
 static ANC350DRV_ID pFirstDrv = NULL;
 
@@ -122,6 +90,9 @@ static motorAxisLogFunc drvPrintParam = NULL;
 #define MAX(a,b) ((a)>(b)? (a): (b))
 #define MIN(a,b) ((a)<(b)? (a): (b))
 
+/* Poll period while a stopped axis is still running */
+#define STOP_POLL_PERIOD 0.02
+
 /*
  * Function: motorAxisReportAxis
  *
@@ -139,10 +110,13 @@ static void motorAxisReportAxis( AXIS_HDL pAxis, int level )
 {
   printf( "Found driver for drvAnc350 card %d, axis %d\n", pAxis->pDrv->card, pAxis->axis );
   if (level > 0) printf( "drvAnc350->axisMutex = %p\n", pAxis->axisMutex );
+  if (level > 0) printf( "  last stop to standstill %.3f s%s\n", pAxis->stopTime, pAxis->stopPending? " (stop pending)": "" );
 
   if (level > 1)
   {
+    epicsMutexLock( pAxis->paramMutex );
     motorParam->dump( pAxis->params );
+    epicsMutexUnlock( pAxis->paramMutex );
   }
 }
 
@@ -295,7 +269,12 @@ static int motorAxisGetInteger( AXIS_HDL pAxis, motorAxisParam_t function, int *
   if (pAxis == NULL) return MOTOR_AXIS_ERROR;
   else
   {
-    return motorParam->getInteger( pAxis->params, (paramIndex) function, value );
+    int status;
+
+    epicsMutexLock( pAxis->paramMutex );
+    status = motorParam->getInteger( pAxis->params, (paramIndex) function, value );
+    epicsMutexUnlock( pAxis->paramMutex );
+    return status;
   }
 }
 
@@ -317,7 +296,12 @@ static int motorAxisGetDouble( AXIS_HDL pAxis, motorAxisParam_t function, double
   if (pAxis == NULL) return MOTOR_AXIS_ERROR;
   else
   {
-    return motorParam->getDouble( pAxis->params, (paramIndex) function, value );
+    int status;
+
+    epicsMutexLock( pAxis->paramMutex );
+    status = motorParam->getDouble( pAxis->params, (paramIndex) function, value );
+    epicsMutexUnlock( pAxis->paramMutex );
+    return status;
   }
 }
 
@@ -339,7 +323,12 @@ static int motorAxisSetCallback( AXIS_HDL pAxis, motorAxisCallbackFunc callback,
   if (pAxis == NULL) return MOTOR_AXIS_ERROR;
   else
   {
-    return motorParam->setCallback( pAxis->params, callback, param );
+    int status;
+
+    epicsMutexLock( pAxis->paramMutex );
+    status = motorParam->setCallback( pAxis->params, callback, param );
+    epicsMutexUnlock( pAxis->paramMutex );
+    return status;
   }
 }
 
@@ -373,6 +362,138 @@ static int motorAxisAsynConnect( const char * port, int addr, asynUser ** ppasyn
     return MOTOR_AXIS_OK;
 }
 
+/*
+ * Function: drvAnc350NextMid
+ *
+ * Parameters: None
+ *
+ * Returns: Next message ID
+ * 
+ * Description:
+ *
+ * Increments the message ID counter under the mid mutex and returns the
+ * new value.  The counter wraps at 10000 so that the ANC350 accepts it.
+ * devAnc350 takes its message IDs from here too, see
+ * drvAnc350RegisterShared, so that a record's ack is never taken for the
+ * reply to a motor GET on the same port.
+ */
+static void drvAnc350MidOnce( void * arg )
+{
+  if ((midMutexId = epicsMutexCreate()) == NULL) {
+    drvPrint( drvPrintParam, TRACE_ERROR, "drvAnc350NextMid: Could not create midMutexId.\n");
+  }
+}
+
+int drvAnc350NextMid( void )
+{
+  int localMid = 1;
+
+  epicsThreadOnce( &midOnceId, drvAnc350MidOnce, NULL );
+	/* Lock the mid mutex and increment */
+  if (epicsMutexLock(midMutexId) == epicsMutexLockOK) {
+	  mid++;
+  	if (mid > 10000){
+  	  mid = 1;  
+  	}
+		localMid = mid;
+    epicsMutexUnlock(midMutexId);
+  } else {
+    drvPrint(drvPrintParam, TRACE_ERROR, "drvAnc350NextMid: Failed to get midMutexId lock.\n");
+  }
+  return localMid;
+}
+
+/*
+ * Function: drvAnc350First
+ *
+ * Parameters: None
+ *
+ * Returns: Pointer to the first driver structure, NULL if none created
+ * 
+ * Description:
+ *
+ * Gives the other driver source files access to the list of controllers.
+ */
+ANC350DRV_ID drvAnc350First( void )
+{
+  return pFirstDrv;
+}
+
+/*
+ * Function: drvAnc350FindCard
+ *
+ * Parameters: card   - Number representing the motor controller
+ *
+ * Returns: Pointer to the driver structure, NULL if not found
+ * 
+ * Description:
+ *
+ * Looks up the controller created with the given card number.
+ */
+ANC350DRV_ID drvAnc350FindCard( int card )
+{
+  ANC350DRV_ID pDrv;
+
+  for ( pDrv=pFirstDrv; pDrv != NULL && (card != pDrv->card); pDrv = pDrv->pNext){}
+  return pDrv;
+}
+
+/*
+ * Function: drvAnc350FindPort
+ *
+ * Parameters: port   - String name of asyn port
+ *
+ * Returns: Pointer to the driver structure, NULL if not found
+ * 
+ * Description:
+ *
+ * Looks up the controller created on the given asyn port.
+ */
+ANC350DRV_ID drvAnc350FindPort( const char * port )
+{
+  ANC350DRV_ID pDrv;
+
+  if (port == NULL) return NULL;
+  for ( pDrv=pFirstDrv; pDrv != NULL && (strcmp( port, pDrv->portName ) != 0); pDrv = pDrv->pNext){}
+  return pDrv;
+}
+
+/*
+ * Function: drvAnc350PortDriven
+ *
+ * Parameters: port   - String name of asyn port
+ *
+ * Returns: Non-zero if a controller was created on the port
+ * 
+ * Description:
+ *
+ * Lets devAnc350 find out whether its records share a port with the
+ * motor driver, whose reads flush the port.
+ */
+int drvAnc350PortDriven( const char * port )
+{
+  return drvAnc350FindPort( port ) != NULL;
+}
+
+/*
+ * Function: drvAnc350RegisterShared
+ *
+ * Parameters: None
+ *
+ * Returns: void
+ * 
+ * Description:
+ *
+ * Called by the registrar.  Makes the message ID counter and the port
+ * check available to devAnc350 through the registry, so that neither
+ * library has to link against the other.
+ */
+void drvAnc350RegisterShared( void )
+{
+  registryFunctionAdd( "drvAnc350NextMid", (REGISTRYFUNCTION) drvAnc350NextMid );
+  registryFunctionAdd( "drvAnc350PortDriven", (REGISTRYFUNCTION) drvAnc350PortDriven );
+}
+
 /*
  * Function: motorAxisSet
  *
@@ -392,22 +513,13 @@ static int motorAxisAsynConnect( const char * port, int addr, asynUser ** ppasyn
 static int motorAxisSet( AXIS_HDL pAxis, int location, int value, int logGlobal )
 {
   asynStatus status;
-	int localMid = 1;
+	int localMid = 1;
   unsigned int nBytesWritten = 0;
   asynUser *pasynUser = (logGlobal? pAxis->pDrv->pasynUser: pAxis->pasynUser);
   UcSetTelegram request;
 
-	/* Lock the mid mutex and increment */
-  if (epicsMutexLock(midMutexId) == epicsMutexLockOK) {
-	  mid++;
-  	if (mid > 10000){
-  	  mid = 1;  
-  	}
-		localMid = mid;
-  } else {
-    drvPrint(drvPrintParam, TRACE_ERROR, "motorAxisSet: Failed to get midMutexId lock.\n");
-  }
-  epicsMutexUnlock(midMutexId);
+	/* Take the next message ID */
+  localMid = drvAnc350NextMid();
 
   /* Create the command data structure */
   request.hdr.length            = sizeof( UcSetTelegram ) - sizeof( Int32 );
@@ -428,12 +540,15 @@ static int motorAxisSet( AXIS_HDL pAxis, int location, int value, int logGlobal
 	status = pasynOctetSyncIO->write(pasynUser,
                                    (char *)&request,
                                    sizeof(UcSetTelegram),
-                                   0.5,
+                                   pAxis->pDrv->setTimeout,
 																	 &nBytesWritten);
 
   if (status){
     return MOTOR_AXIS_ERROR;
   }
+  epicsAtomicIncrSizeT( &pAxis->pDrv->metrics.telegramsSent );
+  drvAnc350TraceTelegram( pAxis, location );
+  drvAnc350VerifyNote( pAxis->pDrv, pAxis->axis - 1, location, value );
   return MOTOR_AXIS_OK;
 }
 
@@ -456,7 +571,7 @@ static int motorAxisSet( AXIS_HDL pAxis, int location, int value, int logGlobal
 static int motorAxisGet( AXIS_HDL pAxis, int location, int *value, int logGlobal )
 {
 	asynStatus status;
-	int localMid = 1;
+	int localMid = 1;
   unsigned int nBytesWritten = 0;
   unsigned int nBytesRead = 0;
   int eom = 0;
@@ -464,6 +579,7 @@ static int motorAxisGet( AXIS_HDL pAxis, int location, int *value, int logGlobal
   int count = 0;
   char raw[512];
   UcGetTelegram request;
+  epicsTimeStamp start;
   asynUser *pasynUser = (logGlobal? pAxis->pDrv->pasynUser: pAxis->pasynUser);
 
   /* Create a union to map the byte response into an acknowledge structure */
@@ -473,17 +589,8 @@ static int motorAxisGet( AXIS_HDL pAxis, int location, int *value, int logGlobal
     UcAckTelegram ack;
   } tel;
 
-	/* Lock the mid mutex and increment */
-  if (epicsMutexLock(midMutexId) == epicsMutexLockOK) {
-	  mid++;
-  	if (mid > 10000){
-  	  mid = 1;  
-  	}
-		localMid = mid;
-  } else {
-    drvPrint(drvPrintParam, TRACE_ERROR, "motorAxisGet: Failed to get midMutexId lock.\n");
-  }
-  epicsMutexUnlock(midMutexId);
+	/* Take the next message ID */
+  localMid = drvAnc350NextMid();
 
   /* Create the request data structure */
   request.hdr.length            = sizeof( UcGetTelegram ) - sizeof( Int32 );
@@ -500,43 +607,108 @@ static int motorAxisGet( AXIS_HDL pAxis, int location, int *value, int logGlobal
 
 
 	/* Send the GET request */
+  drvAnc350TimeGetCurrent( &start );
   status = pasynOctetSyncIO->writeRead(pasynUser,
                                    (char *)&request,
                                    sizeof(UcGetTelegram),
                                    raw,
                                    28,
-                                   0.1,
+                                   pAxis->pDrv->getTimeout,
    																 &nBytesWritten,
                                    &nBytesRead,
                                    &eom);
+  /* Counted once written, as motorAxisSet and the bursts do */
+  if (nBytesWritten == sizeof(UcGetTelegram)) epicsAtomicIncrSizeT( &pAxis->pDrv->metrics.telegramsSent );
 
   if (status==asynSuccess){
+    epicsAtomicIncrSizeT( &pAxis->pDrv->metrics.telegramsReceived );
     for(count = 0; count < nBytesRead; count++){
       tel.raw[count] = raw[count];
     }
  		if (tel.ack.hdr.correlationNumber == localMid){
   		match = 1;
 	  	*value = (epicsInt32)tel.ack.data[0];
+      drvAnc350MetricsRtt( pAxis->pDrv, &start );
 	  } else {
+      epicsAtomicIncrSizeT( &pAxis->pDrv->metrics.mismatches );
       status = asynError;
     }
+  } else if (status==asynTimeout){
+    epicsAtomicIncrSizeT( &pAxis->pDrv->metrics.timeouts );
   }
 
 
   if (status!=asynSuccess){
-    comms++;
-    if (comms > 200){
-      motorParam->setInteger( pAxis->params, motorAxisCommError, 1 );
+    pAxis->pDrv->commErrors++;
+    if (pAxis->pDrv->commErrors > pAxis->pDrv->commErrorLimit){
+      pAxis->commError = 1;
       drvPrint( drvPrintParam, TRACE_ERROR, "anc350AsynMotorGet: Comms error.\n");
     }
     return MOTOR_AXIS_ERROR;
   } else {
-    comms = 0;
+    pAxis->pDrv->commErrors = 0;
   }
-  motorParam->setInteger( pAxis->params, motorAxisCommError, 0 );
+  pAxis->commError = 0;
   return MOTOR_AXIS_OK;
 }
 
+/*
+ * Function: motorAxisSetAwake
+ *
+ * Parameters: pAxis     - Pointer to motor axis handle
+ *             location  - Memory location to set value of
+ *             value     - Value to write into memory location
+ *
+ * Returns: Integer status value
+ * 
+ * Description:
+ *
+ * Sends a set packet that starts the axis, with the axis mutex held.  If
+ * the outputs of the axis were switched off while idle, the writes that
+ * switch them back on go in the same burst, ahead of the set.
+ */
+static int motorAxisSetAwake( AXIS_HDL pAxis, int location, int value )
+{
+  anc350Op ops[ANC350_IDLE_OPS + 1];
+  int nOps = drvAnc350IdleWake( pAxis, ops );
+
+  if (nOps == 0) return motorAxisSet( pAxis, location, value, 0 );
+
+  drvAnc350OpSet( &ops[nOps], location, pAxis->axis - 1, value );
+  drvAnc350Burst( pAxis->pDrv, ops, nOps + 1, pAxis->pDrv->burstTimeout );
+  drvAnc350IdleWoken( pAxis, ops, nOps );
+  if (ops[nOps].status != asynSuccess) return MOTOR_AXIS_ERROR;
+  drvAnc350TraceTelegram( pAxis, location );
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: motorAxisInhibited
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             what    - Command rejected, for the message
+ *
+ * Returns: MOTOR_AXIS_ERROR
+ *
+ * Description:
+ *
+ * Rejects a command to an inhibited axis before any telegram is sent.
+ * Done is published so the motor record does not wait for the move.
+ */
+static int motorAxisInhibited( AXIS_HDL pAxis, const char * what )
+{
+  drvAnc350InhibitRejected( pAxis, what );
+  if (epicsMutexLock( pAxis->axisMutex ) == epicsMutexLockOK){
+    drvAnc350CallbackCommand( pAxis, 1 );
+    epicsMutexLock( pAxis->paramMutex );
+    motorParam->setInteger( pAxis->params, motorAxisDone, 1 );
+    motorParam->callCallback( pAxis->params );
+    epicsMutexUnlock( pAxis->paramMutex );
+    epicsMutexUnlock( pAxis->axisMutex );
+  }
+  return MOTOR_AXIS_ERROR;
+}
+
 /*
  * Function: motorAxisSetDouble
  *
@@ -561,8 +733,10 @@ static int motorAxisSetDouble( AXIS_HDL pAxis, motorAxisParam_t function, double
         {
             if (status == MOTOR_AXIS_OK )
             {
+                epicsMutexLock( pAxis->paramMutex );
                 motorParam->setDouble( pAxis->params, function, value );
                 motorParam->callCallback( pAxis->params );
+                epicsMutexUnlock( pAxis->paramMutex );
             }
             epicsMutexUnlock( pAxis->axisMutex );
         }
@@ -590,6 +764,7 @@ static int motorAxisSetInteger( AXIS_HDL pAxis, motorAxisParam_t function, int v
     if (pAxis == NULL) return MOTOR_AXIS_ERROR;
     else
     {
+        if (function == motorAxisDeferMoves) drvAnc350SyncDeferMoves( pAxis->pDrv, value );
         status = motorAxisSetDouble( pAxis, function, (double) value );
     }
     return status;
@@ -619,6 +794,7 @@ static int motorAxisSetInteger( AXIS_HDL pAxis, motorAxisParam_t function, int v
 static int motorAxisMove( AXIS_HDL pAxis, double position, int relative, double min_velocity, double max_velocity, double acceleration )
 {
 	long imove;
+	int target;
 	int cmd;
 	int posdir = 0;
   int status = MOTOR_AXIS_ERROR;
@@ -626,6 +802,8 @@ static int motorAxisMove( AXIS_HDL pAxis, double position, int relative, double
   //double vel_amp = 0.0;
 
 	if (pAxis != NULL){
+    if (drvAnc350Inhibited( pAxis )) return motorAxisInhibited( pAxis, "move" );
+    drvAnc350TraceStart( pAxis, ANC350_SPAN_MOVE );
     /* Set hump detection */
     status = motorAxisSet( pAxis, ID_ANC_STOP_EN, 1, 0 );
     /* Set amplitude ctrl to amplitude closed loop */
@@ -654,12 +832,36 @@ static int motorAxisMove( AXIS_HDL pAxis, double position, int relative, double
 		imove = (int)(position + pAxis->reference_position);
 
     if (epicsMutexLock( pAxis->axisMutex ) == epicsMutexLockOK){
-      status = motorAxisSet( pAxis, ID_ANC_TARGET, imove, 0 );
-      status = motorAxisSet( pAxis, cmd, 1, 0 );
+      /* Raw target, relative moves are from the last polled position */
+      target = relative? (int)(pAxis->previous_position + pAxis->reference_position + position): imove;
+      /* Arm the in-position trigger before the axis can reach the target */
+      drvAnc350TriggerArm( pAxis, target );
+      status = motorAxisSetAwake( pAxis, ID_ANC_TARGET, imove );
+      drvAnc350HoldSet( pAxis, !relative, imove );
+      /* Hold the RUN back if moves are deferred, it is sent with the rest of the sync group */
+      if (drvAnc350SyncDefer( pAxis, cmd ) == 0){
+        status = motorAxisSet( pAxis, cmd, 1, 0 );
+        /* Time the move to learn its duration */
+        if (status == MOTOR_AXIS_OK){
+          drvAnc350EstimateStart( pAxis, relative? position: position - pAxis->previous_position );
+          drvAnc350StatsStart( pAxis, target );
+        } else {
+          drvAnc350EstimateCancel( pAxis );
+          drvAnc350StatsCancel( pAxis );
+        }
+      } else {
+        drvAnc350EstimateCancel( pAxis );
+        drvAnc350StatsCancel( pAxis );
+      }
       /* Set direction indicator. */
+      drvAnc350CallbackCommand( pAxis, 0 );
+      epicsMutexLock( pAxis->paramMutex );
       motorParam->setInteger(pAxis->params, motorAxisDirection, posdir);
       motorParam->setInteger( pAxis->params, motorAxisDone, 0 );
       motorParam->callCallback( pAxis->params );
+      epicsMutexUnlock( pAxis->paramMutex );
+      /* After the RUN, for the inhibit thread to see a command that raced it */
+      drvAnc350TimeGetCurrent( &pAxis->commandSent );
       epicsMutexUnlock( pAxis->axisMutex );
     }
 	  /* Signal the poller task.*/
@@ -693,6 +895,8 @@ static int motorAxisHome( AXIS_HDL pAxis, double min_velocity, double max_veloci
   //double vel_amp = 0.0;
 
 	if (pAxis != NULL){
+    if (drvAnc350Inhibited( pAxis )) return motorAxisInhibited( pAxis, "home" );
+    drvAnc350TraceStart( pAxis, ANC350_SPAN_HOME );
     /* Set hump detection */
     status = motorAxisSet( pAxis, ID_ANC_STOP_EN, 1, 0 );
     /* Set amplitude ctrl to amplitude closed loop */
@@ -715,11 +919,20 @@ static int motorAxisHome( AXIS_HDL pAxis, double min_velocity, double max_veloci
 		}
 
     if (epicsMutexLock( pAxis->axisMutex ) == epicsMutexLockOK){
-      status = motorAxisSet( pAxis, cmd, 1, 0 );
+      drvAnc350SyncCancel( pAxis );
+      drvAnc350HoldSet( pAxis, 0, 0 );
+      drvAnc350EstimateCancel( pAxis );
+      drvAnc350StatsCancel( pAxis );
+      status = motorAxisSetAwake( pAxis, cmd, 1 );
       /* Set direction indicator. */
+      drvAnc350CallbackCommand( pAxis, 0 );
+      epicsMutexLock( pAxis->paramMutex );
       motorParam->setInteger(pAxis->params, motorAxisDirection, posdir);
       motorParam->setInteger( pAxis->params, motorAxisDone, 0 );
       motorParam->callCallback( pAxis->params );
+      epicsMutexUnlock( pAxis->paramMutex );
+      /* After the RUN, for the inhibit thread to see a command that raced it */
+      drvAnc350TimeGetCurrent( &pAxis->commandSent );
       epicsMutexUnlock( pAxis->axisMutex );
     }
 
@@ -758,6 +971,8 @@ static int motorAxisVelocityMove(  AXIS_HDL pAxis, double min_velocity, double v
   //double vel_amp = 0.0;
 
 	if (pAxis != NULL){
+    if (drvAnc350Inhibited( pAxis )) return motorAxisInhibited( pAxis, "jog" );
+    drvAnc350TraceStart( pAxis, ANC350_SPAN_JOG );
     /* Set hump detection */
     status = motorAxisSet( pAxis, ID_ANC_STOP_EN, 1, 0 );
     /* Set amplitude ctrl to amplitude closed loop */
@@ -781,11 +996,20 @@ static int motorAxisVelocityMove(  AXIS_HDL pAxis, double min_velocity, double v
 		}
 
     if (epicsMutexLock( pAxis->axisMutex ) == epicsMutexLockOK){
-      status = motorAxisSet( pAxis, cmd, 1, 0 );
+      drvAnc350SyncCancel( pAxis );
+      drvAnc350HoldSet( pAxis, 0, 0 );
+      drvAnc350EstimateCancel( pAxis );
+      drvAnc350StatsCancel( pAxis );
+      status = motorAxisSetAwake( pAxis, cmd, 1 );
       /* Set direction indicator. */
+      drvAnc350CallbackCommand( pAxis, 0 );
+      epicsMutexLock( pAxis->paramMutex );
       motorParam->setInteger(pAxis->params, motorAxisDirection, posdir);
       motorParam->setInteger( pAxis->params, motorAxisDone, 0 );
       motorParam->callCallback( pAxis->params );
+      epicsMutexUnlock( pAxis->paramMutex );
+      /* After the RUN, for the inhibit thread to see a command that raced it */
+      drvAnc350TimeGetCurrent( &pAxis->commandSent );
       epicsMutexUnlock( pAxis->axisMutex );
     }
 	  /* Signal the poller task.*/
@@ -831,6 +1055,102 @@ static int motorAxisTriggerProfile( AXIS_HDL pAxis )
   return MOTOR_AXIS_ERROR;
 }
 
+/*
+ * Function: drvAnc350StopDone
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Records the stop to standstill time once RUNNING has been seen clear
+ * after a stop.  Called with the axis mutex held.
+ */
+static void drvAnc350StopDone( AXIS_HDL pAxis )
+{
+  epicsTimeStamp now;
+
+  if (!pAxis->stopPending) return;
+  drvAnc350TimeGetCurrent( &now );
+  pAxis->stopPending = 0;
+  pAxis->stopTime = epicsTimeDiffInSeconds( &now, &pAxis->stopStart );
+  anc350ParamSetDouble( pAxis->pDrv, pAxis->axis, ANC350_STOP_TIME, pAxis->stopTime );
+}
+
+/*
+ * Function: drvAnc350StopWait
+ *
+ * Parameters: pDrv      - Pointer to driver structure
+ *             timeout   - Time to the next poll (seconds)
+ *
+ * Returns: Time to the next poll, at most STOP_POLL_PERIOD while a stop
+ *          is pending
+ *
+ * Description:
+ *
+ * Called by the poller before it waits, with no mutex held, so that the
+ * standstill after a stop is seen, and ANC350_STOP_TIME measured, to
+ * within STOP_POLL_PERIOD rather than the moving poll period.
+ */
+double drvAnc350StopWait( ANC350DRV_ID pDrv, double timeout )
+{
+  int pending = 0;
+  int i;
+
+  for (i = 0; i < pDrv->nAxes && !pending; i++){
+    epicsMutexLock( pDrv->axis[i].axisMutex );
+    pending = pDrv->axis[i].stopPending;
+    epicsMutexUnlock( pDrv->axis[i].axisMutex );
+  }
+  return (pending && timeout > STOP_POLL_PERIOD)? STOP_POLL_PERIOD: timeout;
+}
+
+/*
+ * Function: drvAnc350StopAxis
+ *
+ * Parameters: pAxis     - Pointer to motor axis handle
+ *             running   - Returns non-zero if the axis was still running after the stop
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Stops the axis by clearing the run registers (target approach and both
+ * continuous directions), rather than starting a single step, so the axis
+ * halts where it is whichever way it was moving.  The STATUS read goes in
+ * the same burst, behind the SETs.  It is not repeated here, as that would
+ * hold the axis mutex: if the axis is still running the poller, polling
+ * every STOP_POLL_PERIOD until then (drvAnc350StopWait), sees RUNNING
+ * clear, records the stop time and publishes Done.  Called with the axis
+ * mutex held.
+ */
+static int drvAnc350StopAxis( AXIS_HDL pAxis, int * running )
+{
+  anc350Op ops[4];
+  int index = pAxis->axis - 1;
+  int nOk;
+
+  drvAnc350OpSet( &ops[0], ID_ANC_RUN_TARGET, index, 0 );
+  drvAnc350OpSet( &ops[1], ID_ANC_CONT_FWD, index, 0 );
+  drvAnc350OpSet( &ops[2], ID_ANC_CONT_BKWD, index, 0 );
+  drvAnc350OpGet( &ops[3], ID_ANC_STATUS, index );
+
+  drvAnc350TimeGetCurrent( &pAxis->stopStart );
+  pAxis->stopPending = 1;
+  nOk = drvAnc350Burst( pAxis->pDrv, ops, 4, pAxis->pDrv->burstTimeout );
+
+  *running = (ops[3].status != asynSuccess) || (ops[3].value & ANC_STATUS_RUNNING);
+  if (!*running) drvAnc350StopDone( pAxis );
+
+  if (nOk < 3){
+    drvPrint( drvPrintParam, TRACE_ERROR, "drvAnc350StopAxis: card %d axis %d stop not acknowledged\n",
+              pAxis->pDrv->card, pAxis->axis );
+    return MOTOR_AXIS_ERROR;
+  }
+  return MOTOR_AXIS_OK;
+}
+
 /*
  * Function: motorAxisStop
  *
@@ -847,22 +1167,23 @@ static int motorAxisTriggerProfile( AXIS_HDL pAxis )
  */
 static int motorAxisStop( AXIS_HDL pAxis, double acceleration )
 {
-  int cmd;
   int status = MOTOR_AXIS_ERROR;
+  int running = 1;
   if (pAxis != NULL){
-		if (pAxis->previous_direction == 1){
-			cmd = ID_ANC_SGL_FWD;
-		} else {
-			cmd = ID_ANC_SGL_BKWD;
-		}
-
     pAxis->reference_search = 0;
 
     if (epicsMutexLock( pAxis->axisMutex ) == epicsMutexLockOK){
-      status = motorAxisSet( pAxis, cmd, 1, 0 );
-      /* Set direction indicator. */
-      motorParam->setInteger( pAxis->params, motorAxisDone, 1 );
+      drvAnc350HoldSet( pAxis, 0, 0 );
+      drvAnc350EstimateCancel( pAxis );
+      drvAnc350StatsCancel( pAxis );
+      drvAnc350SyncCancel( pAxis );
+      status = drvAnc350StopAxis( pAxis, &running );
+      /* Done only once the controller reports standstill, otherwise the poller sets it */
+      if (!running) drvAnc350CallbackCommand( pAxis, 1 );
+      epicsMutexLock( pAxis->paramMutex );
+      if (!running) motorParam->setInteger( pAxis->params, motorAxisDone, 1 );
       motorParam->callCallback( pAxis->params );
+      epicsMutexUnlock( pAxis->paramMutex );
       epicsMutexUnlock( pAxis->axisMutex );
     }
 	  /* Signal the poller task.*/
@@ -890,7 +1211,9 @@ static int motorAxisforceCallback(AXIS_HDL pAxis)
 	pAxis->print(pAxis->logParam, TRACE_FLOW, "motorAxisforceCallback: request card %d, axis %d status update\n",
 	             pAxis->pDrv->card, pAxis->axis);
 
+	epicsMutexLock( pAxis->paramMutex );
 	motorParam->forceCallback(pAxis->params);
+	epicsMutexUnlock( pAxis->paramMutex );
 
 	return (MOTOR_AXIS_OK);
 }
@@ -901,15 +1224,40 @@ static int motorAxisforceCallback(AXIS_HDL pAxis)
  * Parameters: pDrv         - Pointer to driver structure
  *             pasynUser    - Pointer to user data
  *
- * Returns: Integer status value
+ * Returns: ANC350_GLOBAL_... problem bits, 0 if the controller is healthy
  * 
  * Description:
  *
- * Currently only returns good status.
+ * Reads the controller-wide registers, the temperature status and the
+ * sensor reference voltage, in one burst and publishes them to the
+ * controller parameters.  The problem bits are set in motorAxisProblem of
+ * every axis.  A register that is not acknowledged keeps its last value.
  */
 static int drvAnc350GetGlobalStatus( ANC350DRV_ID pDrv, asynUser * pasynUser )
 {
-  return 0;
+  anc350Op ops[2];
+  epicsUInt32 globalStatus = 0;
+
+  drvAnc350OpGet( &ops[0], ID_ANC_TEMP_STATUS, 0 );
+  drvAnc350OpGet( &ops[1], ID_ANC_SENSOR_VOLT, 0 );
+
+  if (drvAnc350Burst( pDrv, ops, 2, pDrv->burstTimeout ) != 2) globalStatus |= ANC350_GLOBAL_COMMS;
+
+  if (ops[0].status == asynSuccess){
+    if (ops[0].value == 0) globalStatus |= ANC350_GLOBAL_OVERTEMP;
+    anc350ParamSetInteger( pDrv, 0, ANC350_TEMP_STATUS, ops[0].value );
+  }
+  if (ops[1].status == asynSuccess){
+    anc350ParamSetDouble( pDrv, 0, ANC350_SENSOR_VOLT, ((double)ops[1].value) / 1000.0 );
+  }
+
+  if (globalStatus != pDrv->globalStatus){
+    drvPrint( drvPrintParam, (globalStatus == 0)? TRACE_FLOW: TRACE_ERROR,
+              "drvAnc350GetGlobalStatus: card %d status changed from 0x%x to 0x%x\n",
+              pDrv->card, pDrv->globalStatus, globalStatus );
+  }
+  anc350ParamSetInteger( pDrv, 0, ANC350_GLOBAL_STATUS, (int) globalStatus );
+  return globalStatus;
 }
 
 /*
@@ -917,7 +1265,7 @@ static int drvAnc350GetGlobalStatus( ANC350DRV_ID pDrv, asynUser * pasynUser )
  *
  * Parameters: pAxis         - Pointer to motor axis handle
  *             pasynUser     - Pointer to user data
- *             globalStatus  - Unused
+ *             globalStatus  - ANC350_GLOBAL_... problem bits of the controller
  *
  * Returns: Integer status value
  * 
@@ -941,7 +1289,10 @@ static void drvAnc350GetAxisStatus( AXIS_HDL pAxis, asynUser * pasynUser, epicsU
     int direction = 0;
 		int hump = 0;
 		int humpstatus = 0;
+		int running = 0;
+    anc350Update update;
 
+    memset( &update, 0, sizeof( update ) );
     if (epicsMutexLock( pAxis->axisMutex ) == epicsMutexLockOK)
     {
 		/*Read the axis status.*/
@@ -951,26 +1302,40 @@ static void drvAnc350GetAxisStatus( AXIS_HDL pAxis, asynUser * pasynUser, epicsU
 
 			/* Use for in position */
 			done = value&ANC_STATUS_RUNNING;
-			if (done == 0){
-	        	motorParam->setInteger(pAxis->params, motorAxisDone, 1 );
+			drvAnc350TraceStatus( pAxis, done );
+			if (done == 0 && epicsAtomicGetIntT( &pAxis->syncCmd ) != 0){
+				/* The RUN is held back for a synchronised start, the move has not begun */
+	        	update.set |= ANC350_UPDATE_DONE;
+	        	update.done = 0;
+			} else if (done == 0){
+	        	update.set |= ANC350_UPDATE_DONE;
+	        	update.done = 1;
+				drvAnc350StopDone( pAxis );
+				drvAnc350EstimateDone( pAxis, value&ANC_STATUS_HUMP );
 			} else {
-	    	    motorParam->setInteger(pAxis->params, motorAxisDone, 0 );
+				drvAnc350EstimateRunning( pAxis );
+				if (!pAxis->holdActive){
+	    	    update.set |= ANC350_UPDATE_DONE;
+	    	    update.done = 0;
+				}
 			}
 
 			/* Use for valid reference position */
 	  		referenced = (value&ANC_STATUS_REF_VALID) >> 11;
 			if (referenced == 0){
-	  			motorParam->setInteger(pAxis->params, motorAxisHomed, referenced);
-	        	motorParam->setInteger(pAxis->params, motorAxisHomeSignal, referenced);
+	  			update.set |= ANC350_UPDATE_HOMED;
+	        	update.homed = referenced;
 			} else {
 	        	if (pAxis->reference_search == 1){
 					pAxis->reference_search = 0;
-					status = motorAxisSet( pAxis, ID_ANC_SGL_FWD, 1, 0 );
-					motorParam->setInteger( pAxis->params, motorAxisDone, 1 );
-		  		  	motorParam->setInteger(pAxis->params, motorAxisHomed, referenced);
-					motorParam->setInteger(pAxis->params, motorAxisHomeSignal, referenced);
+					status = drvAnc350StopAxis( pAxis, &running );
+					/* Still running, Done waits for a later poll to see standstill */
+					update.set |= ANC350_UPDATE_DONE | ANC350_UPDATE_HOMED;
+					update.done = !running;
+		  		  	update.homed = referenced;
 		        }
 			}
+			if (update.set & ANC350_UPDATE_DONE) pAxis->pollDone = update.done;
 
 			/* Hump detected? */
       		hump = (value&ANC_STATUS_HUMP) >> 1;
@@ -1000,39 +1365,42 @@ static void drvAnc350GetAxisStatus( AXIS_HDL pAxis, asynUser * pasynUser, epicsU
 		    position -= reference_position;
             pAxis->reference_position = reference_position;
             /* Check the direction using previous position */
- 	  		if ((position - pAxis->previous_position) > 500.0){
+ 	  		if ((position - pAxis->previous_position) > pAxis->directionDeadband){
  	  			direction = 1;
- 	  		} else if ((position - pAxis->previous_position) < -500.0){
+ 	  		} else if ((position - pAxis->previous_position) < -pAxis->directionDeadband){
  	  			direction = 0;
  	  		} else {
  	  			direction = pAxis->previous_direction;
  	  		}
- 	      motorParam->setInteger( pAxis->params, motorAxisDirection, direction);
  	      /*Store position to calculate direction for next poll.*/
  	      pAxis->previous_position = position;
  	      pAxis->previous_direction = direction;
+
+        /* Correct any drift while idle */
+        if (humpstatus == asynSuccess) drvAnc350HoldCheck( pAxis, done, value );
+        /* Count the outcome of a finished move */
+        if (humpstatus == asynSuccess) drvAnc350StatsPoll( pAxis, done, value );
+        /* Switch the outputs off once the axis has been idle long enough */
+        if (humpstatus == asynSuccess) drvAnc350IdleCheck( pAxis, done );
  
-        status = motorParam->setDouble(pAxis->params, motorAxisPosition, position);
-        motorParam->setDouble(pAxis->params, motorAxisEncoderPosn, position);
+        update.set |= ANC350_UPDATE_POSITION;
+        update.position = position;
+        update.direction = direction;
       }
 
 			/* Check for hard limit.  Only hump available so notify limit by checking direction */
+			update.set |= ANC350_UPDATE_LIMITS;
 			if (hump && (humpstatus == asynSuccess)){
-				if (direction == 1){
-					motorParam->setInteger(pAxis->params, motorAxisHighHardLimit, 1);
-					motorParam->setInteger(pAxis->params, motorAxisLowHardLimit, 0);
-				} else {
-					motorParam->setInteger(pAxis->params, motorAxisHighHardLimit, 0);
-					motorParam->setInteger(pAxis->params, motorAxisLowHardLimit, 1);
-				}
-			} else {
-				motorParam->setInteger(pAxis->params, motorAxisHighHardLimit, 0);
-				motorParam->setInteger(pAxis->params, motorAxisLowHardLimit, 0);
+				update.highLimit = (direction == 1);
+				update.lowLimit = (direction != 1);
 			}
 
       /*Combine several comms type errors for the motor record comm error bit.*/
-      motorParam->setInteger( pAxis->params, motorAxisProblem, globalStatus );
-      motorParam->callCallback( pAxis->params );
+      update.set |= ANC350_UPDATE_PROBLEM;
+      update.problem = globalStatus;
+      update.commError = pAxis->commError;
+      /* Handed to the callback thread, the poller does not wait for the motor record */
+      drvAnc350CallbackPost( pAxis, &update );
 
       epicsMutexUnlock( pAxis->axisMutex );
     }
@@ -1063,13 +1431,86 @@ static void drvAnc350GetAxisInitialStatus( AXIS_HDL pAxis, asynUser * pasynUser
 			motorAxisGet(pAxis, ID_ANC_STATUS, &value, 0);
       /* Use for valid reference position */
   		referenced = (value&ANC_STATUS_REF_VALID) >> 11;
+      epicsMutexLock( pAxis->paramMutex );
 	  	motorParam->setInteger(pAxis->params, motorAxisHomed, referenced);
       motorParam->setInteger(pAxis->params, motorAxisHomeSignal, referenced);
 
       motorParam->setDouble(  pAxis->params, motorAxisHasEncoder, 1);
       motorParam->callCallback( pAxis->params );
+      epicsMutexUnlock( pAxis->paramMutex );
+      epicsMutexUnlock( pAxis->axisMutex );
+    }
+}
+
+/*
+ * Function: drvAnc350Poll
+ *
+ * Parameters: pDrv         - Pointer to driver structure
+ *             forced       - Non-zero if the poller was woken by an event
+ *
+ * Returns: Void
+ * 
+ * Description:
+ *
+ * One pass of the polling task.  Every axis is read if it is moving, if
+ * the poller was woken by an event, or if it is time for an idle poll.
+ * Split from drvAnc350Task so that anc350SimRun can drive the same logic
+ * on a virtual clock.
+ */
+void drvAnc350Poll( ANC350DRV_ID pDrv, int forced )
+{
+  int i = 0;
+  int done = 0;
+  double factor = 0.0;
+  epicsTimeStamp start;
+  epicsTimeStamp end;
+
+  drvAnc350TimeGetCurrent( &start );
+  if (epicsMutexLock(pDrv->controllerMutexId) == epicsMutexLockOK) {
+    /* roughly calculate how many moving polls to an idle poll */
+    factor = pDrv->movingPollPeriod / pDrv->idlePollPeriod;
+    epicsMutexUnlock(pDrv->controllerMutexId);
+  }
+  else {
+    drvPrint(drvPrintParam, TRACE_ERROR, "drvAnc350Poll: Failed to get controllerMutexId lock.\n");
+  }
+
+  /* Get global status at the slow poll rate.*/
+  if (pDrv->pollSkipGlobal <= 0.0) {
+    pDrv->globalStatus = drvAnc350GetGlobalStatus(pDrv, pDrv->pasynUser);
+    pDrv->pollSkipGlobal = 1.0;
+  }
+  pDrv->pollSkipGlobal -= factor;
+
+  /* Get axis status */
+  for ( i = 0; i < pDrv->nAxes; i++ )
+  {
+    AXIS_HDL pAxis = &(pDrv->axis[i]);
+    if (forced)
+    {
+      /* If we got an event, then one motor is moving, so force an update for all */
+      done = 0;
+    }
+    else
+    {
+      /* get the cached done status */
+      epicsMutexLock( pAxis->axisMutex );
+      done = pAxis->pollDone;
       epicsMutexUnlock( pAxis->axisMutex );
     }
+    if ((pDrv->pollSkips[i]<=0.0) || (done == 0))
+    {
+      /* if it's time for an idle poll or the motor is moving */
+      drvAnc350GetAxisStatus( pAxis, pDrv->pasynUser, pDrv->globalStatus );
+      pDrv->pollSkips[i] = 1.0;
+    }
+    pDrv->pollSkips[i] -= factor;
+  }
+
+  drvAnc350TimeGetCurrent( &end );
+  epicsAtomicIncrSizeT( &pDrv->metrics.polls );
+  epicsAtomicSetSizeT( &pDrv->metrics.pollLast, (size_t)(epicsTimeDiffInSeconds( &end, &start ) * 1.0e6) );
+  drvAnc350MetricsAdd( &pDrv->metrics.pollSum, epicsTimeDiffInSeconds( &end, &start ) );
 }
 
 /*
@@ -1086,64 +1527,26 @@ static void drvAnc350GetAxisInitialStatus( AXIS_HDL pAxis, asynUser * pasynUser
  */
 static void drvAnc350Task( ANC350DRV_ID pDrv )
 {
-  int i = 0;
-  int done = 0;
   int eventStatus = 0;
-  float timeout = 0.0;
-  float factor = 0.0;
-  float skipglobal = 0.0;
-  float skips[pDrv->nAxes];
-  epicsUInt32 globalStatus = 0;
-
-  for (i=0; i<pDrv->nAxes; i++) {
-    skips[i] = 0;
-  }
+  double timeout = 0.0;
 
   while ( 1 )
   {
     /* Wait for an event, or a timeout. If we get an event, force an update.*/
     if (epicsMutexLock(pDrv->controllerMutexId) == epicsMutexLockOK) {
       timeout = pDrv->movingPollPeriod;
-      /* roughly calculate how many moving polls to an idle poll */
-      factor = pDrv->movingPollPeriod / pDrv->idlePollPeriod;
+      epicsMutexUnlock(pDrv->controllerMutexId);
     }
     else {
       drvPrint(drvPrintParam, TRACE_ERROR, "drvAnc350Task: Failed to get controllerMutexId lock.\n");
     }
-    epicsMutexUnlock(pDrv->controllerMutexId);
+    /* Poll as soon as a move is expected to have arrived */
+    timeout = drvAnc350EstimateWait( pDrv, timeout );
+    /* and again shortly after a stop, until standstill is seen */
+    timeout = drvAnc350StopWait( pDrv, timeout );
     eventStatus = epicsEventWaitWithTimeout(pDrv->pollEventId, timeout);
 
-    /* Get global status at the slow poll rate.*/
-    if (skipglobal <= 0.0) {
-      globalStatus = drvAnc350GetGlobalStatus(pDrv, pDrv->pasynUser);
-      skipglobal = 1.0;
-    }
-    skipglobal -= factor;
-
-    /* Get axis status */
-    for ( i = 0; i < pDrv->nAxes; i++ )
-    {
-      AXIS_HDL pAxis = &(pDrv->axis[i]);
-      if (eventStatus == epicsEventWaitOK)
-      {
-      	/* If we got an event, then one motor is moving, so force an update for all */
-      	done = 0;
-      }
-      else
-      {
-      	/* get the cached done status */
-      	epicsMutexLock( pAxis->axisMutex );
-	      motorParam->getInteger( pAxis->params, motorAxisDone, &done );
-	      epicsMutexUnlock( pAxis->axisMutex );
-      }
-      if ((skips[i]<=0.0) || (done == 0))
-      {
-	      /* if it's time for an idle poll or the motor is moving */
-	      drvAnc350GetAxisStatus( pAxis, pDrv->pasynUser, globalStatus );
-	      skips[i] = 1.0;
-      }
-      skips[i] -= factor;
-    }
+    drvAnc350Poll( pDrv, (eventStatus == epicsEventWaitOK) );
   }
 }
 
@@ -1170,12 +1573,8 @@ int anc350AsynMotorCreate( char *port, int addr, int card, int nAxes )
   ANC350DRV_ID pDrv;
   ANC350DRV_ID * ppLast = &(pFirstDrv);
 
-	/* Create the Mutex for the MID if necessary */
-	if (midMutexId == NULL){
-    if ((midMutexId = epicsMutexCreate()) == NULL) {
-      drvPrint( drvPrintParam, TRACE_ERROR, "anc350AsynMotorCreate: Could not create midMutexId.\n");
-    }
-	}
+	/* Create the Mutex for the MID if necessary */
+  epicsThreadOnce( &midOnceId, drvAnc350MidOnce, NULL );
 
   for ( pDrv = pFirstDrv; pDrv != NULL &&  (pDrv->card != card); pDrv = pDrv->pNext ){
     ppLast = &(pDrv->pNext);
@@ -1192,14 +1591,14 @@ int anc350AsynMotorCreate( char *port, int addr, int card, int nAxes )
 
     if (pDrv != NULL){
       pDrv->axis = (AXIS_HDL) calloc( nAxes, sizeof( motorAxis ) );
+      pDrv->pollSkips = (double *) calloc( nAxes, sizeof( double ) );
 
-      if (pDrv->axis != NULL ){
+      if (pDrv->axis != NULL && pDrv->pollSkips != NULL){
         pDrv->nAxes = nAxes;
         pDrv->card = card;
 
-        /* Set default polling rates.*/
-        pDrv->movingPollPeriod = (double)defaultMovingPollPeriod / 1000.0;
-        pDrv->idlePollPeriod = (double)defaultIdlePollPeriod / 1000.0;
+        /* Set default polling rates, timeouts and thresholds.*/
+        drvAnc350TuneInit( pDrv );
         /* Create event to signal poller task with.*/
         pDrv->pollEventId = epicsEventMustCreate(epicsEventEmpty);
         /* Create mutex ID for controller.*/
@@ -1207,17 +1606,28 @@ int anc350AsynMotorCreate( char *port, int addr, int card, int nAxes )
           drvPrint( drvPrintParam, TRACE_ERROR, "anc350AsynMotorCreate: Could not create controllerMutexId.\n");
         }
 
+        pDrv->portName = epicsStrDup( port );
+        drvAnc350BankInit( pDrv );
+        drvAnc350InhibitInit( pDrv );
+
         status = motorAxisAsynConnect( port, addr, &(pDrv->pasynUser), "\006", "\r" );
+        if (status == MOTOR_AXIS_OK) status = drvAnc350BurstConnect( pDrv, port, addr );
 
         for (i=0; i<nAxes && status == MOTOR_AXIS_OK; i++ ){
           if ((pDrv->axis[i].params = motorParam->create( 0, MOTOR_AXIS_NUM_PARAMS )) != NULL &&
-              (pDrv->axis[i].axisMutex = epicsMutexCreate( )) != NULL){
+              (pDrv->axis[i].axisMutex = epicsMutexCreate( )) != NULL &&
+              (pDrv->axis[i].paramMutex = epicsMutexCreate( )) != NULL){
 
             pDrv->axis[i].pDrv = pDrv;
             pDrv->axis[i].axis = i+1;
             pDrv->axis[i].logParam  = pDrv->pasynUser;
             pDrv->axis[i].pasynUser = pDrv->pasynUser;
             pDrv->axis[i].scale = 1;
+            drvAnc350HoldInit( &(pDrv->axis[i]) );
+            drvAnc350TriggerInit( &(pDrv->axis[i]) );
+            drvAnc350EstimateInit( &(pDrv->axis[i]) );
+            drvAnc350StatsInit( &(pDrv->axis[i]) );
+            drvAnc350IdleInit( &(pDrv->axis[i]) );
 
             asynPrint( pDrv->pasynUser, ASYN_TRACE_FLOW, 
                        "anc350AsynMotorCreate: Created motor for card %d, signal %d OK\n",
@@ -1235,10 +1645,13 @@ int anc350AsynMotorCreate( char *port, int addr, int card, int nAxes )
           for (i=0; i<nAxes; i++ ){
             if (pDrv->axis[i].params != NULL) motorParam->destroy( pDrv->axis[i].params );
             if (pDrv->axis[i].axisMutex != NULL) epicsMutexDestroy( pDrv->axis[i].axisMutex );
+            if (pDrv->axis[i].paramMutex != NULL) epicsMutexDestroy( pDrv->axis[i].paramMutex );
           }
           free ( pDrv );
         }
       } else {
+        free ( pDrv->axis );
+        free ( pDrv->pollSkips );
         free ( pDrv );
         status = MOTOR_AXIS_ERROR;
       }
@@ -1266,6 +1679,13 @@ int anc350AsynMotorCreate( char *port, int addr, int card, int nAxes )
       drvAnc350GetAxisStatus( pAxis, pDrv->pasynUser, 0 );
     }
 
+    /* A simulated controller on virtual time is polled by anc350SimRun */
+    pDrv->virtualTime = drvAnc350SimIsVirtual( port );
+    if (pDrv->virtualTime) return status;
+
+    /* From here on the motor record callbacks run in their own thread */
+    drvAnc350CallbackCreate( pDrv );
+
     pDrv->motorThread = epicsThreadCreate( "drvAnc350Thread",
                                            epicsThreadPriorityLow,
                                            epicsThreadGetStackSize(epicsThreadStackMedium),
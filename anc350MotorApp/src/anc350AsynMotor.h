@@ -6,6 +6,30 @@ extern "C" {
 #endif
 
 int anc350AsynMotorCreate( char *port, int addr, int card, int nAxes );
+void drvAnc350RegisterShared( void );
+int anc350ParamPortConfigure( const char *portName, int card );
+int anc350Snapshot( const char *directory, const char *reference );
+int anc350SnapshotDiff( const char *fileName, const char *reference );
+int anc350SnapshotAxisDiff( const char *fileName, int cardA, int axisA, int cardB, int axisB );
+int anc350SyncGroupAdd( int group, int card );
+int anc350SyncGroupDefer( int group, int defer );
+int anc350TraceShow( int card, int axis );
+int anc350TraceDump( int count );
+int anc350TraceControl( int enable, int reset );
+int anc350TraceSession( int card, const char * filename );
+int anc350SampleStart( double period );
+int anc350VerifyStart( double rate );
+int anc350HomeAll( const char *cards, int forwards, int limit, double timeout );
+int anc350HomeAbort( void );
+int anc350EstimateShow( int card, int axis );
+double anc350EstimateMove( int card, int axis, double distance );
+int anc350SimConfigure( const char *portName, int nAxes, int virtualTime, double velocity, double latency );
+int anc350SimRun( int card, double seconds, int distance, double movePeriod, int homeEvery, double maxLatency );
+int anc350IPConfigure( const char *portName, const char *hostInfo, double cork );
+int anc350MetricsConfigure( const char *address );
+int anc350StoreConfigure( const char *fileName );
+int anc350StoreSave( void );
+int anc350StoreShow( void );
 
 #ifdef __cplusplus
 }
@@ -23,11 +23,359 @@ static void anc350AsynMotorCreateCallFunc(const iocshArgBuf *args)
   anc350AsynMotorCreate( args[0].sval, args[1].ival, args[2].ival, args[3].ival );
 }
 
+/* int anc350ParamPortConfigure(port name, card).*/
+static const iocshArg anc350ParamPortConfigureArg0 = { "port name",     iocshArgString};
+static const iocshArg anc350ParamPortConfigureArg1 = { "card",          iocshArgInt};
+
+static const iocshArg *const anc350ParamPortConfigureArgs[] = {
+  &anc350ParamPortConfigureArg0,
+  &anc350ParamPortConfigureArg1
+};
+static const iocshFuncDef anc350ParamPortConfigureDef ={"anc350ParamPortConfigure",2,anc350ParamPortConfigureArgs};
+
+static void anc350ParamPortConfigureCallFunc(const iocshArgBuf *args)
+{
+  anc350ParamPortConfigure( args[0].sval, args[1].ival );
+}
+
+/* int anc350Snapshot(directory, reference).*/
+static const iocshArg anc350SnapshotArg0 = { "directory",     iocshArgString};
+static const iocshArg anc350SnapshotArg1 = { "reference",     iocshArgString};
+
+static const iocshArg *const anc350SnapshotArgs[] = {
+  &anc350SnapshotArg0,
+  &anc350SnapshotArg1
+};
+static const iocshFuncDef anc350SnapshotDef ={"anc350Snapshot",2,anc350SnapshotArgs};
+
+static void anc350SnapshotCallFunc(const iocshArgBuf *args)
+{
+  anc350Snapshot( args[0].sval, args[1].sval );
+}
+
+/* int anc350SnapshotDiff(file, reference).*/
+static const iocshArg anc350SnapshotDiffArg0 = { "file",          iocshArgString};
+static const iocshArg anc350SnapshotDiffArg1 = { "reference",     iocshArgString};
+
+static const iocshArg *const anc350SnapshotDiffArgs[] = {
+  &anc350SnapshotDiffArg0,
+  &anc350SnapshotDiffArg1
+};
+static const iocshFuncDef anc350SnapshotDiffDef ={"anc350SnapshotDiff",2,anc350SnapshotDiffArgs};
+
+static void anc350SnapshotDiffCallFunc(const iocshArgBuf *args)
+{
+  anc350SnapshotDiff( args[0].sval, args[1].sval );
+}
+
+/* int anc350SnapshotAxisDiff(file, card A, axis A, card B, axis B).*/
+static const iocshArg anc350SnapshotAxisDiffArg0 = { "file",          iocshArgString};
+static const iocshArg anc350SnapshotAxisDiffArg1 = { "card A",        iocshArgInt};
+static const iocshArg anc350SnapshotAxisDiffArg2 = { "axis A",        iocshArgInt};
+static const iocshArg anc350SnapshotAxisDiffArg3 = { "card B",        iocshArgInt};
+static const iocshArg anc350SnapshotAxisDiffArg4 = { "axis B",        iocshArgInt};
+
+static const iocshArg *const anc350SnapshotAxisDiffArgs[] = {
+  &anc350SnapshotAxisDiffArg0,
+  &anc350SnapshotAxisDiffArg1,
+  &anc350SnapshotAxisDiffArg2,
+  &anc350SnapshotAxisDiffArg3,
+  &anc350SnapshotAxisDiffArg4
+};
+static const iocshFuncDef anc350SnapshotAxisDiffDef ={"anc350SnapshotAxisDiff",5,anc350SnapshotAxisDiffArgs};
+
+static void anc350SnapshotAxisDiffCallFunc(const iocshArgBuf *args)
+{
+  anc350SnapshotAxisDiff( args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival );
+}
+
+/* int anc350SyncGroupAdd(group, card).*/
+static const iocshArg anc350SyncGroupAddArg0 = { "group",         iocshArgInt};
+static const iocshArg anc350SyncGroupAddArg1 = { "card",          iocshArgInt};
+
+static const iocshArg *const anc350SyncGroupAddArgs[] = {
+  &anc350SyncGroupAddArg0,
+  &anc350SyncGroupAddArg1
+};
+static const iocshFuncDef anc350SyncGroupAddDef ={"anc350SyncGroupAdd",2,anc350SyncGroupAddArgs};
+
+static void anc350SyncGroupAddCallFunc(const iocshArgBuf *args)
+{
+  anc350SyncGroupAdd( args[0].ival, args[1].ival );
+}
+
+/* int anc350SyncGroupDefer(group, defer).*/
+static const iocshArg anc350SyncGroupDeferArg0 = { "group",         iocshArgInt};
+static const iocshArg anc350SyncGroupDeferArg1 = { "defer",         iocshArgInt};
+
+static const iocshArg *const anc350SyncGroupDeferArgs[] = {
+  &anc350SyncGroupDeferArg0,
+  &anc350SyncGroupDeferArg1
+};
+static const iocshFuncDef anc350SyncGroupDeferDef ={"anc350SyncGroupDefer",2,anc350SyncGroupDeferArgs};
+
+static void anc350SyncGroupDeferCallFunc(const iocshArgBuf *args)
+{
+  anc350SyncGroupDefer( args[0].ival, args[1].ival );
+}
+
+/* int anc350TraceShow(card, axis).*/
+static const iocshArg anc350TraceShowArg0 = { "card",          iocshArgInt};
+static const iocshArg anc350TraceShowArg1 = { "axis",          iocshArgInt};
+
+static const iocshArg *const anc350TraceShowArgs[] = {
+  &anc350TraceShowArg0,
+  &anc350TraceShowArg1
+};
+static const iocshFuncDef anc350TraceShowDef ={"anc350TraceShow",2,anc350TraceShowArgs};
+
+static void anc350TraceShowCallFunc(const iocshArgBuf *args)
+{
+  anc350TraceShow( args[0].ival, args[1].ival );
+}
+
+/* int anc350TraceDump(count).*/
+static const iocshArg anc350TraceDumpArg0 = { "count",         iocshArgInt};
+
+static const iocshArg *const anc350TraceDumpArgs[] = {
+  &anc350TraceDumpArg0
+};
+static const iocshFuncDef anc350TraceDumpDef ={"anc350TraceDump",1,anc350TraceDumpArgs};
+
+static void anc350TraceDumpCallFunc(const iocshArgBuf *args)
+{
+  anc350TraceDump( args[0].ival );
+}
+
+/* int anc350TraceControl(enable, reset).*/
+static const iocshArg anc350TraceControlArg0 = { "enable",        iocshArgInt};
+static const iocshArg anc350TraceControlArg1 = { "reset",         iocshArgInt};
+
+static const iocshArg *const anc350TraceControlArgs[] = {
+  &anc350TraceControlArg0,
+  &anc350TraceControlArg1
+};
+static const iocshFuncDef anc350TraceControlDef ={"anc350TraceControl",2,anc350TraceControlArgs};
+
+static void anc350TraceControlCallFunc(const iocshArgBuf *args)
+{
+  anc350TraceControl( args[0].ival, args[1].ival );
+}
+
+/* int anc350TraceSession(card, filename).*/
+static const iocshArg anc350TraceSessionArg0 = { "card",          iocshArgInt};
+static const iocshArg anc350TraceSessionArg1 = { "filename",      iocshArgString};
+
+static const iocshArg *const anc350TraceSessionArgs[] = {
+  &anc350TraceSessionArg0,
+  &anc350TraceSessionArg1
+};
+static const iocshFuncDef anc350TraceSessionDef ={"anc350TraceSession",2,anc350TraceSessionArgs};
+
+static void anc350TraceSessionCallFunc(const iocshArgBuf *args)
+{
+  anc350TraceSession( args[0].ival, args[1].sval );
+}
+
+/* int anc350SimConfigure(portName, nAxes, virtualTime, velocity, latency).*/
+static const iocshArg anc350SimConfigureArg0 = { "port name",     iocshArgString};
+static const iocshArg anc350SimConfigureArg1 = { "nAxes",         iocshArgInt};
+static const iocshArg anc350SimConfigureArg2 = { "virtualTime",   iocshArgInt};
+static const iocshArg anc350SimConfigureArg3 = { "velocity",      iocshArgDouble};
+static const iocshArg anc350SimConfigureArg4 = { "latency",       iocshArgDouble};
+
+static const iocshArg *const anc350SimConfigureArgs[] = {
+  &anc350SimConfigureArg0,
+  &anc350SimConfigureArg1,
+  &anc350SimConfigureArg2,
+  &anc350SimConfigureArg3,
+  &anc350SimConfigureArg4
+};
+static const iocshFuncDef anc350SimConfigureDef ={"anc350SimConfigure",5,anc350SimConfigureArgs};
+
+static void anc350SimConfigureCallFunc(const iocshArgBuf *args)
+{
+  anc350SimConfigure( args[0].sval, args[1].ival, args[2].ival, args[3].dval, args[4].dval );
+}
+
+/* int anc350SimRun(card, seconds, distance, movePeriod, homeEvery, maxLatency).*/
+static const iocshArg anc350SimRunArg0 = { "card",          iocshArgInt};
+static const iocshArg anc350SimRunArg1 = { "seconds",       iocshArgDouble};
+static const iocshArg anc350SimRunArg2 = { "distance",      iocshArgInt};
+static const iocshArg anc350SimRunArg3 = { "movePeriod",    iocshArgDouble};
+static const iocshArg anc350SimRunArg4 = { "homeEvery",     iocshArgInt};
+static const iocshArg anc350SimRunArg5 = { "maxLatency",    iocshArgDouble};
+
+static const iocshArg *const anc350SimRunArgs[] = {
+  &anc350SimRunArg0,
+  &anc350SimRunArg1,
+  &anc350SimRunArg2,
+  &anc350SimRunArg3,
+  &anc350SimRunArg4,
+  &anc350SimRunArg5
+};
+static const iocshFuncDef anc350SimRunDef ={"anc350SimRun",6,anc350SimRunArgs};
+
+static void anc350SimRunCallFunc(const iocshArgBuf *args)
+{
+  anc350SimRun( args[0].ival, args[1].dval, args[2].ival, args[3].dval, args[4].ival, args[5].dval );
+}
+
+/* int anc350SampleStart(period).*/
+static const iocshArg anc350SampleStartArg0 = { "period",        iocshArgDouble};
+
+static const iocshArg *const anc350SampleStartArgs[] = {
+  &anc350SampleStartArg0
+};
+static const iocshFuncDef anc350SampleStartDef ={"anc350SampleStart",1,anc350SampleStartArgs};
+
+static void anc350SampleStartCallFunc(const iocshArgBuf *args)
+{
+  anc350SampleStart( args[0].dval );
+}
+
+/* int anc350VerifyStart(rate).*/
+static const iocshArg anc350VerifyStartArg0 = { "rate",          iocshArgDouble};
+
+static const iocshArg *const anc350VerifyStartArgs[] = {
+  &anc350VerifyStartArg0
+};
+static const iocshFuncDef anc350VerifyStartDef ={"anc350VerifyStart",1,anc350VerifyStartArgs};
+
+static void anc350VerifyStartCallFunc(const iocshArgBuf *args)
+{
+  anc350VerifyStart( args[0].dval );
+}
+
+/* int anc350HomeAll(cards, forwards, limit, timeout).*/
+static const iocshArg anc350HomeAllArg0 = { "cards",         iocshArgString};
+static const iocshArg anc350HomeAllArg1 = { "forwards",      iocshArgInt};
+static const iocshArg anc350HomeAllArg2 = { "limit",         iocshArgInt};
+static const iocshArg anc350HomeAllArg3 = { "timeout",       iocshArgDouble};
+
+static const iocshArg *const anc350HomeAllArgs[] = {
+  &anc350HomeAllArg0,
+  &anc350HomeAllArg1,
+  &anc350HomeAllArg2,
+  &anc350HomeAllArg3
+};
+static const iocshFuncDef anc350HomeAllDef ={"anc350HomeAll",4,anc350HomeAllArgs};
+
+static void anc350HomeAllCallFunc(const iocshArgBuf *args)
+{
+  anc350HomeAll( args[0].sval, args[1].ival, args[2].ival, args[3].dval );
+}
+
+/* int anc350HomeAbort().*/
+static const iocshFuncDef anc350HomeAbortDef ={"anc350HomeAbort",0,0};
+
+static void anc350HomeAbortCallFunc(const iocshArgBuf *args)
+{
+  anc350HomeAbort();
+}
+
+/* int anc350EstimateShow(card, axis).*/
+static const iocshArg anc350EstimateShowArg0 = { "card",          iocshArgInt};
+static const iocshArg anc350EstimateShowArg1 = { "axis",          iocshArgInt};
+
+static const iocshArg *const anc350EstimateShowArgs[] = {
+  &anc350EstimateShowArg0,
+  &anc350EstimateShowArg1
+};
+static const iocshFuncDef anc350EstimateShowDef ={"anc350EstimateShow",2,anc350EstimateShowArgs};
+
+static void anc350EstimateShowCallFunc(const iocshArgBuf *args)
+{
+  anc350EstimateShow( args[0].ival, args[1].ival );
+}
+
+/* int anc350IPConfigure(portName, hostInfo, cork).*/
+static const iocshArg anc350IPConfigureArg0 = { "port name",     iocshArgString};
+static const iocshArg anc350IPConfigureArg1 = { "host[:port]",   iocshArgString};
+static const iocshArg anc350IPConfigureArg2 = { "cork",          iocshArgDouble};
+
+static const iocshArg *const anc350IPConfigureArgs[] = {
+  &anc350IPConfigureArg0,
+  &anc350IPConfigureArg1,
+  &anc350IPConfigureArg2
+};
+static const iocshFuncDef anc350IPConfigureDef ={"anc350IPConfigure",3,anc350IPConfigureArgs};
+
+static void anc350IPConfigureCallFunc(const iocshArgBuf *args)
+{
+  anc350IPConfigure( args[0].sval, args[1].sval, args[2].dval );
+}
+
+/* int anc350MetricsConfigure(address).*/
+static const iocshArg anc350MetricsConfigureArg0 = { "host[:port] or unix:path", iocshArgString};
+
+static const iocshArg *const anc350MetricsConfigureArgs[] = {
+  &anc350MetricsConfigureArg0
+};
+static const iocshFuncDef anc350MetricsConfigureDef ={"anc350MetricsConfigure",1,anc350MetricsConfigureArgs};
+
+static void anc350MetricsConfigureCallFunc(const iocshArgBuf *args)
+{
+  anc350MetricsConfigure( args[0].sval );
+}
+
+/* int anc350StoreConfigure(fileName).*/
+static const iocshArg anc350StoreConfigureArg0 = { "fileName",      iocshArgString};
+
+static const iocshArg *const anc350StoreConfigureArgs[] = {
+  &anc350StoreConfigureArg0
+};
+static const iocshFuncDef anc350StoreConfigureDef ={"anc350StoreConfigure",1,anc350StoreConfigureArgs};
+
+static void anc350StoreConfigureCallFunc(const iocshArgBuf *args)
+{
+  anc350StoreConfigure( args[0].sval );
+}
+
+/* int anc350StoreSave().*/
+static const iocshFuncDef anc350StoreSaveDef ={"anc350StoreSave",0,0};
+
+static void anc350StoreSaveCallFunc(const iocshArgBuf *args)
+{
+  anc350StoreSave();
+}
+
+/* int anc350StoreShow().*/
+static const iocshFuncDef anc350StoreShowDef ={"anc350StoreShow",0,0};
+
+static void anc350StoreShowCallFunc(const iocshArgBuf *args)
+{
+  anc350StoreShow();
+}
+
 
 /*Register functions for IOC shell.*/
 void anc350AsynMotorRegister(void)
 {
+  drvAnc350RegisterShared();
   iocshRegister(&anc350AsynMotorCreateDef, anc350AsynMotorCreateCallFunc);
+  iocshRegister(&anc350ParamPortConfigureDef, anc350ParamPortConfigureCallFunc);
+  iocshRegister(&anc350SnapshotDef, anc350SnapshotCallFunc);
+  iocshRegister(&anc350SnapshotDiffDef, anc350SnapshotDiffCallFunc);
+  iocshRegister(&anc350SnapshotAxisDiffDef, anc350SnapshotAxisDiffCallFunc);
+  iocshRegister(&anc350SyncGroupAddDef, anc350SyncGroupAddCallFunc);
+  iocshRegister(&anc350SyncGroupDeferDef, anc350SyncGroupDeferCallFunc);
+  iocshRegister(&anc350TraceShowDef, anc350TraceShowCallFunc);
+  iocshRegister(&anc350TraceDumpDef, anc350TraceDumpCallFunc);
+  iocshRegister(&anc350TraceControlDef, anc350TraceControlCallFunc);
+  iocshRegister(&anc350TraceSessionDef, anc350TraceSessionCallFunc);
+  iocshRegister(&anc350SimConfigureDef, anc350SimConfigureCallFunc);
+  iocshRegister(&anc350SimRunDef, anc350SimRunCallFunc);
+  iocshRegister(&anc350SampleStartDef, anc350SampleStartCallFunc);
+  iocshRegister(&anc350VerifyStartDef, anc350VerifyStartCallFunc);
+  iocshRegister(&anc350HomeAllDef, anc350HomeAllCallFunc);
+  iocshRegister(&anc350HomeAbortDef, anc350HomeAbortCallFunc);
+  iocshRegister(&anc350EstimateShowDef, anc350EstimateShowCallFunc);
+  iocshRegister(&anc350IPConfigureDef, anc350IPConfigureCallFunc);
+  iocshRegister(&anc350MetricsConfigureDef, anc350MetricsConfigureCallFunc);
+  iocshRegister(&anc350StoreConfigureDef, anc350StoreConfigureCallFunc);
+  iocshRegister(&anc350StoreSaveDef, anc350StoreSaveCallFunc);
+  iocshRegister(&anc350StoreShowDef, anc350StoreShowCallFunc);
 }
 epicsExportRegistrar(anc350AsynMotorRegister);
 
@@ -0,0 +1,289 @@
+/*
+ * File:   anc350Bank.c
+ *
+ * Description:
+ *
+ * Temperature parameter banks.  The drive settings that suit a positioner
+ * at room temperature stall it in a cryostat, where it needs a higher
+ * amplitude and a lower frequency.  Each axis has a warm and a cold bank
+ * of frequency, amplitude, maximum amplitude and speed gain, and the
+ * driver switches every axis of the controller to the bank that matches
+ * the positioner temperature.
+ *
+ * The controller has no temperature register to go by, ID_ANC_TEMP_STATUS
+ * is only the overtemperature flag of the amplifier.  The temperature is
+ * written to ANC350_TEMPERATURE, usually by a record fed from the cryostat
+ * controller.  The cold bank is used below ANC350_BANK_COLD_BELOW and the
+ * warm bank above ANC350_BANK_WARM_ABOVE, in between the bank in use is
+ * kept, so a temperature hovering at a threshold does not switch back and
+ * forth.
+ *
+ * A switch writes only the registers whose value differs from the one
+ * last written from a bank, for all axes in one burst.  A bank setting of
+ * 0 leaves that register alone.  Each switch is reported with
+ * ASYN_TRACE_WARNING and in ANC350_BANK_LAST.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsMutex.h"
+#include "epicsStdio.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+
+/* Registers of a bank, in the order of the bankValue entries */
+typedef struct anc350BankReg
+{
+  int address;
+  const char * name;
+  double scale;         /* Register counts per unit of the bank setting */
+} anc350BankReg;
+
+static const anc350BankReg bankRegs[ANC350_BANK_REGS] =
+{
+  { ID_ANC_FAST_FREQ, "frequency",          1.0 },
+  { ID_ANC_AMPL,      "amplitude",          1000.0 },
+  { ID_ANC_MAX_AMP,   "maximum amplitude",  1000.0 },
+  { ID_ANC_SPD_GAIN,  "speed gain",         1000.0 },
+};
+
+static const char * bankNames[ANC350_BANKS] = { "warm", "cold" };
+
+static epicsMutexId bankMutexId = NULL;
+static epicsThreadOnceId bankOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350BankOnce( void * arg )
+{
+  bankMutexId = epicsMutexMustCreate();
+}
+
+/*
+ * Function: drvAnc350BankInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * No bank is in use until the first temperature arrives, and the banks of
+ * all axes are empty.
+ */
+void drvAnc350BankInit( ANC350DRV_ID pDrv )
+{
+  epicsThreadOnce( &bankOnceId, anc350BankOnce, NULL );
+  pDrv->bank = -1;
+  pDrv->bankTemperature = 0.0;
+  pDrv->bankColdBelow = 100.0;
+  pDrv->bankWarmAbove = 200.0;
+  pDrv->bankSwitches = 0;
+  pDrv->bankPending = 0;
+}
+
+/*
+ * Function: anc350BankApply
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: Number of registers written
+ *
+ * Description:
+ *
+ * Called with the bank mutex held.  Writes the registers of the bank in
+ * use that differ from the values last written, in one burst.  A failed
+ * write leaves the register pending for the next temperature update.
+ */
+static int anc350BankApply( ANC350DRV_ID pDrv )
+{
+  anc350Op * ops;
+  int * which;
+  int i, j, nOps = 0, written = 0;
+
+  if (pDrv->bank < 0) return 0;
+  ops = callocMustSucceed( pDrv->nAxes * ANC350_BANK_REGS, sizeof( anc350Op ), "anc350BankApply" );
+  which = callocMustSucceed( pDrv->nAxes * ANC350_BANK_REGS, sizeof( int ), "anc350BankApply" );
+
+  for (i = 0; i < pDrv->nAxes; i++){
+    AXIS_HDL pAxis = &pDrv->axis[i];
+
+    for (j = 0; j < ANC350_BANK_REGS; j++){
+      double setting = pAxis->bankValue[pDrv->bank][j];
+      int raw = (int) (setting * bankRegs[j].scale + 0.5);
+
+      if (setting <= 0.0) continue;
+      if ((pAxis->bankWrittenMask & (1 << j)) && pAxis->bankWritten[j] == raw) continue;
+      drvAnc350OpSet( &ops[nOps], bankRegs[j].address, i, raw );
+      which[nOps++] = i * ANC350_BANK_REGS + j;
+    }
+  }
+
+  if (nOps > 0) drvAnc350Burst( pDrv, ops, nOps, pDrv->burstTimeout );
+  pDrv->bankPending = 0;
+  for (i = 0; i < nOps; i++){
+    AXIS_HDL pAxis = &pDrv->axis[which[i] / ANC350_BANK_REGS];
+    j = which[i] % ANC350_BANK_REGS;
+
+    if (ops[i].status == asynSuccess){
+      pAxis->bankWritten[j] = ops[i].value;
+      pAxis->bankWrittenMask |= 1 << j;
+      written++;
+    } else {
+      asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+                 "anc350BankApply: card %d axis %d %s not written\n", pDrv->card, pAxis->axis, bankRegs[j].name );
+      pDrv->bankPending = 1;
+    }
+  }
+
+  free( which );
+  free( ops );
+  return written;
+}
+
+/*
+ * Function: anc350BankSelect
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called with the bank mutex held after a new temperature or threshold.
+ * Switches banks when the temperature is past a threshold.  Before the
+ * first switch the temperature may lie between the thresholds, then the
+ * nearer bank is taken.
+ */
+static void anc350BankSelect( ANC350DRV_ID pDrv )
+{
+  double t = pDrv->bankTemperature;
+  int bank = pDrv->bank;
+  int from = pDrv->bank;
+  int written;
+  char last[80];
+
+  if (t < pDrv->bankColdBelow) bank = ANC350_BANK_COLD;
+  else if (t > pDrv->bankWarmAbove) bank = ANC350_BANK_WARM;
+  else if (bank < 0) bank = (t < (pDrv->bankColdBelow + pDrv->bankWarmAbove) / 2.0)? ANC350_BANK_COLD: ANC350_BANK_WARM;
+
+  if (bank == pDrv->bank){
+    if (pDrv->bankPending) anc350BankApply( pDrv );
+    return;
+  }
+
+  pDrv->bank = bank;
+  pDrv->bankSwitches++;
+  written = anc350BankApply( pDrv );
+
+  epicsSnprintf( last, sizeof( last ), "%s -> %s at %.1f K, %d registers",
+                 (from < 0)? "none": bankNames[from], bankNames[bank], t, written );
+  asynPrint( pDrv->pasynUser, ASYN_TRACE_WARNING, "anc350Bank: card %d %s\n", pDrv->card, last );
+  anc350ParamSetString( pDrv, 0, ANC350_BANK_LAST, last );
+  anc350ParamSetInteger( pDrv, 0, ANC350_BANK, bank + 1 );
+  anc350ParamSetInteger( pDrv, 0, ANC350_BANK_SWITCHES, pDrv->bankSwitches );
+}
+
+/*
+ * Function: anc350BankParamInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Publishes the thresholds and the banks of every axis to the parameter
+ * port.
+ */
+void anc350BankParamInit( ANC350DRV_ID pDrv )
+{
+  int i;
+
+  anc350ParamSetDouble( pDrv, 0, ANC350_BANK_COLD_BELOW, pDrv->bankColdBelow );
+  anc350ParamSetDouble( pDrv, 0, ANC350_BANK_WARM_ABOVE, pDrv->bankWarmAbove );
+  anc350ParamSetInteger( pDrv, 0, ANC350_BANK, pDrv->bank + 1 );
+  anc350ParamSetInteger( pDrv, 0, ANC350_BANK_SWITCHES, pDrv->bankSwitches );
+  anc350ParamSetString( pDrv, 0, ANC350_BANK_LAST, "" );
+
+  for (i = 0; i < pDrv->nAxes; i++){
+    AXIS_HDL pAxis = &pDrv->axis[i];
+    int j;
+
+    for (j = 0; j < ANC350_BANK_REGS; j++){
+      anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_BANK_WARM_FREQ + j, pAxis->bankValue[ANC350_BANK_WARM][j] );
+      anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_BANK_COLD_FREQ + j, pAxis->bankValue[ANC350_BANK_COLD][j] );
+    }
+  }
+}
+
+/*
+ * Function: anc350BankParamWrite
+ *
+ * Parameters: pDrv    - Pointer to driver structure
+ *             addr    - Asyn address, 0 for the controller or the axis
+ *             reason  - Parameter written
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * A new temperature or threshold may switch banks.  A cold threshold that
+ * is not below the warm threshold, or the other way round, would invert
+ * the hysteresis: it is rejected and the parameter goes back to the
+ * threshold in use.  A new setting in the bank in use is written at once.
+ */
+asynStatus anc350BankParamWrite( ANC350DRV_ID pDrv, int addr, int reason )
+{
+  double dval = 0.0;
+  int bank, j;
+
+  if (pDrv == NULL || addr < 0 || addr > pDrv->nAxes) return asynError;
+  anc350ParamGetDouble( pDrv, addr, reason, &dval );
+
+  epicsMutexLock( bankMutexId );
+  switch (reason){
+    case ANC350_TEMPERATURE:
+      pDrv->bankTemperature = dval;
+      anc350BankSelect( pDrv );
+      break;
+    case ANC350_BANK_COLD_BELOW:
+      if (!(dval < pDrv->bankWarmAbove)){
+        asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+                   "anc350Bank: card %d cold threshold %g rejected, must be below the warm threshold %g\n",
+                   pDrv->card, dval, pDrv->bankWarmAbove );
+        anc350ParamSetDouble( pDrv, 0, reason, pDrv->bankColdBelow );
+        epicsMutexUnlock( bankMutexId );
+        return asynError;
+      }
+      pDrv->bankColdBelow = dval;
+      if (pDrv->bank >= 0) anc350BankSelect( pDrv );
+      break;
+    case ANC350_BANK_WARM_ABOVE:
+      if (!(dval > pDrv->bankColdBelow)){
+        asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+                   "anc350Bank: card %d warm threshold %g rejected, must be above the cold threshold %g\n",
+                   pDrv->card, dval, pDrv->bankColdBelow );
+        anc350ParamSetDouble( pDrv, 0, reason, pDrv->bankWarmAbove );
+        epicsMutexUnlock( bankMutexId );
+        return asynError;
+      }
+      pDrv->bankWarmAbove = dval;
+      if (pDrv->bank >= 0) anc350BankSelect( pDrv );
+      break;
+    default:
+      if (addr < 1) break;
+      bank = (reason >= ANC350_BANK_COLD_FREQ)? ANC350_BANK_COLD: ANC350_BANK_WARM;
+      j = reason - ((bank == ANC350_BANK_COLD)? ANC350_BANK_COLD_FREQ: ANC350_BANK_WARM_FREQ);
+      pDrv->axis[addr - 1].bankValue[bank][j] = (dval > 0.0)? dval: 0.0;
+      if (bank == pDrv->bank) anc350BankApply( pDrv );
+      break;
+  }
+  epicsMutexUnlock( bankMutexId );
+  return asynSuccess;
+}
@@ -0,0 +1,340 @@
+/*
+ * File:   anc350Batch.c
+ *
+ * Description:
+ *
+ * Batch register access for sequencer programs and other drivers, see
+ * anc350Batch.h.  Batches run through the pipelined burst layer.  Submitted
+ * batches are queued to a thread per controller, created when the first
+ * batch for that controller is submitted, so a slow controller does not
+ * hold up batches for the others.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsThread.h"
+#include "epicsEvent.h"
+#include "epicsMutex.h"
+#include "ellLib.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350Batch.h"
+
+struct anc350Batch
+{
+  ELLNODE node;                 /* Must be first, batches are queued on an ELLLIST */
+  ANC350DRV_ID pDrv;
+  int nOps;
+  int maxOps;
+  anc350Op * ops;
+  int nOk;
+  int submitted;
+  double timeout;
+  anc350BatchCallback callback;
+  void * pvt;
+  epicsEventId doneEvent;
+};
+
+typedef struct anc350BatchQueue
+{
+  ELLLIST list;
+  epicsMutexId lock;
+  epicsEventId event;
+  epicsThreadId thread;
+} anc350BatchQueue;
+
+static epicsMutexId batchMutexId = NULL;
+static epicsThreadOnceId batchOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350BatchInit( void * arg )
+{
+  batchMutexId = epicsMutexMustCreate();
+}
+
+/*
+ * Function: anc350BatchCreate
+ *
+ * Parameters: port     - String name of the asyn port given to anc350AsynMotorCreate
+ *             maxOps   - Maximum number of operations in the batch
+ *
+ * Returns: Pointer to the batch, NULL if there is no controller on the port
+ */
+anc350Batch * anc350BatchCreate( const char * port, int maxOps )
+{
+  ANC350DRV_ID pDrv = drvAnc350FindPort( port );
+  anc350Batch * pBatch;
+
+  if (pDrv == NULL){
+    printf( "anc350BatchCreate: no ANC350 controller on port %s\n", (port != NULL)? port: "(null)" );
+    return NULL;
+  }
+  if (maxOps < 1) maxOps = 1;
+
+  pBatch = callocMustSucceed( 1, sizeof( anc350Batch ), "anc350BatchCreate" );
+  pBatch->ops = callocMustSucceed( maxOps, sizeof( anc350Op ), "anc350BatchCreate" );
+  pBatch->pDrv = pDrv;
+  pBatch->maxOps = maxOps;
+  pBatch->doneEvent = epicsEventMustCreate( epicsEventEmpty );
+  return pBatch;
+}
+
+/*
+ * Function: anc350BatchFree
+ *
+ * Parameters: pBatch   - Pointer to the batch
+ *
+ * Returns: void
+ */
+void anc350BatchFree( anc350Batch * pBatch )
+{
+  if (pBatch == NULL) return;
+  epicsEventDestroy( pBatch->doneEvent );
+  free( pBatch->ops );
+  free( pBatch );
+}
+
+/*
+ * Function: anc350BatchReset
+ *
+ * Parameters: pBatch   - Pointer to the batch
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Removes all operations so the batch can be reused.
+ */
+void anc350BatchReset( anc350Batch * pBatch )
+{
+  pBatch->nOps = 0;
+  pBatch->nOk = 0;
+}
+
+/*
+ * Function: anc350BatchGet
+ *
+ * Parameters: pBatch   - Pointer to the batch
+ *             axis     - Axis (0 based), trigger number, or 0 for controller registers
+ *             address  - Register address
+ *
+ * Returns: Index of the operation, -1 if the batch is full
+ */
+int anc350BatchGet( anc350Batch * pBatch, int axis, int address )
+{
+  if (pBatch->nOps >= pBatch->maxOps) return -1;
+  drvAnc350OpGet( &pBatch->ops[pBatch->nOps], address, axis );
+  return pBatch->nOps++;
+}
+
+/*
+ * Function: anc350BatchSet
+ *
+ * Parameters: pBatch   - Pointer to the batch
+ *             axis     - Axis (0 based), trigger number, or 0 for controller registers
+ *             address  - Register address
+ *             value    - Value to write
+ *
+ * Returns: Index of the operation, -1 if the batch is full
+ */
+int anc350BatchSet( anc350Batch * pBatch, int axis, int address, int value )
+{
+  if (pBatch->nOps >= pBatch->maxOps) return -1;
+  drvAnc350OpSet( &pBatch->ops[pBatch->nOps], address, axis, value );
+  return pBatch->nOps++;
+}
+
+/*
+ * Function: anc350BatchRegister
+ *
+ * Parameters: name   - Register name, as used in snapshot files
+ *
+ * Returns: Register address, -1 if the name is unknown
+ */
+int anc350BatchRegister( const char * name )
+{
+  const anc350Register * pReg = anc350FindRegister( name );
+
+  return (pReg != NULL)? pReg->address: -1;
+}
+
+/*
+ * Function: anc350BatchExecute
+ *
+ * Parameters: pBatch   - Pointer to the batch
+ *             timeout  - Time allowed for the acks of each pipeline group (seconds)
+ *
+ * Returns: 0 if every operation was acknowledged OK, otherwise -1
+ */
+int anc350BatchExecute( anc350Batch * pBatch, double timeout )
+{
+  pBatch->nOk = drvAnc350Burst( pBatch->pDrv, pBatch->ops, pBatch->nOps, timeout );
+  return (pBatch->nOk == pBatch->nOps)? 0: -1;
+}
+
+/*
+ * Function: anc350BatchTask
+ *
+ * Parameters: pQueue   - Queue of the controller
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Batch thread of one controller.  Runs the submitted batches in order and
+ * signals their completion.  The batch is handed back, and doneEvent
+ * signalled, before the callback runs, so that nothing of the batch is
+ * touched once a waiter may free it; the callback gets its own copy of
+ * the callback arguments.
+ */
+static void anc350BatchTask( anc350BatchQueue * pQueue )
+{
+  anc350Batch * pBatch;
+  anc350BatchCallback callback;
+  void * pvt;
+
+  while (1){
+    epicsEventMustWait( pQueue->event );
+
+    while (1){
+      epicsMutexLock( pQueue->lock );
+      pBatch = (anc350Batch *) ellGet( &pQueue->list );
+      epicsMutexUnlock( pQueue->lock );
+      if (pBatch == NULL) break;
+
+      anc350BatchExecute( pBatch, pBatch->timeout );
+      callback = pBatch->callback;
+      pvt = pBatch->pvt;
+      pBatch->submitted = 0;
+      epicsEventSignal( pBatch->doneEvent );
+      if (callback != NULL) callback( pBatch, pvt );
+    }
+  }
+}
+
+/*
+ * Function: anc350BatchQueueGet
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: Pointer to the batch queue of the controller
+ *
+ * Description:
+ *
+ * Returns the batch queue of the controller, creating the queue and its
+ * thread on first use.
+ */
+static anc350BatchQueue * anc350BatchQueueGet( ANC350DRV_ID pDrv )
+{
+  anc350BatchQueue * pQueue;
+  char threadName[32];
+
+  epicsThreadOnce( &batchOnceId, anc350BatchInit, NULL );
+
+  epicsMutexLock( batchMutexId );
+  if ((pQueue = pDrv->pBatchQueue) == NULL){
+    pQueue = callocMustSucceed( 1, sizeof( anc350BatchQueue ), "anc350BatchQueueGet" );
+    ellInit( &pQueue->list );
+    pQueue->lock = epicsMutexMustCreate();
+    pQueue->event = epicsEventMustCreate( epicsEventEmpty );
+    sprintf( threadName, "anc350Batch%d", pDrv->card );
+    pQueue->thread = epicsThreadMustCreate( threadName,
+                                            epicsThreadPriorityMedium,
+                                            epicsThreadGetStackSize( epicsThreadStackMedium ),
+                                            (EPICSTHREADFUNC) anc350BatchTask, (void *) pQueue );
+    pDrv->pBatchQueue = pQueue;
+  }
+  epicsMutexUnlock( batchMutexId );
+  return pQueue;
+}
+
+/*
+ * Function: anc350BatchSubmit
+ *
+ * Parameters: pBatch    - Pointer to the batch
+ *             timeout   - Time allowed for the acks of each pipeline group (seconds)
+ *             callback  - Called in the batch thread on completion, may be NULL
+ *             pvt       - Passed to the callback
+ *
+ * Returns: 0 if the batch was queued, -1 if it is already submitted
+ */
+int anc350BatchSubmit( anc350Batch * pBatch, double timeout, anc350BatchCallback callback, void * pvt )
+{
+  anc350BatchQueue * pQueue = anc350BatchQueueGet( pBatch->pDrv );
+
+  if (pBatch->submitted) return -1;
+
+  pBatch->timeout = timeout;
+  pBatch->callback = callback;
+  pBatch->pvt = pvt;
+  pBatch->nOk = 0;
+  pBatch->submitted = 1;
+  epicsEventTryWait( pBatch->doneEvent );
+
+  epicsMutexLock( pQueue->lock );
+  ellAdd( &pQueue->list, &pBatch->node );
+  epicsMutexUnlock( pQueue->lock );
+  epicsEventSignal( pQueue->event );
+  return 0;
+}
+
+/*
+ * Function: anc350BatchWait
+ *
+ * Parameters: pBatch    - Pointer to the batch
+ *             waitTime  - Maximum time to wait (seconds)
+ *
+ * Returns: 0 if every operation was acknowledged OK, otherwise -1
+ */
+int anc350BatchWait( anc350Batch * pBatch, double waitTime )
+{
+  if (epicsEventWaitWithTimeout( pBatch->doneEvent, waitTime ) != epicsEventWaitOK) return -1;
+  return (pBatch->nOk == pBatch->nOps)? 0: -1;
+}
+
+/*
+ * Function: anc350BatchNumOps
+ *
+ * Parameters: pBatch   - Pointer to the batch
+ *
+ * Returns: Number of operations in the batch
+ */
+int anc350BatchNumOps( anc350Batch * pBatch )
+{
+  return pBatch->nOps;
+}
+
+/*
+ * Function: anc350BatchNumOk
+ *
+ * Parameters: pBatch   - Pointer to the batch
+ *
+ * Returns: Number of operations acknowledged OK by the last run
+ */
+int anc350BatchNumOk( anc350Batch * pBatch )
+{
+  return pBatch->nOk;
+}
+
+/*
+ * Function: anc350BatchResult
+ *
+ * Parameters: pBatch   - Pointer to the batch
+ *             op       - Index of the operation
+ *             value    - Returns the value read (GET) or written (SET), may be NULL
+ *             reason   - Returns the UC_REASON_... of the ack, -1 if none arrived, may be NULL
+ *
+ * Returns: 0 if the operation was acknowledged OK, otherwise -1
+ */
+int anc350BatchResult( anc350Batch * pBatch, int op, int * value, int * reason )
+{
+  if (op < 0 || op >= pBatch->nOps) return -1;
+  if (value != NULL) *value = pBatch->ops[op].value;
+  if (reason != NULL) *reason = pBatch->ops[op].reason;
+  return (pBatch->ops[op].status == asynSuccess)? 0: -1;
+}
@@ -0,0 +1,65 @@
+/*
+ * File:   anc350Batch.h
+ *
+ * Description:
+ *
+ * Batch register access to ANC350 controllers driven by anc350AsynMotor,
+ * for sequencer programs and other drivers.  A batch is a list of GET and
+ * SET operations on one controller, identified by the asyn port given to
+ * anc350AsynMotorCreate.  The operations are sent as pipelined bursts, so
+ * a batch of N registers costs roughly one network round trip per
+ * pipeline group rather than one per register.
+ *
+ *   anc350Batch * pBatch = anc350BatchCreate( "IP1", 8 );
+ *   anc350BatchGet( pBatch, 0, ID_ANC_COUNTER );
+ *   anc350BatchSet( pBatch, 1, ID_ANC_AMPL, 30000 );
+ *   if (anc350BatchExecute( pBatch, 0.5 ) == 0) anc350BatchResult( pBatch, 0, &position, NULL );
+ *
+ * A batch may also be submitted for execution in the background, with a
+ * completion callback, anc350BatchWait or both.  A batch must not be
+ * changed or freed while it is submitted.  anc350BatchWait returns before
+ * the callback runs, and the callback may submit the batch again, but it
+ * must not free it: free a batch with a callback from another thread once
+ * the callback has returned.
+ */
+#ifndef ANC350_BATCH_H
+#define ANC350_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct anc350Batch anc350Batch;
+
+/* Called in the batch thread of the controller when a submitted batch completes,
+ * after anc350BatchWait has been released.  Must not free the batch. */
+typedef void (*anc350BatchCallback)( anc350Batch * pBatch, void * pvt );
+
+anc350Batch * anc350BatchCreate( const char * port, int maxOps );
+void anc350BatchFree( anc350Batch * pBatch );
+void anc350BatchReset( anc350Batch * pBatch );
+
+/* Add an operation.  axis is the controller axis (0 based, as the S<n> of
+ * devAnc350 records), trigger number, or 0 for controller registers.
+ * Returns the index of the operation in the batch, -1 if the batch is full. */
+int anc350BatchGet( anc350Batch * pBatch, int axis, int address );
+int anc350BatchSet( anc350Batch * pBatch, int axis, int address, int value );
+int anc350BatchRegister( const char * name );
+
+/* Run the batch in the calling thread.  Returns 0 if every operation was acknowledged OK. */
+int anc350BatchExecute( anc350Batch * pBatch, double timeout );
+
+/* Queue the batch to the batch thread of the controller.  Returns 0 if queued. */
+int anc350BatchSubmit( anc350Batch * pBatch, double timeout, anc350BatchCallback callback, void * pvt );
+/* Wait up to waitTime seconds for a submitted batch.  Returns 0 if every operation was acknowledged OK. */
+int anc350BatchWait( anc350Batch * pBatch, double waitTime );
+
+/* Results, valid once the batch has completed */
+int anc350BatchNumOps( anc350Batch * pBatch );
+int anc350BatchNumOk( anc350Batch * pBatch );
+int anc350BatchResult( anc350Batch * pBatch, int op, int * value, int * reason );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,552 @@
+/*
+ * File:   anc350Burst.c
+ *
+ * Description:
+ *
+ * Pipelined telegram bursts for the ANC350 asyn motor driver.  A burst
+ * writes a group of GET and SET telegrams back-to-back in a single write,
+ * then collects the acknowledgements as they arrive and matches them to
+ * the requests by correlation number.  The port is locked for the whole
+ * burst so the acks cannot be consumed by another client of the port.
+ * This turns N round trips into roughly one for each group of telegrams.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsTime.h"
+#include "epicsAtomic.h"
+#include "epicsMutex.h"
+#include "asynDriver.h"
+#include "asynOctet.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+
+#define MIN(a,b) ((a)<(b)? (a): (b))
+
+/*
+ * Function: drvAnc350BurstConnect
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *             port   - String name of asyn port
+ *             addr   - Address value
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Creates the asynUser used for bursts and finds the octet interface of
+ * the port.  Bursts call the interface directly with the port locked
+ * rather than going through asynOctetSyncIO, which would try to take the
+ * port again for every read.
+ */
+int drvAnc350BurstConnect( ANC350DRV_ID pDrv, const char * port, int addr )
+{
+  asynUser * pasynUser;
+  asynInterface * pasynInterface;
+  asynStatus status;
+
+  pasynUser = pasynManager->createAsynUser( 0, 0 );
+  status = pasynManager->connectDevice( pasynUser, port, addr );
+  if (status != asynSuccess){
+    printf( "drvAnc350BurstConnect: unable to connect to port %s: %s\n", port, pasynUser->errorMessage );
+    pasynManager->freeAsynUser( pasynUser );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  pasynInterface = pasynManager->findInterface( pasynUser, asynOctetType, 1 );
+  if (pasynInterface == NULL){
+    printf( "drvAnc350BurstConnect: port %s has no %s interface\n", port, asynOctetType );
+    pasynManager->disconnect( pasynUser );
+    pasynManager->freeAsynUser( pasynUser );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  pDrv->pasynUserBurst = pasynUser;
+  pDrv->pOctet = (asynOctet *) pasynInterface->pinterface;
+  pDrv->octetPvt = pasynInterface->drvPvt;
+  pDrv->priorityMutex = epicsMutexMustCreate();
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: drvAnc350OpGet
+ *
+ * Parameters: op       - Pointer to the operation to fill in
+ *             address  - Register address
+ *             index    - Axis (0 based) or trigger index
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Initialises a GET operation for use with drvAnc350Burst.
+ */
+void drvAnc350OpGet( anc350Op * op, int address, int index )
+{
+  memset( op, 0, sizeof( anc350Op ) );
+  op->opcode = UC_GET;
+  op->address = address;
+  op->index = index;
+  op->reason = -1;
+  op->status = asynTimeout;
+}
+
+/*
+ * Function: drvAnc350OpSet
+ *
+ * Parameters: op       - Pointer to the operation to fill in
+ *             address  - Register address
+ *             index    - Axis (0 based) or trigger index
+ *             value    - Value to write
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Initialises a SET operation for use with drvAnc350Burst.
+ */
+void drvAnc350OpSet( anc350Op * op, int address, int index, int value )
+{
+  drvAnc350OpGet( op, address, index );
+  op->opcode = UC_SET;
+  op->value = value;
+}
+
+/*
+ * Function: drvAnc350BurstEncode
+ *
+ * Parameters: op   - Pointer to the operation
+ *             buf  - Buffer to encode the telegram into
+ *
+ * Returns: Number of bytes encoded
+ *
+ * Description:
+ *
+ * Encodes a GET or SET telegram for the operation, using the
+ * correlation number already stored in the operation.
+ */
+static size_t drvAnc350BurstEncode( const anc350Op * op, char * buf )
+{
+  if (op->opcode == UC_SET){
+    UcSetTelegram request;
+
+    request.hdr.length            = sizeof( UcSetTelegram ) - sizeof( Int32 );
+    request.hdr.opcode            = UC_SET;
+    request.hdr.address           = op->address;
+    request.hdr.index             = op->index;
+    request.hdr.correlationNumber = op->mid;
+    request.data[0]               = op->value;
+    memcpy( buf, &request, sizeof( UcSetTelegram ) );
+    return sizeof( UcSetTelegram );
+  } else {
+    UcGetTelegram request;
+
+    request.hdr.length            = sizeof( UcGetTelegram ) - sizeof( Int32 );
+    request.hdr.opcode            = UC_GET;
+    request.hdr.address           = op->address;
+    request.hdr.index             = op->index;
+    request.hdr.correlationNumber = op->mid;
+    memcpy( buf, &request, sizeof( UcGetTelegram ) );
+    return sizeof( UcGetTelegram );
+  }
+}
+
+/*
+ * Function: drvAnc350BurstMatch
+ *
+ * Parameters: ops     - Operations of the group in flight
+ *             nOps    - Number of operations in the group
+ *             pTel    - Pointer to a complete received telegram
+ *
+ * Returns: 1 if the telegram completed an operation, 0 for an ack that
+ *          matches no operation, -1 for any other telegram
+ *
+ * Description:
+ *
+ * Matches an acknowledge to the operation with the same correlation
+ * number.  Tell telegrams (events) and stale acks are ignored.
+ */
+static int drvAnc350BurstMatch( anc350Op * ops, int nOps, const char * pTel )
+{
+  UcAckTelegram ack;
+  int i;
+
+  memset( &ack, 0, sizeof( ack ) );
+  memcpy( &ack, pTel, MIN( sizeof( ack ), sizeof( Int32 ) + (size_t)((const UcTelegram *)pTel)->length ) );
+  if (ack.hdr.opcode != UC_ACK) return -1;
+
+  for (i = 0; i < nOps; i++){
+    if (ops[i].reason < 0 && ops[i].mid == ack.hdr.correlationNumber){
+      ops[i].reason = ack.reason;
+      if (ops[i].opcode == UC_GET) ops[i].value = ack.data[0];
+      ops[i].status = (ack.reason == UC_REASON_OK)? asynSuccess: asynError;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Receive buffer, carried from one pipeline group to the next */
+typedef struct drvAnc350BurstRx
+{
+  char in[UC_MAXSIZE * 4];
+  size_t fill;
+} drvAnc350BurstRx;
+
+/*
+ * Function: drvAnc350BurstWrite
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             ops      - Operations of the group
+ *             nOps     - Number of operations, at most ANC350_MAX_PIPELINE
+ *             timeout  - Write timeout (seconds)
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Assigns correlation numbers and writes the telegrams of one group with a
+ * single write.  The port must be locked.
+ */
+static asynStatus drvAnc350BurstWrite( ANC350DRV_ID pDrv, anc350Op * ops, int nOps, double timeout )
+{
+  asynUser * pasynUser = pDrv->pasynUserBurst;
+  char out[ANC350_MAX_PIPELINE * sizeof( UcSetTelegram )];
+  size_t len = 0;
+  size_t nWritten = 0;
+  asynStatus status;
+  int i;
+
+  for (i = 0; i < nOps; i++){
+    ops[i].mid = drvAnc350NextMid();
+    len += drvAnc350BurstEncode( &ops[i], out + len );
+  }
+
+  pasynUser->timeout = timeout;
+  drvAnc350TimeGetCurrent( &pDrv->metrics.lastWrite );
+  status = pDrv->pOctet->write( pDrv->octetPvt, pasynUser, out, len, &nWritten );
+  if (status != asynSuccess || nWritten != len){
+    asynPrint( pasynUser, ASYN_TRACE_ERROR,
+               "drvAnc350Burst: card %d write failed %s\n", pDrv->card, pasynUser->errorMessage );
+    return asynError;
+  }
+  epicsAtomicAddSizeT( &pDrv->metrics.telegramsSent, (size_t) nOps );
+  return asynSuccess;
+}
+
+/*
+ * Function: drvAnc350BurstCollect
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             ops      - Operations of the group
+ *             nOps     - Number of operations in the group
+ *             timeout  - Time allowed for the acks (seconds)
+ *             pRx      - Receive buffer
+ *
+ * Returns: asynStatus of the last read
+ *
+ * Description:
+ *
+ * Reads whole receive buffers until every operation of the group has been
+ * acknowledged or the timeout expires.  The port must be locked.
+ */
+static asynStatus drvAnc350BurstCollect( ANC350DRV_ID pDrv, anc350Op * ops, int nOps, double timeout,
+                                         drvAnc350BurstRx * pRx )
+{
+  asynUser * pasynUser = pDrv->pasynUserBurst;
+  asynStatus status = asynSuccess;
+  int pending = nOps;
+  epicsTimeStamp start;
+  epicsTimeStamp now;
+
+  epicsTimeGetCurrent( &start );
+  while (pending > 0){
+    size_t nRead = 0;
+    size_t pos = 0;
+    int eom = 0;
+    double remaining;
+
+    epicsTimeGetCurrent( &now );
+    remaining = timeout - epicsTimeDiffInSeconds( &now, &start );
+    if (remaining <= 0.0) break;
+
+    /* Take whatever has arrived, up to the free space in the buffer */
+    pasynUser->timeout = remaining;
+    status = pDrv->pOctet->read( pDrv->octetPvt, pasynUser, pRx->in + pRx->fill, sizeof( pRx->in ) - pRx->fill, &nRead, &eom );
+    if (nRead == 0){
+      if (status == asynSuccess) continue;
+      if (status == asynTimeout) status = asynSuccess;
+      break;
+    }
+    status = asynSuccess;
+    pRx->fill += nRead;
+
+    /* Extract every complete telegram in the buffer */
+    while (pRx->fill - pos >= sizeof( Int32 )){
+      Int32 length;
+
+      memcpy( &length, pRx->in + pos, sizeof( Int32 ) );
+      if (length < (Int32)(sizeof( UcTelegram ) - sizeof( Int32 )) || length > UC_MAXSIZE){
+        /* Lost framing, discard what we have and wait for the next telegram */
+        asynPrint( pasynUser, ASYN_TRACE_ERROR,
+                   "drvAnc350Burst: card %d bad telegram length %d\n", pDrv->card, (int)length );
+        pos = pRx->fill;
+        break;
+      }
+      if (pRx->fill - pos < sizeof( Int32 ) + (size_t)length) break;
+      epicsAtomicIncrSizeT( &pDrv->metrics.telegramsReceived );
+      switch (drvAnc350BurstMatch( ops, nOps, pRx->in + pos )){
+        case 1:
+          pending--;
+          break;
+        case 0:
+          epicsAtomicIncrSizeT( &pDrv->metrics.mismatches );
+          break;
+      }
+      pos += sizeof( Int32 ) + (size_t)length;
+    }
+    memmove( pRx->in, pRx->in + pos, pRx->fill - pos );
+    pRx->fill -= pos;
+  }
+
+  if (pending > 0){
+    asynPrint( pasynUser, ASYN_TRACE_ERROR,
+               "drvAnc350Burst: card %d %d of %d acks missing\n", pDrv->card, pending, nOps );
+    epicsAtomicAddSizeT( &pDrv->metrics.timeouts, (size_t) pending );
+  } else {
+    drvAnc350MetricsRtt( pDrv, &pDrv->metrics.lastWrite );
+  }
+  return status;
+}
+
+/*
+ * Function: drvAnc350BurstReset
+ *
+ * Parameters: ops   - Array of operations
+ *             nOps  - Number of operations
+ *
+ * Returns: void
+ */
+static void drvAnc350BurstReset( anc350Op * ops, int nOps )
+{
+  int i;
+
+  for (i = 0; i < nOps; i++){
+    ops[i].reason = -1;
+    ops[i].status = asynTimeout;
+  }
+}
+
+/*
+ * Function: drvAnc350BurstCount
+ *
+ * Parameters: pDrv  - Pointer to driver structure
+ *             ops   - Array of operations
+ *             nOps  - Number of operations
+ *
+ * Returns: Number of operations acknowledged with UC_REASON_OK
+ *
+ * Description:
+ *
+ * Also passes the acknowledged SETs to the configuration copy.
+ */
+static int drvAnc350BurstCount( ANC350DRV_ID pDrv, const anc350Op * ops, int nOps )
+{
+  int nOk = 0;
+  int i;
+
+  for (i = 0; i < nOps; i++){
+    if (ops[i].status != asynSuccess) continue;
+    nOk++;
+    if (ops[i].opcode == UC_SET) drvAnc350VerifyNote( pDrv, ops[i].index, ops[i].address, ops[i].value );
+  }
+  return nOk;
+}
+
+/*
+ * Function: drvAnc350BurstServe
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             pRx      - Receive buffer
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Sends the operations posted by drvAnc350BurstPriority, if any, and
+ * collects their acks.  The port must be locked.  Called by every burst
+ * before each group, so priority telegrams wait at most for the group in
+ * flight rather than for the whole burst.
+ */
+static void drvAnc350BurstServe( ANC350DRV_ID pDrv, drvAnc350BurstRx * pRx )
+{
+  anc350Op * ops;
+  int nOps;
+  double timeout;
+
+  if (pDrv->priorityMutex == NULL || pDrv->pPriorityOps == NULL) return;
+  epicsMutexLock( pDrv->priorityMutex );
+  ops = pDrv->pPriorityOps;
+  nOps = pDrv->nPriorityOps;
+  timeout = pDrv->priorityTimeout;
+  pDrv->pPriorityOps = NULL;
+  epicsMutexUnlock( pDrv->priorityMutex );
+  if (ops == NULL) return;
+
+  if (drvAnc350BurstWrite( pDrv, ops, nOps, timeout ) == asynSuccess){
+    drvAnc350BurstCollect( pDrv, ops, nOps, timeout, pRx );
+  }
+}
+
+/*
+ * Function: drvAnc350Burst
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             ops      - Array of operations to perform
+ *             nOps     - Number of operations
+ *             timeout  - Time allowed for the acks of each group (seconds)
+ *
+ * Returns: Number of operations acknowledged with UC_REASON_OK
+ *
+ * Description:
+ *
+ * Performs the operations as pipelined bursts of up to pDrv->pipelineDepth
+ * telegrams.  Each group is written with a single write and the acks are
+ * read back in whole receive buffers.  Operations whose ack does not
+ * arrive within the timeout are left with status asynTimeout and reason -1.
+ */
+int drvAnc350Burst( ANC350DRV_ID pDrv, anc350Op * ops, int nOps, double timeout )
+{
+  asynUser * pasynUser = pDrv->pasynUserBurst;
+  drvAnc350BurstRx rx;
+  int first;
+  int depth;
+  asynStatus status = asynSuccess;
+
+  if (pasynUser == NULL || nOps <= 0) return 0;
+
+  depth = pDrv->pipelineDepth;
+  if (depth < 1) depth = 1;
+  if (depth > ANC350_MAX_PIPELINE) depth = ANC350_MAX_PIPELINE;
+
+  drvAnc350BurstReset( ops, nOps );
+  rx.fill = 0;
+
+  pasynManager->lockPort( pasynUser );
+
+  /* Remove any stale acks left by unacknowledged SETs */
+  pDrv->pOctet->flush( pDrv->octetPvt, pasynUser );
+
+  for (first = 0; first < nOps && status == asynSuccess; first += depth){
+    int n = MIN( depth, nOps - first );
+
+    drvAnc350BurstServe( pDrv, &rx );
+    status = drvAnc350BurstWrite( pDrv, ops + first, n, timeout );
+    if (status == asynSuccess) status = drvAnc350BurstCollect( pDrv, ops + first, n, timeout, &rx );
+  }
+
+  pasynManager->unlockPort( pasynUser );
+
+  return drvAnc350BurstCount( pDrv, ops, nOps );
+}
+
+/*
+ * Function: drvAnc350BurstPriority
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             ops      - Array of operations to perform
+ *             nOps     - Number of operations, at most ANC350_MAX_PIPELINE
+ *             timeout  - Time allowed for the acks (seconds)
+ *
+ * Returns: Number of operations acknowledged with UC_REASON_OK
+ *
+ * Description:
+ *
+ * Performs the operations ahead of any burst already holding the port.
+ * They are posted for the holder to send before its next group, and sent
+ * here if the port comes free first.  One caller at a time per controller,
+ * the inhibit thread.
+ */
+int drvAnc350BurstPriority( ANC350DRV_ID pDrv, anc350Op * ops, int nOps, double timeout )
+{
+  asynUser * pasynUser = pDrv->pasynUserBurst;
+  drvAnc350BurstRx rx;
+
+  if (pasynUser == NULL || nOps <= 0 || nOps > ANC350_MAX_PIPELINE) return 0;
+
+  drvAnc350BurstReset( ops, nOps );
+  rx.fill = 0;
+
+  epicsMutexLock( pDrv->priorityMutex );
+  pDrv->pPriorityOps = ops;
+  pDrv->nPriorityOps = nOps;
+  pDrv->priorityTimeout = timeout;
+  epicsMutexUnlock( pDrv->priorityMutex );
+
+  pasynManager->lockPort( pasynUser );
+  drvAnc350BurstServe( pDrv, &rx );
+  pasynManager->unlockPort( pasynUser );
+
+  return drvAnc350BurstCount( pDrv, ops, nOps );
+}
+
+/*
+ * Function: drvAnc350BurstStart
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             ops      - Array of operations to perform
+ *             nOps     - Number of operations, at most ANC350_MAX_PIPELINE
+ *             timeout  - Write timeout (seconds)
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * First half of a burst that is split across several controllers: locks
+ * the port and writes the telegrams, without waiting for the acks.  If the
+ * call succeeds the port stays locked until drvAnc350BurstFinish is called.
+ * Used to put telegrams on the wire to several controllers back-to-back.
+ */
+int drvAnc350BurstStart( ANC350DRV_ID pDrv, anc350Op * ops, int nOps, double timeout )
+{
+  asynUser * pasynUser = pDrv->pasynUserBurst;
+
+  if (pasynUser == NULL || nOps <= 0 || nOps > ANC350_MAX_PIPELINE) return MOTOR_AXIS_ERROR;
+
+  drvAnc350BurstReset( ops, nOps );
+  pasynManager->lockPort( pasynUser );
+  pDrv->pOctet->flush( pDrv->octetPvt, pasynUser );
+  if (drvAnc350BurstWrite( pDrv, ops, nOps, timeout ) != asynSuccess){
+    pasynManager->unlockPort( pasynUser );
+    return MOTOR_AXIS_ERROR;
+  }
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: drvAnc350BurstFinish
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             ops      - Operations passed to drvAnc350BurstStart
+ *             nOps     - Number of operations
+ *             timeout  - Time allowed for the acks (seconds)
+ *
+ * Returns: Number of operations acknowledged with UC_REASON_OK
+ *
+ * Description:
+ *
+ * Second half of a split burst: collects the acks and unlocks the port.
+ */
+int drvAnc350BurstFinish( ANC350DRV_ID pDrv, anc350Op * ops, int nOps, double timeout )
+{
+  drvAnc350BurstRx rx;
+
+  rx.fill = 0;
+  drvAnc350BurstCollect( pDrv, ops, nOps, timeout, &rx );
+  pasynManager->unlockPort( pDrv->pasynUserBurst );
+  return drvAnc350BurstCount( pDrv, ops, nOps );
+}
@@ -0,0 +1,297 @@
+/*
+ * File:   anc350Callback.c
+ *
+ * Description:
+ *
+ * Delivery of poller status updates to the motor record.  The poller does
+ * not call the motor record callback itself: each axis status it reads is
+ * posted as an anc350Update to a single-producer single-consumer ring of
+ * the controller, and a callback thread per controller applies the
+ * updates to the axis parameters and calls the callback.  Posting never
+ * blocks; the poller only ever writes the ring head and the callback
+ * thread only the tail.
+ *
+ * The callback thread takes everything on the ring each time it wakes and
+ * merges the updates of each axis, so an update superseded by a later one
+ * of the same axis is never delivered, and calls the callback once per
+ * axis.  If the ring is full the update is dropped, counted, and the axis
+ * polled again on the next pass.
+ *
+ * Commands that publish Done themselves (move, home, jog, stop) bump the
+ * generation of the axis.  The Done state of an update read before the
+ * command is then not applied, so a stale Done cannot end a new move.
+ *
+ * A controller on virtual time has no callback thread; its updates are
+ * delivered in the poller so that anc350SimRun sees them at once.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsEvent.h"
+#include "epicsMutex.h"
+#include "epicsAtomic.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+
+/* Updates held on the ring per axis */
+#define CALLBACK_QUEUE_PER_AXIS 16
+
+typedef struct anc350CallbackQueue
+{
+  ANC350DRV_ID pDrv;
+  int size;
+  anc350Update * ring;
+  int head;                     /* Next slot written, only changed by the poller */
+  int tail;                     /* Next slot read, only changed by the callback thread */
+  int dropped;
+  anc350Update * merged;        /* One per axis, used by the callback thread */
+  epicsEventId event;
+  epicsThreadId thread;
+} anc350CallbackQueue;
+
+/*
+ * Function: anc350CallbackMerge
+ *
+ * Parameters: pTo     - Update to merge into
+ *             pFrom   - Later update of the same axis
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * The merged update takes the generation of the later update.  If the
+ * generation has changed, the Done state is only kept if the later update
+ * carries one.
+ */
+static void anc350CallbackMerge( anc350Update * pTo, const anc350Update * pFrom )
+{
+  if (pTo->set == 0) pTo->posted = pFrom->posted;
+  /* A Done read before a command is not carried into the new generation */
+  if (pTo->generation != pFrom->generation) pTo->set &= ~ANC350_UPDATE_DONE;
+  pTo->set |= pFrom->set;
+  pTo->generation = pFrom->generation;
+  if (pFrom->set & ANC350_UPDATE_DONE) pTo->done = pFrom->done;
+  if (pFrom->set & ANC350_UPDATE_HOMED) pTo->homed = pFrom->homed;
+  if (pFrom->set & ANC350_UPDATE_POSITION){
+    pTo->position = pFrom->position;
+    pTo->direction = pFrom->direction;
+  }
+  if (pFrom->set & ANC350_UPDATE_LIMITS){
+    pTo->highLimit = pFrom->highLimit;
+    pTo->lowLimit = pFrom->lowLimit;
+  }
+  if (pFrom->set & ANC350_UPDATE_PROBLEM){
+    pTo->problem = pFrom->problem;
+    pTo->commError = pFrom->commError;
+  }
+}
+
+/*
+ * Function: anc350CallbackDeliver
+ *
+ * Parameters: pAxis     - Pointer to motor axis handle
+ *             pUpdate   - Update to deliver
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Applies the update to the axis parameters and calls the motor record
+ * callback.  Takes the parameter mutex of the axis, never its axis mutex.
+ */
+static void anc350CallbackDeliver( AXIS_HDL pAxis, const anc350Update * pUpdate )
+{
+  epicsMutexLock( pAxis->paramMutex );
+  if ((pUpdate->set & ANC350_UPDATE_DONE) && pUpdate->generation == epicsAtomicGetIntT( &pAxis->cbGeneration )){
+    motorParam->setInteger( pAxis->params, motorAxisDone, pUpdate->done );
+  }
+  if (pUpdate->set & ANC350_UPDATE_HOMED){
+    motorParam->setInteger( pAxis->params, motorAxisHomed, pUpdate->homed );
+    motorParam->setInteger( pAxis->params, motorAxisHomeSignal, pUpdate->homed );
+  }
+  if (pUpdate->set & ANC350_UPDATE_POSITION){
+    motorParam->setInteger( pAxis->params, motorAxisDirection, pUpdate->direction );
+    motorParam->setDouble( pAxis->params, motorAxisPosition, pUpdate->position );
+    motorParam->setDouble( pAxis->params, motorAxisEncoderPosn, pUpdate->position );
+  }
+  if (pUpdate->set & ANC350_UPDATE_LIMITS){
+    motorParam->setInteger( pAxis->params, motorAxisHighHardLimit, pUpdate->highLimit );
+    motorParam->setInteger( pAxis->params, motorAxisLowHardLimit, pUpdate->lowLimit );
+  }
+  if (pUpdate->set & ANC350_UPDATE_PROBLEM){
+    motorParam->setInteger( pAxis->params, motorAxisProblem, pUpdate->problem );
+    motorParam->setInteger( pAxis->params, motorAxisCommError, pUpdate->commError );
+  }
+  drvAnc350TraceCallback( pAxis );
+  motorParam->callCallback( pAxis->params );
+  drvAnc350TraceCallback( pAxis );
+  epicsMutexUnlock( pAxis->paramMutex );
+}
+
+/*
+ * Function: anc350CallbackTask
+ *
+ * Parameters: arg   - Pointer to the queue
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Callback thread of one controller.
+ */
+static void anc350CallbackTask( void * arg )
+{
+  anc350CallbackQueue * pQueue = (anc350CallbackQueue *) arg;
+  ANC350DRV_ID pDrv = pQueue->pDrv;
+  int dropped = 0;
+
+  while (1){
+    epicsTimeStamp now;
+    double lag = 0.0;
+    int head;
+    int tail = pQueue->tail;
+    int i;
+
+    epicsEventMustWait( pQueue->event );
+
+    head = epicsAtomicGetIntT( &pQueue->head );
+    epicsAtomicReadMemoryBarrier();
+    if (head == tail) continue;
+
+    for (; tail != head; tail = (tail + 1) % pQueue->size){
+      const anc350Update * pUpdate = &pQueue->ring[tail];
+
+      anc350CallbackMerge( &pQueue->merged[pUpdate->axis - 1], pUpdate );
+    }
+    /* The slots must be read before the poller can reuse them */
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetIntT( &pQueue->tail, tail );
+
+    drvAnc350TimeGetCurrent( &now );
+    for (i = 0; i < pDrv->nAxes; i++){
+      anc350Update * pMerged = &pQueue->merged[i];
+
+      if (pMerged->set == 0) continue;
+      if (epicsTimeDiffInSeconds( &now, &pMerged->posted ) > lag) lag = epicsTimeDiffInSeconds( &now, &pMerged->posted );
+      anc350CallbackDeliver( &pDrv->axis[i], pMerged );
+      pMerged->set = 0;
+    }
+
+    anc350ParamSetDouble( pDrv, 0, ANC350_CB_LAG, lag );
+    if (epicsAtomicGetIntT( &pQueue->dropped ) != dropped){
+      dropped = epicsAtomicGetIntT( &pQueue->dropped );
+      anc350ParamSetInteger( pDrv, 0, ANC350_CB_DROPPED, dropped );
+    }
+  }
+}
+
+/*
+ * Function: drvAnc350CallbackCreate
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Creates the ring and starts the callback thread of the controller.
+ * Until it is called, and if it fails, updates are delivered in the
+ * poller.
+ */
+int drvAnc350CallbackCreate( ANC350DRV_ID pDrv )
+{
+  anc350CallbackQueue * pQueue;
+
+  pQueue = callocMustSucceed( 1, sizeof( anc350CallbackQueue ), "drvAnc350CallbackCreate" );
+  pQueue->pDrv = pDrv;
+  pQueue->size = pDrv->nAxes * CALLBACK_QUEUE_PER_AXIS;
+  pQueue->ring = callocMustSucceed( pQueue->size, sizeof( anc350Update ), "drvAnc350CallbackCreate" );
+  pQueue->merged = callocMustSucceed( pDrv->nAxes, sizeof( anc350Update ), "drvAnc350CallbackCreate" );
+  pQueue->event = epicsEventMustCreate( epicsEventEmpty );
+
+  pQueue->thread = epicsThreadCreate( "drvAnc350Callback", epicsThreadPriorityMedium,
+                                      epicsThreadGetStackSize( epicsThreadStackMedium ),
+                                      anc350CallbackTask, pQueue );
+  if (pQueue->thread == NULL){
+    asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+               "drvAnc350CallbackCreate: card %d cannot start the callback thread, callbacks run in the poller\n",
+               pDrv->card );
+    epicsEventDestroy( pQueue->event );
+    free( pQueue->merged );
+    free( pQueue->ring );
+    free( pQueue );
+    return MOTOR_AXIS_ERROR;
+  }
+  pDrv->pCallbackQueue = pQueue;
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: drvAnc350CallbackPost
+ *
+ * Parameters: pAxis     - Pointer to motor axis handle
+ *             pUpdate   - Status read by the poller
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called by the poller only, with the axis mutex held.  Never waits.
+ */
+void drvAnc350CallbackPost( AXIS_HDL pAxis, anc350Update * pUpdate )
+{
+  anc350CallbackQueue * pQueue = pAxis->pDrv->pCallbackQueue;
+  int head;
+  int next;
+
+  pUpdate->axis = pAxis->axis;
+  pUpdate->generation = epicsAtomicGetIntT( &pAxis->cbGeneration );
+  drvAnc350TimeGetCurrent( &pUpdate->posted );
+
+  if (pQueue == NULL){
+    anc350CallbackDeliver( pAxis, pUpdate );
+    return;
+  }
+
+  head = pQueue->head;
+  next = (head + 1) % pQueue->size;
+  if (next == epicsAtomicGetIntT( &pQueue->tail )){
+    epicsAtomicIncrIntT( &pQueue->dropped );
+    /* Poll the axis again next pass, its next update replaces this one */
+    pAxis->pDrv->pollSkips[pAxis->axis - 1] = 0.0;
+    epicsEventSignal( pQueue->event );
+    return;
+  }
+  pQueue->ring[head] = *pUpdate;
+  epicsAtomicWriteMemoryBarrier();
+  epicsAtomicSetIntT( &pQueue->head, next );
+  epicsEventSignal( pQueue->event );
+}
+
+/*
+ * Function: drvAnc350CallbackCommand
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             done    - Done state published by the command
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called with the axis mutex held, before the parameter mutex is taken,
+ * by a command that sets Done itself.  Done states of updates still on
+ * the ring are then ignored.
+ */
+void drvAnc350CallbackCommand( AXIS_HDL pAxis, int done )
+{
+  epicsAtomicIncrIntT( &pAxis->cbGeneration );
+  pAxis->pollDone = done;
+}
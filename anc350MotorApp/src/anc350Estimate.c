@@ -0,0 +1,525 @@
+/*
+ * File:   anc350Estimate.c
+ *
+ * Description:
+ *
+ * Learned move durations.  Every move that runs to completion is timed
+ * from its RUN command to its stop, and the time is fitted against the
+ * move distance with recursive least squares:
+ *
+ *   duration = c0 + c1 * sqrt(|d|) + c2 * |d|,   d in thousands of counts
+ *
+ * The constant covers command and poll latency, the square root term the
+ * slow approach to the target and the linear term the stepping speed.
+ * Each axis has one model per direction.  This driver does not pass the
+ * motor record velocity to the controller, the step amplitude and
+ * frequency are set on the controller itself, so the direction is the
+ * only part of the move profile the driver can tell apart.  Old moves are
+ * slowly forgotten, so the models follow changes in load and temperature.
+ *
+ * The stop itself is not seen, only that it happened between the last
+ * poll that read the axis running and the first poll that read it
+ * stopped.  The middle of that interval is learned.  Past the predicted
+ * arrival the poller brackets the stop with polls whose spacing grows
+ * with the overrun, see drvAnc350EstimateWait, so the interval stays
+ * short without polling a badly predicted move at the margin rate.
+ *
+ * Predictions are published to the parameter port and are available from
+ * anc350EstimateMove.  The poller wakes up at the predicted arrival of a
+ * move, so the end of a move is seen without waiting for the rest of the
+ * poll period.  With anc350StoreConfigure the models are kept across
+ * restarts in the calibration store.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "epicsTime.h"
+#include "epicsMutex.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+/* Initial uncertainty of the model terms, also the bound on it while a model is not excited */
+#define ESTIMATE_P0 100.0
+/* Weight of the previous moves at each update */
+#define ESTIMATE_FORGET 0.995
+/* Moves learned in a direction before it is used for predictions */
+#define ESTIMATE_MIN_MOVES 3
+/* Time after the predicted arrival the poller wakes up (seconds) */
+#define ESTIMATE_MARGIN 0.005
+/* Spacing of the polls after the predicted arrival, as a fraction of the overrun */
+#define ESTIMATE_BRACKET 0.25
+
+/*
+ * Function: anc350EstimateTerms
+ *
+ * Parameters: distance   - Move distance in counts
+ *             x          - Returns the model terms
+ *
+ * Returns: void
+ */
+static void anc350EstimateTerms( double distance, double x[ANC350_EST_TERMS] )
+{
+  double d = fabs( distance ) / 1000.0;
+
+  x[0] = 1.0;
+  x[1] = sqrt( d );
+  x[2] = d;
+}
+
+/*
+ * Function: anc350EstimateReset
+ *
+ * Parameters: pModel   - Pointer to a model
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Forgets everything learned.
+ */
+static void anc350EstimateReset( anc350EstModel * pModel )
+{
+  int i;
+  int j;
+
+  pModel->n = 0;
+  for (i = 0; i < ANC350_EST_TERMS; i++){
+    pModel->theta[i] = 0.0;
+    for (j = 0; j < ANC350_EST_TERMS; j++) pModel->p[i][j] = (i == j)? ESTIMATE_P0: 0.0;
+  }
+}
+
+/*
+ * Function: anc350EstimateUpdate
+ *
+ * Parameters: pModel     - Pointer to a model
+ *             distance   - Move distance in counts
+ *             duration   - Measured duration in seconds
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * One recursive least squares step with forgetting.  While the moves do
+ * not tell the terms apart (the same distance over and over) forgetting
+ * would let the uncertainty grow without bound, so it is only applied
+ * while the uncertainty is below its initial value.
+ */
+static void anc350EstimateUpdate( anc350EstModel * pModel, double distance, double duration )
+{
+  double x[ANC350_EST_TERMS];
+  double px[ANC350_EST_TERMS];
+  double k[ANC350_EST_TERMS];
+  double denominator;
+  double error;
+  double trace = 0.0;
+  double forget;
+  int i;
+  int j;
+
+  anc350EstimateTerms( distance, x );
+
+  for (i = 0; i < ANC350_EST_TERMS; i++){
+    px[i] = 0.0;
+    for (j = 0; j < ANC350_EST_TERMS; j++) px[i] += pModel->p[i][j] * x[j];
+    trace += pModel->p[i][i];
+  }
+  forget = (trace < ESTIMATE_P0 * ANC350_EST_TERMS)? ESTIMATE_FORGET: 1.0;
+
+  denominator = forget;
+  error = duration;
+  for (i = 0; i < ANC350_EST_TERMS; i++){
+    denominator += x[i] * px[i];
+    error -= pModel->theta[i] * x[i];
+  }
+  for (i = 0; i < ANC350_EST_TERMS; i++){
+    k[i] = px[i] / denominator;
+    pModel->theta[i] += k[i] * error;
+  }
+  /* P is symmetric, so x'P is px' */
+  for (i = 0; i < ANC350_EST_TERMS; i++){
+    for (j = 0; j < ANC350_EST_TERMS; j++){
+      pModel->p[i][j] = (pModel->p[i][j] - k[i] * px[j]) / forget;
+    }
+  }
+  pModel->n++;
+}
+
+/*
+ * Function: drvAnc350EstimatePredict
+ *
+ * Parameters: pAxis      - Pointer to motor axis handle
+ *             distance   - Move distance in counts, the sign gives the direction
+ *
+ * Returns: Predicted duration in seconds, -1 if not enough moves have been learned
+ *
+ * Description:
+ *
+ * Called with the axis mutex held.
+ */
+double drvAnc350EstimatePredict( AXIS_HDL pAxis, double distance )
+{
+  anc350EstModel * pModel = &pAxis->estModel[(distance > 0.0)? 1: 0];
+  double x[ANC350_EST_TERMS];
+  double duration = 0.0;
+  int i;
+
+  if (pModel->n < ESTIMATE_MIN_MOVES) return -1.0;
+
+  anc350EstimateTerms( distance, x );
+  for (i = 0; i < ANC350_EST_TERMS; i++) duration += pModel->theta[i] * x[i];
+  return (duration > 0.0)? duration: 0.0;
+}
+
+/*
+ * Function: drvAnc350EstimateInit
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Starts the axis with empty models.
+ */
+void drvAnc350EstimateInit( AXIS_HDL pAxis )
+{
+  anc350EstimateReset( &pAxis->estModel[0] );
+  anc350EstimateReset( &pAxis->estModel[1] );
+  pAxis->estPending = 0;
+  pAxis->estDistance = 0.0;
+  pAxis->estPredicted = -1.0;
+}
+
+/*
+ * Function: drvAnc350EstimateStart
+ *
+ * Parameters: pAxis      - Pointer to motor axis handle
+ *             distance   - Move distance in counts
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called by motorAxisMove with the axis mutex held, once the RUN command
+ * has been acknowledged.
+ */
+void drvAnc350EstimateStart( AXIS_HDL pAxis, double distance )
+{
+  drvAnc350TimeGetCurrent( &pAxis->estStart );
+  pAxis->estRunning = pAxis->estStart;
+  pAxis->estPending = 1;
+  pAxis->estDistance = distance;
+  pAxis->estPredicted = drvAnc350EstimatePredict( pAxis, distance );
+  anc350ParamSetDouble( pAxis->pDrv, pAxis->axis, ANC350_EST_PREDICTED, pAxis->estPredicted );
+}
+
+/*
+ * Function: drvAnc350EstimateCancel
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called with the axis mutex held when a move is stopped, held back for a
+ * synchronised start, or replaced by a jog or home.  The move is not
+ * learned.
+ */
+void drvAnc350EstimateCancel( AXIS_HDL pAxis )
+{
+  pAxis->estPending = 0;
+}
+
+/*
+ * Function: drvAnc350EstimateRunning
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called by the poller with the axis mutex held when it reads the axis
+ * running.  The stop of the move being timed is later than now.
+ */
+void drvAnc350EstimateRunning( AXIS_HDL pAxis )
+{
+  if (pAxis->estPending) drvAnc350TimeGetCurrent( &pAxis->estRunning );
+}
+
+/*
+ * Function: drvAnc350EstimateDone
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             hump    - Non-zero if the move ended on a hump
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called by the poller with the axis mutex held when it sees the axis
+ * stopped.  Learns the duration of the move, unless it was cut short by
+ * a hump, as the middle of the interval since the last poll that read
+ * the axis running.
+ */
+void drvAnc350EstimateDone( AXIS_HDL pAxis, int hump )
+{
+  ANC350DRV_ID pDrv = pAxis->pDrv;
+  epicsTimeStamp now;
+  double duration;
+
+  if (!pAxis->estPending) return;
+  pAxis->estPending = 0;
+  if (hump) return;
+
+  drvAnc350TimeGetCurrent( &now );
+  duration = (epicsTimeDiffInSeconds( &now, &pAxis->estStart ) +
+              epicsTimeDiffInSeconds( &pAxis->estRunning, &pAxis->estStart )) / 2.0;
+  anc350EstimateUpdate( &pAxis->estModel[(pAxis->estDistance > 0.0)? 1: 0], pAxis->estDistance, duration );
+
+  anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_EST_LAST, duration );
+  anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_EST_ERROR, (pAxis->estPredicted < 0.0)? 0.0: duration - pAxis->estPredicted );
+  anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_EST_MOVES, pAxis->estModel[0].n + pAxis->estModel[1].n );
+  anc350EstimateParamWrite( pDrv, pAxis->axis, ANC350_EST_DISTANCE );
+
+  drvAnc350StoreChanged();
+}
+
+/*
+ * Function: drvAnc350EstimateWait
+ *
+ * Parameters: pDrv      - Pointer to driver structure
+ *             timeout   - Time to the next poll (seconds)
+ *
+ * Returns: Time to the next poll, shortened to just after the earliest
+ *          predicted arrival that falls before it
+ *
+ * Description:
+ *
+ * Called by the poller before it waits, with no mutex held.  A move still
+ * running past its predicted arrival is polled again after
+ * ESTIMATE_BRACKET of the overrun.
+ */
+double drvAnc350EstimateWait( ANC350DRV_ID pDrv, double timeout )
+{
+  epicsTimeStamp now;
+  int i;
+
+  drvAnc350TimeGetCurrent( &now );
+  for (i = 0; i < pDrv->nAxes; i++){
+    AXIS_HDL pAxis = &pDrv->axis[i];
+    double arrival = -1.0;
+    double elapsed;
+
+    epicsMutexLock( pAxis->axisMutex );
+    if (pAxis->estPending && pAxis->estPredicted >= 0.0){
+      elapsed = epicsTimeDiffInSeconds( &now, &pAxis->estStart );
+      arrival = pAxis->estPredicted + ESTIMATE_MARGIN - elapsed;
+      if (arrival <= 0.0) arrival = ESTIMATE_MARGIN + ESTIMATE_BRACKET * (elapsed - pAxis->estPredicted);
+    }
+    epicsMutexUnlock( pAxis->axisMutex );
+    if (arrival > 0.0 && arrival < timeout) timeout = arrival;
+  }
+  return timeout;
+}
+
+/*
+ * Function: anc350EstimateParamInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Publishes the model state of every axis to the parameter port.
+ */
+void anc350EstimateParamInit( ANC350DRV_ID pDrv )
+{
+  int i;
+
+  for (i = 0; i < pDrv->nAxes; i++){
+    AXIS_HDL pAxis = &pDrv->axis[i];
+
+    epicsMutexLock( pAxis->axisMutex );
+    anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_EST_MOVES, pAxis->estModel[0].n + pAxis->estModel[1].n );
+    anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_EST_PREDICTED, pAxis->estPredicted );
+    epicsMutexUnlock( pAxis->axisMutex );
+    anc350EstimateParamWrite( pDrv, pAxis->axis, ANC350_EST_DISTANCE );
+  }
+}
+
+/*
+ * Function: anc350EstimateParamWrite
+ *
+ * Parameters: pDrv    - Pointer to driver structure
+ *             addr    - Asyn address, the axis
+ *             reason  - Parameter written
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Publishes the predicted duration of a move of ANC350_EST_DISTANCE counts.
+ * Called in the port thread when the distance is written, and after each
+ * learned move.
+ */
+asynStatus anc350EstimateParamWrite( ANC350DRV_ID pDrv, int addr, int reason )
+{
+  double distance = 0.0;
+
+  if (pDrv == NULL || addr < 1 || addr > pDrv->nAxes) return asynError;
+
+  anc350ParamGetDouble( pDrv, addr, ANC350_EST_DISTANCE, &distance );
+  anc350ParamSetDouble( pDrv, addr, ANC350_EST_DURATION, anc350EstimateMove( pDrv->card, addr, distance ) );
+  return asynSuccess;
+}
+
+/*
+ * Function: anc350EstimateMove
+ *
+ * Parameters: card       - Number representing the motor controller
+ *             axis       - Axis number (1 based)
+ *             distance   - Move distance in counts, the sign gives the direction
+ *
+ * Returns: Predicted duration in seconds, -1 if it is not known yet
+ *
+ * Description:
+ *
+ * Query interface for scan planners in the IOC.
+ */
+double anc350EstimateMove( int card, int axis, double distance )
+{
+  ANC350DRV_ID pDrv = drvAnc350FindCard( card );
+  AXIS_HDL pAxis;
+  double duration;
+
+  if (pDrv == NULL || axis < 1 || axis > pDrv->nAxes) return -1.0;
+  pAxis = &pDrv->axis[axis - 1];
+
+  if (epicsMutexLock( pAxis->axisMutex ) != epicsMutexLockOK) return -1.0;
+  duration = drvAnc350EstimatePredict( pAxis, distance );
+  epicsMutexUnlock( pAxis->axisMutex );
+  return duration;
+}
+
+/* Models of one axis in the calibration store, ANC350_STORE_ESTIMATE_V 1 */
+typedef struct anc350EstimateKept
+{
+  epicsInt32 n[2];
+  double theta[2][ANC350_EST_TERMS];
+  double p[2][ANC350_EST_TERMS][ANC350_EST_TERMS];
+} anc350EstimateKept;
+
+/*
+ * Function: drvAnc350EstimateKeep
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             buf     - Buffer for the store payload
+ *             size    - Size of the buffer
+ *
+ * Returns: Payload length, 0 if there is nothing to keep
+ *
+ * Description:
+ *
+ * Called by the calibration store with the axis mutex held.
+ */
+size_t drvAnc350EstimateKeep( AXIS_HDL pAxis, void * buf, size_t size )
+{
+  anc350EstimateKept kept;
+  int dir;
+
+  if (size < sizeof( kept ) || pAxis->estModel[0].n + pAxis->estModel[1].n == 0) return 0;
+  for (dir = 0; dir < 2; dir++){
+    kept.n[dir] = pAxis->estModel[dir].n;
+    memcpy( kept.theta[dir], pAxis->estModel[dir].theta, sizeof( kept.theta[dir] ) );
+    memcpy( kept.p[dir], pAxis->estModel[dir].p, sizeof( kept.p[dir] ) );
+  }
+  memcpy( buf, &kept, sizeof( kept ) );
+  return sizeof( kept );
+}
+
+/*
+ * Function: drvAnc350EstimateRestore
+ *
+ * Parameters: pAxis    - Pointer to motor axis handle
+ *             version  - Payload version it was kept with
+ *             buf      - Payload
+ *             length   - Payload length
+ *
+ * Returns: 0 if the models were restored, -1 if the payload was rejected
+ *
+ * Description:
+ *
+ * Called by the calibration store with the axis mutex held.  Payloads of
+ * an older version are converted here when the layout changes.
+ */
+int drvAnc350EstimateRestore( AXIS_HDL pAxis, int version, const void * buf, size_t length )
+{
+  anc350EstimateKept kept;
+  int dir;
+
+  if (version != ANC350_STORE_ESTIMATE_V || length != sizeof( kept )) return -1;
+  memcpy( &kept, buf, sizeof( kept ) );
+  for (dir = 0; dir < 2; dir++){
+    if (kept.n[dir] < 0) return -1;
+    pAxis->estModel[dir].n = kept.n[dir];
+    memcpy( pAxis->estModel[dir].theta, kept.theta[dir], sizeof( kept.theta[dir] ) );
+    memcpy( pAxis->estModel[dir].p, kept.p[dir], sizeof( kept.p[dir] ) );
+  }
+  return 0;
+}
+
+/*
+ * Function: anc350EstimateShow
+ *
+ * Parameters: card   - Number representing the motor controller, -1 for all
+ *             axis   - Axis number (1 based), 0 for all
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Prints the models and the predicted durations of a few move distances.
+ */
+int anc350EstimateShow( int card, int axis )
+{
+  static const double distances[] = { 1000.0, 10000.0, 100000.0, 1000000.0 };
+  ANC350DRV_ID pDrv;
+  int i;
+  int dir;
+  int j;
+
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    if (card >= 0 && pDrv->card != card) continue;
+    for (i = 0; i < pDrv->nAxes; i++){
+      AXIS_HDL pAxis = &pDrv->axis[i];
+
+      if (axis > 0 && pAxis->axis != axis) continue;
+      epicsMutexLock( pAxis->axisMutex );
+      for (dir = 1; dir >= 0; dir--){
+        anc350EstModel * pModel = &pAxis->estModel[dir];
+
+        printf( "card %d axis %d %s: %d moves, t = %.4g + %.4g sqrt(d) + %.4g d (d in 1000 counts)\n",
+                pDrv->card, pAxis->axis, dir? "forward": "backward", pModel->n,
+                pModel->theta[0], pModel->theta[1], pModel->theta[2] );
+        printf( "   " );
+        for (j = 0; j < (int)(sizeof( distances ) / sizeof( distances[0] )); j++){
+          printf( " %g: %.3f s", distances[j], drvAnc350EstimatePredict( pAxis, dir? distances[j]: -distances[j] ) );
+        }
+        printf( "\n" );
+      }
+      epicsMutexUnlock( pAxis->axisMutex );
+    }
+  }
+  return MOTOR_AXIS_OK;
+}
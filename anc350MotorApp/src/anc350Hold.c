@@ -0,0 +1,221 @@
+/*
+ * File:   anc350Hold.c
+ *
+ * Description:
+ *
+ * Active position hold.  Stick-slip positioners drift after a move, most
+ * of all when cold.  With hold enabled on an axis, the idle polls compare
+ * the position with the position to hold: the target of the last move, or
+ * where the axis came to rest after a jog, home or stop.  When the drift
+ * is larger than the deadband a correction is made with a TARGET and
+ * RUN_TARGET burst, at most once per hold interval.  Corrections are not
+ * reported to the motor record as motion.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "epicsTime.h"
+#include "epicsMutex.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+
+#define HOLD_DEFAULT_DEADBAND 100.0
+#define HOLD_DEFAULT_INTERVAL 5.0
+
+/*
+ * Function: drvAnc350HoldInit
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Sets the default hold settings.  Hold starts disabled.
+ */
+void drvAnc350HoldInit( AXIS_HDL pAxis )
+{
+  pAxis->holdEnable = 0;
+  pAxis->holdDeadband = HOLD_DEFAULT_DEADBAND;
+  pAxis->holdInterval = HOLD_DEFAULT_INTERVAL;
+  pAxis->holdValid = 0;
+  pAxis->holdActive = 0;
+}
+
+/*
+ * Function: drvAnc350HoldSet
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             valid   - Non-zero if target is the position to hold, zero to
+ *                       hold wherever the axis next comes to rest
+ *             target  - Raw counter value to hold
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called when a move, jog, home or stop is started, with the axis mutex
+ * held.  Cancels any correction in progress.
+ */
+void drvAnc350HoldSet( AXIS_HDL pAxis, int valid, int target )
+{
+  pAxis->holdValid = valid;
+  pAxis->holdTarget = target;
+  pAxis->holdActive = 0;
+}
+
+/*
+ * Function: drvAnc350HoldCheck
+ *
+ * Parameters: pAxis    - Pointer to motor axis handle
+ *             running  - Non-zero if the controller reports the axis running
+ *             counter  - Raw counter value read by the poller
+ *
+ * Returns: Non-zero if the axis is running a hold correction
+ *
+ * Description:
+ *
+ * Called by the poller for every status poll, with the axis mutex held.
+ * The poller keeps reporting the axis as done while this returns non-zero.
+ */
+int drvAnc350HoldCheck( AXIS_HDL pAxis, int running, int counter )
+{
+  ANC350DRV_ID pDrv = pAxis->pDrv;
+  anc350Op ops[ANC350_IDLE_OPS + 2];
+  epicsTimeStamp now;
+  double drift;
+  int nWake;
+
+  if (running) return pAxis->holdActive;
+  pAxis->holdActive = 0;
+  if (!pAxis->holdEnable) return 0;
+
+  if (!pAxis->holdValid){
+    pAxis->holdTarget = counter;
+    pAxis->holdValid = 1;
+    return 0;
+  }
+
+  drift = (double)(counter - pAxis->holdTarget);
+  if (fabs( drift ) > pAxis->holdMaxDrift){
+    pAxis->holdMaxDrift = fabs( drift );
+    anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_HOLD_MAX_DRIFT, pAxis->holdMaxDrift );
+  }
+  anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_HOLD_DRIFT, drift );
+  if (fabs( drift ) <= pAxis->holdDeadband) return 0;
+  if (drvAnc350Inhibited( pAxis )) return 0;
+
+  /* Rate limit the corrections */
+  drvAnc350TimeGetCurrent( &now );
+  if (pAxis->holdCorrections > 0 && epicsTimeDiffInSeconds( &now, &pAxis->holdLast ) < pAxis->holdInterval) return 0;
+
+  /* Outputs switched off while idle are switched on in the same burst */
+  nWake = drvAnc350IdleWake( pAxis, ops );
+  drvAnc350OpSet( &ops[nWake], ID_ANC_TARGET, pAxis->axis - 1, pAxis->holdTarget );
+  drvAnc350OpSet( &ops[nWake + 1], ID_ANC_RUN_TARGET, pAxis->axis - 1, 1 );
+  pAxis->holdLast = now;
+  drvAnc350Burst( pDrv, ops, nWake + 2, pDrv->burstTimeout );
+  drvAnc350TimeGetCurrent( &pAxis->commandSent );
+  drvAnc350IdleWoken( pAxis, ops, nWake );
+  if (ops[nWake].status != asynSuccess || ops[nWake + 1].status != asynSuccess){
+    asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+               "drvAnc350HoldCheck: card %d axis %d correction not acknowledged\n", pDrv->card, pAxis->axis );
+    return 0;
+  }
+
+  pAxis->holdActive = 1;
+  pAxis->holdCorrections++;
+  anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_HOLD_CORRECTIONS, pAxis->holdCorrections );
+  epicsEventSignal( pDrv->pollEventId );
+  return 1;
+}
+
+/*
+ * Function: anc350HoldParamInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Publishes the hold settings of every axis to the parameter port.
+ */
+void anc350HoldParamInit( ANC350DRV_ID pDrv )
+{
+  int i;
+
+  for (i = 0; i < pDrv->nAxes; i++){
+    AXIS_HDL pAxis = &pDrv->axis[i];
+
+    anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_HOLD, pAxis->holdEnable );
+    anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_HOLD_DEADBAND, pAxis->holdDeadband );
+    anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_HOLD_INTERVAL, pAxis->holdInterval );
+  }
+}
+
+/*
+ * Function: anc350HoldParamWrite
+ *
+ * Parameters: pDrv    - Pointer to driver structure
+ *             addr    - Asyn address, the axis
+ *             reason  - Parameter written
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Applies a change to the hold settings.  Enabling hold clears the
+ * statistics and holds the position the axis is at.  An interval that is
+ * not above 0 is rejected and the parameter goes back to the interval in
+ * use.
+ */
+asynStatus anc350HoldParamWrite( ANC350DRV_ID pDrv, int addr, int reason )
+{
+  AXIS_HDL pAxis;
+  int ival = 0;
+  double dval = 0.0;
+
+  if (pDrv == NULL || addr < 1 || addr > pDrv->nAxes) return asynError;
+  pAxis = &pDrv->axis[addr - 1];
+
+  if (epicsMutexLock( pAxis->axisMutex ) != epicsMutexLockOK) return asynError;
+  switch (reason){
+    case ANC350_HOLD:
+      anc350ParamGetInteger( pDrv, addr, reason, &ival );
+      if (ival && !pAxis->holdEnable){
+        pAxis->holdValid = 0;
+        pAxis->holdCorrections = 0;
+        pAxis->holdMaxDrift = 0.0;
+        anc350ParamSetInteger( pDrv, addr, ANC350_HOLD_CORRECTIONS, 0 );
+        anc350ParamSetDouble( pDrv, addr, ANC350_HOLD_DRIFT, 0.0 );
+        anc350ParamSetDouble( pDrv, addr, ANC350_HOLD_MAX_DRIFT, 0.0 );
+      }
+      pAxis->holdEnable = (ival != 0);
+      break;
+    case ANC350_HOLD_DEADBAND:
+      anc350ParamGetDouble( pDrv, addr, reason, &dval );
+      pAxis->holdDeadband = fabs( dval );
+      break;
+    case ANC350_HOLD_INTERVAL:
+      anc350ParamGetDouble( pDrv, addr, reason, &dval );
+      /* A zero or negative interval would correct on every idle poll */
+      if (!(dval > 0.0)){
+        asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+                   "anc350Hold: card %d axis %d interval %g rejected, must be above 0\n",
+                   pDrv->card, pAxis->axis, dval );
+        anc350ParamSetDouble( pDrv, addr, reason, pAxis->holdInterval );
+        epicsMutexUnlock( pAxis->axisMutex );
+        return asynError;
+      }
+      pAxis->holdInterval = dval;
+      break;
+  }
+  epicsMutexUnlock( pAxis->axisMutex );
+  return asynSuccess;
+}
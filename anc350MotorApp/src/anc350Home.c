@@ -0,0 +1,506 @@
+/*
+ * File:   anc350Home.c
+ *
+ * Description:
+ *
+ * Crate-wide homing job.  anc350HomeAll (or ANC350_HOME_ALL on the crate
+ * port) runs the reference search of every axis of one or more
+ * controllers, the same search as motorAxisHome: hump detection and
+ * amplitude control on, then continuous motion until the controller
+ * reports a valid reference.  Up to a given number of searches run at
+ * once on each controller, and all controllers run together, so the job
+ * takes about as long as the slowest axis.
+ *
+ * The job thread reads the status of every searching axis of a controller
+ * in one burst each HOME_PERIOD, and sends the stops and the next starts
+ * in a second burst.  An axis that stops on a hump before it has found
+ * its reference searches once more in the other direction.  Axes that
+ * already have a valid reference are skipped.
+ *
+ * Each axis reports its state (ANC350_HOME_STATE_...) and search time; the crate
+ * port reports the searches active, remaining and failed, and the time
+ * since the job started.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsMutex.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+#define HOME_PERIOD 0.05
+#define HOME_DEFAULT_AXIS_TIMEOUT 120.0
+
+typedef struct anc350HomeAxis
+{
+  AXIS_HDL pAxis;
+  int state;                    /* ANC350_HOME_STATE_... */
+  int cmd;                      /* ID_ANC_CONT_FWD or ID_ANC_CONT_BKWD while searching */
+  int reversed;                 /* Already searching in the other direction */
+  epicsTimeStamp start;
+} anc350HomeAxis;
+
+/* Axes of one controller in the job */
+typedef struct anc350HomeController
+{
+  ANC350DRV_ID pDrv;
+  anc350HomeAxis * axes;
+  anc350Op * ops;               /* Status reads, then up to 5 SETs per axis */
+  int * index;                  /* Axis of each status read */
+  int * start;                  /* SET starting each axis in this pass, -1 if none */
+  int * wake;                   /* Output wake SETs ahead of the start of each axis */
+} anc350HomeController;
+
+typedef struct anc350HomeJob
+{
+  int nControllers;
+  anc350HomeController * controllers;
+  int limit;                    /* Searches at once per controller, 0 for every axis */
+  int forwards;
+  double timeout;               /* Per axis (seconds) */
+  epicsTimeStamp start;
+} anc350HomeJob;
+
+static int homeRunning = 0;
+static int homeAbort = 0;
+static epicsMutexId homeMutexId = NULL;
+static epicsThreadOnceId homeOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350HomeInit( void * arg )
+{
+  homeMutexId = epicsMutexMustCreate();
+}
+
+/*
+ * Function: anc350HomeSetState
+ *
+ * Parameters: pHome   - Pointer to the axis of the job
+ *             state   - ANC350_HOME_...
+ *             now     - Current time
+ *
+ * Returns: void
+ */
+static void anc350HomeSetState( anc350HomeAxis * pHome, int state, const epicsTimeStamp * now )
+{
+  AXIS_HDL pAxis = pHome->pAxis;
+
+  pHome->state = state;
+  if (state == ANC350_HOME_STATE_SEARCHING) pHome->start = *now;
+  if (state == ANC350_HOME_STATE_DONE || state == ANC350_HOME_STATE_FAILED){
+    anc350ParamSetDouble( pAxis->pDrv, pAxis->axis, ANC350_HOME_ELAPSED, epicsTimeDiffInSeconds( now, &pHome->start ) );
+  }
+  anc350ParamSetInteger( pAxis->pDrv, pAxis->axis, ANC350_HOME_STATE, state );
+}
+
+/*
+ * Function: anc350HomeStartAxis
+ *
+ * Parameters: pHome   - Pointer to the axis of the job
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Takes the axis from the motor record features about to be bypassed,
+ * as motorAxisHome does, and gets the poller to follow it.
+ */
+static void anc350HomeStartAxis( anc350HomeAxis * pHome )
+{
+  AXIS_HDL pAxis = pHome->pAxis;
+
+  epicsMutexLock( pAxis->axisMutex );
+  drvAnc350HoldSet( pAxis, 0, 0 );
+  drvAnc350EstimateCancel( pAxis );
+  drvAnc350StatsCancel( pAxis );
+  drvAnc350CallbackCommand( pAxis, 0 );
+  epicsMutexUnlock( pAxis->axisMutex );
+  epicsEventSignal( pAxis->pDrv->pollEventId );
+}
+
+/*
+ * Function: anc350HomeSelected
+ *
+ * Parameters: cards   - Comma separated controller cards, NULL or empty for all
+ *             card    - Card to look for
+ *
+ * Returns: Non-zero if the card is selected
+ */
+static int anc350HomeSelected( const char * cards, int card )
+{
+  const char * p = cards;
+
+  if (cards == NULL || *cards == '\0') return 1;
+  while (*p != '\0'){
+    char * end;
+    long value = strtol( p, &end, 0 );
+
+    if (end == p) break;
+    if (value == card) return 1;
+    p = end;
+    while (*p == ',' || *p == ' ') p++;
+  }
+  return 0;
+}
+
+/*
+ * Function: anc350HomePass
+ *
+ * Parameters: pJob    - Pointer to the job
+ *             pCtrl   - Pointer to the controller of the job
+ *             abort   - Non-zero to stop every search
+ *
+ * Returns: Number of axes still waiting or searching
+ *
+ * Description:
+ *
+ * One pass over a controller: read the searching axes in one burst, then
+ * stop the finished ones and start waiting ones up to the limit in a
+ * second burst.
+ */
+static int anc350HomePass( anc350HomeJob * pJob, anc350HomeController * pCtrl, int abort )
+{
+  ANC350DRV_ID pDrv = pCtrl->pDrv;
+  anc350Op * reads = pCtrl->ops;
+  anc350Op * sets = pCtrl->ops + pDrv->nAxes;
+  epicsTimeStamp now;
+  int nReads = 0;
+  int nSets = 0;
+  int active = 0;
+  int remaining = 0;
+  int limit = (pJob->limit > 0)? pJob->limit: pDrv->nAxes;
+  int i;
+  int k;
+
+  for (i = 0; i < pDrv->nAxes; i++){
+    if (pCtrl->axes[i].state != ANC350_HOME_STATE_SEARCHING) continue;
+    pCtrl->index[nReads] = i;
+    drvAnc350OpGet( &reads[nReads++], ID_ANC_STATUS, i );
+  }
+  if (nReads > 0) drvAnc350Burst( pDrv, reads, nReads, pDrv->burstTimeout );
+  drvAnc350TimeGetCurrent( &now );
+
+  for (k = 0; k < nReads; k++){
+    anc350HomeAxis * pHome = &pCtrl->axes[pCtrl->index[k]];
+    int ok = (reads[k].status == asynSuccess);
+    int axis = pCtrl->index[k];
+
+    if (ok && (reads[k].value & ANC_STATUS_REF_VALID)){
+      drvAnc350OpSet( &sets[nSets++], pHome->cmd, axis, 0 );
+      anc350HomeSetState( pHome, ANC350_HOME_STATE_DONE, &now );
+    } else if (abort || drvAnc350Inhibited( &pDrv->axis[axis] ) ||
+               epicsTimeDiffInSeconds( &now, &pHome->start ) > pJob->timeout ||
+               (ok && !(reads[k].value & ANC_STATUS_RUNNING) && pHome->reversed)){
+      drvAnc350OpSet( &sets[nSets++], pHome->cmd, axis, 0 );
+      anc350HomeSetState( pHome, ANC350_HOME_STATE_FAILED, &now );
+      asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+                 "anc350HomeAll: card %d axis %d %s\n", pDrv->card, axis + 1,
+                 abort? "search aborted": drvAnc350Inhibited( &pDrv->axis[axis] )? "search inhibited": "no reference found" );
+    } else if (ok && !(reads[k].value & ANC_STATUS_RUNNING)){
+      /* Stopped on a hump before the reference, search the other way once */
+      drvAnc350OpSet( &sets[nSets++], pHome->cmd, axis, 0 );
+      pHome->cmd = (pHome->cmd == ID_ANC_CONT_FWD)? ID_ANC_CONT_BKWD: ID_ANC_CONT_FWD;
+      pHome->reversed = 1;
+      drvAnc350OpSet( &sets[nSets++], pHome->cmd, axis, 1 );
+      active++;
+    } else {
+      active++;
+    }
+  }
+
+  for (i = 0; i < pDrv->nAxes; i++){
+    anc350HomeAxis * pHome = &pCtrl->axes[i];
+
+    if (pHome->state != ANC350_HOME_STATE_WAITING) continue;
+    if (abort){
+      anc350HomeSetState( pHome, ANC350_HOME_STATE_IDLE, &now );
+      continue;
+    }
+    if (drvAnc350Inhibited( &pDrv->axis[i] )){
+      asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+                 "anc350HomeAll: card %d axis %d search inhibited\n", pDrv->card, i + 1 );
+      anc350HomeSetState( pHome, ANC350_HOME_STATE_FAILED, &now );
+      continue;
+    }
+    if (active >= limit) continue;
+
+    anc350HomeStartAxis( pHome );
+    pHome->cmd = pJob->forwards? ID_ANC_CONT_FWD: ID_ANC_CONT_BKWD;
+    pHome->reversed = 0;
+    /* Outputs switched off while idle are switched on in the same burst */
+    epicsMutexLock( pDrv->axis[i].axisMutex );
+    pCtrl->wake[i] = drvAnc350IdleWake( &pDrv->axis[i], &sets[nSets] );
+    epicsMutexUnlock( pDrv->axis[i].axisMutex );
+    nSets += pCtrl->wake[i];
+    drvAnc350OpSet( &sets[nSets++], ID_ANC_STOP_EN, i, 1 );
+    drvAnc350OpSet( &sets[nSets++], ID_ANC_REGSPD_SELSP, i, 1 );
+    pCtrl->start[i] = nSets;
+    drvAnc350OpSet( &sets[nSets++], pHome->cmd, i, 1 );
+    anc350HomeSetState( pHome, ANC350_HOME_STATE_SEARCHING, &now );
+    active++;
+  }
+
+  if (nSets > 0) drvAnc350Burst( pDrv, sets, nSets, pDrv->burstTimeout );
+
+  for (i = 0; i < pDrv->nAxes; i++){
+    anc350HomeAxis * pHome = &pCtrl->axes[i];
+
+    if (pCtrl->start[i] >= 0 && pCtrl->wake[i] > 0){
+      epicsMutexLock( pDrv->axis[i].axisMutex );
+      drvAnc350IdleWoken( &pDrv->axis[i], &sets[pCtrl->start[i] - 2 - pCtrl->wake[i]], pCtrl->wake[i] );
+      epicsMutexUnlock( pDrv->axis[i].axisMutex );
+    }
+    if (pCtrl->start[i] >= 0 && sets[pCtrl->start[i]].status != asynSuccess){
+      asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+                 "anc350HomeAll: card %d axis %d search not started\n", pDrv->card, i + 1 );
+      anc350HomeSetState( pHome, ANC350_HOME_STATE_FAILED, &now );
+    }
+    pCtrl->start[i] = -1;
+    if (pHome->state == ANC350_HOME_STATE_WAITING || pHome->state == ANC350_HOME_STATE_SEARCHING) remaining++;
+  }
+  return remaining;
+}
+
+/*
+ * Function: anc350HomeJobFree
+ *
+ * Parameters: pJob   - Pointer to the job
+ *
+ * Returns: void
+ */
+static void anc350HomeJobFree( anc350HomeJob * pJob )
+{
+  int c;
+
+  for (c = 0; c < pJob->nControllers; c++){
+    free( pJob->controllers[c].axes );
+    free( pJob->controllers[c].ops );
+    free( pJob->controllers[c].index );
+    free( pJob->controllers[c].start );
+    free( pJob->controllers[c].wake );
+  }
+  free( pJob->controllers );
+  free( pJob );
+}
+
+/*
+ * Function: anc350HomeTask
+ *
+ * Parameters: arg   - Pointer to the job
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Job thread, ends when every axis has finished.
+ */
+static void anc350HomeTask( void * arg )
+{
+  anc350HomeJob * pJob = (anc350HomeJob * ) arg;
+  int remaining = 1;
+  int failed = 0;
+  int c;
+  int i;
+
+  while (remaining > 0){
+    epicsTimeStamp now;
+    int abort;
+    int active = 0;
+
+    epicsMutexLock( homeMutexId );
+    abort = homeAbort;
+    epicsMutexUnlock( homeMutexId );
+
+    remaining = 0;
+    for (c = 0; c < pJob->nControllers; c++){
+      remaining += anc350HomePass( pJob, &pJob->controllers[c], abort );
+    }
+
+    failed = 0;
+    for (c = 0; c < pJob->nControllers; c++){
+      for (i = 0; i < pJob->controllers[c].pDrv->nAxes; i++){
+        if (pJob->controllers[c].axes[i].state == ANC350_HOME_STATE_SEARCHING) active++;
+        if (pJob->controllers[c].axes[i].state == ANC350_HOME_STATE_FAILED) failed++;
+      }
+    }
+    drvAnc350TimeGetCurrent( &now );
+    anc350ParamSetInteger( NULL, 0, ANC350_HOME_ACTIVE, active );
+    anc350ParamSetInteger( NULL, 0, ANC350_HOME_REMAINING, remaining );
+    anc350ParamSetInteger( NULL, 0, ANC350_HOME_FAILED, failed );
+    anc350ParamSetDouble( NULL, 0, ANC350_HOME_TIME, epicsTimeDiffInSeconds( &now, &pJob->start ) );
+
+    if (remaining > 0) drvAnc350Sleep( HOME_PERIOD );
+  }
+
+  printf( "anc350HomeAll: finished, %d axes failed\n", failed );
+  anc350HomeJobFree( pJob );
+
+  epicsMutexLock( homeMutexId );
+  homeRunning = 0;
+  homeAbort = 0;
+  epicsMutexUnlock( homeMutexId );
+  anc350ParamSetInteger( NULL, 0, ANC350_HOME_ALL, 0 );
+}
+
+/*
+ * Function: anc350HomeAll
+ *
+ * Parameters: cards      - Comma separated controller cards, NULL or empty
+ *                          for every controller
+ *             forwards   - Non-zero to search forwards first
+ *             limit      - Searches at once per controller, 0 for every axis
+ *             timeout    - Time allowed for each axis (seconds), 0 for the default
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Starts a homing job.  Returns once the job is running; only one job can
+ * run at a time.
+ */
+int anc350HomeAll( const char * cards, int forwards, int limit, double timeout )
+{
+  anc350HomeJob * pJob;
+  ANC350DRV_ID pDrv;
+  anc350Op * reads;
+  epicsTimeStamp now;
+  int i;
+
+  epicsThreadOnce( &homeOnceId, anc350HomeInit, NULL );
+
+  epicsMutexLock( homeMutexId );
+  if (homeRunning){
+    epicsMutexUnlock( homeMutexId );
+    printf( "anc350HomeAll: a homing job is already running\n" );
+    return MOTOR_AXIS_ERROR;
+  }
+  homeRunning = 1;
+  homeAbort = 0;
+  epicsMutexUnlock( homeMutexId );
+
+  pJob = callocMustSucceed( 1, sizeof( anc350HomeJob ), "anc350HomeAll" );
+  pJob->forwards = (forwards != 0);
+  pJob->limit = (limit > 0)? limit: 0;
+  pJob->timeout = (timeout > 0.0)? timeout: HOME_DEFAULT_AXIS_TIMEOUT;
+  drvAnc350TimeGetCurrent( &pJob->start );
+
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext) pJob->nControllers++;
+  pJob->controllers = callocMustSucceed( (pJob->nControllers > 0)? pJob->nControllers: 1,
+                                         sizeof( anc350HomeController ), "anc350HomeAll" );
+
+  pJob->nControllers = 0;
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    anc350HomeController * pCtrl;
+
+    if (!anc350HomeSelected( cards, pDrv->card )) continue;
+
+    pCtrl = &pJob->controllers[pJob->nControllers++];
+    pCtrl->pDrv = pDrv;
+    pCtrl->axes = callocMustSucceed( pDrv->nAxes, sizeof( anc350HomeAxis ), "anc350HomeAll" );
+    pCtrl->ops = callocMustSucceed( 6 * pDrv->nAxes, sizeof( anc350Op ), "anc350HomeAll" );
+    pCtrl->index = callocMustSucceed( pDrv->nAxes, sizeof( int ), "anc350HomeAll" );
+    pCtrl->start = callocMustSucceed( pDrv->nAxes, sizeof( int ), "anc350HomeAll" );
+    pCtrl->wake = callocMustSucceed( pDrv->nAxes, sizeof( int ), "anc350HomeAll" );
+
+    /* Axes that already have a reference are left alone */
+    reads = pCtrl->ops;
+    for (i = 0; i < pDrv->nAxes; i++) drvAnc350OpGet( &reads[i], ID_ANC_STATUS, i );
+    drvAnc350Burst( pDrv, reads, pDrv->nAxes, pDrv->burstTimeout );
+    drvAnc350TimeGetCurrent( &now );
+    for (i = 0; i < pDrv->nAxes; i++){
+      anc350HomeAxis * pHome = &pCtrl->axes[i];
+
+      pHome->pAxis = &pDrv->axis[i];
+      pCtrl->start[i] = -1;
+      pHome->start = now;
+      anc350ParamSetDouble( pDrv, i + 1, ANC350_HOME_ELAPSED, 0.0 );
+      if (reads[i].status == asynSuccess && (reads[i].value & ANC_STATUS_REF_VALID)){
+        anc350HomeSetState( pHome, ANC350_HOME_STATE_SKIPPED, &now );
+      } else {
+        anc350HomeSetState( pHome, ANC350_HOME_STATE_WAITING, &now );
+      }
+    }
+  }
+
+  if (pJob->nControllers == 0){
+    printf( "anc350HomeAll: no controller selected by \"%s\"\n", (cards != NULL)? cards: "" );
+    anc350HomeJobFree( pJob );
+    epicsMutexLock( homeMutexId );
+    homeRunning = 0;
+    epicsMutexUnlock( homeMutexId );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  anc350ParamSetInteger( NULL, 0, ANC350_HOME_ALL, 1 );
+  if (epicsThreadCreate( "anc350Home", epicsThreadPriorityMedium,
+                         epicsThreadGetStackSize( epicsThreadStackMedium ),
+                         anc350HomeTask, pJob ) == NULL){
+    printf( "anc350HomeAll: cannot start the homing thread\n" );
+    anc350HomeJobFree( pJob );
+    epicsMutexLock( homeMutexId );
+    homeRunning = 0;
+    epicsMutexUnlock( homeMutexId );
+    anc350ParamSetInteger( NULL, 0, ANC350_HOME_ALL, 0 );
+    return MOTOR_AXIS_ERROR;
+  }
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: anc350HomeAbort
+ *
+ * Parameters: None
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Stops every search of the running job.  Axes not yet started are left
+ * idle.
+ */
+int anc350HomeAbort( void )
+{
+  epicsThreadOnce( &homeOnceId, anc350HomeInit, NULL );
+
+  epicsMutexLock( homeMutexId );
+  if (homeRunning) homeAbort = 1;
+  epicsMutexUnlock( homeMutexId );
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: anc350HomeParamWrite
+ *
+ * Parameters: None
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Called in the crate port thread when ANC350_HOME_ALL is written.  1
+ * homes every controller with ANC350_HOME_DIR, ANC350_HOME_LIMIT and
+ * ANC350_HOME_TIMEOUT, 0 aborts the job.
+ */
+asynStatus anc350HomeParamWrite( void )
+{
+  int start = 0;
+  int forwards = 0;
+  int limit = 0;
+  double timeout = 0.0;
+
+  anc350ParamGetInteger( NULL, 0, ANC350_HOME_ALL, &start );
+  if (!start) return (anc350HomeAbort() == MOTOR_AXIS_OK)? asynSuccess: asynError;
+
+  anc350ParamGetInteger( NULL, 0, ANC350_HOME_DIR, &forwards );
+  anc350ParamGetInteger( NULL, 0, ANC350_HOME_LIMIT, &limit );
+  anc350ParamGetDouble( NULL, 0, ANC350_HOME_TIMEOUT, &timeout );
+  return (anc350HomeAll( NULL, forwards, limit, timeout ) == MOTOR_AXIS_OK)? asynSuccess: asynError;
+}
@@ -0,0 +1,597 @@
+/*
+ * File:   anc350IP.c
+ *
+ * Description:
+ *
+ * Native TCP transport for the ANC350 link.  anc350IPConfigure creates an
+ * asyn port with the asynOctet interface, like drvAsynIPPortConfigure, so
+ * anc350AsynMotorCreate and the devAnc350 records can use it in place of
+ * an IP port.  The port owns a non-blocking socket with TCP_NODELAY set.
+ *
+ * Writes are copied onto a transmit queue and the whole queue is sent with
+ * one send.  With a cork time set, writes are held on the queue for up to
+ * that long so that telegrams written one after another (the SETs of a
+ * move, for example) leave in one segment.  The queue is always sent
+ * before a read or flush, so a caller waiting for an ack never waits for
+ * the cork.  Reads take everything the socket holds into a receive buffer
+ * and hand it out from there, so the second read of a telegram normally
+ * costs no system call.
+ *
+ * The port counts telegrams and system calls; asynReport shows the
+ * system calls per telegram.
+ *
+ * Only the port thread raises asyn exceptions.  A send of the transmit
+ * thread that fails marks the connection broken, and the next call on the
+ * port closes it and reports the disconnect.  Built for Unix hosts only,
+ * see the Makefile.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "osiSock.h"
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsMutex.h"
+#include "epicsEvent.h"
+#include "epicsString.h"
+#include "epicsStdio.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+#include "asynOctet.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+#define IP_DEFAULT_PORT 2101
+#define IP_CONNECT_TIMEOUT 2.0
+#define IP_TX_SIZE 8192
+#define IP_RX_SIZE 65536
+
+/* A controller that went away must not kill the IOC with SIGPIPE */
+#ifdef MSG_NOSIGNAL
+#define IP_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define IP_SEND_FLAGS 0
+#endif
+
+typedef struct anc350IPPort
+{
+  char * portName;
+  char * hostInfo;
+  struct sockaddr_in address;
+  double cork;                  /* Seconds writes may wait on the queue, 0 to send at once */
+  int fd;
+  epicsMutexId lock;            /* Socket, queue and receive buffer */
+  epicsEventId txEvent;
+  asynUser * pasynUserTx;       /* Error messages of the transmit thread */
+  int broken;                   /* The transmit thread saw the connection fail */
+  char tx[IP_TX_SIZE];
+  size_t txFill;
+  size_t txSent;                /* Bytes of the queue already sent */
+  epicsTimeStamp txFirst;       /* When the oldest queued write was queued */
+  char rx[IP_RX_SIZE];
+  size_t rxFill;
+  size_t rxPos;
+  unsigned long nTelegrams;
+  unsigned long nWrites;
+  unsigned long nSend;
+  unsigned long nRecv;
+  unsigned long nPoll;
+  asynInterface common;
+  asynInterface octet;
+} anc350IPPort;
+
+/*
+ * Function: anc350IPCount
+ *
+ * Parameters: data       - Written data
+ *             numchars   - Number of bytes
+ *
+ * Returns: Number of telegrams in the data
+ */
+static unsigned long anc350IPCount( const char * data, size_t numchars )
+{
+  unsigned long n = 0;
+  size_t pos = 0;
+
+  while (numchars - pos >= sizeof( Int32 )){
+    Int32 length;
+
+    memcpy( &length, data + pos, sizeof( Int32 ) );
+    if (length <= 0 || length > UC_MAXSIZE) break;
+    pos += sizeof( Int32 ) + (size_t)length;
+    n++;
+  }
+  return (n > 0)? n: 1;
+}
+
+/*
+ * Function: anc350IPWait
+ *
+ * Parameters: pIP       - Pointer to the port
+ *             events    - POLLIN or POLLOUT
+ *             timeout   - Seconds to wait, negative to wait for ever
+ *
+ * Returns: 1 if the socket is ready, 0 on timeout, -1 on error
+ *
+ * Description:
+ *
+ * Called with the lock held.
+ */
+static int anc350IPWait( anc350IPPort * pIP, short events, double timeout )
+{
+  struct pollfd pfd;
+  int status;
+
+  pfd.fd = pIP->fd;
+  pfd.events = events;
+  pfd.revents = 0;
+  do {
+    pIP->nPoll++;
+    status = poll( &pfd, 1, (timeout < 0.0)? -1: (int)(timeout * 1000.0 + 0.5) );
+  } while (status < 0 && errno == EINTR);
+  if (status > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) && !(pfd.revents & events)) return -1;
+  return (status > 0)? 1: status;
+}
+
+/*
+ * Function: anc350IPClose
+ *
+ * Parameters: pIP         - Pointer to the port
+ *             pasynUser   - Pointer to the asynUser of the caller
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Closes the socket and drops the queue.  Called with the lock held.
+ */
+static void anc350IPClose( anc350IPPort * pIP, asynUser * pasynUser )
+{
+  if (pIP->fd < 0) return;
+  epicsSocketDestroy( pIP->fd );
+  pIP->fd = -1;
+  pIP->broken = 0;
+  pIP->txFill = 0;
+  pIP->txSent = 0;
+  pIP->rxFill = 0;
+  pIP->rxPos = 0;
+  pasynManager->exceptionDisconnect( pasynUser );
+}
+
+/*
+ * Function: anc350IPFail
+ *
+ * Parameters: pIP         - Pointer to the port
+ *             pasynUser   - Pointer to the asynUser of the caller
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Drops a connection that failed.  From the transmit thread the port is
+ * only marked broken, see anc350IPCheck.  Called with the lock held.
+ */
+static void anc350IPFail( anc350IPPort * pIP, asynUser * pasynUser )
+{
+  if (pasynUser == pIP->pasynUserTx) pIP->broken = 1;
+  else anc350IPClose( pIP, pasynUser );
+}
+
+/*
+ * Function: anc350IPCheck
+ *
+ * Parameters: pIP         - Pointer to the port
+ *             pasynUser   - Pointer to the asynUser of the caller
+ *
+ * Returns: asynSuccess if the port is connected
+ *
+ * Description:
+ *
+ * Called on the port thread with the lock held.  Closes a connection the
+ * transmit thread found broken.
+ */
+static asynStatus anc350IPCheck( anc350IPPort * pIP, asynUser * pasynUser )
+{
+  if (pIP->fd >= 0 && pIP->broken){
+    epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: connection lost", pIP->portName );
+    anc350IPClose( pIP, pasynUser );
+    return asynError;
+  }
+  if (pIP->fd < 0){
+    epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: not connected", pIP->portName );
+    return asynError;
+  }
+  return asynSuccess;
+}
+
+/*
+ * Function: anc350IPWrite
+ *
+ * Parameters: pIP         - Pointer to the port
+ *             pasynUser   - Pointer to the asynUser of the caller
+ *             data        - Data to send
+ *             numchars    - Number of bytes
+ *             pDone       - Bytes already sent, updated
+ *             timeout     - Seconds allowed for the socket to take the data
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Sends the data, one send for everything the socket will take.  Called
+ * with the lock held.
+ */
+static asynStatus anc350IPWrite( anc350IPPort * pIP, asynUser * pasynUser, const char * data, size_t numchars,
+                                 size_t * pDone, double timeout )
+{
+  while (*pDone < numchars){
+    ssize_t n;
+
+    if (pIP->fd < 0 || pIP->broken){
+      epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: not connected", pIP->portName );
+      return asynError;
+    }
+
+    pIP->nSend++;
+    n = send( pIP->fd, data + *pDone, numchars - *pDone, IP_SEND_FLAGS );
+    if (n > 0){
+      *pDone += (size_t) n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+      int ready = anc350IPWait( pIP, POLLOUT, timeout );
+
+      if (ready == 0){
+        epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: write timeout", pIP->portName );
+        return asynTimeout;
+      }
+      if (ready < 0){
+        epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: connection lost", pIP->portName );
+        anc350IPFail( pIP, pasynUser );
+        return asynError;
+      }
+    } else if (n < 0 && errno != EINTR){
+      epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: write failed: %s",
+                     pIP->portName, strerror( errno ) );
+      anc350IPFail( pIP, pasynUser );
+      return asynError;
+    }
+  }
+  return asynSuccess;
+}
+
+/*
+ * Function: anc350IPSend
+ *
+ * Parameters: pIP         - Pointer to the port
+ *             pasynUser   - Pointer to the asynUser of the caller
+ *             timeout     - Seconds allowed for the socket to take the queue
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Sends the transmit queue.  Called with the lock held.
+ */
+static asynStatus anc350IPSend( anc350IPPort * pIP, asynUser * pasynUser, double timeout )
+{
+  asynStatus status = anc350IPWrite( pIP, pasynUser, pIP->tx, pIP->txFill, &pIP->txSent, timeout );
+
+  if (status == asynSuccess){
+    pIP->txFill = 0;
+    pIP->txSent = 0;
+  }
+  return status;
+}
+
+/*
+ * Function: anc350IPTxTask
+ *
+ * Parameters: arg   - Pointer to the port
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Sends corked writes once the oldest has waited the cork time.
+ */
+static void anc350IPTxTask( void * arg )
+{
+  anc350IPPort * pIP = (anc350IPPort *) arg;
+
+  while (1){
+    epicsTimeStamp now;
+    double wait = -1.0;
+
+    epicsMutexLock( pIP->lock );
+    if (pIP->txFill > pIP->txSent && !pIP->broken){
+      epicsTimeGetCurrent( &now );
+      wait = pIP->cork - epicsTimeDiffInSeconds( &now, &pIP->txFirst );
+      if (wait <= 0.0){
+        anc350IPSend( pIP, pIP->pasynUserTx, IP_CONNECT_TIMEOUT );
+        wait = -1.0;
+      }
+    }
+    epicsMutexUnlock( pIP->lock );
+
+    if (wait < 0.0) epicsEventMustWait( pIP->txEvent );
+    else epicsEventWaitWithTimeout( pIP->txEvent, wait );
+  }
+}
+
+/* asynCommon methods */
+static void ipReport( void * drvPvt, FILE * fp, int details )
+{
+  anc350IPPort * pIP = (anc350IPPort *) drvPvt;
+  unsigned long nCalls;
+  unsigned long nTelegrams;
+
+  epicsMutexLock( pIP->lock );
+  nCalls = pIP->nSend + pIP->nRecv + pIP->nPoll;
+  nTelegrams = pIP->nTelegrams;
+  fprintf( fp, "ANC350 TCP port %s to %s, %s, cork %g s\n", pIP->portName, pIP->hostInfo,
+           (pIP->fd < 0)? "disconnected": pIP->broken? "broken": "connected", pIP->cork );
+  if (details > 0){
+    fprintf( fp, "  %lu telegrams in %lu writes, %lu send, %lu recv, %lu poll, %.2f system calls per telegram\n",
+             nTelegrams, pIP->nWrites, pIP->nSend, pIP->nRecv, pIP->nPoll,
+             (nTelegrams > 0)? (double) nCalls / (double) nTelegrams: 0.0 );
+  }
+  epicsMutexUnlock( pIP->lock );
+}
+
+static asynStatus ipConnect( void * drvPvt, asynUser * pasynUser )
+{
+  anc350IPPort * pIP = (anc350IPPort *) drvPvt;
+  int flag = 1;
+  int ready;
+  int error = 0;
+  osiSocklen_t len = sizeof( error );
+  SOCKET fd;
+
+  epicsMutexLock( pIP->lock );
+  if (pIP->fd >= 0){
+    epicsMutexUnlock( pIP->lock );
+    epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: already connected", pIP->portName );
+    return asynError;
+  }
+
+  if ((fd = epicsSocketCreate( AF_INET, SOCK_STREAM, 0 )) == INVALID_SOCKET){
+    epicsMutexUnlock( pIP->lock );
+    epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: cannot create socket", pIP->portName );
+    return asynError;
+  }
+  setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, (char *) &flag, sizeof( flag ) );
+  fcntl( fd, F_SETFL, fcntl( fd, F_GETFL, 0 ) | O_NONBLOCK );
+  pIP->fd = fd;
+
+  if (connect( fd, (struct sockaddr *) &pIP->address, sizeof( pIP->address ) ) < 0){
+    if (errno != EINPROGRESS ||
+        (ready = anc350IPWait( pIP, POLLOUT, IP_CONNECT_TIMEOUT )) <= 0 ||
+        getsockopt( fd, SOL_SOCKET, SO_ERROR, (char *) &error, &len ) < 0 || error != 0){
+      epicsSocketDestroy( fd );
+      pIP->fd = -1;
+      epicsMutexUnlock( pIP->lock );
+      epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: cannot connect to %s",
+                     pIP->portName, pIP->hostInfo );
+      return asynError;
+    }
+  }
+  pIP->broken = 0;
+  pIP->rxFill = 0;
+  pIP->rxPos = 0;
+  epicsMutexUnlock( pIP->lock );
+
+  pasynManager->exceptionConnect( pasynUser );
+  return asynSuccess;
+}
+
+static asynStatus ipDisconnect( void * drvPvt, asynUser * pasynUser )
+{
+  anc350IPPort * pIP = (anc350IPPort *) drvPvt;
+
+  epicsMutexLock( pIP->lock );
+  anc350IPClose( pIP, pasynUser );
+  epicsMutexUnlock( pIP->lock );
+  return asynSuccess;
+}
+
+static asynCommon ipCommon = { ipReport, ipConnect, ipDisconnect };
+
+/* asynOctet methods */
+static asynStatus ipWriteOctet( void * drvPvt, asynUser * pasynUser, const char * data, size_t numchars,
+                                size_t * nbytesTransfered )
+{
+  anc350IPPort * pIP = (anc350IPPort *) drvPvt;
+  asynStatus status = asynSuccess;
+
+  *nbytesTransfered = 0;
+  epicsMutexLock( pIP->lock );
+  if ((status = anc350IPCheck( pIP, pasynUser )) != asynSuccess){
+    epicsMutexUnlock( pIP->lock );
+    return status;
+  }
+
+  /* Make room on the queue, a write too big for it is sent on its own */
+  if (pIP->txFill + numchars > sizeof( pIP->tx )){
+    status = anc350IPSend( pIP, pasynUser, pasynUser->timeout );
+  }
+  if (status == asynSuccess && numchars > sizeof( pIP->tx )){
+    size_t done = 0;
+
+    status = anc350IPWrite( pIP, pasynUser, data, numchars, &done, pasynUser->timeout );
+  } else if (status == asynSuccess){
+    if (pIP->txFill == pIP->txSent) epicsTimeGetCurrent( &pIP->txFirst );
+    memcpy( pIP->tx + pIP->txFill, data, numchars );
+    pIP->txFill += numchars;
+    if (pIP->cork <= 0.0) status = anc350IPSend( pIP, pasynUser, pasynUser->timeout );
+  }
+  if (status == asynSuccess){
+    *nbytesTransfered = numchars;
+    pIP->nWrites++;
+    pIP->nTelegrams += anc350IPCount( data, numchars );
+  }
+  epicsMutexUnlock( pIP->lock );
+
+  if (status == asynSuccess && pIP->cork > 0.0) epicsEventSignal( pIP->txEvent );
+  if (status == asynSuccess) asynPrintIO( pasynUser, ASYN_TRACEIO_DRIVER, data, numchars, "%s write\n", pIP->portName );
+  return status;
+}
+
+static asynStatus ipReadOctet( void * drvPvt, asynUser * pasynUser, char * data, size_t maxchars,
+                               size_t * nbytesTransfered, int * eomReason )
+{
+  anc350IPPort * pIP = (anc350IPPort *) drvPvt;
+  asynStatus status = asynSuccess;
+  size_t n;
+
+  *nbytesTransfered = 0;
+  if (eomReason) *eomReason = 0;
+  epicsMutexLock( pIP->lock );
+  status = anc350IPCheck( pIP, pasynUser );
+
+  /* Whatever is still corked has to go before an answer can come back */
+  if (status == asynSuccess && pIP->txFill > pIP->txSent) status = anc350IPSend( pIP, pasynUser, pasynUser->timeout );
+
+  while (status == asynSuccess && pIP->rxPos == pIP->rxFill){
+    ssize_t nRecv;
+    int ready;
+
+    if (pIP->fd < 0){
+      epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: not connected", pIP->portName );
+      status = asynError;
+      break;
+    }
+    pIP->nRecv++;
+    nRecv = recv( pIP->fd, pIP->rx, sizeof( pIP->rx ), 0 );
+    if (nRecv > 0){
+      pIP->rxFill = (size_t) nRecv;
+      pIP->rxPos = 0;
+    } else if (nRecv == 0){
+      epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: closed by the controller", pIP->portName );
+      anc350IPClose( pIP, pasynUser );
+      status = asynError;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK){
+      if ((ready = anc350IPWait( pIP, POLLIN, pasynUser->timeout )) == 0){
+        epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: read timeout", pIP->portName );
+        status = asynTimeout;
+      } else if (ready < 0){
+        epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: connection lost", pIP->portName );
+        anc350IPClose( pIP, pasynUser );
+        status = asynError;
+      }
+    } else if (errno != EINTR){
+      epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: read failed: %s",
+                     pIP->portName, strerror( errno ) );
+      anc350IPClose( pIP, pasynUser );
+      status = asynError;
+    }
+  }
+
+  if (status == asynSuccess){
+    n = pIP->rxFill - pIP->rxPos;
+    if (n > maxchars) n = maxchars;
+    memcpy( data, pIP->rx + pIP->rxPos, n );
+    pIP->rxPos += n;
+    *nbytesTransfered = n;
+    if (eomReason && n == maxchars) *eomReason = ASYN_EOM_CNT;
+  }
+  epicsMutexUnlock( pIP->lock );
+
+  if (status == asynSuccess) asynPrintIO( pasynUser, ASYN_TRACEIO_DRIVER, data, *nbytesTransfered, "%s read\n", pIP->portName );
+  return status;
+}
+
+static asynStatus ipFlushOctet( void * drvPvt, asynUser * pasynUser )
+{
+  anc350IPPort * pIP = (anc350IPPort *) drvPvt;
+  asynStatus status = asynSuccess;
+
+  epicsMutexLock( pIP->lock );
+  status = anc350IPCheck( pIP, pasynUser );
+  if (status == asynSuccess && pIP->txFill > pIP->txSent) status = anc350IPSend( pIP, pasynUser, pasynUser->timeout );
+
+  /* Drop everything received so far */
+  pIP->rxFill = 0;
+  pIP->rxPos = 0;
+  while (pIP->fd >= 0){
+    pIP->nRecv++;
+    if (recv( pIP->fd, pIP->rx, sizeof( pIP->rx ), 0 ) <= 0) break;
+  }
+  epicsMutexUnlock( pIP->lock );
+  return status;
+}
+
+static asynOctet ipOctet = { ipWriteOctet, ipReadOctet, ipFlushOctet };
+
+/*
+ * Function: anc350IPConfigure
+ *
+ * Parameters: portName   - Name of the asyn port to create
+ *             hostInfo   - Controller address, host[:port], port 2101 if not given
+ *             cork       - Seconds writes may be held back to be sent together,
+ *                          0 to send every write at once
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Creates a TCP port to a controller.  Use in place of
+ * drvAsynIPPortConfigure, before anc350AsynMotorCreate for the port.
+ */
+int anc350IPConfigure( const char * portName, const char * hostInfo, double cork )
+{
+  anc350IPPort * pIP;
+
+  if (portName == NULL || hostInfo == NULL){
+    printf( "anc350IPConfigure: port name and host are required\n" );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  pIP = callocMustSucceed( 1, sizeof( anc350IPPort ), "anc350IPConfigure" );
+  pIP->portName = epicsStrDup( portName );
+  pIP->hostInfo = epicsStrDup( hostInfo );
+  pIP->cork = (cork > 0.0)? cork: 0.0;
+  pIP->fd = -1;
+  pIP->lock = epicsMutexMustCreate();
+  pIP->txEvent = epicsEventMustCreate( epicsEventEmpty );
+
+  osiSockAttach();
+  if (aToIPAddr( hostInfo, IP_DEFAULT_PORT, &pIP->address ) < 0){
+    printf( "anc350IPConfigure: unknown host %s\n", hostInfo );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  if (pasynManager->registerPort( portName, ASYN_CANBLOCK, 1, 0, 0 ) != asynSuccess){
+    printf( "anc350IPConfigure: registerPort %s failed\n", portName );
+    return MOTOR_AXIS_ERROR;
+  }
+  pIP->common.interfaceType = asynCommonType;
+  pIP->common.pinterface = &ipCommon;
+  pIP->common.drvPvt = pIP;
+  pIP->octet.interfaceType = asynOctetType;
+  pIP->octet.pinterface = &ipOctet;
+  pIP->octet.drvPvt = pIP;
+  if (pasynManager->registerInterface( portName, &pIP->common ) != asynSuccess ||
+      pasynOctetBase->initialize( portName, &pIP->octet, 0, 0, 0 ) != asynSuccess){
+    printf( "anc350IPConfigure: cannot register the interfaces of %s\n", portName );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  if (pIP->cork > 0.0){
+    pIP->pasynUserTx = pasynManager->createAsynUser( 0, 0 );
+    pasynManager->connectDevice( pIP->pasynUserTx, portName, -1 );
+    if (epicsThreadCreate( "anc350IPTx", epicsThreadPriorityHigh,
+                           epicsThreadGetStackSize( epicsThreadStackSmall ),
+                           anc350IPTxTask, pIP ) == NULL){
+      printf( "anc350IPConfigure: cannot start the transmit thread, writes are sent at once\n" );
+      pIP->cork = 0.0;
+    }
+  }
+  return MOTOR_AXIS_OK;
+}
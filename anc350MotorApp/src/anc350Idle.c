@@ -0,0 +1,210 @@
+/*
+ * File:   anc350Idle.c
+ *
+ * Description:
+ *
+ * Idle power-down of the output stages.  An axis left with its outputs
+ * enabled dissipates power in the positioner and couples amplifier noise
+ * into it.  With an idle time set (ANC350_IDLE_TIME), the poller switches
+ * off ID_ANC_RELAIS and ID_ANC_INT_EN of an axis that has not been busy
+ * for that long, remembering the values they had.
+ *
+ * The next motion command switches them back on in the same burst as the
+ * command itself, so waking an axis adds two telegrams to a write that is
+ * made anyway rather than round trips of its own.  The controller handles
+ * the telegrams of a burst in order, so the outputs are on before the
+ * axis starts.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "epicsTime.h"
+#include "epicsMutex.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+
+/*
+ * Function: drvAnc350IdleInit
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * The outputs are left alone until an idle time is set.
+ */
+void drvAnc350IdleInit( AXIS_HDL pAxis )
+{
+  pAxis->idleTime = 0.0;
+  pAxis->idleOff = 0;
+  pAxis->idleSwitches = 0;
+  drvAnc350TimeGetCurrent( &pAxis->idleSince );
+}
+
+/*
+ * Function: drvAnc350IdleWake
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             ops     - Room for ANC350_IDLE_OPS operations
+ *
+ * Returns: Number of operations added, 0 if the outputs are on
+ *
+ * Description:
+ *
+ * Called with the axis mutex held by a command about to start the axis.
+ * Adds the writes that switch the outputs back on, to be sent in the same
+ * burst ahead of the command.  The caller passes the result of the burst
+ * to drvAnc350IdleWoken.
+ */
+int drvAnc350IdleWake( AXIS_HDL pAxis, anc350Op * ops )
+{
+  drvAnc350TimeGetCurrent( &pAxis->idleSince );
+  if (!pAxis->idleOff) return 0;
+
+  drvAnc350OpSet( &ops[0], ID_ANC_RELAIS, pAxis->axis - 1, pAxis->idleRelais );
+  drvAnc350OpSet( &ops[1], ID_ANC_INT_EN, pAxis->axis - 1, pAxis->idleIntEn );
+  return ANC350_IDLE_OPS;
+}
+
+/*
+ * Function: drvAnc350IdleWoken
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             ops     - Operations added by drvAnc350IdleWake, after the burst
+ *             nOps    - Number of operations added
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Marks the outputs on if both writes were acknowledged.  Otherwise they
+ * are still taken to be off and the next command tries again.
+ */
+void drvAnc350IdleWoken( AXIS_HDL pAxis, const anc350Op * ops, int nOps )
+{
+  int i;
+
+  if (nOps == 0) return;
+  for (i = 0; i < nOps; i++){
+    if (ops[i].status != asynSuccess){
+      asynPrint( pAxis->pDrv->pasynUser, ASYN_TRACE_ERROR,
+                 "drvAnc350IdleWoken: card %d axis %d outputs not switched on\n", pAxis->pDrv->card, pAxis->axis );
+      return;
+    }
+  }
+  pAxis->idleOff = 0;
+  anc350ParamSetInteger( pAxis->pDrv, pAxis->axis, ANC350_IDLE_OFF, 0 );
+}
+
+/*
+ * Function: drvAnc350IdleCheck
+ *
+ * Parameters: pAxis    - Pointer to motor axis handle
+ *             running  - Non-zero if the controller reports the axis running
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called by the poller for every status poll, with the axis mutex held.
+ * An axis with a hold correction, reference search or held back RUN is
+ * busy even while it is not running.
+ */
+void drvAnc350IdleCheck( AXIS_HDL pAxis, int running )
+{
+  ANC350DRV_ID pDrv = pAxis->pDrv;
+  anc350Op ops[ANC350_IDLE_OPS];
+  epicsTimeStamp now;
+
+  drvAnc350TimeGetCurrent( &now );
+  if (running || pAxis->holdActive || pAxis->reference_search || pAxis->syncCmd != 0){
+    pAxis->idleSince = now;
+    return;
+  }
+  if (pAxis->idleTime <= 0.0 || pAxis->idleOff) return;
+  if (epicsTimeDiffInSeconds( &now, &pAxis->idleSince ) < pAxis->idleTime) return;
+
+  /* Keep the settings to restore, an axis may run on the external input only */
+  drvAnc350OpGet( &ops[0], ID_ANC_RELAIS, pAxis->axis - 1 );
+  drvAnc350OpGet( &ops[1], ID_ANC_INT_EN, pAxis->axis - 1 );
+  if (drvAnc350Burst( pDrv, ops, ANC350_IDLE_OPS, pDrv->burstTimeout ) != ANC350_IDLE_OPS) return;
+  pAxis->idleRelais = ops[0].value;
+  pAxis->idleIntEn = ops[1].value;
+
+  drvAnc350OpSet( &ops[0], ID_ANC_RELAIS, pAxis->axis - 1, 0 );
+  drvAnc350OpSet( &ops[1], ID_ANC_INT_EN, pAxis->axis - 1, 0 );
+  if (drvAnc350Burst( pDrv, ops, ANC350_IDLE_OPS, pDrv->burstTimeout ) != ANC350_IDLE_OPS){
+    asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+               "drvAnc350IdleCheck: card %d axis %d outputs not switched off\n", pDrv->card, pAxis->axis );
+  } else {
+    pAxis->idleSwitches++;
+  }
+  /* Even after a failure: either write may have been applied, the next command restores both */
+  pAxis->idleOff = 1;
+  anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_IDLE_OFF, 1 );
+  anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_IDLE_SWITCHES, pAxis->idleSwitches );
+}
+
+/*
+ * Function: anc350IdleParamInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Publishes the idle settings of every axis to the parameter port.
+ */
+void anc350IdleParamInit( ANC350DRV_ID pDrv )
+{
+  int i;
+
+  for (i = 0; i < pDrv->nAxes; i++){
+    AXIS_HDL pAxis = &pDrv->axis[i];
+
+    anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_IDLE_TIME, pAxis->idleTime );
+    anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_IDLE_OFF, pAxis->idleOff );
+    anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_IDLE_SWITCHES, pAxis->idleSwitches );
+  }
+}
+
+/*
+ * Function: anc350IdleParamWrite
+ *
+ * Parameters: pDrv    - Pointer to driver structure
+ *             addr    - Asyn address, the axis
+ *             reason  - Parameter written
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Applies a new idle time.  Setting it to 0 switches the outputs of an
+ * idle axis back on at once.
+ */
+asynStatus anc350IdleParamWrite( ANC350DRV_ID pDrv, int addr, int reason )
+{
+  AXIS_HDL pAxis;
+  anc350Op ops[ANC350_IDLE_OPS];
+  double dval = 0.0;
+  int nOps;
+
+  if (pDrv == NULL || addr < 1 || addr > pDrv->nAxes) return asynError;
+  pAxis = &pDrv->axis[addr - 1];
+
+  anc350ParamGetDouble( pDrv, addr, reason, &dval );
+  if (epicsMutexLock( pAxis->axisMutex ) != epicsMutexLockOK) return asynError;
+  pAxis->idleTime = (dval > 0.0)? dval: 0.0;
+  if (pAxis->idleTime == 0.0 && (nOps = drvAnc350IdleWake( pAxis, ops )) > 0){
+    drvAnc350Burst( pDrv, ops, nOps, pDrv->burstTimeout );
+    drvAnc350IdleWoken( pAxis, ops, nOps );
+  }
+  epicsMutexUnlock( pAxis->axisMutex );
+  return asynSuccess;
+}
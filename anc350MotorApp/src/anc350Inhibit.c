@@ -0,0 +1,295 @@
+/*
+ * File:   anc350Inhibit.c
+ *
+ * Description:
+ *
+ * Motion inhibit enforced in the driver.  An interlock that stops an axis
+ * by writing the motor record STOP field waits for Channel Access, the
+ * record and the poller.  ANC350_INHIBIT (per axis) and ANC350_INHIBIT_ALL
+ * (per controller) are inputs any record can drive, through an output
+ * link from the interlock or a CP input link.
+ *
+ * While an axis is inhibited, moves, jogs and homes are rejected as soon
+ * as they are called, and hold corrections, homing jobs and held back
+ * sync group RUNs leave it alone.  Setting an inhibit wakes a high
+ * priority thread of the controller, which clears the run registers of
+ * the newly inhibited axes with drvAnc350BurstPriority.  Those telegrams
+ * go ahead of any burst in progress, so the stop waits at most for one
+ * group of telegrams in flight and then one round trip.  The time from the
+ * inhibit write to the stop being acknowledged is published in
+ * ANC350_INHIBIT_LATENCY and ANC350_INHIBIT_LATENCY_MAX.
+ *
+ * The thread then takes the axis mutex of each stopped axis to cancel
+ * hold, estimate and statistics, and stops it again if a command that
+ * was already past its check sent a RUN after the priority stop.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsEvent.h"
+#include "epicsMutex.h"
+#include "epicsAtomic.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+
+#define INHIBIT_STOP_OPS 3
+
+/*
+ * Function: drvAnc350InhibitInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Nothing is inhibited.  The thread is started with the parameter port,
+ * the only way to set an inhibit.
+ */
+void drvAnc350InhibitInit( ANC350DRV_ID pDrv )
+{
+  pDrv->inhibit = 0;
+  pDrv->inhibitEvent = epicsEventMustCreate( epicsEventEmpty );
+  pDrv->inhibitThread = NULL;
+  pDrv->inhibitRejects = 0;
+  pDrv->inhibitStops = 0;
+  pDrv->inhibitLatencyMax = 0.0;
+}
+
+/*
+ * Function: drvAnc350Inhibited
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: Non-zero if the axis must not move
+ *
+ * Description:
+ *
+ * Takes no mutex, it is called on every command.
+ */
+int drvAnc350Inhibited( AXIS_HDL pAxis )
+{
+  return epicsAtomicGetIntT( &pAxis->inhibit ) || epicsAtomicGetIntT( &pAxis->pDrv->inhibit );
+}
+
+/*
+ * Function: drvAnc350InhibitRejected
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             what    - Command rejected, for the message
+ *
+ * Returns: void
+ */
+void drvAnc350InhibitRejected( AXIS_HDL pAxis, const char * what )
+{
+  ANC350DRV_ID pDrv = pAxis->pDrv;
+
+  asynPrint( pDrv->pasynUser, ASYN_TRACE_WARNING,
+             "anc350Inhibit: card %d axis %d %s rejected, axis inhibited\n", pDrv->card, pAxis->axis, what );
+  anc350ParamSetInteger( pDrv, 0, ANC350_INHIBIT_REJECTS, epicsAtomicIncrIntT( &pDrv->inhibitRejects ) );
+}
+
+/*
+ * Function: anc350InhibitStop
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Stops the axes inhibited since the last call, in priority bursts of as
+ * many axes as fit in one group.
+ */
+static void anc350InhibitStop( ANC350DRV_ID pDrv )
+{
+  anc350Op ops[ANC350_MAX_PIPELINE];
+  int axes[ANC350_MAX_PIPELINE / INHIBIT_STOP_OPS];
+  int first = 0;
+
+  while (first < pDrv->nAxes){
+    epicsTimeStamp earliest;
+    epicsTimeStamp acked;
+    int nAxes = 0;
+    int nOps = 0;
+    int i;
+
+    for (; first < pDrv->nAxes && nOps + INHIBIT_STOP_OPS <= ANC350_MAX_PIPELINE; first++){
+      AXIS_HDL pAxis = &pDrv->axis[first];
+
+      if (!epicsAtomicCmpAndSwapIntT( &pAxis->inhibitPending, 1, 0 )) continue;
+      if (nAxes == 0 || epicsTimeLessThan( &pAxis->inhibitStart, &earliest )) earliest = pAxis->inhibitStart;
+      drvAnc350OpSet( &ops[nOps++], ID_ANC_RUN_TARGET, first, 0 );
+      drvAnc350OpSet( &ops[nOps++], ID_ANC_CONT_FWD, first, 0 );
+      drvAnc350OpSet( &ops[nOps++], ID_ANC_CONT_BKWD, first, 0 );
+      axes[nAxes++] = first;
+    }
+    if (nAxes == 0) continue;
+
+    drvAnc350BurstPriority( pDrv, ops, nOps, pDrv->burstTimeout );
+    drvAnc350TimeGetCurrent( &acked );
+
+    for (i = 0; i < nAxes; i++){
+      AXIS_HDL pAxis = &pDrv->axis[axes[i]];
+      anc350Op * pStop = &ops[i * INHIBIT_STOP_OPS];
+      int ok = (pStop[0].status == asynSuccess && pStop[1].status == asynSuccess && pStop[2].status == asynSuccess);
+      double latency = epicsTimeDiffInSeconds( &acked, &pAxis->inhibitStart );
+
+      if (!ok){
+        asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+                   "anc350Inhibit: card %d axis %d stop not acknowledged\n", pDrv->card, pAxis->axis );
+      }
+
+      epicsMutexLock( pAxis->axisMutex );
+      pAxis->reference_search = 0;
+      drvAnc350HoldSet( pAxis, 0, 0 );
+      drvAnc350EstimateCancel( pAxis );
+      drvAnc350StatsCancel( pAxis );
+      drvAnc350SyncCancel( pAxis );
+      /* A command past its check may have started the axis after the stop, or the stop failed */
+      if (!ok || !epicsTimeLessThan( &pAxis->commandSent, &pAxis->inhibitStart )){
+        drvAnc350OpSet( &pStop[0], ID_ANC_RUN_TARGET, axes[i], 0 );
+        drvAnc350OpSet( &pStop[1], ID_ANC_CONT_FWD, axes[i], 0 );
+        drvAnc350OpSet( &pStop[2], ID_ANC_CONT_BKWD, axes[i], 0 );
+        drvAnc350Burst( pDrv, pStop, INHIBIT_STOP_OPS, pDrv->burstTimeout );
+      }
+      epicsMutexUnlock( pAxis->axisMutex );
+
+      asynPrint( pDrv->pasynUser, ASYN_TRACE_WARNING,
+                 "anc350Inhibit: card %d axis %d stopped %.1f ms after the inhibit\n",
+                 pDrv->card, pAxis->axis, 1000.0 * latency );
+      if (latency > pDrv->inhibitLatencyMax) pDrv->inhibitLatencyMax = latency;
+      pDrv->inhibitStops++;
+    }
+
+    anc350ParamSetDouble( pDrv, 0, ANC350_INHIBIT_LATENCY, epicsTimeDiffInSeconds( &acked, &earliest ) );
+    anc350ParamSetDouble( pDrv, 0, ANC350_INHIBIT_LATENCY_MAX, pDrv->inhibitLatencyMax );
+    anc350ParamSetInteger( pDrv, 0, ANC350_INHIBIT_STOPS, pDrv->inhibitStops );
+    /* Let the poller publish Done */
+    epicsEventSignal( pDrv->pollEventId );
+  }
+}
+
+/*
+ * Function: anc350InhibitTask
+ *
+ * Parameters: arg   - Pointer to driver structure
+ *
+ * Returns: void
+ */
+static void anc350InhibitTask( void * arg )
+{
+  ANC350DRV_ID pDrv = (ANC350DRV_ID) arg;
+
+  for (;;){
+    epicsEventMustWait( pDrv->inhibitEvent );
+    anc350InhibitStop( pDrv );
+  }
+}
+
+/*
+ * Function: anc350InhibitPublish
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             start   - Time of the inhibit write
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Publishes the inhibited state of the axis after either input changed,
+ * and hands a newly inhibited axis to the inhibit thread.
+ */
+static void anc350InhibitPublish( AXIS_HDL pAxis, const epicsTimeStamp * start )
+{
+  int inhibited = drvAnc350Inhibited( pAxis );
+  int was = 0;
+
+  anc350ParamGetInteger( pAxis->pDrv, pAxis->axis, ANC350_INHIBITED, &was );
+  if (inhibited && !was){
+    pAxis->inhibitStart = *start;
+    epicsAtomicSetIntT( &pAxis->inhibitPending, 1 );
+  }
+  anc350ParamSetInteger( pAxis->pDrv, pAxis->axis, ANC350_INHIBITED, inhibited );
+}
+
+/*
+ * Function: anc350InhibitParamInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Publishes the inhibit state and starts the inhibit thread of the
+ * controller.
+ */
+void anc350InhibitParamInit( ANC350DRV_ID pDrv )
+{
+  char name[32];
+  int i;
+
+  anc350ParamSetInteger( pDrv, 0, ANC350_INHIBIT_ALL, pDrv->inhibit );
+  anc350ParamSetDouble( pDrv, 0, ANC350_INHIBIT_LATENCY, 0.0 );
+  anc350ParamSetDouble( pDrv, 0, ANC350_INHIBIT_LATENCY_MAX, pDrv->inhibitLatencyMax );
+  anc350ParamSetInteger( pDrv, 0, ANC350_INHIBIT_REJECTS, pDrv->inhibitRejects );
+  anc350ParamSetInteger( pDrv, 0, ANC350_INHIBIT_STOPS, pDrv->inhibitStops );
+  for (i = 0; i < pDrv->nAxes; i++){
+    anc350ParamSetInteger( pDrv, i + 1, ANC350_INHIBIT, pDrv->axis[i].inhibit );
+    anc350ParamSetInteger( pDrv, i + 1, ANC350_INHIBITED, drvAnc350Inhibited( &pDrv->axis[i] ) );
+  }
+
+  if (pDrv->inhibitThread != NULL) return;
+  sprintf( name, "anc350Inhibit%d", pDrv->card );
+  pDrv->inhibitThread = epicsThreadCreate( name, epicsThreadPriorityHigh,
+                                           epicsThreadGetStackSize( epicsThreadStackMedium ),
+                                           anc350InhibitTask, pDrv );
+  if (pDrv->inhibitThread == NULL){
+    printf( "anc350InhibitParamInit: card %d could not start the inhibit thread\n", pDrv->card );
+  }
+}
+
+/*
+ * Function: anc350InhibitParamWrite
+ *
+ * Parameters: pDrv    - Pointer to driver structure
+ *             addr    - Asyn address, 0 for the controller or the axis
+ *             reason  - ANC350_INHIBIT or ANC350_INHIBIT_ALL
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Applies an inhibit input.  The flags are set before the thread is woken,
+ * so commands are rejected from here on.  Clearing an inhibit only allows
+ * new commands, it does not restart anything.
+ */
+asynStatus anc350InhibitParamWrite( ANC350DRV_ID pDrv, int addr, int reason )
+{
+  epicsTimeStamp now;
+  int ival = 0;
+  int i;
+
+  if (pDrv == NULL || addr < 0 || addr > pDrv->nAxes) return asynError;
+  drvAnc350TimeGetCurrent( &now );
+  anc350ParamGetInteger( pDrv, addr, reason, &ival );
+
+  if (reason == ANC350_INHIBIT_ALL){
+    epicsAtomicSetIntT( &pDrv->inhibit, (ival != 0) );
+    for (i = 0; i < pDrv->nAxes; i++) anc350InhibitPublish( &pDrv->axis[i], &now );
+  } else {
+    if (addr < 1) return asynError;
+    epicsAtomicSetIntT( &pDrv->axis[addr - 1].inhibit, (ival != 0) );
+    anc350InhibitPublish( &pDrv->axis[addr - 1], &now );
+  }
+
+  if (ival) epicsEventSignal( pDrv->inhibitEvent );
+  return asynSuccess;
+}
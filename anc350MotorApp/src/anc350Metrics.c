@@ -0,0 +1,270 @@
+/*
+ * File:   anc350Metrics.c
+ *
+ * Description:
+ *
+ * Driver health in the Prometheus text exposition format, for site
+ * monitoring.  The driver keeps the counters of anc350Metrics per
+ * controller and a move count and total move time per axis; they are
+ * only changed with the epicsAtomic functions, except the 64 bit time
+ * totals, which there are no epicsAtomic functions for and which are
+ * guarded by a lock of their own.  drvAnc350MetricsRender takes no
+ * driver lock, so a scrape never holds up the poller.  The server that answers the scrapes is in
+ * anc350MetricsServer.c.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsMutex.h"
+#include "epicsAtomic.h"
+#include "epicsStdio.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+/* Upper bounds of the round trip time buckets (seconds), the last is +Inf */
+static const double rttBounds[ANC350_RTT_BUCKETS - 1] =
+{
+  0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5
+};
+
+/* Guards the 64 bit time totals */
+static epicsMutexId metricsTotalLock = NULL;
+static epicsThreadOnceId metricsOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350MetricsInit( void * arg )
+{
+  metricsTotalLock = epicsMutexMustCreate();
+}
+
+/*
+ * Function: drvAnc350MetricsAdd
+ *
+ * Parameters: pCounter  - Time total in microseconds
+ *             seconds   - Time to add
+ *
+ * Returns: void
+ */
+void drvAnc350MetricsAdd( epicsUInt64 * pCounter, double seconds )
+{
+  if (seconds <= 0.0) return;
+  epicsThreadOnce( &metricsOnceId, anc350MetricsInit, NULL );
+  epicsMutexLock( metricsTotalLock );
+  *pCounter += (epicsUInt64)(seconds * 1.0e6);
+  epicsMutexUnlock( metricsTotalLock );
+}
+
+/*
+ * Function: anc350MetricsSeconds
+ *
+ * Parameters: pCounter  - Time total in microseconds
+ *
+ * Returns: The total in seconds
+ */
+static double anc350MetricsSeconds( const epicsUInt64 * pCounter )
+{
+  epicsUInt64 value;
+
+  epicsThreadOnce( &metricsOnceId, anc350MetricsInit, NULL );
+  epicsMutexLock( metricsTotalLock );
+  value = *pCounter;
+  epicsMutexUnlock( metricsTotalLock );
+  return (double) value * 1.0e-6;
+}
+
+/*
+ * Function: drvAnc350MetricsRtt
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             pStart   - Time the telegram was sent
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Counts a round trip completed now in the histogram of the controller.
+ */
+void drvAnc350MetricsRtt( ANC350DRV_ID pDrv, const epicsTimeStamp * pStart )
+{
+  epicsTimeStamp now;
+  double rtt;
+  int i;
+
+  drvAnc350TimeGetCurrent( &now );
+  rtt = epicsTimeDiffInSeconds( &now, pStart );
+  for (i = 0; i < ANC350_RTT_BUCKETS - 1 && rtt > rttBounds[i]; i++);
+  epicsAtomicIncrSizeT( &pDrv->metrics.rtt[i] );
+  epicsAtomicIncrSizeT( &pDrv->metrics.rttCount );
+  drvAnc350MetricsAdd( &pDrv->metrics.rttSum, rtt );
+}
+
+/*
+ * Function: anc350MetricsPrintf
+ *
+ * Parameters: pText    - Response under construction
+ *             format   - printf format
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Appends to the response, growing the buffer as needed.
+ */
+static void anc350MetricsPrintf( anc350MetricsText * pText, const char * format, ... )
+{
+  va_list args;
+  int n;
+
+  while (1){
+    va_start( args, format );
+    n = epicsVsnprintf( pText->buf + pText->len, pText->size - pText->len, format, args );
+    va_end( args );
+    if (n >= 0 && (size_t) n < pText->size - pText->len) break;
+    pText->size *= 2;
+    pText->buf = realloc( pText->buf, pText->size );
+    if (pText->buf == NULL) cantProceed( "anc350MetricsPrintf" );
+  }
+  pText->len += n;
+}
+
+/*
+ * Function: anc350MetricsController
+ *
+ * Parameters: pText    - Response under construction
+ *             name     - Metric name
+ *             type     - "counter" or "gauge"
+ *             help     - Help text
+ *             offset   - Offset of the value in anc350Metrics
+ *             scale    - Factor applied to the value
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Writes one controller metric, a sample per controller.
+ */
+static void anc350MetricsController( anc350MetricsText * pText, const char * name, const char * type,
+                                     const char * help, size_t offset, double scale )
+{
+  ANC350DRV_ID pDrv;
+
+  anc350MetricsPrintf( pText, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type );
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    size_t * pValue = (size_t *)((char *) &pDrv->metrics + offset);
+
+    anc350MetricsPrintf( pText, "%s{card=\"%d\",port=\"%s\"} %.15g\n", name, pDrv->card, pDrv->portName,
+                         (double) epicsAtomicGetSizeT( pValue ) * scale );
+  }
+}
+
+/*
+ * Function: anc350MetricsControllerTime
+ *
+ * Parameters: pText    - Response under construction
+ *             name     - Metric name
+ *             help     - Help text
+ *             offset   - Offset of the time total in anc350Metrics
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Writes one controller time total as a counter in seconds.
+ */
+static void anc350MetricsControllerTime( anc350MetricsText * pText, const char * name, const char * help,
+                                         size_t offset )
+{
+  ANC350DRV_ID pDrv;
+
+  anc350MetricsPrintf( pText, "# HELP %s %s\n# TYPE %s counter\n", name, help, name );
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    epicsUInt64 * pValue = (epicsUInt64 *)((char *) &pDrv->metrics + offset);
+
+    anc350MetricsPrintf( pText, "%s{card=\"%d\",port=\"%s\"} %.6f\n", name, pDrv->card, pDrv->portName,
+                         anc350MetricsSeconds( pValue ) );
+  }
+}
+
+/*
+ * Function: drvAnc350MetricsRender
+ *
+ * Parameters: pText   - Response to fill
+ *
+ * Returns: void
+ */
+void drvAnc350MetricsRender( anc350MetricsText * pText )
+{
+  ANC350DRV_ID pDrv;
+  int i;
+
+  anc350MetricsController( pText, "anc350_telegrams_sent_total", "counter",
+                           "Telegrams sent to the controller.",
+                           offsetof( anc350Metrics, telegramsSent ), 1.0 );
+  anc350MetricsController( pText, "anc350_telegrams_received_total", "counter",
+                           "Telegrams received from the controller.",
+                           offsetof( anc350Metrics, telegramsReceived ), 1.0 );
+  anc350MetricsController( pText, "anc350_timeouts_total", "counter",
+                           "Telegrams whose acknowledge never arrived.",
+                           offsetof( anc350Metrics, timeouts ), 1.0 );
+  anc350MetricsController( pText, "anc350_correlation_mismatches_total", "counter",
+                           "Acknowledges that matched no telegram in flight.",
+                           offsetof( anc350Metrics, mismatches ), 1.0 );
+
+  anc350MetricsPrintf( pText, "# HELP anc350_rtt_seconds Telegram round trip time.\n"
+                              "# TYPE anc350_rtt_seconds histogram\n" );
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    size_t cumulative = 0;
+
+    for (i = 0; i < ANC350_RTT_BUCKETS; i++){
+      cumulative += epicsAtomicGetSizeT( &pDrv->metrics.rtt[i] );
+      if (i < ANC350_RTT_BUCKETS - 1){
+        anc350MetricsPrintf( pText, "anc350_rtt_seconds_bucket{card=\"%d\",port=\"%s\",le=\"%g\"} %lu\n",
+                             pDrv->card, pDrv->portName, rttBounds[i], (unsigned long) cumulative );
+      } else {
+        anc350MetricsPrintf( pText, "anc350_rtt_seconds_bucket{card=\"%d\",port=\"%s\",le=\"+Inf\"} %lu\n",
+                             pDrv->card, pDrv->portName, (unsigned long) cumulative );
+      }
+    }
+    anc350MetricsPrintf( pText, "anc350_rtt_seconds_sum{card=\"%d\",port=\"%s\"} %.6f\n", pDrv->card,
+                         pDrv->portName, anc350MetricsSeconds( &pDrv->metrics.rttSum ) );
+    anc350MetricsPrintf( pText, "anc350_rtt_seconds_count{card=\"%d\",port=\"%s\"} %lu\n", pDrv->card,
+                         pDrv->portName, (unsigned long) epicsAtomicGetSizeT( &pDrv->metrics.rttCount ) );
+  }
+
+  anc350MetricsController( pText, "anc350_poll_cycle_seconds", "gauge",
+                           "Duration of the last poll of every axis.",
+                           offsetof( anc350Metrics, pollLast ), 1.0e-6 );
+  anc350MetricsController( pText, "anc350_polls_total", "counter",
+                           "Polls of the controller.",
+                           offsetof( anc350Metrics, polls ), 1.0 );
+  anc350MetricsControllerTime( pText, "anc350_poll_seconds_total",
+                               "Time spent polling the controller.",
+                               offsetof( anc350Metrics, pollSum ) );
+
+  anc350MetricsPrintf( pText, "# HELP anc350_axis_moves_total Moves completed by the axis.\n"
+                              "# TYPE anc350_axis_moves_total counter\n" );
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    for (i = 0; i < pDrv->nAxes; i++){
+      anc350MetricsPrintf( pText, "anc350_axis_moves_total{card=\"%d\",port=\"%s\",axis=\"%d\"} %lu\n",
+                           pDrv->card, pDrv->portName, i + 1,
+                           (unsigned long) epicsAtomicGetSizeT( &pDrv->axis[i].metricMoves ) );
+    }
+  }
+  anc350MetricsPrintf( pText, "# HELP anc350_axis_move_seconds_total Total duration of the moves of the axis.\n"
+                              "# TYPE anc350_axis_move_seconds_total counter\n" );
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    for (i = 0; i < pDrv->nAxes; i++){
+      anc350MetricsPrintf( pText, "anc350_axis_move_seconds_total{card=\"%d\",port=\"%s\",axis=\"%d\"} %.6f\n",
+                           pDrv->card, pDrv->portName, i + 1, anc350MetricsSeconds( &pDrv->axis[i].metricMoveTime ) );
+    }
+  }
+}
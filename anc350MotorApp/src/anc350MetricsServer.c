@@ -0,0 +1,220 @@
+/*
+ * File:   anc350MetricsServer.c
+ *
+ * Description:
+ *
+ * Server for the driver health metrics of anc350Metrics.c.
+ * anc350MetricsConfigure starts a server thread listening on a loopback
+ * TCP address or a unix socket.  Each connection is answered with one
+ * HTTP/1.0 response holding every metric and then closed.  Connections
+ * are non-blocking, and a client that has not taken the whole response
+ * within METRICS_SEND_TIMEOUT is dropped, so one slow scraper cannot
+ * stall the server for the others.  Built for Unix hosts only, see the
+ * Makefile.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/un.h>
+
+#include "osiSock.h"
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsStdio.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+#define METRICS_DEFAULT_PORT 9350
+#define METRICS_REQUEST_TIMEOUT 1000    /* ms */
+#define METRICS_SEND_TIMEOUT 2.0        /* Seconds for the whole response */
+
+#ifdef MSG_NOSIGNAL
+#define METRICS_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define METRICS_SEND_FLAGS 0
+#endif
+#define METRICS_UNIX_PREFIX "unix:"
+
+static SOCKET metricsFd = INVALID_SOCKET;
+
+/*
+ * Function: anc350MetricsSend
+ *
+ * Parameters: fd        - Connected non-blocking socket
+ *             pData     - Data to send
+ *             len       - Number of bytes
+ *             pDeadline - Time by which the client must have taken the data
+ *
+ * Returns: 0 if the data was sent, -1 if the client is to be dropped
+ */
+static int anc350MetricsSend( SOCKET fd, const char * pData, size_t len, const epicsTimeStamp * pDeadline )
+{
+  while (len > 0){
+    ssize_t n = send( fd, pData, len, METRICS_SEND_FLAGS );
+
+    if (n > 0){
+      pData += n;
+      len -= n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+      struct pollfd pfd;
+      epicsTimeStamp now;
+      double left;
+
+      epicsTimeGetCurrent( &now );
+      left = epicsTimeDiffInSeconds( pDeadline, &now );
+      if (left <= 0.0) return -1;
+      pfd.fd = fd;
+      pfd.events = POLLOUT;
+      if (poll( &pfd, 1, (int)(left * 1000.0) + 1 ) < 0 && errno != EINTR) return -1;
+    } else if (n < 0 && errno == EINTR){
+      continue;
+    } else {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Function: anc350MetricsTask
+ *
+ * Parameters: arg   - Unused
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Server thread.  The request itself is not parsed: whatever the path,
+ * the reply is the full set of metrics.
+ */
+static void anc350MetricsTask( void * arg )
+{
+  anc350MetricsText text;
+  char header[160];
+  char request[1024];
+
+  text.size = 16384;
+  text.buf = mallocMustSucceed( text.size, "anc350MetricsTask" );
+
+  while (1){
+    struct pollfd pfd;
+    epicsTimeStamp deadline;
+    SOCKET fd = accept( metricsFd, NULL, NULL );
+
+    if (fd == INVALID_SOCKET){
+      if (errno != EINTR) epicsThreadSleep( 1.0 );
+      continue;
+    }
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL, 0 ) | O_NONBLOCK );
+
+    /* Wait for the request so the client does not see a reset */
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (poll( &pfd, 1, METRICS_REQUEST_TIMEOUT ) > 0) recv( fd, request, sizeof( request ), 0 );
+
+    text.len = 0;
+    drvAnc350MetricsRender( &text );
+    epicsSnprintf( header, sizeof( header ),
+                   "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                   "Content-Length: %lu\r\nConnection: close\r\n\r\n", (unsigned long) text.len );
+    epicsTimeGetCurrent( &deadline );
+    epicsTimeAddSeconds( &deadline, METRICS_SEND_TIMEOUT );
+    if (anc350MetricsSend( fd, header, strlen( header ), &deadline ) == 0){
+      anc350MetricsSend( fd, text.buf, text.len, &deadline );
+    }
+    epicsSocketDestroy( fd );
+  }
+}
+
+/*
+ * Function: anc350MetricsConfigure
+ *
+ * Parameters: address   - host[:port] to listen on, port 9350 if not given,
+ *                         or unix:path for a unix socket
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Starts the metrics server.  Meant for a loopback address or a unix
+ * socket; any other address is accepted with a warning, as the metrics
+ * are served without authentication.
+ */
+int anc350MetricsConfigure( const char * address )
+{
+  SOCKET fd;
+
+  if (metricsFd != INVALID_SOCKET){
+    printf( "anc350MetricsConfigure: the metrics server is already running\n" );
+    return MOTOR_AXIS_ERROR;
+  }
+  if (address == NULL || *address == '\0') address = "127.0.0.1";
+
+  osiSockAttach();
+  if (strncmp( address, METRICS_UNIX_PREFIX, strlen( METRICS_UNIX_PREFIX ) ) == 0){
+    struct sockaddr_un local;
+    const char * path = address + strlen( METRICS_UNIX_PREFIX );
+
+    if (strlen( path ) == 0 || strlen( path ) >= sizeof( local.sun_path )){
+      printf( "anc350MetricsConfigure: bad socket path %s\n", path );
+      return MOTOR_AXIS_ERROR;
+    }
+    memset( &local, 0, sizeof( local ) );
+    local.sun_family = AF_UNIX;
+    strcpy( local.sun_path, path );
+    unlink( path );
+    if ((fd = epicsSocketCreate( AF_UNIX, SOCK_STREAM, 0 )) == INVALID_SOCKET ||
+        bind( fd, (struct sockaddr *) &local, sizeof( local ) ) < 0){
+      printf( "anc350MetricsConfigure: cannot bind %s: %s\n", path, strerror( errno ) );
+      if (fd != INVALID_SOCKET) epicsSocketDestroy( fd );
+      return MOTOR_AXIS_ERROR;
+    }
+  } else {
+    struct sockaddr_in local;
+
+    if (aToIPAddr( address, METRICS_DEFAULT_PORT, &local ) < 0){
+      printf( "anc350MetricsConfigure: unknown address %s\n", address );
+      return MOTOR_AXIS_ERROR;
+    }
+    if ((ntohl( local.sin_addr.s_addr ) >> 24) != 127){
+      printf( "anc350MetricsConfigure: warning, %s is not a loopback address\n", address );
+    }
+    if ((fd = epicsSocketCreate( AF_INET, SOCK_STREAM, 0 )) == INVALID_SOCKET){
+      printf( "anc350MetricsConfigure: cannot create socket\n" );
+      return MOTOR_AXIS_ERROR;
+    }
+    epicsSocketEnableAddressReuseDuringTimeWaitState( fd );
+    if (bind( fd, (struct sockaddr *) &local, sizeof( local ) ) < 0){
+      printf( "anc350MetricsConfigure: cannot bind %s: %s\n", address, strerror( errno ) );
+      epicsSocketDestroy( fd );
+      return MOTOR_AXIS_ERROR;
+    }
+  }
+
+  if (listen( fd, 4 ) < 0){
+    printf( "anc350MetricsConfigure: cannot listen on %s\n", address );
+    epicsSocketDestroy( fd );
+    return MOTOR_AXIS_ERROR;
+  }
+  metricsFd = fd;
+
+  if (epicsThreadCreate( "anc350Metrics", epicsThreadPriorityLow,
+                         epicsThreadGetStackSize( epicsThreadStackMedium ),
+                         anc350MetricsTask, NULL ) == NULL){
+    printf( "anc350MetricsConfigure: cannot start the server thread\n" );
+    epicsSocketDestroy( fd );
+    metricsFd = INVALID_SOCKET;
+    return MOTOR_AXIS_ERROR;
+  }
+  return MOTOR_AXIS_OK;
+}
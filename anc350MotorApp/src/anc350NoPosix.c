@@ -0,0 +1,55 @@
+/*
+ * File:   anc350NoPosix.c
+ *
+ * Description:
+ *
+ * Stand-ins for the parts of the driver that need sockets, poll, mmap or
+ * fsync, built in place of anc350IP.c, anc350MetricsServer.c and
+ * anc350Store.c on targets other than Unix hosts (see the Makefile).  The
+ * iocsh commands stay registered and say they are not available, and
+ * the calibration store is never written.
+ */
+#include <stddef.h>
+#include <stdio.h>
+
+#include "epicsTime.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+void drvAnc350StoreChanged( void )
+{
+}
+
+int anc350IPConfigure( const char * portName, const char * hostInfo, double cork )
+{
+  printf( "anc350IPConfigure: not available on this target, use drvAsynIPPortConfigure\n" );
+  return MOTOR_AXIS_ERROR;
+}
+
+int anc350MetricsConfigure( const char * address )
+{
+  printf( "anc350MetricsConfigure: not available on this target\n" );
+  return MOTOR_AXIS_ERROR;
+}
+
+int anc350StoreConfigure( const char * fileName )
+{
+  printf( "anc350StoreConfigure: not available on this target\n" );
+  return MOTOR_AXIS_ERROR;
+}
+
+int anc350StoreSave( void )
+{
+  printf( "anc350StoreSave: not available on this target\n" );
+  return MOTOR_AXIS_ERROR;
+}
+
+int anc350StoreShow( void )
+{
+  printf( "anc350StoreShow: not available on this target\n" );
+  return MOTOR_AXIS_ERROR;
+}
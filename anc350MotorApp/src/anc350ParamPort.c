@@ -0,0 +1,968 @@
+/*
+ * File:   anc350ParamPort.c
+ *
+ * Description:
+ *
+ * Asyn port exposing the driver level parameters of the ANC350 asyn motor
+ * driver, so that records using the standard asyn device support (DTYP
+ * asynInt32, asynFloat64, asynOctetWrite, asynFloat64ArrayIn ...) can
+ * control driver features and read back their results.  The motor record interface has a fixed set
+ * of parameters, so everything beyond it goes through this port.
+ *
+ * One port is created per controller with anc350ParamPortConfigure.  Asyn
+ * address 0 is the controller and addresses 1 to nAxes are the axes.  A port
+ * created with card -1 is the crate port, holding the parameters of the jobs
+ * that span every controller in the IOC at address 0, and those of the
+ * synchronisation groups at addresses 1 to ANC350_MAX_SYNC_GROUPS.
+ *
+ * The drvInfo strings are the names in the parameter table below, e.g.
+ *
+ *   field(OUT, "@asyn($(PORT),0,1)ANC350_SNAPSHOT")
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsMutex.h"
+#include "epicsString.h"
+#include "epicsStdio.h"
+#include "cantProceed.h"
+#include "ellLib.h"
+#include "asynDriver.h"
+#include "asynDrvUser.h"
+#include "asynInt32.h"
+#include "asynFloat64.h"
+#include "asynFloat64Array.h"
+#include "asynOctet.h"
+
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+#define ANC350_TYPE_INT32     0
+#define ANC350_TYPE_FLOAT64   1
+#define ANC350_TYPE_OCTET     2
+#define ANC350_TYPE_FLOAT64_ARRAY 3
+
+#define ANC350_SCOPE_CRATE       0x1   /* Crate port, address 0 */
+#define ANC350_SCOPE_CONTROLLER  0x2   /* Controller port, address 0 */
+#define ANC350_SCOPE_AXIS        0x4   /* Controller port, addresses 1 to nAxes */
+#define ANC350_SCOPE_GROUP       0x8   /* Crate port, addresses 1 to ANC350_MAX_SYNC_GROUPS */
+
+typedef struct anc350ParamDef
+{
+  const char * name;
+  int type;
+  int scope;
+} anc350ParamDef;
+
+static const anc350ParamDef paramDefs[ANC350_NUM_PARAMS] =
+{
+  [ANC350_SNAPSHOT]        = { "ANC350_SNAPSHOT",        ANC350_TYPE_INT32,   ANC350_SCOPE_CRATE },
+  [ANC350_SNAPSHOT_DIR]    = { "ANC350_SNAPSHOT_DIR",    ANC350_TYPE_OCTET,   ANC350_SCOPE_CRATE },
+  [ANC350_SNAPSHOT_REF]    = { "ANC350_SNAPSHOT_REF",    ANC350_TYPE_OCTET,   ANC350_SCOPE_CRATE },
+  [ANC350_SNAPSHOT_FILE]   = { "ANC350_SNAPSHOT_FILE",   ANC350_TYPE_OCTET,   ANC350_SCOPE_CRATE },
+  [ANC350_SNAPSHOT_DIFFS]  = { "ANC350_SNAPSHOT_DIFFS",  ANC350_TYPE_INT32,   ANC350_SCOPE_CRATE },
+  [ANC350_SNAPSHOT_TIME]   = { "ANC350_SNAPSHOT_TIME",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_CRATE },
+  [ANC350_SYNC_DEFER]      = { "ANC350_SYNC_DEFER",      ANC350_TYPE_INT32,   ANC350_SCOPE_GROUP },
+  [ANC350_SYNC_MOVES]      = { "ANC350_SYNC_MOVES",      ANC350_TYPE_INT32,   ANC350_SCOPE_GROUP },
+  [ANC350_SYNC_SKEW]       = { "ANC350_SYNC_SKEW",       ANC350_TYPE_FLOAT64, ANC350_SCOPE_GROUP },
+  [ANC350_SYNC_SKEW_LIMIT] = { "ANC350_SYNC_SKEW_LIMIT", ANC350_TYPE_FLOAT64, ANC350_SCOPE_GROUP },
+  [ANC350_STOP_TIME]       = { "ANC350_STOP_TIME",       ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_HOLD]            = { "ANC350_HOLD",            ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_HOLD_DEADBAND]   = { "ANC350_HOLD_DEADBAND",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_HOLD_INTERVAL]   = { "ANC350_HOLD_INTERVAL",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_HOLD_CORRECTIONS]= { "ANC350_HOLD_CORRECTIONS",ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_HOLD_DRIFT]      = { "ANC350_HOLD_DRIFT",      ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_HOLD_MAX_DRIFT]  = { "ANC350_HOLD_MAX_DRIFT",  ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_TRIG]            = { "ANC350_TRIG",            ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_TRIG_OUTPUT]     = { "ANC350_TRIG_OUTPUT",     ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_TRIG_WINDOW]     = { "ANC350_TRIG_WINDOW",     ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_TRIG_EPS]        = { "ANC350_TRIG_EPS",        ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_TRIG_POL]        = { "ANC350_TRIG_POL",        ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_TRIG_ARMED]      = { "ANC350_TRIG_ARMED",      ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_SAMPLE_PERIOD]   = { "ANC350_SAMPLE_PERIOD",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_CRATE },
+  [ANC350_SAMPLE_POSITIONS]= { "ANC350_SAMPLE_POSITIONS",ANC350_TYPE_FLOAT64_ARRAY, ANC350_SCOPE_CRATE },
+  [ANC350_SAMPLE_STATUS]   = { "ANC350_SAMPLE_STATUS",   ANC350_TYPE_FLOAT64_ARRAY, ANC350_SCOPE_CRATE },
+  [ANC350_SAMPLE_COUNT]    = { "ANC350_SAMPLE_COUNT",    ANC350_TYPE_INT32,   ANC350_SCOPE_CRATE },
+  [ANC350_SAMPLE_MISSED]   = { "ANC350_SAMPLE_MISSED",   ANC350_TYPE_INT32,   ANC350_SCOPE_CRATE },
+  [ANC350_SAMPLE_SKEW]     = { "ANC350_SAMPLE_SKEW",     ANC350_TYPE_FLOAT64, ANC350_SCOPE_CRATE },
+  [ANC350_SAMPLE_SKEW_MAX] = { "ANC350_SAMPLE_SKEW_MAX", ANC350_TYPE_FLOAT64, ANC350_SCOPE_CRATE },
+  [ANC350_SAMPLE_OFFSET]   = { "ANC350_SAMPLE_OFFSET",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_SAMPLE_OFFSET_MAX]={ "ANC350_SAMPLE_OFFSET_MAX",ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_GLOBAL_STATUS]   = { "ANC350_GLOBAL_STATUS",   ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_TEMP_STATUS]     = { "ANC350_TEMP_STATUS",     ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_SENSOR_VOLT]     = { "ANC350_SENSOR_VOLT",     ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_EST_DISTANCE]    = { "ANC350_EST_DISTANCE",    ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_EST_DURATION]    = { "ANC350_EST_DURATION",    ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_EST_PREDICTED]   = { "ANC350_EST_PREDICTED",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_EST_LAST]        = { "ANC350_EST_LAST",        ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_EST_ERROR]       = { "ANC350_EST_ERROR",       ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_EST_MOVES]       = { "ANC350_EST_MOVES",       ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_STAT_DURATION]   = { "ANC350_STAT_DURATION",   ANC350_TYPE_FLOAT64_ARRAY, ANC350_SCOPE_AXIS },
+  [ANC350_STAT_POLLS]      = { "ANC350_STAT_POLLS",      ANC350_TYPE_FLOAT64_ARRAY, ANC350_SCOPE_AXIS },
+  [ANC350_STAT_OVERSHOOT]  = { "ANC350_STAT_OVERSHOOT",  ANC350_TYPE_FLOAT64_ARRAY, ANC350_SCOPE_AXIS },
+  [ANC350_STAT_ERROR]      = { "ANC350_STAT_ERROR",      ANC350_TYPE_FLOAT64_ARRAY, ANC350_SCOPE_AXIS },
+  [ANC350_STAT_RETRIES]    = { "ANC350_STAT_RETRIES",    ANC350_TYPE_FLOAT64_ARRAY, ANC350_SCOPE_AXIS },
+  [ANC350_STAT_MOVES]      = { "ANC350_STAT_MOVES",      ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_STAT_RESET]      = { "ANC350_STAT_RESET",      ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_CB_LAG]          = { "ANC350_CB_LAG",          ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_CB_DROPPED]      = { "ANC350_CB_DROPPED",      ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_VERIFY_RATE]     = { "ANC350_VERIFY_RATE",     ANC350_TYPE_FLOAT64, ANC350_SCOPE_CRATE },
+  [ANC350_VERIFY_SWEEPS]   = { "ANC350_VERIFY_SWEEPS",   ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_VERIFY_DIVERGED] = { "ANC350_VERIFY_DIVERGED", ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_VERIFY_LAST]     = { "ANC350_VERIFY_LAST",     ANC350_TYPE_OCTET,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_CFG_AMPLITUDE]   = { "ANC350_CFG_AMPLITUDE",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_CFG_FREQUENCY]   = { "ANC350_CFG_FREQUENCY",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_HOME_ALL]        = { "ANC350_HOME_ALL",        ANC350_TYPE_INT32,   ANC350_SCOPE_CRATE },
+  [ANC350_HOME_DIR]        = { "ANC350_HOME_DIR",        ANC350_TYPE_INT32,   ANC350_SCOPE_CRATE },
+  [ANC350_HOME_LIMIT]      = { "ANC350_HOME_LIMIT",      ANC350_TYPE_INT32,   ANC350_SCOPE_CRATE },
+  [ANC350_HOME_TIMEOUT]    = { "ANC350_HOME_TIMEOUT",    ANC350_TYPE_FLOAT64, ANC350_SCOPE_CRATE },
+  [ANC350_HOME_ACTIVE]     = { "ANC350_HOME_ACTIVE",     ANC350_TYPE_INT32,   ANC350_SCOPE_CRATE },
+  [ANC350_HOME_REMAINING]  = { "ANC350_HOME_REMAINING",  ANC350_TYPE_INT32,   ANC350_SCOPE_CRATE },
+  [ANC350_HOME_FAILED]     = { "ANC350_HOME_FAILED",     ANC350_TYPE_INT32,   ANC350_SCOPE_CRATE },
+  [ANC350_HOME_TIME]       = { "ANC350_HOME_TIME",       ANC350_TYPE_FLOAT64, ANC350_SCOPE_CRATE },
+  [ANC350_HOME_STATE]      = { "ANC350_HOME_STATE",      ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_HOME_ELAPSED]    = { "ANC350_HOME_ELAPSED",    ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_IDLE_TIME]       = { "ANC350_IDLE_TIME",       ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_IDLE_OFF]        = { "ANC350_IDLE_OFF",        ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_IDLE_SWITCHES]   = { "ANC350_IDLE_SWITCHES",   ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_TEMPERATURE]     = { "ANC350_TEMPERATURE",     ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_BANK_COLD_BELOW] = { "ANC350_BANK_COLD_BELOW", ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_BANK_WARM_ABOVE] = { "ANC350_BANK_WARM_ABOVE", ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_BANK]            = { "ANC350_BANK",            ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_BANK_SWITCHES]   = { "ANC350_BANK_SWITCHES",   ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_BANK_LAST]       = { "ANC350_BANK_LAST",       ANC350_TYPE_OCTET,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_BANK_WARM_FREQ]  = { "ANC350_BANK_WARM_FREQ",  ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_BANK_WARM_AMPL]  = { "ANC350_BANK_WARM_AMPL",  ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_BANK_WARM_MAX_AMPL] = { "ANC350_BANK_WARM_MAX_AMPL", ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_BANK_WARM_SPD_GAIN] = { "ANC350_BANK_WARM_SPD_GAIN", ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_BANK_COLD_FREQ]  = { "ANC350_BANK_COLD_FREQ",  ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_BANK_COLD_AMPL]  = { "ANC350_BANK_COLD_AMPL",  ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_BANK_COLD_MAX_AMPL] = { "ANC350_BANK_COLD_MAX_AMPL", ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_BANK_COLD_SPD_GAIN] = { "ANC350_BANK_COLD_SPD_GAIN", ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+  [ANC350_INHIBIT]         = { "ANC350_INHIBIT",         ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_INHIBIT_ALL]     = { "ANC350_INHIBIT_ALL",     ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_INHIBITED]       = { "ANC350_INHIBITED",       ANC350_TYPE_INT32,   ANC350_SCOPE_AXIS },
+  [ANC350_INHIBIT_LATENCY] = { "ANC350_INHIBIT_LATENCY", ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_INHIBIT_LATENCY_MAX] = { "ANC350_INHIBIT_LATENCY_MAX", ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_INHIBIT_REJECTS] = { "ANC350_INHIBIT_REJECTS", ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_INHIBIT_STOPS]   = { "ANC350_INHIBIT_STOPS",   ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_TUNE_MOVING_POLL]   = { "ANC350_TUNE_MOVING_POLL",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_TUNE_IDLE_POLL]     = { "ANC350_TUNE_IDLE_POLL",     ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_TUNE_GET_TIMEOUT]   = { "ANC350_TUNE_GET_TIMEOUT",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_TUNE_SET_TIMEOUT]   = { "ANC350_TUNE_SET_TIMEOUT",   ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_TUNE_BURST_TIMEOUT] = { "ANC350_TUNE_BURST_TIMEOUT", ANC350_TYPE_FLOAT64, ANC350_SCOPE_CONTROLLER },
+  [ANC350_TUNE_COMM_ERRORS]   = { "ANC350_TUNE_COMM_ERRORS",   ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_TUNE_PIPELINE]      = { "ANC350_TUNE_PIPELINE",      ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_TUNE_DEFAULTS]      = { "ANC350_TUNE_DEFAULTS",      ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_TUNE_REJECTS]       = { "ANC350_TUNE_REJECTS",       ANC350_TYPE_INT32,   ANC350_SCOPE_CONTROLLER },
+  [ANC350_TUNE_DIRECTION]     = { "ANC350_TUNE_DIRECTION",     ANC350_TYPE_FLOAT64, ANC350_SCOPE_AXIS },
+};
+
+typedef struct anc350ParamValue
+{
+  int ival;
+  double dval;
+  char * sval;
+  epicsFloat64 * aval;
+  size_t nElements;
+  epicsTimeStamp timestamp;     /* Time the array was taken */
+} anc350ParamValue;
+
+typedef struct anc350ParamPort
+{
+  char * portName;
+  ANC350DRV_ID pDrv;            /* NULL for the crate port */
+  int maxAddr;
+  epicsMutexId lock;
+  anc350ParamValue * values;    /* maxAddr * ANC350_NUM_PARAMS */
+  asynInterface common;
+  asynInterface drvUser;
+  asynInterface int32;
+  asynInterface float64;
+  asynInterface octet;
+  asynInterface float64Array;
+  void * int32InterruptPvt;
+  void * float64InterruptPvt;
+  void * octetInterruptPvt;
+  void * float64ArrayInterruptPvt;
+} anc350ParamPort;
+
+static anc350ParamPort * pCratePort = NULL;
+
+/*
+ * Function: anc350ParamFindPort
+ *
+ * Parameters: pDrv   - Pointer to driver structure, NULL for the crate port
+ *
+ * Returns: Pointer to the parameter port, NULL if none configured
+ */
+static anc350ParamPort * anc350ParamFindPort( ANC350DRV_ID pDrv )
+{
+  return (pDrv == NULL)? pCratePort: pDrv->pParamPort;
+}
+
+/*
+ * Function: anc350ParamValueOf
+ *
+ * Parameters: pPort   - Pointer to the parameter port
+ *             addr    - Asyn address
+ *             reason  - Parameter index
+ *
+ * Returns: Pointer to the stored value, NULL if out of range
+ */
+static anc350ParamValue * anc350ParamValueOf( anc350ParamPort * pPort, int addr, int reason )
+{
+  if (pPort == NULL || addr < 0 || addr >= pPort->maxAddr || reason < 0 || reason >= ANC350_NUM_PARAMS) return NULL;
+  return &pPort->values[addr * ANC350_NUM_PARAMS + reason];
+}
+
+/*
+ * Function: anc350ParamCheck
+ *
+ * Parameters: pPort      - Pointer to the parameter port
+ *             pasynUser  - Pointer to the asynUser of the request
+ *             type       - Expected ANC350_TYPE_...
+ *             pAddr      - Returns the asyn address
+ *
+ * Returns: Pointer to the stored value, NULL if the request is invalid
+ *
+ * Description:
+ *
+ * Validates the address, reason and type of a request and sets an error
+ * message if the request cannot be served.
+ */
+static anc350ParamValue * anc350ParamCheck( anc350ParamPort * pPort, asynUser * pasynUser, int type, int * pAddr )
+{
+  int reason = pasynUser->reason;
+  anc350ParamValue * pValue;
+
+  pasynManager->getAddr( pasynUser, pAddr );
+  pValue = anc350ParamValueOf( pPort, *pAddr, reason );
+  if (pValue == NULL){
+    epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize,
+                   "%s: invalid address %d or reason %d", pPort->portName, *pAddr, reason );
+    return NULL;
+  }
+  if (paramDefs[reason].type != type){
+    epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize,
+                   "%s: %s has the wrong type for this interface", pPort->portName, paramDefs[reason].name );
+    return NULL;
+  }
+  return pValue;
+}
+
+/*
+ * Function: anc350ParamWriteHook
+ *
+ * Parameters: pPort   - Pointer to the parameter port
+ *             addr    - Asyn address
+ *             reason  - Parameter that has been written
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Passes a write from a record on to the driver feature owning the
+ * parameter.  Called in the port thread after the value has been stored.
+ */
+static asynStatus anc350ParamWriteHook( anc350ParamPort * pPort, int addr, int reason )
+{
+  switch (reason){
+    case ANC350_SNAPSHOT:
+      return anc350SnapshotParamWrite();
+    case ANC350_SYNC_DEFER:
+      return anc350SyncParamWrite( addr );
+    case ANC350_SAMPLE_PERIOD:
+      return anc350SampleParamWrite();
+    case ANC350_VERIFY_RATE:
+      return anc350VerifyParamWrite();
+    case ANC350_HOME_ALL:
+      return anc350HomeParamWrite();
+    case ANC350_HOLD:
+    case ANC350_HOLD_DEADBAND:
+    case ANC350_HOLD_INTERVAL:
+      return anc350HoldParamWrite( pPort->pDrv, addr, reason );
+    case ANC350_TRIG:
+    case ANC350_TRIG_OUTPUT:
+    case ANC350_TRIG_WINDOW:
+    case ANC350_TRIG_EPS:
+    case ANC350_TRIG_POL:
+      return anc350TriggerParamWrite( pPort->pDrv, addr, reason );
+    case ANC350_EST_DISTANCE:
+      return anc350EstimateParamWrite( pPort->pDrv, addr, reason );
+    case ANC350_STAT_RESET:
+      return anc350StatsParamWrite( pPort->pDrv, addr, reason );
+    case ANC350_IDLE_TIME:
+      return anc350IdleParamWrite( pPort->pDrv, addr, reason );
+    case ANC350_TEMPERATURE:
+    case ANC350_BANK_COLD_BELOW:
+    case ANC350_BANK_WARM_ABOVE:
+    case ANC350_BANK_WARM_FREQ:
+    case ANC350_BANK_WARM_AMPL:
+    case ANC350_BANK_WARM_MAX_AMPL:
+    case ANC350_BANK_WARM_SPD_GAIN:
+    case ANC350_BANK_COLD_FREQ:
+    case ANC350_BANK_COLD_AMPL:
+    case ANC350_BANK_COLD_MAX_AMPL:
+    case ANC350_BANK_COLD_SPD_GAIN:
+      return anc350BankParamWrite( pPort->pDrv, addr, reason );
+    case ANC350_INHIBIT:
+    case ANC350_INHIBIT_ALL:
+      return anc350InhibitParamWrite( pPort->pDrv, addr, reason );
+    case ANC350_TUNE_MOVING_POLL:
+    case ANC350_TUNE_IDLE_POLL:
+    case ANC350_TUNE_GET_TIMEOUT:
+    case ANC350_TUNE_SET_TIMEOUT:
+    case ANC350_TUNE_BURST_TIMEOUT:
+    case ANC350_TUNE_COMM_ERRORS:
+    case ANC350_TUNE_PIPELINE:
+    case ANC350_TUNE_DEFAULTS:
+    case ANC350_TUNE_DIRECTION:
+      return anc350TuneParamWrite( pPort->pDrv, addr, reason );
+    default:
+      return asynSuccess;
+  }
+}
+
+/*
+ * Function: anc350ParamPostInt32
+ *
+ * Parameters: pPort   - Pointer to the parameter port
+ *             addr    - Asyn address
+ *             reason  - Parameter index
+ *             value   - New value
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Calls the I/O Intr clients registered for the parameter.
+ */
+static void anc350ParamPostInt32( anc350ParamPort * pPort, int addr, int reason, int value )
+{
+  ELLLIST * pclientList;
+  interruptNode * pnode;
+
+  pasynManager->interruptStart( pPort->int32InterruptPvt, &pclientList );
+  for (pnode = (interruptNode *) ellFirst( pclientList ); pnode != NULL; pnode = (interruptNode *) ellNext( &pnode->node )){
+    asynInt32Interrupt * pInterrupt = (asynInt32Interrupt *) pnode->drvPvt;
+    if (pInterrupt->pasynUser->reason == reason && pInterrupt->addr == addr){
+      pInterrupt->callback( pInterrupt->userPvt, pInterrupt->pasynUser, value );
+    }
+  }
+  pasynManager->interruptEnd( pPort->int32InterruptPvt );
+}
+
+/*
+ * Function: anc350ParamPostFloat64
+ *
+ * Parameters: pPort   - Pointer to the parameter port
+ *             addr    - Asyn address
+ *             reason  - Parameter index
+ *             value   - New value
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Calls the I/O Intr clients registered for the parameter.
+ */
+static void anc350ParamPostFloat64( anc350ParamPort * pPort, int addr, int reason, double value )
+{
+  ELLLIST * pclientList;
+  interruptNode * pnode;
+
+  pasynManager->interruptStart( pPort->float64InterruptPvt, &pclientList );
+  for (pnode = (interruptNode *) ellFirst( pclientList ); pnode != NULL; pnode = (interruptNode *) ellNext( &pnode->node )){
+    asynFloat64Interrupt * pInterrupt = (asynFloat64Interrupt *) pnode->drvPvt;
+    if (pInterrupt->pasynUser->reason == reason && pInterrupt->addr == addr){
+      pInterrupt->callback( pInterrupt->userPvt, pInterrupt->pasynUser, value );
+    }
+  }
+  pasynManager->interruptEnd( pPort->float64InterruptPvt );
+}
+
+/*
+ * Function: anc350ParamPostOctet
+ *
+ * Parameters: pPort   - Pointer to the parameter port
+ *             addr    - Asyn address
+ *             reason  - Parameter index
+ *             value   - New string
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Calls the I/O Intr clients registered for the parameter.
+ */
+static void anc350ParamPostOctet( anc350ParamPort * pPort, int addr, int reason, char * value )
+{
+  ELLLIST * pclientList;
+  interruptNode * pnode;
+
+  pasynManager->interruptStart( pPort->octetInterruptPvt, &pclientList );
+  for (pnode = (interruptNode *) ellFirst( pclientList ); pnode != NULL; pnode = (interruptNode *) ellNext( &pnode->node )){
+    asynOctetInterrupt * pInterrupt = (asynOctetInterrupt *) pnode->drvPvt;
+    if (pInterrupt->pasynUser->reason == reason && pInterrupt->addr == addr){
+      pInterrupt->callback( pInterrupt->userPvt, pInterrupt->pasynUser, value, strlen( value ), ASYN_EOM_END );
+    }
+  }
+  pasynManager->interruptEnd( pPort->octetInterruptPvt );
+}
+
+/*
+ * Function: anc350ParamPostFloat64Array
+ *
+ * Parameters: pPort      - Pointer to the parameter port
+ *             addr       - Asyn address
+ *             reason     - Parameter index
+ *             value      - New array
+ *             nElements  - Number of elements
+ *             pTime      - Time the array was taken
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Calls the I/O Intr clients registered for the parameter.  The time is
+ * passed in the asynUser so that records with TSE -2 are stamped with it.
+ */
+static void anc350ParamPostFloat64Array( anc350ParamPort * pPort, int addr, int reason, epicsFloat64 * value,
+                                         size_t nElements, const epicsTimeStamp * pTime )
+{
+  ELLLIST * pclientList;
+  interruptNode * pnode;
+
+  pasynManager->interruptStart( pPort->float64ArrayInterruptPvt, &pclientList );
+  for (pnode = (interruptNode *) ellFirst( pclientList ); pnode != NULL; pnode = (interruptNode *) ellNext( &pnode->node )){
+    asynFloat64ArrayInterrupt * pInterrupt = (asynFloat64ArrayInterrupt *) pnode->drvPvt;
+    if (pInterrupt->pasynUser->reason == reason && pInterrupt->addr == addr){
+      pInterrupt->pasynUser->timestamp = *pTime;
+      pInterrupt->callback( pInterrupt->userPvt, pInterrupt->pasynUser, value, nElements );
+    }
+  }
+  pasynManager->interruptEnd( pPort->float64ArrayInterruptPvt );
+}
+
+/*
+ * Function: anc350ParamSetInteger
+ *
+ * Parameters: pDrv    - Pointer to driver structure, NULL for the crate port
+ *             addr    - Asyn address (0 controller, 1..nAxes axis)
+ *             reason  - Parameter index
+ *             value   - New value
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Stores an integer parameter and posts it to I/O Intr records if it
+ * has changed.  Does nothing if no parameter port has been configured.
+ */
+void anc350ParamSetInteger( ANC350DRV_ID pDrv, int addr, int reason, int value )
+{
+  anc350ParamPort * pPort = anc350ParamFindPort( pDrv );
+  anc350ParamValue * pValue = anc350ParamValueOf( pPort, addr, reason );
+  int changed;
+
+  if (pValue == NULL) return;
+  epicsMutexLock( pPort->lock );
+  changed = (pValue->ival != value);
+  pValue->ival = value;
+  epicsMutexUnlock( pPort->lock );
+  if (changed) anc350ParamPostInt32( pPort, addr, reason, value );
+}
+
+/*
+ * Function: anc350ParamSetDouble
+ *
+ * Parameters: pDrv    - Pointer to driver structure, NULL for the crate port
+ *             addr    - Asyn address (0 controller, 1..nAxes axis)
+ *             reason  - Parameter index
+ *             value   - New value
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Stores a double parameter and posts it to I/O Intr records if it
+ * has changed.  Does nothing if no parameter port has been configured.
+ */
+void anc350ParamSetDouble( ANC350DRV_ID pDrv, int addr, int reason, double value )
+{
+  anc350ParamPort * pPort = anc350ParamFindPort( pDrv );
+  anc350ParamValue * pValue = anc350ParamValueOf( pPort, addr, reason );
+  int changed;
+
+  if (pValue == NULL) return;
+  epicsMutexLock( pPort->lock );
+  changed = (pValue->dval != value);
+  pValue->dval = value;
+  epicsMutexUnlock( pPort->lock );
+  if (changed) anc350ParamPostFloat64( pPort, addr, reason, value );
+}
+
+/*
+ * Function: anc350ParamSetString
+ *
+ * Parameters: pDrv    - Pointer to driver structure, NULL for the crate port
+ *             addr    - Asyn address (0 controller, 1..nAxes axis)
+ *             reason  - Parameter index
+ *             value   - New string
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Stores a string parameter and posts it to I/O Intr records.
+ */
+void anc350ParamSetString( ANC350DRV_ID pDrv, int addr, int reason, const char * value )
+{
+  anc350ParamPort * pPort = anc350ParamFindPort( pDrv );
+  anc350ParamValue * pValue = anc350ParamValueOf( pPort, addr, reason );
+  char * copy;
+
+  if (pValue == NULL) return;
+  copy = epicsStrDup( value );
+  epicsMutexLock( pPort->lock );
+  free( pValue->sval );
+  pValue->sval = epicsStrDup( value );
+  epicsMutexUnlock( pPort->lock );
+  /* Post a private copy, the stored string may be replaced meanwhile */
+  anc350ParamPostOctet( pPort, addr, reason, copy );
+  free( copy );
+}
+
+/*
+ * Function: anc350ParamSetDoubleArray
+ *
+ * Parameters: pDrv       - Pointer to driver structure, NULL for the crate port
+ *             addr       - Asyn address (0 controller, 1..nAxes axis)
+ *             reason     - Parameter index
+ *             value      - New array
+ *             nElements  - Number of elements
+ *             pTime      - Time the array was taken
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Stores a copy of an array parameter and posts it to I/O Intr records.
+ */
+void anc350ParamSetDoubleArray( ANC350DRV_ID pDrv, int addr, int reason, const double * value, size_t nElements,
+                                const epicsTimeStamp * pTime )
+{
+  anc350ParamPort * pPort = anc350ParamFindPort( pDrv );
+  anc350ParamValue * pValue = anc350ParamValueOf( pPort, addr, reason );
+  epicsFloat64 * copy;
+
+  if (pValue == NULL || nElements == 0) return;
+  copy = mallocMustSucceed( nElements * sizeof( epicsFloat64 ), "anc350ParamSetDoubleArray" );
+  memcpy( copy, value, nElements * sizeof( epicsFloat64 ) );
+  epicsMutexLock( pPort->lock );
+  if (pValue->nElements != nElements){
+    free( pValue->aval );
+    pValue->aval = mallocMustSucceed( nElements * sizeof( epicsFloat64 ), "anc350ParamSetDoubleArray" );
+    pValue->nElements = nElements;
+  }
+  memcpy( pValue->aval, value, nElements * sizeof( epicsFloat64 ) );
+  pValue->timestamp = *pTime;
+  epicsMutexUnlock( pPort->lock );
+  /* Post a private copy, the stored array may be replaced meanwhile */
+  anc350ParamPostFloat64Array( pPort, addr, reason, copy, nElements, pTime );
+  free( copy );
+}
+
+/*
+ * Function: anc350ParamGetInteger
+ *
+ * Parameters: pDrv    - Pointer to driver structure, NULL for the crate port
+ *             addr    - Asyn address (0 controller, 1..nAxes axis)
+ *             reason  - Parameter index
+ *             value   - Pointer to store value
+ *
+ * Returns: 0 on success, -1 if there is no such parameter
+ */
+int anc350ParamGetInteger( ANC350DRV_ID pDrv, int addr, int reason, int * value )
+{
+  anc350ParamPort * pPort = anc350ParamFindPort( pDrv );
+  anc350ParamValue * pValue = anc350ParamValueOf( pPort, addr, reason );
+
+  if (pValue == NULL) return -1;
+  epicsMutexLock( pPort->lock );
+  *value = pValue->ival;
+  epicsMutexUnlock( pPort->lock );
+  return 0;
+}
+
+/*
+ * Function: anc350ParamGetDouble
+ *
+ * Parameters: pDrv    - Pointer to driver structure, NULL for the crate port
+ *             addr    - Asyn address (0 controller, 1..nAxes axis)
+ *             reason  - Parameter index
+ *             value   - Pointer to store value
+ *
+ * Returns: 0 on success, -1 if there is no such parameter
+ */
+int anc350ParamGetDouble( ANC350DRV_ID pDrv, int addr, int reason, double * value )
+{
+  anc350ParamPort * pPort = anc350ParamFindPort( pDrv );
+  anc350ParamValue * pValue = anc350ParamValueOf( pPort, addr, reason );
+
+  if (pValue == NULL) return -1;
+  epicsMutexLock( pPort->lock );
+  *value = pValue->dval;
+  epicsMutexUnlock( pPort->lock );
+  return 0;
+}
+
+/*
+ * Function: anc350ParamGetString
+ *
+ * Parameters: pDrv      - Pointer to driver structure, NULL for the crate port
+ *             addr      - Asyn address (0 controller, 1..nAxes axis)
+ *             reason    - Parameter index
+ *             value     - Buffer to copy the string into
+ *             maxChars  - Size of the buffer
+ *
+ * Returns: 0 on success, -1 if there is no such parameter
+ */
+int anc350ParamGetString( ANC350DRV_ID pDrv, int addr, int reason, char * value, size_t maxChars )
+{
+  anc350ParamPort * pPort = anc350ParamFindPort( pDrv );
+  anc350ParamValue * pValue = anc350ParamValueOf( pPort, addr, reason );
+
+  if (pValue == NULL || maxChars == 0) return -1;
+  epicsMutexLock( pPort->lock );
+  strncpy( value, (pValue->sval != NULL)? pValue->sval: "", maxChars - 1 );
+  value[maxChars - 1] = '\0';
+  epicsMutexUnlock( pPort->lock );
+  return 0;
+}
+
+/* asynCommon methods */
+static void paramReport( void * drvPvt, FILE * fp, int details )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+
+  if (pPort->pDrv == NULL){
+    fprintf( fp, "ANC350 crate parameter port %s\n", pPort->portName );
+  } else {
+    fprintf( fp, "ANC350 parameter port %s, card %d, %d axes\n", pPort->portName, pPort->pDrv->card, pPort->pDrv->nAxes );
+  }
+}
+
+static asynStatus paramConnect( void * drvPvt, asynUser * pasynUser )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+  int addr;
+
+  pasynManager->getAddr( pasynUser, &addr );
+  if (addr >= pPort->maxAddr){
+    epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize,
+                   "%s: address %d out of range", pPort->portName, addr );
+    return asynError;
+  }
+  pasynManager->exceptionConnect( pasynUser );
+  return asynSuccess;
+}
+
+static asynStatus paramDisconnect( void * drvPvt, asynUser * pasynUser )
+{
+  pasynManager->exceptionDisconnect( pasynUser );
+  return asynSuccess;
+}
+
+static asynCommon paramCommon = { paramReport, paramConnect, paramDisconnect };
+
+/* asynDrvUser methods */
+static asynStatus paramDrvUserCreate( void * drvPvt, asynUser * pasynUser, const char * drvInfo,
+                                      const char ** pptypeName, size_t * psize )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+  int addr;
+  int scope;
+  int i;
+
+  pasynManager->getAddr( pasynUser, &addr );
+  if (pPort->pDrv == NULL) scope = (addr == 0)? ANC350_SCOPE_CRATE: ANC350_SCOPE_GROUP;
+  else if (addr == 0) scope = ANC350_SCOPE_CONTROLLER;
+  else scope = ANC350_SCOPE_AXIS;
+
+  for (i = 0; i < ANC350_NUM_PARAMS; i++){
+    if (paramDefs[i].name != NULL && strcmp( paramDefs[i].name, drvInfo ) == 0){
+      if ((paramDefs[i].scope & scope) == 0){
+        epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize,
+                       "%s: %s is not available at address %d", pPort->portName, drvInfo, addr );
+        return asynError;
+      }
+      pasynUser->reason = i;
+      if (pptypeName) *pptypeName = paramDefs[i].name;
+      if (psize) *psize = sizeof( int );
+      return asynSuccess;
+    }
+  }
+  epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize,
+                 "%s: unknown parameter %s", pPort->portName, drvInfo );
+  return asynError;
+}
+
+static asynStatus paramDrvUserGetType( void * drvPvt, asynUser * pasynUser, const char ** pptypeName, size_t * psize )
+{
+  if (pasynUser->reason < 0 || pasynUser->reason >= ANC350_NUM_PARAMS) return asynError;
+  if (pptypeName) *pptypeName = paramDefs[pasynUser->reason].name;
+  if (psize) *psize = sizeof( int );
+  return asynSuccess;
+}
+
+static asynStatus paramDrvUserDestroy( void * drvPvt, asynUser * pasynUser )
+{
+  return asynSuccess;
+}
+
+static asynDrvUser paramDrvUser = { paramDrvUserCreate, paramDrvUserGetType, paramDrvUserDestroy };
+
+/* asynInt32 methods */
+static asynStatus paramWriteInt32( void * drvPvt, asynUser * pasynUser, epicsInt32 value )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+  anc350ParamValue * pValue;
+  int addr;
+
+  if ((pValue = anc350ParamCheck( pPort, pasynUser, ANC350_TYPE_INT32, &addr )) == NULL) return asynError;
+  epicsMutexLock( pPort->lock );
+  pValue->ival = value;
+  epicsMutexUnlock( pPort->lock );
+  return anc350ParamWriteHook( pPort, addr, pasynUser->reason );
+}
+
+static asynStatus paramReadInt32( void * drvPvt, asynUser * pasynUser, epicsInt32 * value )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+  anc350ParamValue * pValue;
+  int addr;
+
+  if ((pValue = anc350ParamCheck( pPort, pasynUser, ANC350_TYPE_INT32, &addr )) == NULL) return asynError;
+  epicsMutexLock( pPort->lock );
+  *value = pValue->ival;
+  epicsMutexUnlock( pPort->lock );
+  return asynSuccess;
+}
+
+static asynInt32 paramInt32 = { paramWriteInt32, paramReadInt32 };
+
+/* asynFloat64 methods */
+static asynStatus paramWriteFloat64( void * drvPvt, asynUser * pasynUser, epicsFloat64 value )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+  anc350ParamValue * pValue;
+  int addr;
+
+  if ((pValue = anc350ParamCheck( pPort, pasynUser, ANC350_TYPE_FLOAT64, &addr )) == NULL) return asynError;
+  epicsMutexLock( pPort->lock );
+  pValue->dval = value;
+  epicsMutexUnlock( pPort->lock );
+  return anc350ParamWriteHook( pPort, addr, pasynUser->reason );
+}
+
+static asynStatus paramReadFloat64( void * drvPvt, asynUser * pasynUser, epicsFloat64 * value )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+  anc350ParamValue * pValue;
+  int addr;
+
+  if ((pValue = anc350ParamCheck( pPort, pasynUser, ANC350_TYPE_FLOAT64, &addr )) == NULL) return asynError;
+  epicsMutexLock( pPort->lock );
+  *value = pValue->dval;
+  epicsMutexUnlock( pPort->lock );
+  return asynSuccess;
+}
+
+static asynFloat64 paramFloat64 = { paramWriteFloat64, paramReadFloat64 };
+
+/* asynOctet methods */
+static asynStatus paramWriteOctet( void * drvPvt, asynUser * pasynUser, const char * data, size_t numchars,
+                                   size_t * nbytesTransfered )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+  anc350ParamValue * pValue;
+  char * copy;
+  int addr;
+
+  if ((pValue = anc350ParamCheck( pPort, pasynUser, ANC350_TYPE_OCTET, &addr )) == NULL) return asynError;
+  copy = mallocMustSucceed( numchars + 1, "anc350ParamPort" );
+  memcpy( copy, data, numchars );
+  copy[numchars] = '\0';
+  epicsMutexLock( pPort->lock );
+  free( pValue->sval );
+  pValue->sval = copy;
+  epicsMutexUnlock( pPort->lock );
+  *nbytesTransfered = numchars;
+  return anc350ParamWriteHook( pPort, addr, pasynUser->reason );
+}
+
+static asynStatus paramReadOctet( void * drvPvt, asynUser * pasynUser, char * data, size_t maxchars,
+                                  size_t * nbytesTransfered, int * eomReason )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+  anc350ParamValue * pValue;
+  size_t len = 0;
+  int addr;
+
+  if ((pValue = anc350ParamCheck( pPort, pasynUser, ANC350_TYPE_OCTET, &addr )) == NULL) return asynError;
+  if (maxchars == 0) return asynError;
+  epicsMutexLock( pPort->lock );
+  if (pValue->sval != NULL){
+    len = strlen( pValue->sval );
+    if (len > maxchars - 1) len = maxchars - 1;
+    memcpy( data, pValue->sval, len );
+  }
+  epicsMutexUnlock( pPort->lock );
+  data[len] = '\0';
+  *nbytesTransfered = len;
+  if (eomReason) *eomReason = ASYN_EOM_END;
+  return asynSuccess;
+}
+
+static asynStatus paramFlushOctet( void * drvPvt, asynUser * pasynUser )
+{
+  return asynSuccess;
+}
+
+static asynOctet paramOctet = { paramWriteOctet, paramReadOctet, paramFlushOctet };
+
+/* asynFloat64Array methods */
+static asynStatus paramWriteFloat64Array( void * drvPvt, asynUser * pasynUser, epicsFloat64 * value, size_t nElements )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+
+  epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize,
+                 "%s: array parameters are read only", pPort->portName );
+  return asynError;
+}
+
+static asynStatus paramReadFloat64Array( void * drvPvt, asynUser * pasynUser, epicsFloat64 * value, size_t nElements,
+                                         size_t * nIn )
+{
+  anc350ParamPort * pPort = (anc350ParamPort *) drvPvt;
+  anc350ParamValue * pValue;
+  int addr;
+
+  if ((pValue = anc350ParamCheck( pPort, pasynUser, ANC350_TYPE_FLOAT64_ARRAY, &addr )) == NULL) return asynError;
+  epicsMutexLock( pPort->lock );
+  *nIn = (pValue->nElements < nElements)? pValue->nElements: nElements;
+  if (*nIn > 0) memcpy( value, pValue->aval, *nIn * sizeof( epicsFloat64 ) );
+  pasynUser->timestamp = pValue->timestamp;
+  epicsMutexUnlock( pPort->lock );
+  return asynSuccess;
+}
+
+static asynFloat64Array paramFloat64Array = { paramWriteFloat64Array, paramReadFloat64Array };
+
+/*
+ * Function: anc350ParamPortConfigure
+ *
+ * Parameters: portName  - Name of the asyn port to create
+ *             card      - Number representing the motor controller, -1 for the crate port
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Creates the parameter port of a controller created previously with
+ * anc350AsynMotorCreate, or the crate port if card is -1.
+ */
+int anc350ParamPortConfigure( const char * portName, int card )
+{
+  anc350ParamPort * pPort;
+  ANC350DRV_ID pDrv = NULL;
+  asynStatus status;
+
+  if (card >= 0){
+    if ((pDrv = drvAnc350FindCard( card )) == NULL){
+      printf( "anc350ParamPortConfigure: card %d has not been created\n", card );
+      return MOTOR_AXIS_ERROR;
+    }
+    if (pDrv->pParamPort != NULL){
+      printf( "anc350ParamPortConfigure: card %d already has a parameter port\n", card );
+      return MOTOR_AXIS_ERROR;
+    }
+  } else if (pCratePort != NULL){
+    printf( "anc350ParamPortConfigure: the crate port already exists\n" );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  pPort = callocMustSucceed( 1, sizeof( anc350ParamPort ), "anc350ParamPortConfigure" );
+  pPort->portName = epicsStrDup( portName );
+  pPort->pDrv = pDrv;
+  pPort->maxAddr = (pDrv == NULL)? ANC350_MAX_SYNC_GROUPS + 1: pDrv->nAxes + 1;
+  pPort->lock = epicsMutexMustCreate();
+  pPort->values = callocMustSucceed( pPort->maxAddr * ANC350_NUM_PARAMS, sizeof( anc350ParamValue ),
+                                     "anc350ParamPortConfigure" );
+
+  status = pasynManager->registerPort( portName, ASYN_MULTIDEVICE | ASYN_CANBLOCK, 1, 0, 0 );
+  if (status != asynSuccess){
+    printf( "anc350ParamPortConfigure: registerPort %s failed\n", portName );
+    goto fail;
+  }
+
+  pPort->common.interfaceType = asynCommonType;
+  pPort->common.pinterface = &paramCommon;
+  pPort->common.drvPvt = pPort;
+  pPort->drvUser.interfaceType = asynDrvUserType;
+  pPort->drvUser.pinterface = &paramDrvUser;
+  pPort->drvUser.drvPvt = pPort;
+  pPort->int32.interfaceType = asynInt32Type;
+  pPort->int32.pinterface = &paramInt32;
+  pPort->int32.drvPvt = pPort;
+  pPort->float64.interfaceType = asynFloat64Type;
+  pPort->float64.pinterface = &paramFloat64;
+  pPort->float64.drvPvt = pPort;
+  pPort->octet.interfaceType = asynOctetType;
+  pPort->octet.pinterface = &paramOctet;
+  pPort->octet.drvPvt = pPort;
+  pPort->float64Array.interfaceType = asynFloat64ArrayType;
+  pPort->float64Array.pinterface = &paramFloat64Array;
+  pPort->float64Array.drvPvt = pPort;
+
+  if (pasynManager->registerInterface( portName, &pPort->common ) != asynSuccess ||
+      pasynManager->registerInterface( portName, &pPort->drvUser ) != asynSuccess ||
+      pasynInt32Base->initialize( portName, &pPort->int32 ) != asynSuccess ||
+      pasynManager->registerInterruptSource( portName, &pPort->int32, &pPort->int32InterruptPvt ) != asynSuccess ||
+      pasynFloat64Base->initialize( portName, &pPort->float64 ) != asynSuccess ||
+      pasynManager->registerInterruptSource( portName, &pPort->float64, &pPort->float64InterruptPvt ) != asynSuccess ||
+      pasynOctetBase->initialize( portName, &pPort->octet, 0, 0, 0 ) != asynSuccess ||
+      pasynManager->registerInterruptSource( portName, &pPort->octet, &pPort->octetInterruptPvt ) != asynSuccess ||
+      pasynFloat64ArrayBase->initialize( portName, &pPort->float64Array ) != asynSuccess ||
+      pasynManager->registerInterruptSource( portName, &pPort->float64Array, &pPort->float64ArrayInterruptPvt ) != asynSuccess){
+    printf( "anc350ParamPortConfigure: cannot register the interfaces of %s\n", portName );
+    goto fail;
+  }
+
+  if (pDrv == NULL) pCratePort = pPort;
+  else pDrv->pParamPort = pPort;
+
+  /* Publish the settings the driver starts with */
+  if (pDrv != NULL){
+    anc350HoldParamInit( pDrv );
+    anc350TriggerParamInit( pDrv );
+    anc350EstimateParamInit( pDrv );
+    anc350StatsParamInit( pDrv );
+    anc350IdleParamInit( pDrv );
+    anc350BankParamInit( pDrv );
+    anc350InhibitParamInit( pDrv );
+    anc350TuneParamInit( pDrv );
+  }
+  return MOTOR_AXIS_OK;
+
+ fail:
+  free( pPort->values );
+  epicsMutexDestroy( pPort->lock );
+  free( pPort->portName );
+  free( pPort );
+  return MOTOR_AXIS_ERROR;
+}
@@ -0,0 +1,622 @@
+/*
+ * File:   anc350PollSim.c
+ *
+ * Description:
+ *
+ * Offline poll strategy simulator.  Replays a recorded session of moves,
+ * written by anc350TraceSession or by hand, through alternative polling
+ * and caching strategies and reports for each the telegrams per second it
+ * costs, how long after an axis stopped its Done was published, and how
+ * stale the position readback of a moving axis was.  The poll periods can
+ * then be tuned against the traffic of a beamline before they are
+ * deployed.
+ *
+ *   anc350PollSim [-m movingPeriod] [-i idlePeriod] [-s strategy] session
+ *
+ * A session has one event per line, "seconds axis start|stop", in any
+ * order; "#" starts a comment and anything after the event is ignored,
+ * except a time after "stop".  A recorded stop is the first poll that saw
+ * the axis stopped, later than the real stop by up to a poll period, and
+ * taking it as the stop biases every Done latency low.  anc350TraceSession
+ * therefore writes the last poll that still saw the axis running after the
+ * stop, and the replay draws the stop uniformly between the two (the same
+ * draws for every strategy).  Stops without that time are taken as they
+ * are, and the report says how many there were.
+ *
+ * The strategies are:
+ *
+ *   fixed     The poller of anc350AsynMotor.c without move estimates.  It
+ *             ticks at the moving period, reads busy axes on every tick
+ *             and idle axes at the idle period, and a command forces a
+ *             tick that reads every axis.
+ *   deadline  As fixed, with the tick brought forward to the predicted
+ *             arrival of a move as anc350Estimate.c does.  Predictions
+ *             are the mean duration of the earlier moves of the axis, the
+ *             session does not record distances.
+ *   event     Every axis on its own schedule.  A command starts polling
+ *             that axis at the moving period until it is done, idle axes
+ *             are read at the idle period, nothing else is read.
+ *   change    As event, reading only the registers that can change.  An
+ *             idle axis costs the status register, a busy axis the status
+ *             and counter, and amplitude and reference counter are read
+ *             only when the status changed.
+ *
+ * The telegrams of the commands themselves are the same for every strategy
+ * and are not counted.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_MAX_AXES        64
+#define SIM_MAX_LINE        256
+
+/* Telegrams of a full axis read, see drvAnc350GetAxisStatus */
+#define SIM_TELEGRAMS_AXIS  4
+#define SIM_TELEGRAMS_GLOBAL 1
+
+/* Poll brought forward past the predicted arrival, as ESTIMATE_MARGIN */
+#define SIM_ESTIMATE_MARGIN 0.005
+
+/* Times closer than this are the same time */
+#define SIM_RESOLUTION      1.0e-6
+
+#define SIM_FIXED     0
+#define SIM_DEADLINE  1
+#define SIM_EVENT     2
+#define SIM_CHANGE    3
+#define SIM_STRATEGIES 4
+
+static const char * strategyNames[SIM_STRATEGIES] = { "fixed", "deadline", "event", "change" };
+
+typedef struct simEvent
+{
+  double time;
+  double after;         /* Stop: last time seen running, -1 if unknown */
+  int axis;
+  int stop;
+  int line;
+} simEvent;
+
+typedef struct simMove
+{
+  double start;
+  double stop;
+} simMove;
+
+/* Replay state of one axis */
+typedef struct simAxis
+{
+  simMove * moves;
+  int nMoves;
+  int nextCommand;      /* Next move to command */
+  int cursor;           /* First move that has not stopped, for simRunning */
+  int current;          /* Move the driver waits for */
+  int busy;             /* Commanded and Done not yet seen */
+  double cmdTime;
+  double windowStart;   /* Start of the busy window, for staleness */
+  double lastRead;      /* Last read of the counter */
+  double skip;          /* Idle poll countdown of fixed and deadline */
+  double nextPoll;      /* Next read of event and change */
+  int cachedRunning;    /* Last status read, for change */
+  double estSum;
+  int estN;
+} simAxis;
+
+/* Results of one strategy */
+typedef struct simResult
+{
+  double telegrams;
+  double polls;
+  double * latency;
+  int nLatency;
+  int merged;           /* Moves whose Done was overtaken by the next command */
+  double staleSum;      /* Integral of the readback age over busy windows */
+  double staleTime;     /* Total length of the busy windows */
+  double staleMax;
+} simResult;
+
+typedef struct simSession
+{
+  simAxis axis[SIM_MAX_AXES];
+  int nAxes;
+  int nMoves;
+  int nUnbounded;       /* Stops taken at the poll that saw them */
+  double end;
+} simSession;
+
+/*
+ * Function: simCompareEvents
+ *
+ * Description:
+ *
+ * Orders events by time, stops before starts at the same time and then
+ * by line, so a session need not be sorted.
+ */
+static int simCompareEvents( const void * a, const void * b )
+{
+  const simEvent * ea = (const simEvent *) a;
+  const simEvent * eb = (const simEvent *) b;
+
+  if (ea->time != eb->time) return (ea->time < eb->time)? -1: 1;
+  if (ea->stop != eb->stop) return eb->stop - ea->stop;
+  return ea->line - eb->line;
+}
+
+static int simCompareDoubles( const void * a, const void * b )
+{
+  double da = *(const double *) a;
+  double db = *(const double *) b;
+
+  return (da < db)? -1: (da > db)? 1: 0;
+}
+
+/*
+ * Function: simLoad
+ *
+ * Parameters: filename  - Session file
+ *             pSession  - Session to fill in
+ *
+ * Returns: 0 on success, -1 on error
+ *
+ * Description:
+ *
+ * Reads the events and pairs each start with the next stop of the axis.
+ * A start without a stop, or a stop without a start, is reported and
+ * dropped.  A stop with the time the axis was last seen running is drawn
+ * between that time and the stop.
+ */
+static int simLoad( const char * filename, simSession * pSession )
+{
+  FILE * fp;
+  simEvent * events = NULL;
+  int nEvents = 0;
+  int maxEvents = 0;
+  int open[SIM_MAX_AXES];
+  char line[SIM_MAX_LINE];
+  int lineNo = 0;
+  int i;
+
+  if ((fp = fopen( filename, "r" )) == NULL){
+    fprintf( stderr, "anc350PollSim: cannot open %s\n", filename );
+    return -1;
+  }
+  while (fgets( line, sizeof( line ), fp ) != NULL){
+    simEvent event;
+    char what[16];
+    char * hash;
+
+    lineNo++;
+    if ((hash = strchr( line, '#' )) != NULL) *hash = '\0';
+    event.after = -1.0;
+    if (sscanf( line, "%lf %d %15s %lf", &event.time, &event.axis, what, &event.after ) < 3) continue;
+    if (event.axis < 1 || event.axis > SIM_MAX_AXES){
+      fprintf( stderr, "anc350PollSim: %s:%d: axis %d out of range\n", filename, lineNo, event.axis );
+      continue;
+    }
+    if (strcmp( what, "start" ) == 0){
+      event.stop = 0;
+      event.after = -1.0;
+    }
+    else if (strcmp( what, "stop" ) == 0) event.stop = 1;
+    else {
+      fprintf( stderr, "anc350PollSim: %s:%d: unknown event %s\n", filename, lineNo, what );
+      continue;
+    }
+    event.line = lineNo;
+
+    if (nEvents == maxEvents){
+      maxEvents = (maxEvents == 0)? 1024: 2 * maxEvents;
+      if ((events = realloc( events, maxEvents * sizeof( simEvent ) )) == NULL){
+        fprintf( stderr, "anc350PollSim: out of memory\n" );
+        fclose( fp );
+        return -1;
+      }
+    }
+    events[nEvents++] = event;
+  }
+  fclose( fp );
+
+  qsort( events, nEvents, sizeof( simEvent ), simCompareEvents );
+  memset( pSession, 0, sizeof( *pSession ) );
+  for (i = 0; i < SIM_MAX_AXES; i++) open[i] = -1;
+  srand( 1 );
+
+  for (i = 0; i < nEvents; i++){
+    int a = events[i].axis - 1;
+    simAxis * pAxis = &pSession->axis[a];
+
+    if (!events[i].stop){
+      if (open[a] >= 0){
+        fprintf( stderr, "anc350PollSim: line %d: axis %d started again before it stopped, earlier start dropped\n",
+                 events[i].line, a + 1 );
+      }
+      open[a] = i;
+      continue;
+    }
+    if (open[a] < 0){
+      fprintf( stderr, "anc350PollSim: line %d: axis %d stopped without a start, dropped\n", events[i].line, a + 1 );
+      continue;
+    }
+    if ((pAxis->moves = realloc( pAxis->moves, (pAxis->nMoves + 1) * sizeof( simMove ) )) == NULL){
+      fprintf( stderr, "anc350PollSim: out of memory\n" );
+      free( events );
+      return -1;
+    }
+    pAxis->moves[pAxis->nMoves].start = events[open[a]].time;
+    pAxis->moves[pAxis->nMoves].stop = events[i].time;
+    if (events[i].after >= 0.0 && events[i].after <= events[i].time){
+      double after = (events[i].after > events[open[a]].time)? events[i].after: events[open[a]].time;
+
+      pAxis->moves[pAxis->nMoves].stop = after + (events[i].time - after) * rand() / ((double) RAND_MAX + 1.0);
+    } else {
+      pSession->nUnbounded++;
+    }
+    pAxis->nMoves++;
+    pSession->nMoves++;
+    open[a] = -1;
+    if (a + 1 > pSession->nAxes) pSession->nAxes = a + 1;
+    if (events[i].time > pSession->end) pSession->end = events[i].time;
+  }
+  for (i = 0; i < SIM_MAX_AXES; i++){
+    if (open[i] >= 0) fprintf( stderr, "anc350PollSim: axis %d never stopped, last start dropped\n", i + 1 );
+  }
+
+  free( events );
+  return 0;
+}
+
+/*
+ * Function: simRunning
+ *
+ * Parameters: pAxis  - Axis
+ *             t      - Time of the read, not before the previous one
+ *
+ * Returns: Non-zero if the axis runs at t
+ */
+static int simRunning( simAxis * pAxis, double t )
+{
+  while (pAxis->cursor < pAxis->nMoves && pAxis->moves[pAxis->cursor].stop <= t + SIM_RESOLUTION) pAxis->cursor++;
+  return pAxis->cursor < pAxis->nMoves && pAxis->moves[pAxis->cursor].start <= t;
+}
+
+/*
+ * Function: simCommand
+ *
+ * Parameters: pAxis    - Axis
+ *             pResult  - Results of the strategy
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Issues the next move of the axis.  A move still waiting for its Done is
+ * overtaken, as a new command to a busy axis is in the driver.
+ */
+static void simCommand( simAxis * pAxis, simResult * pResult )
+{
+  if (pAxis->busy) pResult->merged++;
+  else pAxis->windowStart = pAxis->moves[pAxis->nextCommand].start;
+  pAxis->current = pAxis->nextCommand++;
+  pAxis->cmdTime = pAxis->moves[pAxis->current].start;
+  pAxis->busy = 1;
+}
+
+/*
+ * Function: simRead
+ *
+ * Parameters: pAxis      - Axis
+ *             t          - Time of the read
+ *             telegrams  - Telegrams the read costs
+ *             counter    - Non-zero if the read includes the counter
+ *             pResult    - Results of the strategy
+ *
+ * Returns: Running state read
+ *
+ * Description:
+ *
+ * Reads an axis, accounting the age the counter readback had reached and
+ * publishing Done if the axis was busy and has stopped.
+ */
+static int simRead( simAxis * pAxis, double t, int telegrams, int counter, simResult * pResult )
+{
+  int running = simRunning( pAxis, t );
+
+  pResult->telegrams += telegrams;
+  if (counter){
+    if (pAxis->busy){
+      double ref = (pAxis->lastRead > pAxis->windowStart)? pAxis->lastRead: pAxis->windowStart;
+
+      pResult->staleSum += (t - ref) * (t - ref) / 2.0;
+      if (t - ref > pResult->staleMax) pResult->staleMax = t - ref;
+    }
+    pAxis->lastRead = t;
+  }
+
+  if (pAxis->busy && !running){
+    simMove * pMove = &pAxis->moves[pAxis->current];
+
+    pResult->latency[pResult->nLatency++] = t - pMove->stop;
+    pResult->staleTime += t - pAxis->windowStart;
+    pAxis->estSum += t - pAxis->cmdTime;
+    pAxis->estN++;
+    pAxis->busy = 0;
+  }
+  return running;
+}
+
+/*
+ * Function: simNextCommand
+ *
+ * Returns: Time of the next command of any axis, -1 when there is none
+ */
+static double simNextCommand( simSession * pSession, int * pAxisIndex )
+{
+  double t = -1.0;
+  int i;
+
+  for (i = 0; i < pSession->nAxes; i++){
+    simAxis * pAxis = &pSession->axis[i];
+
+    if (pAxis->nextCommand >= pAxis->nMoves) continue;
+    if (t < 0.0 || pAxis->moves[pAxis->nextCommand].start < t){
+      t = pAxis->moves[pAxis->nextCommand].start;
+      *pAxisIndex = i;
+    }
+  }
+  return t;
+}
+
+/*
+ * Function: simTicked
+ *
+ * Parameters: pSession  - Session
+ *             strategy  - SIM_FIXED or SIM_DEADLINE
+ *             moving    - Moving poll period (seconds)
+ *             idle      - Idle poll period (seconds)
+ *             pResult   - Results to fill in
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Replays the session through the poller of anc350AsynMotor.c,
+ * drvAnc350Task and drvAnc350Poll.
+ */
+static void simTicked( simSession * pSession, int strategy, double moving, double idle, simResult * pResult )
+{
+  double factor = moving / idle;
+  double skipGlobal = 0.0;
+  double t = 0.0;
+  double tick = 0.0;
+  int forced = 0;
+  int busy = 0;
+  int i;
+
+  for (;;){
+    double timeout = moving;
+    double command;
+    int a = 0;
+
+    /* drvAnc350Poll */
+    if (skipGlobal <= 0.0){
+      pResult->telegrams += SIM_TELEGRAMS_GLOBAL;
+      skipGlobal = 1.0;
+    }
+    skipGlobal -= factor;
+    busy = 0;
+    for (i = 0; i < pSession->nAxes; i++){
+      simAxis * pAxis = &pSession->axis[i];
+
+      if (forced || pAxis->busy || pAxis->skip <= 0.0){
+        pResult->polls++;
+        simRead( pAxis, t, SIM_TELEGRAMS_AXIS, 1, pResult );
+        pAxis->skip = 1.0;
+      }
+      pAxis->skip -= factor;
+      busy |= pAxis->busy;
+    }
+
+    /* drvAnc350EstimateWait */
+    if (strategy == SIM_DEADLINE){
+      for (i = 0; i < pSession->nAxes; i++){
+        simAxis * pAxis = &pSession->axis[i];
+        double arrival;
+
+        if (!pAxis->busy || pAxis->estN == 0) continue;
+        arrival = pAxis->estSum / pAxis->estN + SIM_ESTIMATE_MARGIN - (t - pAxis->cmdTime);
+        /* Past the arrival the poll that woke for it has been made */
+        if (arrival > SIM_RESOLUTION && arrival < timeout) timeout = arrival;
+      }
+    }
+    tick = t + timeout;
+
+    /* A command signals the poller */
+    command = simNextCommand( pSession, &a );
+    if (command < 0.0 && !busy && t > pSession->end) break;
+    if (command >= 0.0 && command <= tick){
+      t = command;
+      while ((command = simNextCommand( pSession, &a )) >= 0.0 && command <= t){
+        simCommand( &pSession->axis[a], pResult );
+      }
+      forced = 1;
+    } else {
+      t = tick;
+      forced = 0;
+    }
+  }
+}
+
+/*
+ * Function: simScheduled
+ *
+ * Parameters: pSession  - Session
+ *             strategy  - SIM_EVENT or SIM_CHANGE
+ *             moving    - Moving poll period (seconds)
+ *             idle      - Idle poll period (seconds)
+ *             pResult   - Results to fill in
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Replays the session with every axis polled on its own schedule.
+ */
+static void simScheduled( simSession * pSession, int strategy, double moving, double idle, simResult * pResult )
+{
+  double nextGlobal = 0.0;
+  int i;
+
+  for (i = 0; i < pSession->nAxes; i++) pSession->axis[i].nextPoll = 0.0;
+
+  for (;;){
+    double t = nextGlobal;
+    double command;
+    int busy = 0;
+    int a = 0;
+
+    for (i = 0; i < pSession->nAxes; i++){
+      if (pSession->axis[i].nextPoll < t) t = pSession->axis[i].nextPoll;
+      busy |= pSession->axis[i].busy;
+    }
+    command = simNextCommand( pSession, &a );
+    if (command < 0.0 && !busy && t > pSession->end) break;
+
+    if (command >= 0.0 && command <= t){
+      simAxis * pAxis = &pSession->axis[a];
+
+      simCommand( pAxis, pResult );
+      pAxis->nextPoll = command + moving;
+      continue;
+    }
+
+    if (t == nextGlobal){
+      pResult->telegrams += SIM_TELEGRAMS_GLOBAL;
+      nextGlobal = t + idle;
+    }
+    for (i = 0; i < pSession->nAxes; i++){
+      simAxis * pAxis = &pSession->axis[i];
+      int wasBusy = pAxis->busy;
+      int running;
+
+      if (pAxis->nextPoll != t) continue;
+      pResult->polls++;
+      if (strategy == SIM_EVENT){
+        simRead( pAxis, t, SIM_TELEGRAMS_AXIS, 1, pResult );
+      } else {
+        /* Status first, the counter only while busy, the rest on a change */
+        running = simRead( pAxis, t, wasBusy? 2: 1, wasBusy, pResult );
+        if (running != pAxis->cachedRunning || pAxis->busy != wasBusy){
+          pResult->telegrams += wasBusy? SIM_TELEGRAMS_AXIS - 2: SIM_TELEGRAMS_AXIS - 1;
+        }
+        pAxis->cachedRunning = running;
+      }
+      pAxis->nextPoll = t + (pAxis->busy? moving: idle);
+    }
+  }
+}
+
+/*
+ * Function: simReport
+ *
+ * Parameters: strategy  - Strategy replayed
+ *             duration  - Length of the session (seconds)
+ *             pResult   - Results of the strategy
+ *
+ * Returns: void
+ */
+static void simReport( int strategy, double duration, simResult * pResult )
+{
+  double sum = 0.0;
+  int n = pResult->nLatency;
+  int i;
+
+  qsort( pResult->latency, n, sizeof( double ), simCompareDoubles );
+  for (i = 0; i < n; i++) sum += pResult->latency[i];
+
+  printf( "%-9s %11.2f %9.2f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %6d\n",
+          strategyNames[strategy],
+          (duration > 0.0)? pResult->telegrams / duration: 0.0,
+          (duration > 0.0)? pResult->polls / duration: 0.0,
+          (n > 0)? 1000.0 * sum / n: 0.0,
+          (n > 0)? 1000.0 * pResult->latency[(int) (0.50 * (n - 1) + 0.5)]: 0.0,
+          (n > 0)? 1000.0 * pResult->latency[(int) (0.95 * (n - 1) + 0.5)]: 0.0,
+          (n > 0)? 1000.0 * pResult->latency[n - 1]: 0.0,
+          (pResult->staleTime > 0.0)? 1000.0 * pResult->staleSum / pResult->staleTime: 0.0,
+          1000.0 * pResult->staleMax,
+          pResult->merged );
+}
+
+static void simUsage( void )
+{
+  fprintf( stderr, "usage: anc350PollSim [-m movingPeriod] [-i idlePeriod] [-s fixed|deadline|event|change] session\n" );
+}
+
+int main( int argc, char * argv[] )
+{
+  simSession session;
+  double moving = 0.5;
+  double idle = 1.0;
+  const char * filename = NULL;
+  int only = -1;
+  int strategy;
+  int i;
+
+  for (i = 1; i < argc; i++){
+    if (strcmp( argv[i], "-m" ) == 0 && i + 1 < argc) moving = atof( argv[++i] );
+    else if (strcmp( argv[i], "-i" ) == 0 && i + 1 < argc) idle = atof( argv[++i] );
+    else if (strcmp( argv[i], "-s" ) == 0 && i + 1 < argc){
+      i++;
+      for (only = 0; only < SIM_STRATEGIES && strcmp( argv[i], strategyNames[only] ) != 0; only++);
+      if (only == SIM_STRATEGIES){
+        simUsage();
+        return 1;
+      }
+    }
+    else if (argv[i][0] != '-' && filename == NULL) filename = argv[i];
+    else {
+      simUsage();
+      return 1;
+    }
+  }
+  if (filename == NULL || moving <= 0.0 || idle < moving){
+    simUsage();
+    return 1;
+  }
+
+  if (simLoad( filename, &session ) != 0) return 1;
+  printf( "%d moves on %d axes over %.1f s, moving period %.3f s, idle period %.3f s\n",
+          session.nMoves, session.nAxes, session.end, moving, idle );
+  if (session.nUnbounded > 0){
+    printf( "%d stops have no last running time and are taken at the poll that saw them, their Done latencies read low\n",
+            session.nUnbounded );
+  }
+  printf( "%-9s %11s %9s %9s %9s %9s %9s %9s %9s %6s\n", "strategy", "telegrams/s", "reads/s",
+          "done ms", "p50", "p95", "max", "stale ms", "max", "merged" );
+
+  for (strategy = 0; strategy < SIM_STRATEGIES; strategy++){
+    simResult result;
+
+    if (only >= 0 && strategy != only) continue;
+    memset( &result, 0, sizeof( result ) );
+    result.latency = calloc( session.nMoves + 1, sizeof( double ) );
+    for (i = 0; i < session.nAxes; i++){
+      simAxis * pAxis = &session.axis[i];
+      simMove * moves = pAxis->moves;
+      int nMoves = pAxis->nMoves;
+
+      memset( pAxis, 0, sizeof( *pAxis ) );
+      pAxis->moves = moves;
+      pAxis->nMoves = nMoves;
+    }
+
+    if (strategy == SIM_FIXED || strategy == SIM_DEADLINE) simTicked( &session, strategy, moving, idle, &result );
+    else simScheduled( &session, strategy, moving, idle, &result );
+    simReport( strategy, session.end, &result );
+    free( result.latency );
+  }
+
+  for (i = 0; i < session.nAxes; i++) free( session.axis[i].moves );
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * File:   anc350Registers.c
+ *
+ * Description:
+ *
+ * Table of the readable ANC350 registers, used by the driver features that
+ * walk the whole controller configuration (snapshots and diffs).  The APS
+ * parameters use the names of the attocube *.aps files so that snapshot
+ * files can be compared with the vendor parameter files.
+ */
+#include <stddef.h>
+#include <string.h>
+
+#include "anc350.h"
+#include "drvAnc350.h"
+
+const anc350Register anc350Registers[] =
+{
+  /* Axis status and position */
+  { "status",                 ID_ANC_STATUS,        ANC350_REG_AXIS },
+  { "counter",                ID_ANC_COUNTER,       ANC350_REG_AXIS },
+  { "refcounter",             ID_ANC_REFCOUNTER,    ANC350_REG_AXIS },
+  { "target",                 ID_ANC_TARGET,        ANC350_REG_AXIS },
+  { "leftlimit",              ID_ANC_LEFT_LIMIT,    ANC350_REG_AXIS },
+  { "rightlimit",             ID_ANC_RIGHT_LIMIT,   ANC350_REG_AXIS },
+
+  /* Positioning parameters */
+  { "amplitude",              ID_ANC_AMPL,          ANC350_REG_AXIS },
+  { "frequency",              ID_ANC_FAST_FREQ,     ANC350_REG_AXIS },
+  { "dclevel",                ID_ANC_ACT_AMPL,      ANC350_REG_AXIS },
+  { "speed",                  ID_ANC_REGSPD_SETP,   ANC350_REG_AXIS },
+  { "stepwidth",              ID_ANC_REGSPD_SETPS,  ANC350_REG_AXIS },
+  { "relais",                 ID_ANC_RELAIS,        ANC350_REG_AXIS },
+  { "capacity",               ID_ANC_CAP_VALUE,     ANC350_REG_AXIS },
+
+  /* Scanner and dither module */
+  { "bwlimit",                ID_ANC_BW_LIMIT,      ANC350_REG_AXIS },
+  { "dcin",                   ID_ANC_DCIN_EN,       ANC350_REG_AXIS },
+  { "intenable",              ID_ANC_INT_EN,        ANC350_REG_AXIS },
+  { "acin",                   ID_ANC_ACIN_EN,       ANC350_REG_AXIS },
+
+  /* Actor specific (APS) parameters */
+  { "poslooprange",           ID_ANC_DIST_SLOW,     ANC350_REG_AXIS },
+  { "speedgain",              ID_ANC_SPD_GAIN,      ANC350_REG_AXIS },
+  { "adaptsetpctrl",          ID_ANC_SPD_ENABLE,    ANC350_REG_AXIS },
+  { "actoroffset",            ID_ANC_LOOP_OFFS,     ANC350_REG_AXIS },
+  { "actorgain",              ID_ANC_LOOP_GAIN,     ANC350_REG_AXIS },
+  { "maxampl",                ID_ANC_MAX_AMP,       ANC350_REG_AXIS },
+  { "sensordir",              ID_ANC_SEN_DIR,       ANC350_REG_AXIS },
+  { "period",                 ID_ANC_PERIOD,        ANC350_REG_AXIS },
+  { "amplctrlavg",            ID_ANC_REGSPD_AVG,    ANC350_REG_AXIS },
+  { "targetctrlavg",          ID_ANC_REGPOS_AVG,    ANC350_REG_AXIS },
+  { "amplctrlsensitivity",    ID_ANC_REGSPD_KI,     ANC350_REG_AXIS },
+  { "targetctrlsensitivity",  ID_ANC_REGPOS_KP,     ANC350_REG_AXIS },
+  { "slowspeed",              ID_ANC_SLOW_SPEED,    ANC350_REG_AXIS },
+  { "actordir",               ID_ANC_ACTOR_DIR,     ANC350_REG_AXIS },
+  { "transfertype",           ID_ANC_SCALE_MODE,    ANC350_REG_AXIS },
+  { "positionmin",            ID_ANC_RES_ANGLEMIN,  ANC350_REG_AXIS },
+  { "positionmax",            ID_ANC_RES_ANGLEMAX,  ANC350_REG_AXIS },
+  { "transfergain",           ID_ANC_SENSOR_GAIN,   ANC350_REG_AXIS },
+  { "maxfrequ",               ID_ANC_MAX_FREQU,     ANC350_REG_AXIS },
+  { "rotary",                 ID_ANC_ACT_ROTARY,    ANC350_REG_AXIS },
+  { "singlecircle",           ID_ANC_SGLCIRCLE,     ANC350_REG_AXIS },
+  { "humpenable",             ID_ANC_STOP_EN,       ANC350_REG_AXIS },
+  { "sensorunit",             ID_ANC_UNIT,          ANC350_REG_AXIS },
+  { "sensoravg",              ID_ANC_SEN_AVG,       ANC350_REG_AXIS },
+  { "amplctrl",               ID_ANC_REGSPD_SELSP,  ANC350_REG_AXIS },
+  { "targetrange",            ID_ANC_DIST_STOP,     ANC350_REG_AXIS },
+  { "targettime",             ID_ANC_TARGET_TIME,   ANC350_REG_AXIS },
+  { "refoffset",              ID_ANC_REF_OFFS,      ANC350_REG_AXIS },
+  { "sensorres",              ID_ANC_SENSOR_RES,    ANC350_REG_AXIS },
+
+  /* Triggers */
+  { "triggerlow",             ID_ANC_TRG_LOW,       ANC350_REG_TRIGGER },
+  { "triggerhigh",            ID_ANC_TRG_HIGH,      ANC350_REG_TRIGGER },
+  { "triggerpol",             ID_ANC_TRG_POL,       ANC350_REG_TRIGGER },
+  { "triggeraxis",            ID_ANC_TRG_AXIS,      ANC350_REG_TRIGGER },
+  { "triggereps",             ID_ANC_TRG_EPS,       ANC350_REG_TRIGGER },
+  { "triggerunit",            ID_ANC_TRG_UNIT,      ANC350_REG_TRIGGER },
+
+  /* Controller wide */
+  { "tempstatus",             ID_ANC_TEMP_STATUS,   ANC350_REG_GLOBAL },
+  { "sensorvolt",             ID_ANC_SENSOR_VOLT,   ANC350_REG_GLOBAL },
+};
+
+const int anc350NumRegisters = sizeof( anc350Registers ) / sizeof( anc350Registers[0] );
+
+/*
+ * Function: anc350FindRegister
+ *
+ * Parameters: name   - Register name as used in the table
+ *
+ * Returns: Pointer to the table entry, NULL if not found
+ *
+ * Description:
+ *
+ * Looks a register up by name.
+ */
+const anc350Register * anc350FindRegister( const char * name )
+{
+  int i;
+
+  for (i = 0; i < anc350NumRegisters; i++){
+    if (strcmp( anc350Registers[i].name, name ) == 0) return &anc350Registers[i];
+  }
+  return NULL;
+}
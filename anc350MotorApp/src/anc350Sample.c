@@ -0,0 +1,284 @@
+/*
+ * File:   anc350Sample.c
+ *
+ * Description:
+ *
+ * Crate-wide synchronised position sampling.  Each controller's poller
+ * runs on its own phase, so positions read by different pollers can be up
+ * to a poll period apart.  While sampling is running (ANC350_SAMPLE_PERIOD
+ * on the crate port, or anc350SampleStart) one thread wakes on a shared
+ * clock.  On each tick it writes the COUNTER and STATUS reads of every
+ * axis of every controller back-to-back, one write per controller, before
+ * collecting any acks, the same way the synchronisation groups start
+ * their moves.
+ *
+ * Every tick publishes one snapshot: a waveform of the positions of all
+ * axes (reference position subtracted, as reported to the motor record)
+ * and one of their status words, in controller creation order then axis
+ * order, both stamped with the time of the first write.  The skew of the
+ * tick is the time between the first and last controller's write.  Each
+ * controller reports its own offset from the first write.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsEvent.h"
+#include "epicsMutex.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+#define SAMPLE_MIN_PERIOD 0.01
+/* Two reads per axis must fit in one pipelined write */
+#define SAMPLE_MAX_AXES (ANC350_MAX_PIPELINE / 2)
+
+/* Reads of one controller, written in one go */
+typedef struct anc350SampleRead
+{
+  ANC350DRV_ID pDrv;
+  int nAxes;
+  int failed;
+  epicsTimeStamp sent;
+  anc350Op ops[ANC350_MAX_PIPELINE];
+} anc350SampleRead;
+
+static double samplePeriod = 0.0;
+static int sampleCount = 0;
+static int sampleMissed = 0;
+static double sampleSkewMax = 0.0;
+static epicsEventId sampleEventId = NULL;
+static epicsMutexId sampleMutexId = NULL;
+static epicsThreadId sampleThreadId = NULL;
+static epicsThreadOnceId sampleOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350SampleInit( void * arg )
+{
+  sampleMutexId = epicsMutexMustCreate();
+  sampleEventId = epicsEventMustCreate( epicsEventEmpty );
+}
+
+/*
+ * Function: anc350SampleTick
+ *
+ * Parameters: None
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Reads every axis of every controller and publishes the snapshot.
+ */
+static void anc350SampleTick( void )
+{
+  ANC350DRV_ID pDrv;
+  anc350SampleRead * reads;
+  double * positions;
+  double * statuses;
+  int nControllers = 0;
+  int nValues = 0;
+  int n = 0;
+  int i;
+  int j;
+  double skew = 0.0;
+
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    nControllers++;
+    nValues += (pDrv->nAxes < SAMPLE_MAX_AXES)? pDrv->nAxes: SAMPLE_MAX_AXES;
+  }
+  if (nControllers == 0) return;
+
+  reads = callocMustSucceed( nControllers, sizeof( anc350SampleRead ), "anc350SampleTick" );
+  positions = callocMustSucceed( nValues, sizeof( double ), "anc350SampleTick" );
+  statuses = callocMustSucceed( nValues, sizeof( double ), "anc350SampleTick" );
+
+  for (pDrv = drvAnc350First(), i = 0; pDrv != NULL; pDrv = pDrv->pNext, i++){
+    reads[i].pDrv = pDrv;
+    reads[i].nAxes = (pDrv->nAxes < SAMPLE_MAX_AXES)? pDrv->nAxes: SAMPLE_MAX_AXES;
+    for (j = 0; j < reads[i].nAxes; j++){
+      drvAnc350OpGet( &reads[i].ops[2 * j], ID_ANC_COUNTER, j );
+      drvAnc350OpGet( &reads[i].ops[2 * j + 1], ID_ANC_STATUS, j );
+    }
+  }
+
+  /* Put every read on the wire before collecting any acks */
+  for (i = 0; i < nControllers; i++){
+    if (drvAnc350BurstStart( reads[i].pDrv, reads[i].ops, 2 * reads[i].nAxes, reads[i].pDrv->burstTimeout ) != MOTOR_AXIS_OK){
+      reads[i].failed = 1;
+    }
+    drvAnc350TimeGetCurrent( &reads[i].sent );
+  }
+  for (i = 0; i < nControllers; i++){
+    if (!reads[i].failed) drvAnc350BurstFinish( reads[i].pDrv, reads[i].ops, 2 * reads[i].nAxes, reads[i].pDrv->burstTimeout );
+  }
+
+  for (i = 0; i < nControllers; i++){
+    double offset = epicsTimeDiffInSeconds( &reads[i].sent, &reads[0].sent );
+    double offsetMax = 0.0;
+
+    for (j = 0; j < reads[i].nAxes; j++, n++){
+      anc350Op * pCounter = &reads[i].ops[2 * j];
+      anc350Op * pStatus = &reads[i].ops[2 * j + 1];
+      AXIS_HDL pAxis = &reads[i].pDrv->axis[j];
+      double reference = 0.0;
+
+      epicsMutexLock( pAxis->axisMutex );
+      reference = pAxis->reference_position;
+      epicsMutexUnlock( pAxis->axisMutex );
+
+      positions[n] = (!reads[i].failed && pCounter->status == asynSuccess)? (double) pCounter->value - reference: NAN;
+      statuses[n] = (!reads[i].failed && pStatus->status == asynSuccess)? (double) pStatus->value: -1.0;
+    }
+    if (offset > skew) skew = offset;
+
+    anc350ParamSetDouble( reads[i].pDrv, 0, ANC350_SAMPLE_OFFSET, offset );
+    anc350ParamGetDouble( reads[i].pDrv, 0, ANC350_SAMPLE_OFFSET_MAX, &offsetMax );
+    if (offset > offsetMax) anc350ParamSetDouble( reads[i].pDrv, 0, ANC350_SAMPLE_OFFSET_MAX, offset );
+  }
+
+  epicsMutexLock( sampleMutexId );
+  sampleCount++;
+  if (skew > sampleSkewMax) sampleSkewMax = skew;
+  epicsMutexUnlock( sampleMutexId );
+
+  anc350ParamSetDoubleArray( NULL, 0, ANC350_SAMPLE_POSITIONS, positions, nValues, &reads[0].sent );
+  anc350ParamSetDoubleArray( NULL, 0, ANC350_SAMPLE_STATUS, statuses, nValues, &reads[0].sent );
+  anc350ParamSetDouble( NULL, 0, ANC350_SAMPLE_SKEW, skew );
+  anc350ParamSetDouble( NULL, 0, ANC350_SAMPLE_SKEW_MAX, sampleSkewMax );
+  anc350ParamSetInteger( NULL, 0, ANC350_SAMPLE_COUNT, sampleCount );
+
+  free( statuses );
+  free( positions );
+  free( reads );
+}
+
+/*
+ * Function: anc350SampleTask
+ *
+ * Parameters: arg   - Unused
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Sampling thread.  Ticks are scheduled from the previous tick rather
+ * than from the end of the last sample, so the rate does not drift.  A
+ * tick that is already late when it is due is skipped and counted.
+ */
+static void anc350SampleTask( void * arg )
+{
+  epicsTimeStamp next;
+  epicsTimeStamp now;
+
+  epicsTimeGetCurrent( &next );
+  while (1){
+    double period;
+    double wait;
+
+    epicsMutexLock( sampleMutexId );
+    period = samplePeriod;
+    epicsMutexUnlock( sampleMutexId );
+
+    if (period <= 0.0){
+      epicsEventMustWait( sampleEventId );
+      epicsTimeGetCurrent( &next );
+      continue;
+    }
+
+    epicsTimeGetCurrent( &now );
+    wait = epicsTimeDiffInSeconds( &next, &now );
+    if (wait > 0.0 && epicsEventWaitWithTimeout( sampleEventId, wait ) == epicsEventWaitOK){
+      /* The period has changed, start again from now */
+      epicsTimeGetCurrent( &next );
+      continue;
+    }
+
+    anc350SampleTick();
+
+    epicsTimeAddSeconds( &next, period );
+    epicsTimeGetCurrent( &now );
+    if (epicsTimeDiffInSeconds( &now, &next ) > 0.0){
+      epicsMutexLock( sampleMutexId );
+      sampleMissed++;
+      epicsMutexUnlock( sampleMutexId );
+      anc350ParamSetInteger( NULL, 0, ANC350_SAMPLE_MISSED, sampleMissed );
+      next = now;
+      epicsTimeAddSeconds( &next, period );
+    }
+  }
+}
+
+/*
+ * Function: anc350SampleStart
+ *
+ * Parameters: period   - Sampling period in seconds, 0 to stop sampling
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Starts, changes or stops crate-wide sampling.  Starting clears the
+ * statistics.
+ */
+int anc350SampleStart( double period )
+{
+  epicsThreadOnce( &sampleOnceId, anc350SampleInit, NULL );
+
+  if (period > 0.0 && period < SAMPLE_MIN_PERIOD){
+    printf( "anc350SampleStart: period raised to the minimum of %g s\n", SAMPLE_MIN_PERIOD );
+    period = SAMPLE_MIN_PERIOD;
+  }
+  if (period < 0.0) period = 0.0;
+
+  epicsMutexLock( sampleMutexId );
+  if (period > 0.0 && samplePeriod <= 0.0){
+    sampleCount = 0;
+    sampleMissed = 0;
+    sampleSkewMax = 0.0;
+  }
+  samplePeriod = period;
+  if (sampleThreadId == NULL && period > 0.0){
+    sampleThreadId = epicsThreadCreate( "anc350Sample", epicsThreadPriorityMedium,
+                                        epicsThreadGetStackSize( epicsThreadStackMedium ),
+                                        anc350SampleTask, NULL );
+    if (sampleThreadId == NULL){
+      samplePeriod = 0.0;
+      epicsMutexUnlock( sampleMutexId );
+      printf( "anc350SampleStart: cannot start the sampling thread\n" );
+      return MOTOR_AXIS_ERROR;
+    }
+  }
+  epicsMutexUnlock( sampleMutexId );
+
+  anc350ParamSetInteger( NULL, 0, ANC350_SAMPLE_MISSED, sampleMissed );
+  anc350ParamSetDouble( NULL, 0, ANC350_SAMPLE_SKEW_MAX, sampleSkewMax );
+  epicsEventSignal( sampleEventId );
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: anc350SampleParamWrite
+ *
+ * Parameters: None
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Called in the crate port thread when ANC350_SAMPLE_PERIOD is written.
+ */
+asynStatus anc350SampleParamWrite( void )
+{
+  double period = 0.0;
+
+  anc350ParamGetDouble( NULL, 0, ANC350_SAMPLE_PERIOD, &period );
+  return (anc350SampleStart( period ) == MOTOR_AXIS_OK)? asynSuccess: asynError;
+}
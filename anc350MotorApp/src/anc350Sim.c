@@ -0,0 +1,724 @@
+/*
+ * File:   anc350Sim.c
+ *
+ * Description:
+ *
+ * Simulated ANC350 controller and virtual time harness.
+ *
+ * anc350SimConfigure creates an asyn port that answers GET and SET
+ * telegrams like a controller, with a simple motion model: an axis moves
+ * at a fixed speed to its target, or continuously, and passes a reference
+ * mark at position 0.  anc350AsynMotorCreate is then pointed at the port
+ * instead of the IP port of a real controller.
+ *
+ * A port created with virtualTime set puts the driver on a virtual clock.
+ * The clock only moves when the simulated controller answers a telegram
+ * (by the configured latency), when the driver sleeps, and when the
+ * harness advances it, so no controller on the port gets a polling
+ * thread.  anc350SimRun then runs the poller scheduling logic of
+ * drvAnc350Poll against a script of moves and homes, emulating the poller
+ * wait on the virtual clock, and checks the telegram counts, the latency
+ * from standstill to Done, and updates the poller missed.  Hours of
+ * polling run in seconds and give the same result every time.
+ *
+ * Virtual time is for a harness IOC only: once a virtual port exists every
+ * timestamp taken by the driver is virtual, and no motor records should be
+ * loaded for the simulated controllers.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsMutex.h"
+#include "epicsEvent.h"
+#include "epicsString.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+#include "asynOctet.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+#define SIM_MAX_INDEX 8
+#define SIM_NUM_REGS 0x0800
+#define SIM_BUFFER_SIZE 4096
+#define SIM_DEFAULT_VELOCITY 10000.0    /* Counts per second */
+#define SIM_DEFAULT_LATENCY 0.0005      /* Seconds per telegram */
+#define SIM_START_POSITION -1000.0      /* Axes start below the reference mark */
+#define SIM_STUCK_TIME 10.0             /* Standstill without Done that counts as a missed update */
+
+#define SIM_IDLE    0
+#define SIM_TARGET  1
+#define SIM_FWD     2
+#define SIM_BKWD    3
+
+typedef struct anc350SimAxis
+{
+  int running;                  /* SIM_IDLE, SIM_TARGET, SIM_FWD or SIM_BKWD */
+  double position;
+  double target;
+  int refValid;
+  epicsTimeStamp updated;       /* Time the position was last advanced to */
+  epicsTimeStamp stopped;       /* Time the last motion ended */
+  epicsTimeStamp refSeen;       /* Time the reference mark was last passed */
+} anc350SimAxis;
+
+typedef struct anc350SimPort
+{
+  struct anc350SimPort * pNext;
+  char * portName;
+  int nAxes;
+  int virtualTime;
+  double velocity;
+  double latency;
+  epicsMutexId lock;
+  Int32 * regs;                 /* SIM_MAX_INDEX by SIM_NUM_REGS register values */
+  anc350SimAxis axis[SIM_MAX_INDEX];
+  char in[SIM_BUFFER_SIZE];
+  size_t inFill;
+  char out[SIM_BUFFER_SIZE];
+  size_t outFill;
+  unsigned long nGets;
+  unsigned long nSets;
+  asynInterface common;
+  asynInterface octet;
+} anc350SimPort;
+
+extern motorAxisDrvSET_t anc350AsynMotor;
+
+static anc350SimPort * pFirstSim = NULL;
+static int simVirtual = 0;
+static epicsTimeStamp simNow;
+static epicsMutexId simClockLock = NULL;
+static epicsThreadOnceId simOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350SimInit( void * arg )
+{
+  simClockLock = epicsMutexMustCreate();
+  epicsTimeGetCurrent( &simNow );
+}
+
+/*
+ * Function: drvAnc350TimeGetCurrent
+ *
+ * Parameters: pNow   - Returns the current time
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * The clock used by the driver for everything it times.  It is the
+ * virtual clock once a virtual simulated port exists, the wall clock
+ * otherwise.
+ */
+void drvAnc350TimeGetCurrent( epicsTimeStamp * pNow )
+{
+  if (!simVirtual){
+    epicsTimeGetCurrent( pNow );
+    return;
+  }
+  epicsMutexLock( simClockLock );
+  *pNow = simNow;
+  epicsMutexUnlock( simClockLock );
+}
+
+/*
+ * Function: anc350SimAdvance
+ *
+ * Parameters: seconds   - Time to move the virtual clock on by
+ *
+ * Returns: void
+ */
+static void anc350SimAdvance( double seconds )
+{
+  if (seconds <= 0.0) return;
+  epicsMutexLock( simClockLock );
+  epicsTimeAddSeconds( &simNow, seconds );
+  epicsMutexUnlock( simClockLock );
+}
+
+/*
+ * Function: drvAnc350Sleep
+ *
+ * Parameters: seconds   - Time to wait
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Sleeps on the driver clock.  On virtual time the clock is moved on.
+ */
+void drvAnc350Sleep( double seconds )
+{
+  if (simVirtual) anc350SimAdvance( seconds );
+  else epicsThreadSleep( seconds );
+}
+
+static anc350SimPort * anc350SimFind( const char * port )
+{
+  anc350SimPort * pSim;
+
+  for (pSim = pFirstSim; pSim != NULL && strcmp( pSim->portName, port ) != 0; pSim = pSim->pNext){}
+  return pSim;
+}
+
+/*
+ * Function: drvAnc350SimIsVirtual
+ *
+ * Parameters: port   - Name of the asyn port of a controller
+ *
+ * Returns: Non-zero if the port is a simulated controller on virtual time
+ */
+int drvAnc350SimIsVirtual( const char * port )
+{
+  anc350SimPort * pSim = anc350SimFind( port );
+
+  return (pSim != NULL && pSim->virtualTime);
+}
+
+/*
+ * Function: anc350SimUpdate
+ *
+ * Parameters: pSim   - Pointer to the simulated port
+ *             pAxis  - Simulated axis
+ *             pNow   - Time to advance the axis to
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Moves the axis on to the given time.  Called with the port lock held.
+ */
+static void anc350SimUpdate( anc350SimPort * pSim, anc350SimAxis * pAxis, const epicsTimeStamp * pNow )
+{
+  double dt = epicsTimeDiffInSeconds( pNow, &pAxis->updated );
+  double step = pSim->velocity * dt;
+  double from = pAxis->position;
+
+  if (dt <= 0.0) return;
+  switch (pAxis->running){
+    case SIM_TARGET:
+      if (fabs( pAxis->target - pAxis->position ) <= step){
+        /* Work out when it arrived rather than using the time of the poll */
+        pAxis->stopped = pAxis->updated;
+        epicsTimeAddSeconds( &pAxis->stopped, fabs( pAxis->target - pAxis->position ) / pSim->velocity );
+        pAxis->position = pAxis->target;
+        pAxis->running = SIM_IDLE;
+      } else {
+        pAxis->position += (pAxis->target > pAxis->position)? step: -step;
+      }
+      break;
+    case SIM_FWD:
+      pAxis->position += step;
+      break;
+    case SIM_BKWD:
+      pAxis->position -= step;
+      break;
+  }
+
+  /* Passing the reference mark makes the reference valid */
+  if ((from < 0.0 && pAxis->position >= 0.0) || (from > 0.0 && pAxis->position <= 0.0)){
+    pAxis->refValid = 1;
+    pAxis->refSeen = pAxis->updated;
+    epicsTimeAddSeconds( &pAxis->refSeen, fabs( from ) / pSim->velocity );
+  }
+  pAxis->updated = *pNow;
+}
+
+static void anc350SimStop( anc350SimAxis * pAxis, const epicsTimeStamp * pNow )
+{
+  if (pAxis->running == SIM_IDLE) return;
+  pAxis->running = SIM_IDLE;
+  pAxis->stopped = *pNow;
+}
+
+/*
+ * Function: anc350SimTelegram
+ *
+ * Parameters: pSim   - Pointer to the simulated port
+ *             pTel   - GET or SET telegram received
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Carries out a telegram and queues the ack.  Called with the port lock
+ * held.
+ */
+static void anc350SimTelegram( anc350SimPort * pSim, const char * pTel )
+{
+  UcSetTelegram set;
+  UcAckTelegram ack;
+  epicsTimeStamp now;
+  anc350SimAxis * pAxis = NULL;
+  Int32 * pReg = NULL;
+
+  memset( &set, 0, sizeof( set ) );
+  memcpy( &set.hdr, pTel, sizeof( UcTelegram ) );
+  if (set.hdr.opcode == UC_SET) memcpy( &set, pTel, sizeof( UcSetTelegram ) );
+
+  if (pSim->virtualTime) anc350SimAdvance( pSim->latency );
+  drvAnc350TimeGetCurrent( &now );
+
+  memset( &ack, 0, sizeof( ack ) );
+  ack.hdr = set.hdr;
+  ack.hdr.length = sizeof( UcAckTelegram ) - sizeof( Int32 );
+  ack.hdr.opcode = UC_ACK;
+  ack.reason = UC_REASON_OK;
+
+  if (set.hdr.index < 0 || set.hdr.index >= SIM_MAX_INDEX ||
+      set.hdr.address < 0 || set.hdr.address >= SIM_NUM_REGS){
+    ack.reason = UC_REASON_ADDR;
+  } else {
+    pReg = &pSim->regs[set.hdr.index * SIM_NUM_REGS + set.hdr.address];
+    if (set.hdr.index < pSim->nAxes){
+      pAxis = &pSim->axis[set.hdr.index];
+      anc350SimUpdate( pSim, pAxis, &now );
+    }
+  }
+
+  if (pReg != NULL && set.hdr.opcode == UC_SET){
+    pSim->nSets++;
+    *pReg = set.data[0];
+    ack.data[0] = set.data[0];
+    if (pAxis != NULL){
+      switch (set.hdr.address){
+        case ID_ANC_RUN_TARGET:
+        case ID_ANC_RUN_RELATIVE:
+          if (set.data[0]){
+            Int32 target = pSim->regs[set.hdr.index * SIM_NUM_REGS + ID_ANC_TARGET];
+            Int32 reference = pSim->regs[set.hdr.index * SIM_NUM_REGS + ID_ANC_REFCOUNTER];
+
+            pAxis->target = (set.hdr.address == ID_ANC_RUN_TARGET)? target: pAxis->position + target - reference;
+            pAxis->running = SIM_TARGET;
+          } else if (pAxis->running == SIM_TARGET){
+            anc350SimStop( pAxis, &now );
+          }
+          break;
+        case ID_ANC_CONT_FWD:
+        case ID_ANC_CONT_BKWD:
+          if (set.data[0]){
+            pAxis->running = (set.hdr.address == ID_ANC_CONT_FWD)? SIM_FWD: SIM_BKWD;
+          } else if (pAxis->running == ((set.hdr.address == ID_ANC_CONT_FWD)? SIM_FWD: SIM_BKWD)){
+            anc350SimStop( pAxis, &now );
+          }
+          break;
+      }
+    }
+  } else if (pReg != NULL){
+    pSim->nGets++;
+    ack.data[0] = *pReg;
+    if (pAxis != NULL){
+      switch (set.hdr.address){
+        case ID_ANC_STATUS:
+          ack.data[0] = ANC_STATUS_ENABLE | ((pAxis->running != SIM_IDLE)? ANC_STATUS_RUNNING: 0) |
+                        (pAxis->refValid? ANC_STATUS_REF_VALID: 0);
+          break;
+        case ID_ANC_COUNTER:
+          ack.data[0] = (Int32) floor( pAxis->position + 0.5 );
+          break;
+      }
+    }
+  }
+
+  if (pSim->outFill + sizeof( ack ) <= sizeof( pSim->out )){
+    memcpy( pSim->out + pSim->outFill, &ack, sizeof( ack ) );
+    pSim->outFill += sizeof( ack );
+  }
+}
+
+/* asynCommon methods */
+static void simReport( void * drvPvt, FILE * fp, int details )
+{
+  anc350SimPort * pSim = (anc350SimPort *) drvPvt;
+
+  fprintf( fp, "ANC350 simulated controller %s, %d axes, %s time, %lu gets, %lu sets\n",
+           pSim->portName, pSim->nAxes, pSim->virtualTime? "virtual": "wall clock", pSim->nGets, pSim->nSets );
+}
+
+static asynStatus simConnect( void * drvPvt, asynUser * pasynUser )
+{
+  pasynManager->exceptionConnect( pasynUser );
+  return asynSuccess;
+}
+
+static asynStatus simDisconnect( void * drvPvt, asynUser * pasynUser )
+{
+  pasynManager->exceptionDisconnect( pasynUser );
+  return asynSuccess;
+}
+
+static asynCommon simCommon = { simReport, simConnect, simDisconnect };
+
+/* asynOctet methods */
+static asynStatus simWriteOctet( void * drvPvt, asynUser * pasynUser, const char * data, size_t numchars,
+                                 size_t * nbytesTransfered )
+{
+  anc350SimPort * pSim = (anc350SimPort *) drvPvt;
+  size_t pos = 0;
+
+  epicsMutexLock( pSim->lock );
+  if (pSim->inFill + numchars > sizeof( pSim->in )) pSim->inFill = 0;
+  memcpy( pSim->in + pSim->inFill, data, numchars );
+  pSim->inFill += numchars;
+
+  while (pSim->inFill - pos >= sizeof( Int32 )){
+    Int32 length;
+
+    memcpy( &length, pSim->in + pos, sizeof( Int32 ) );
+    if (length < (Int32)(sizeof( UcTelegram ) - sizeof( Int32 )) || length > UC_MAXSIZE){
+      pos = pSim->inFill;
+      break;
+    }
+    if (pSim->inFill - pos < sizeof( Int32 ) + (size_t)length) break;
+    anc350SimTelegram( pSim, pSim->in + pos );
+    pos += sizeof( Int32 ) + (size_t)length;
+  }
+  memmove( pSim->in, pSim->in + pos, pSim->inFill - pos );
+  pSim->inFill -= pos;
+  epicsMutexUnlock( pSim->lock );
+
+  *nbytesTransfered = numchars;
+  return asynSuccess;
+}
+
+static asynStatus simReadOctet( void * drvPvt, asynUser * pasynUser, char * data, size_t maxchars,
+                                size_t * nbytesTransfered, int * eomReason )
+{
+  anc350SimPort * pSim = (anc350SimPort *) drvPvt;
+  size_t n;
+
+  epicsMutexLock( pSim->lock );
+  n = (pSim->outFill < maxchars)? pSim->outFill: maxchars;
+  memcpy( data, pSim->out, n );
+  memmove( pSim->out, pSim->out + n, pSim->outFill - n );
+  pSim->outFill -= n;
+  epicsMutexUnlock( pSim->lock );
+
+  *nbytesTransfered = n;
+  if (eomReason) *eomReason = (n == maxchars)? ASYN_EOM_CNT: 0;
+  /* Everything is answered as it is written, so there is nothing to wait for */
+  return (n > 0)? asynSuccess: asynTimeout;
+}
+
+static asynStatus simFlushOctet( void * drvPvt, asynUser * pasynUser )
+{
+  anc350SimPort * pSim = (anc350SimPort *) drvPvt;
+
+  epicsMutexLock( pSim->lock );
+  pSim->outFill = 0;
+  epicsMutexUnlock( pSim->lock );
+  return asynSuccess;
+}
+
+static asynOctet simOctet = { simWriteOctet, simReadOctet, simFlushOctet };
+
+/*
+ * Function: anc350SimConfigure
+ *
+ * Parameters: portName     - Name of the asyn port to create
+ *             nAxes        - Number of axes to simulate
+ *             virtualTime  - Non-zero to run the driver on virtual time
+ *             velocity     - Speed of the axes in counts per second, 0 for the default
+ *             latency      - Time to answer each telegram in seconds on virtual time,
+ *                            negative for the default
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Creates a simulated controller.  Must be called before
+ * anc350AsynMotorCreate for the port.
+ */
+int anc350SimConfigure( const char * portName, int nAxes, int virtualTime, double velocity, double latency )
+{
+  anc350SimPort * pSim;
+  int i;
+
+  if (nAxes < 1 || nAxes > SIM_MAX_INDEX){
+    printf( "anc350SimConfigure: nAxes must be 1 to %d\n", SIM_MAX_INDEX );
+    return MOTOR_AXIS_ERROR;
+  }
+  if (anc350SimFind( portName ) != NULL){
+    printf( "anc350SimConfigure: %s already exists\n", portName );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  epicsThreadOnce( &simOnceId, anc350SimInit, NULL );
+  if (virtualTime) simVirtual = 1;
+
+  pSim = callocMustSucceed( 1, sizeof( anc350SimPort ), "anc350SimConfigure" );
+  pSim->portName = epicsStrDup( portName );
+  pSim->nAxes = nAxes;
+  pSim->virtualTime = (virtualTime != 0);
+  pSim->velocity = (velocity > 0.0)? velocity: SIM_DEFAULT_VELOCITY;
+  pSim->latency = (latency >= 0.0)? latency: SIM_DEFAULT_LATENCY;
+  pSim->lock = epicsMutexMustCreate();
+  pSim->regs = callocMustSucceed( SIM_MAX_INDEX * SIM_NUM_REGS, sizeof( Int32 ), "anc350SimConfigure" );
+  for (i = 0; i < nAxes; i++){
+    pSim->axis[i].position = SIM_START_POSITION;
+    drvAnc350TimeGetCurrent( &pSim->axis[i].updated );
+    pSim->axis[i].stopped = pSim->axis[i].updated;
+    pSim->regs[i * SIM_NUM_REGS + ID_ANC_AMPL] = 30000;
+  }
+  pSim->regs[ID_ANC_TEMP_STATUS] = 1;
+  pSim->regs[ID_ANC_SENSOR_VOLT] = 2000;
+
+  if (pasynManager->registerPort( portName, 0, 1, 0, 0 ) != asynSuccess){
+    printf( "anc350SimConfigure: registerPort %s failed\n", portName );
+    return MOTOR_AXIS_ERROR;
+  }
+  pSim->common.interfaceType = asynCommonType;
+  pSim->common.pinterface = &simCommon;
+  pSim->common.drvPvt = pSim;
+  pSim->octet.interfaceType = asynOctetType;
+  pSim->octet.pinterface = &simOctet;
+  pSim->octet.drvPvt = pSim;
+  if (pasynManager->registerInterface( portName, &pSim->common ) != asynSuccess ||
+      pasynOctetBase->initialize( portName, &pSim->octet, 0, 0, 0 ) != asynSuccess){
+    printf( "anc350SimConfigure: cannot register the interfaces of %s\n", portName );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  pSim->pNext = pFirstSim;
+  pFirstSim = pSim;
+  return MOTOR_AXIS_OK;
+}
+
+/* Harness state of one axis */
+typedef struct anc350SimRunAxis
+{
+  int busy;                     /* Waiting for Done */
+  int homing;
+  int target;                   /* Alternates between one and two move distances */
+  int commands;
+  double nextCommand;           /* Seconds from the start of the run */
+} anc350SimRunAxis;
+
+/*
+ * Function: anc350SimCommand
+ *
+ * Parameters: pRun       - Harness state of the axis
+ *             pAxis      - Axis to command
+ *             pSim       - Simulated port of the controller
+ *             distance   - Move distance in counts
+ *             homeEvery  - Home every this many commands, 0 to home once
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Starts the next home or move of the script for an axis, the way the
+ * motor record would.
+ */
+static void anc350SimCommand( anc350SimRunAxis * pRun, AXIS_HDL pAxis, anc350SimPort * pSim,
+                              int distance, int homeEvery )
+{
+  int homed = 0;
+
+  anc350AsynMotor.getInteger( pAxis, motorAxisHomed, &homed );
+  if (homeEvery > 0 && pRun->commands > 0 && pRun->commands % homeEvery == 0){
+    /* Lose the reference so that the home has something to find */
+    epicsMutexLock( pSim->lock );
+    pSim->axis[pAxis->axis - 1].refValid = 0;
+    epicsMutexUnlock( pSim->lock );
+    homed = 0;
+  }
+
+  if (!homed){
+    pRun->homing = 1;
+    anc350AsynMotor.home( pAxis, 0.0, 0.0, 0.0, (pAxis->previous_position < 0.0) );
+  } else {
+    pRun->homing = 0;
+    /* Stay clear of the reference mark so that a later home always passes it */
+    pRun->target = (pRun->target == distance)? 2 * distance: distance;
+    anc350AsynMotor.move( pAxis, (double) pRun->target, 0, 0.0, 0.0, 0.0 );
+  }
+  pRun->busy = 1;
+  pRun->commands++;
+}
+
+/*
+ * Function: anc350SimRun
+ *
+ * Parameters: card        - Controller created on a virtual simulated port
+ *             seconds     - Virtual time to run for
+ *             distance    - Move distance in counts
+ *             movePeriod  - Time between Done and the next move, in seconds
+ *             homeEvery   - Home every this many commands, 0 to home once
+ *             maxLatency  - Largest allowed time from standstill to Done, 0 for no limit
+ *
+ * Returns: Integer status value, MOTOR_AXIS_ERROR if a check failed
+ *
+ * Description:
+ *
+ * Runs the poller of the controller on virtual time while every axis
+ * homes and then moves back and forth between one and two distances.  The poller wait is emulated: a
+ * poll happens when the moving poll period runs out, or straight away if
+ * the poll event was signalled, by a command or by the driver itself.
+ *
+ * Reports the polls and telegrams per move and the latency from the
+ * simulated axis stopping (or, for a home, passing the reference mark) to
+ * the driver publishing Done.  Fails if Done is published while the axis
+ * is still moving, if the position published with Done is not where the
+ * axis stopped, if an axis stands still for SIM_STUCK_TIME without Done,
+ * or if the latency is larger than maxLatency.
+ */
+int anc350SimRun( int card, double seconds, int distance, double movePeriod, int homeEvery, double maxLatency )
+{
+  ANC350DRV_ID pDrv = drvAnc350FindCard( card );
+  anc350SimPort * pSim;
+  anc350SimRunAxis * runs;
+  unsigned long nTelegrams;
+  double t = 0.0;
+  double timeout = 0.0;
+  double sumLatency = 0.0;
+  double worstLatency = 0.0;
+  int nPolls = 0;
+  int nForced = 0;
+  int nMoves = 0;
+  int nHomes = 0;
+  int nDone = 0;
+  int nEarly = 0;
+  int nStale = 0;
+  int nStuck = 0;
+  int nSlow = 0;
+  int i;
+
+  if (pDrv == NULL || !pDrv->virtualTime || (pSim = anc350SimFind( pDrv->portName )) == NULL){
+    printf( "anc350SimRun: card %d is not on a virtual time simulated port\n", card );
+    return MOTOR_AXIS_ERROR;
+  }
+  if (movePeriod < 0.0) movePeriod = 0.0;
+
+  runs = callocMustSucceed( pDrv->nAxes, sizeof( anc350SimRunAxis ), "anc350SimRun" );
+  epicsMutexLock( pSim->lock );
+  nTelegrams = pSim->nGets + pSim->nSets;
+  epicsMutexUnlock( pSim->lock );
+
+  while (t < seconds){
+    epicsTimeStamp before;
+    epicsTimeStamp after;
+    double wake;
+    int forced;
+
+    epicsMutexLock( pDrv->controllerMutexId );
+    timeout = pDrv->movingPollPeriod;
+    epicsMutexUnlock( pDrv->controllerMutexId );
+    timeout = drvAnc350EstimateWait( pDrv, timeout );
+    timeout = drvAnc350StopWait( pDrv, timeout );
+    wake = t + timeout;
+
+    /* Wait for the poll event or the timeout, starting commands that fall due meanwhile */
+    forced = (epicsEventTryWait( pDrv->pollEventId ) == epicsEventWaitOK);
+    while (!forced){
+      double next = wake;
+      int due = -1;
+
+      for (i = 0; i < pDrv->nAxes; i++){
+        if (!runs[i].busy && runs[i].nextCommand < next){
+          next = runs[i].nextCommand;
+          due = i;
+        }
+      }
+      if (next > t){
+        anc350SimAdvance( next - t );
+        t = next;
+      }
+      if (due < 0) break;
+      anc350SimCommand( &runs[due], &pDrv->axis[due], pSim, distance, homeEvery );
+      if (runs[due].homing) nHomes++;
+      else nMoves++;
+      forced = (epicsEventTryWait( pDrv->pollEventId ) == epicsEventWaitOK);
+    }
+    if (t >= seconds) break;
+
+    /* The poll itself takes virtual time, one telegram latency at a time */
+    drvAnc350TimeGetCurrent( &before );
+    drvAnc350Poll( pDrv, forced );
+    drvAnc350TimeGetCurrent( &after );
+    t += epicsTimeDiffInSeconds( &after, &before );
+    nPolls++;
+    if (forced) nForced++;
+
+    /* Check what the poll published against the simulated axes */
+    for (i = 0; i < pDrv->nAxes; i++){
+      AXIS_HDL pAxis = &pDrv->axis[i];
+      anc350SimAxis simAxis;
+      double position = 0.0;
+      double latency;
+      int done = 0;
+      Int32 reference;
+
+      epicsMutexLock( pSim->lock );
+      anc350SimUpdate( pSim, &pSim->axis[i], &after );
+      simAxis = pSim->axis[i];
+      reference = pSim->regs[i * SIM_NUM_REGS + ID_ANC_REFCOUNTER];
+      epicsMutexUnlock( pSim->lock );
+
+      anc350AsynMotor.getInteger( pAxis, motorAxisDone, &done );
+      if (!runs[i].busy) continue;
+      if (!done){
+        if (simAxis.running == SIM_IDLE && epicsTimeDiffInSeconds( &after, &simAxis.stopped ) > SIM_STUCK_TIME){
+          printf( "anc350SimRun: %.3f s axis %d stopped %.1f s ago without Done\n", t, i + 1,
+                  epicsTimeDiffInSeconds( &after, &simAxis.stopped ) );
+          nStuck++;
+          runs[i].busy = 0;
+          runs[i].nextCommand = t + movePeriod;
+        }
+        continue;
+      }
+
+      runs[i].busy = 0;
+      runs[i].nextCommand = t + movePeriod;
+      nDone++;
+      if (runs[i].homing){
+        latency = epicsTimeDiffInSeconds( &after, &simAxis.refSeen );
+      } else if (simAxis.running != SIM_IDLE){
+        printf( "anc350SimRun: %.3f s axis %d Done while still moving\n", t, i + 1 );
+        nEarly++;
+        continue;
+      } else {
+        latency = epicsTimeDiffInSeconds( &after, &simAxis.stopped );
+        anc350AsynMotor.getDouble( pAxis, motorAxisPosition, &position );
+        if (fabs( position - (floor( simAxis.position + 0.5 ) - reference) ) > 0.5){
+          printf( "anc350SimRun: %.3f s axis %d Done at %.0f, axis is at %.0f\n", t, i + 1,
+                  position, floor( simAxis.position + 0.5 ) - reference );
+          nStale++;
+        }
+      }
+      sumLatency += latency;
+      if (latency > worstLatency) worstLatency = latency;
+      if (maxLatency > 0.0 && latency > maxLatency) nSlow++;
+    }
+  }
+
+  epicsMutexLock( pSim->lock );
+  nTelegrams = pSim->nGets + pSim->nSets - nTelegrams;
+  epicsMutexUnlock( pSim->lock );
+  free( runs );
+
+  printf( "anc350SimRun: card %d, %.1f s virtual time\n", card, t );
+  printf( "  %d moves, %d homes, %d completed\n", nMoves, nHomes, nDone );
+  printf( "  %d polls (%d forced by events), %lu telegrams", nPolls, nForced, nTelegrams );
+  if (nMoves + nHomes > 0) printf( ", %.1f per command", (double) nTelegrams / (nMoves + nHomes) );
+  printf( "\n" );
+  if (nDone > 0){
+    printf( "  standstill to Done: mean %.1f ms, max %.1f ms\n", 1000.0 * sumLatency / nDone, 1000.0 * worstLatency );
+  }
+  printf( "  %d early Done, %d stale positions, %d missed Done, %d slower than %.1f ms\n",
+          nEarly, nStale, nStuck, nSlow, 1000.0 * maxLatency );
+
+  if (nEarly > 0 || nStale > 0 || nStuck > 0 || nSlow > 0){
+    printf( "anc350SimRun: FAILED\n" );
+    return MOTOR_AXIS_ERROR;
+  }
+  printf( "anc350SimRun: passed\n" );
+  return MOTOR_AXIS_OK;
+}
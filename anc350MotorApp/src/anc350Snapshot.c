@@ -0,0 +1,533 @@
+/*
+ * File:   anc350Snapshot.c
+ *
+ * Description:
+ *
+ * Register snapshots of every ANC350 controller in the IOC.  A snapshot
+ * reads every register in the register table for every axis, trigger and
+ * controller with pipelined bursts and writes the values to a timestamped
+ * text file, one register per line:
+ *
+ *   # card target register address value
+ *   0 axis1 actorgain 0x054E 1000000
+ *
+ * Snapshot files can be compared with each other, and the axes of one
+ * snapshot can be compared with each other, to find why one axis behaves
+ * differently from the rest.  A snapshot is taken from the IOC shell with
+ * anc350Snapshot or by writing 1 to ANC350_SNAPSHOT on the crate port.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsMutex.h"
+#include "epicsString.h"
+#include "epicsStdio.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+#define SNAPSHOT_TARGET_SIZE 16
+#define SNAPSHOT_NAME_SIZE 32
+
+typedef struct anc350SnapValue
+{
+  int card;
+  char target[SNAPSHOT_TARGET_SIZE];    /* controller, axis<n> or trigger<n> */
+  char name[SNAPSHOT_NAME_SIZE];
+  int address;
+  int valid;
+  int value;
+} anc350SnapValue;
+
+typedef struct anc350Snap
+{
+  int nValues;
+  int maxValues;
+  anc350SnapValue * values;
+} anc350Snap;
+
+/* The last snapshot captured, used for axis comparisons */
+static anc350Snap * pLastSnap = NULL;
+static epicsMutexId snapMutexId = NULL;
+static epicsThreadOnceId snapOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350SnapInit( void * arg )
+{
+  snapMutexId = epicsMutexMustCreate();
+}
+
+/*
+ * Function: anc350SnapFree
+ *
+ * Parameters: pSnap   - Pointer to the snapshot
+ *
+ * Returns: void
+ */
+static void anc350SnapFree( anc350Snap * pSnap )
+{
+  if (pSnap == NULL) return;
+  free( pSnap->values );
+  free( pSnap );
+}
+
+/*
+ * Function: anc350SnapAdd
+ *
+ * Parameters: pSnap    - Pointer to the snapshot
+ *             card     - Controller card number
+ *             target   - controller, axis<n> or trigger<n>
+ *             name     - Register name
+ *             address  - Register address
+ *             valid    - Non-zero if value was read
+ *             value    - Value read
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Appends a value to the snapshot, growing the array as required.
+ */
+static void anc350SnapAdd( anc350Snap * pSnap, int card, const char * target, const char * name,
+                           int address, int valid, int value )
+{
+  anc350SnapValue * pValue;
+
+  if (pSnap->nValues == pSnap->maxValues){
+    pSnap->maxValues = (pSnap->maxValues == 0)? 256: 2 * pSnap->maxValues;
+    pSnap->values = realloc( pSnap->values, pSnap->maxValues * sizeof( anc350SnapValue ) );
+    if (pSnap->values == NULL) cantProceed( "anc350SnapAdd: out of memory\n" );
+  }
+  pValue = &pSnap->values[pSnap->nValues++];
+  pValue->card = card;
+  strncpy( pValue->target, target, SNAPSHOT_TARGET_SIZE - 1 );
+  pValue->target[SNAPSHOT_TARGET_SIZE - 1] = '\0';
+  strncpy( pValue->name, name, SNAPSHOT_NAME_SIZE - 1 );
+  pValue->name[SNAPSHOT_NAME_SIZE - 1] = '\0';
+  pValue->address = address;
+  pValue->valid = valid;
+  pValue->value = value;
+}
+
+/*
+ * Function: anc350SnapFind
+ *
+ * Parameters: pSnap    - Pointer to the snapshot
+ *             card     - Controller card number
+ *             target   - controller, axis<n> or trigger<n>
+ *             name     - Register name
+ *
+ * Returns: Pointer to the value, NULL if not in the snapshot
+ */
+static anc350SnapValue * anc350SnapFind( anc350Snap * pSnap, int card, const char * target, const char * name )
+{
+  int i;
+
+  for (i = 0; i < pSnap->nValues; i++){
+    anc350SnapValue * pValue = &pSnap->values[i];
+    if (pValue->card == card && strcmp( pValue->target, target ) == 0 && strcmp( pValue->name, name ) == 0) return pValue;
+  }
+  return NULL;
+}
+
+/*
+ * Function: anc350SnapCaptureCard
+ *
+ * Parameters: pDrv    - Pointer to driver structure
+ *             pSnap   - Snapshot to add the values to
+ *
+ * Returns: Number of registers read successfully
+ *
+ * Description:
+ *
+ * Reads every register of one controller.  All GETs are issued through
+ * drvAnc350Burst, so they go out in groups of pipelineDepth telegrams.
+ */
+static int anc350SnapCaptureCard( ANC350DRV_ID pDrv, anc350Snap * pSnap )
+{
+  int nOps = 0;
+  int nOk;
+  int i;
+  int index;
+  anc350Op * ops;
+  char target[SNAPSHOT_TARGET_SIZE];
+
+  ops = callocMustSucceed( anc350NumRegisters * (pDrv->nAxes + ANC_MAX_TRIGGER + 2), sizeof( anc350Op ),
+                           "anc350SnapCaptureCard" );
+
+  for (i = 0; i < anc350NumRegisters; i++){
+    const anc350Register * pReg = &anc350Registers[i];
+
+    if (pReg->scope == ANC350_REG_AXIS){
+      for (index = 0; index < pDrv->nAxes; index++) drvAnc350OpGet( &ops[nOps++], pReg->address, index );
+    } else if (pReg->scope == ANC350_REG_TRIGGER){
+      for (index = 0; index <= ANC_MAX_TRIGGER; index++) drvAnc350OpGet( &ops[nOps++], pReg->address, index );
+    } else {
+      drvAnc350OpGet( &ops[nOps++], pReg->address, 0 );
+    }
+  }
+
+  nOk = drvAnc350Burst( pDrv, ops, nOps, pDrv->burstTimeout );
+
+  /* The ops were built in table order, walk the table again to name them */
+  nOps = 0;
+  for (i = 0; i < anc350NumRegisters; i++){
+    const anc350Register * pReg = &anc350Registers[i];
+    int count = (pReg->scope == ANC350_REG_AXIS)? pDrv->nAxes:
+                (pReg->scope == ANC350_REG_TRIGGER)? ANC_MAX_TRIGGER + 1: 1;
+
+    for (index = 0; index < count; index++, nOps++){
+      if (pReg->scope == ANC350_REG_AXIS) sprintf( target, "axis%d", index + 1 );
+      else if (pReg->scope == ANC350_REG_TRIGGER) sprintf( target, "trigger%d", index );
+      else strcpy( target, "controller" );
+      anc350SnapAdd( pSnap, pDrv->card, target, pReg->name, pReg->address,
+                     ops[nOps].status == asynSuccess, ops[nOps].value );
+    }
+  }
+
+  free( ops );
+  return nOk;
+}
+
+/*
+ * Function: anc350SnapWrite
+ *
+ * Parameters: pSnap     - Pointer to the snapshot
+ *             fileName  - File to write
+ *             stamp     - Time the snapshot was taken
+ *
+ * Returns: 0 on success, -1 on error
+ */
+static int anc350SnapWrite( anc350Snap * pSnap, const char * fileName, const epicsTimeStamp * stamp )
+{
+  FILE * fp;
+  char timeText[64];
+  int i;
+
+  if ((fp = fopen( fileName, "w" )) == NULL){
+    printf( "anc350Snapshot: cannot open %s for writing\n", fileName );
+    return -1;
+  }
+  epicsTimeToStrftime( timeText, sizeof( timeText ), "%Y-%m-%d %H:%M:%S.%03f", stamp );
+  fprintf( fp, "# ANC350 register snapshot\n" );
+  fprintf( fp, "# time %s\n", timeText );
+  fprintf( fp, "# card target register address value\n" );
+  for (i = 0; i < pSnap->nValues; i++){
+    anc350SnapValue * pValue = &pSnap->values[i];
+    if (pValue->valid){
+      fprintf( fp, "%d %s %s 0x%04X %d\n", pValue->card, pValue->target, pValue->name, pValue->address, pValue->value );
+    } else {
+      fprintf( fp, "%d %s %s 0x%04X ?\n", pValue->card, pValue->target, pValue->name, pValue->address );
+    }
+  }
+  fclose( fp );
+  return 0;
+}
+
+/*
+ * Function: anc350SnapRead
+ *
+ * Parameters: fileName  - Snapshot file to read
+ *
+ * Returns: Pointer to the snapshot, NULL on error
+ */
+static anc350Snap * anc350SnapRead( const char * fileName )
+{
+  FILE * fp;
+  char line[256];
+  anc350Snap * pSnap;
+
+  if ((fp = fopen( fileName, "r" )) == NULL){
+    printf( "anc350Snapshot: cannot open %s\n", fileName );
+    return NULL;
+  }
+  pSnap = callocMustSucceed( 1, sizeof( anc350Snap ), "anc350SnapRead" );
+  while (fgets( line, sizeof( line ), fp ) != NULL){
+    int card;
+    char target[SNAPSHOT_TARGET_SIZE];
+    char name[SNAPSHOT_NAME_SIZE];
+    unsigned int address;
+    char valueText[32];
+
+    if (line[0] == '#') continue;
+    if (sscanf( line, "%d %15s %31s %x %31s", &card, target, name, &address, valueText ) != 5) continue;
+    anc350SnapAdd( pSnap, card, target, name, (int) address, valueText[0] != '?', atoi( valueText ) );
+  }
+  fclose( fp );
+  return pSnap;
+}
+
+/*
+ * Function: anc350SnapPrintValue
+ *
+ * Parameters: pValue  - Value to print, may be NULL
+ *
+ * Returns: void
+ */
+static void anc350SnapPrintValue( const anc350SnapValue * pValue )
+{
+  if (pValue == NULL) printf( " %12s", "missing" );
+  else if (!pValue->valid) printf( " %12s", "?" );
+  else printf( " %12d", pValue->value );
+}
+
+/*
+ * Function: anc350SnapSame
+ *
+ * Parameters: pA, pB  - Values to compare, either may be NULL
+ *
+ * Returns: Non-zero if both are present and equal, or both unreadable
+ */
+static int anc350SnapSame( const anc350SnapValue * pA, const anc350SnapValue * pB )
+{
+  if (pA == NULL || pB == NULL) return 0;
+  if (pA->valid != pB->valid) return 0;
+  return !pA->valid || pA->value == pB->value;
+}
+
+/*
+ * Function: anc350SnapCompare
+ *
+ * Parameters: pA, pB  - Snapshots to compare
+ *
+ * Returns: Number of differences
+ *
+ * Description:
+ *
+ * Prints every register whose value differs between the two snapshots,
+ * including registers present in only one of them.
+ */
+static int anc350SnapCompare( anc350Snap * pA, anc350Snap * pB )
+{
+  int nDiffs = 0;
+  int i;
+
+  for (i = 0; i < pA->nValues; i++){
+    anc350SnapValue * pValueA = &pA->values[i];
+    anc350SnapValue * pValueB = anc350SnapFind( pB, pValueA->card, pValueA->target, pValueA->name );
+
+    if (anc350SnapSame( pValueA, pValueB )) continue;
+    if (nDiffs++ == 0) printf( "card target       register              %12s %12s\n", "this", "reference" );
+    printf( "%4d %-12s %-21s", pValueA->card, pValueA->target, pValueA->name );
+    anc350SnapPrintValue( pValueA );
+    anc350SnapPrintValue( pValueB );
+    printf( "\n" );
+  }
+  for (i = 0; i < pB->nValues; i++){
+    anc350SnapValue * pValueB = &pB->values[i];
+
+    if (anc350SnapFind( pA, pValueB->card, pValueB->target, pValueB->name ) != NULL) continue;
+    if (nDiffs++ == 0) printf( "card target       register              %12s %12s\n", "this", "reference" );
+    printf( "%4d %-12s %-21s", pValueB->card, pValueB->target, pValueB->name );
+    anc350SnapPrintValue( NULL );
+    anc350SnapPrintValue( pValueB );
+    printf( "\n" );
+  }
+  printf( "%d difference%s\n", nDiffs, (nDiffs == 1)? "": "s" );
+  return nDiffs;
+}
+
+/*
+ * Function: anc350Snapshot
+ *
+ * Parameters: directory  - Directory to write the snapshot file to, current directory if empty
+ *             reference  - Snapshot file to compare against, may be empty
+ *
+ * Returns: Number of differences against the reference, 0 if there is no
+ *          reference, -1 on error
+ *
+ * Description:
+ *
+ * Captures every register of every controller to a file named
+ * anc350-YYYYMMDD-HHMMSS.snap and optionally compares it with a reference
+ * snapshot.  The result is also posted to the crate parameter port.
+ */
+int anc350Snapshot( const char * directory, const char * reference )
+{
+  anc350Snap * pSnap;
+  anc350Snap * pRef;
+  ANC350DRV_ID pDrv;
+  epicsTimeStamp start;
+  epicsTimeStamp end;
+  char stampText[32];
+  char fileName[512];
+  int nRead = 0;
+  int nDiffs = 0;
+  double seconds;
+
+  epicsThreadOnce( &snapOnceId, anc350SnapInit, NULL );
+
+  if (drvAnc350First() == NULL){
+    printf( "anc350Snapshot: no controllers have been created\n" );
+    return -1;
+  }
+
+  pSnap = callocMustSucceed( 1, sizeof( anc350Snap ), "anc350Snapshot" );
+  epicsTimeGetCurrent( &start );
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    nRead += anc350SnapCaptureCard( pDrv, pSnap );
+  }
+  epicsTimeGetCurrent( &end );
+  seconds = epicsTimeDiffInSeconds( &end, &start );
+
+  epicsTimeToStrftime( stampText, sizeof( stampText ), "%Y%m%d-%H%M%S", &start );
+  epicsSnprintf( fileName, sizeof( fileName ), "%s%sanc350-%s.snap",
+                 (directory != NULL && directory[0] != '\0')? directory: ".", "/", stampText );
+  if (anc350SnapWrite( pSnap, fileName, &start ) != 0){
+    anc350SnapFree( pSnap );
+    return -1;
+  }
+  printf( "anc350Snapshot: %d of %d registers read in %.3f s, written to %s\n",
+          nRead, pSnap->nValues, seconds, fileName );
+
+  if (reference != NULL && reference[0] != '\0'){
+    if ((pRef = anc350SnapRead( reference )) != NULL){
+      printf( "Differences against %s:\n", reference );
+      nDiffs = anc350SnapCompare( pSnap, pRef );
+      anc350SnapFree( pRef );
+    } else {
+      nDiffs = -1;
+    }
+  }
+
+  epicsMutexLock( snapMutexId );
+  anc350SnapFree( pLastSnap );
+  pLastSnap = pSnap;
+  epicsMutexUnlock( snapMutexId );
+
+  anc350ParamSetString( NULL, 0, ANC350_SNAPSHOT_FILE, fileName );
+  anc350ParamSetInteger( NULL, 0, ANC350_SNAPSHOT_DIFFS, nDiffs );
+  anc350ParamSetDouble( NULL, 0, ANC350_SNAPSHOT_TIME, seconds );
+  return nDiffs;
+}
+
+/*
+ * Function: anc350SnapshotDiff
+ *
+ * Parameters: fileName   - Snapshot file
+ *             reference  - Snapshot file to compare against
+ *
+ * Returns: Number of differences, -1 on error
+ *
+ * Description:
+ *
+ * Compares two snapshot files and prints the registers that differ.
+ */
+int anc350SnapshotDiff( const char * fileName, const char * reference )
+{
+  anc350Snap * pA;
+  anc350Snap * pB;
+  int nDiffs = -1;
+
+  if (fileName == NULL || reference == NULL){
+    printf( "Usage: anc350SnapshotDiff file reference\n" );
+    return -1;
+  }
+  pA = anc350SnapRead( fileName );
+  pB = anc350SnapRead( reference );
+  if (pA != NULL && pB != NULL) nDiffs = anc350SnapCompare( pA, pB );
+  anc350SnapFree( pA );
+  anc350SnapFree( pB );
+  return nDiffs;
+}
+
+/*
+ * Function: anc350SnapshotAxisDiff
+ *
+ * Parameters: fileName  - Snapshot file, the last snapshot taken if empty
+ *             cardA     - Card of the first axis
+ *             axisA     - First axis (1 based)
+ *             cardB     - Card of the second axis
+ *             axisB     - Second axis (1 based)
+ *
+ * Returns: Number of differences, -1 on error
+ *
+ * Description:
+ *
+ * Compares the axis registers of two axes within one snapshot.  The axes
+ * may be on different controllers.  Position and status registers are
+ * included, so expect them to differ.
+ */
+int anc350SnapshotAxisDiff( const char * fileName, int cardA, int axisA, int cardB, int axisB )
+{
+  anc350Snap * pSnap = NULL;
+  char targetA[SNAPSHOT_TARGET_SIZE];
+  char targetB[SNAPSHOT_TARGET_SIZE];
+  int nDiffs = 0;
+  int i;
+
+  epicsThreadOnce( &snapOnceId, anc350SnapInit, NULL );
+
+  epicsMutexLock( snapMutexId );
+  if (fileName != NULL && fileName[0] != '\0'){
+    pSnap = anc350SnapRead( fileName );
+  } else if (pLastSnap != NULL){
+    pSnap = callocMustSucceed( 1, sizeof( anc350Snap ), "anc350SnapshotAxisDiff" );
+    for (i = 0; i < pLastSnap->nValues; i++){
+      anc350SnapValue * pValue = &pLastSnap->values[i];
+      anc350SnapAdd( pSnap, pValue->card, pValue->target, pValue->name, pValue->address, pValue->valid, pValue->value );
+    }
+  } else {
+    printf( "anc350SnapshotAxisDiff: no snapshot has been taken, give a file name\n" );
+  }
+  epicsMutexUnlock( snapMutexId );
+  if (pSnap == NULL) return -1;
+
+  sprintf( targetA, "axis%d", axisA );
+  sprintf( targetB, "axis%d", axisB );
+  printf( "register              %6d/%-5s %6d/%-5s\n", cardA, targetA + 4, cardB, targetB + 4 );
+  for (i = 0; i < anc350NumRegisters; i++){
+    anc350SnapValue * pValueA;
+    anc350SnapValue * pValueB;
+
+    if (anc350Registers[i].scope != ANC350_REG_AXIS) continue;
+    pValueA = anc350SnapFind( pSnap, cardA, targetA, anc350Registers[i].name );
+    pValueB = anc350SnapFind( pSnap, cardB, targetB, anc350Registers[i].name );
+    if (anc350SnapSame( pValueA, pValueB )) continue;
+    nDiffs++;
+    printf( "%-21s", anc350Registers[i].name );
+    anc350SnapPrintValue( pValueA );
+    anc350SnapPrintValue( pValueB );
+    printf( "\n" );
+  }
+  printf( "%d difference%s\n", nDiffs, (nDiffs == 1)? "": "s" );
+  anc350SnapFree( pSnap );
+  return nDiffs;
+}
+
+/*
+ * Function: anc350SnapshotParamWrite
+ *
+ * Parameters: None
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Called in the crate port thread when ANC350_SNAPSHOT is written.  Takes
+ * a snapshot into ANC350_SNAPSHOT_DIR, compares it with ANC350_SNAPSHOT_REF
+ * and resets the trigger, so the record completes when the job is done.
+ */
+asynStatus anc350SnapshotParamWrite( void )
+{
+  char directory[256];
+  char reference[256];
+  int trigger = 0;
+  int status;
+
+  anc350ParamGetInteger( NULL, 0, ANC350_SNAPSHOT, &trigger );
+  if (trigger == 0) return asynSuccess;
+
+  anc350ParamGetString( NULL, 0, ANC350_SNAPSHOT_DIR, directory, sizeof( directory ) );
+  anc350ParamGetString( NULL, 0, ANC350_SNAPSHOT_REF, reference, sizeof( reference ) );
+  status = anc350Snapshot( directory, reference );
+  anc350ParamSetInteger( NULL, 0, ANC350_SNAPSHOT, 0 );
+  return (status < 0)? asynError: asynSuccess;
+}
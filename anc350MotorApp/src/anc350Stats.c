@@ -0,0 +1,329 @@
+/*
+ * File:   anc350Stats.c
+ *
+ * Description:
+ *
+ * Per-axis motion statistics.  Every move started by the motor record is
+ * followed by the poller until the axis stops, and its outcome is counted
+ * in fixed size histograms kept with the axis:
+ *
+ *   duration    RUN command to the poll that sees the axis stopped (s)
+ *   polls       polls of the axis from the RUN command to Done
+ *   overshoot   peak travel past the target seen by the polls (counts)
+ *   error       final distance from the target (counts)
+ *   retries     moves to the same target just before this one, which is
+ *               how motor record retries show up in the driver
+ *
+ * The first four use power of two bins: bin 0 counts values below the
+ * base, bin i values from base * 2^(i-1) up to base * 2^i, and the last
+ * bin everything above.  The retries histogram has one bin per retry
+ * count, the last bin again taking everything above.  Each histogram is
+ * published as a waveform after every move and can be cleared with
+ * ANC350_STAT_RESET.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "epicsTime.h"
+#include "epicsMutex.h"
+#include "epicsAtomic.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+
+/* Targets closer than this are the same target (counts) */
+#define STAT_SAME_TARGET 1
+
+typedef struct anc350StatDef
+{
+  int reason;
+  double base;      /* Upper edge of bin 0, 0 for one bin per integer value */
+} anc350StatDef;
+
+static const anc350StatDef statDefs[ANC350_STAT_KINDS] =
+{
+  [ANC350_STAT_KIND_DURATION]  = { ANC350_STAT_DURATION,  0.01 },
+  [ANC350_STAT_KIND_POLLS]     = { ANC350_STAT_POLLS,     1.0 },
+  [ANC350_STAT_KIND_OVERSHOOT] = { ANC350_STAT_OVERSHOOT, 1.0 },
+  [ANC350_STAT_KIND_ERROR]     = { ANC350_STAT_ERROR,     1.0 },
+  [ANC350_STAT_KIND_RETRIES]   = { ANC350_STAT_RETRIES,   0.0 },
+};
+
+/*
+ * Function: anc350StatsBin
+ *
+ * Parameters: kind    - ANC350_STAT_KIND_...
+ *             value   - Value to count
+ *
+ * Returns: Histogram bin of the value
+ */
+static int anc350StatsBin( int kind, double value )
+{
+  double edge = statDefs[kind].base;
+  int bin;
+
+  if (edge <= 0.0){
+    bin = (value < 0.0)? 0: (int) value;
+    return (bin < ANC350_STAT_BINS - 1)? bin: ANC350_STAT_BINS - 1;
+  }
+  for (bin = 0; bin < ANC350_STAT_BINS - 1 && value >= edge; bin++) edge *= 2.0;
+  return bin;
+}
+
+/*
+ * Function: anc350StatsPublish
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Posts the histograms and the move count.  Called with the axis mutex
+ * held.
+ */
+static void anc350StatsPublish( AXIS_HDL pAxis )
+{
+  double counts[ANC350_STAT_BINS];
+  epicsTimeStamp now;
+  int kind;
+  int i;
+
+  drvAnc350TimeGetCurrent( &now );
+  for (kind = 0; kind < ANC350_STAT_KINDS; kind++){
+    for (i = 0; i < ANC350_STAT_BINS; i++) counts[i] = (double) pAxis->statHist[kind][i];
+    anc350ParamSetDoubleArray( pAxis->pDrv, pAxis->axis, statDefs[kind].reason, counts, ANC350_STAT_BINS, &now );
+  }
+  anc350ParamSetInteger( pAxis->pDrv, pAxis->axis, ANC350_STAT_MOVES, pAxis->statMoves );
+}
+
+/*
+ * Function: drvAnc350StatsInit
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Starts the axis with empty histograms.
+ */
+void drvAnc350StatsInit( AXIS_HDL pAxis )
+{
+  memset( pAxis->statHist, 0, sizeof( pAxis->statHist ) );
+  pAxis->statMoves = 0;
+  pAxis->statPending = 0;
+  pAxis->statLastValid = 0;
+  pAxis->statRetry = 0;
+}
+
+/*
+ * Function: drvAnc350StatsStart
+ *
+ * Parameters: pAxis    - Pointer to motor axis handle
+ *             target   - Raw target position of the move
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called by motorAxisMove with the axis mutex held, once the RUN command
+ * has been sent.
+ */
+void drvAnc350StatsStart( AXIS_HDL pAxis, int target )
+{
+  int counter = (int)(pAxis->previous_position + pAxis->reference_position);
+
+  if (pAxis->statLastValid && abs( target - pAxis->statLastTarget ) <= STAT_SAME_TARGET) pAxis->statRetry++;
+  else pAxis->statRetry = 0;
+  pAxis->statLastTarget = target;
+  pAxis->statLastValid = 1;
+
+  drvAnc350TimeGetCurrent( &pAxis->statStart );
+  pAxis->statPending = 1;
+  pAxis->statTarget = target;
+  pAxis->statDirection = (target >= counter)? 1: -1;
+  pAxis->statPolls = 0;
+  pAxis->statOvershoot = 0.0;
+}
+
+/*
+ * Function: drvAnc350StatsCancel
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called with the axis mutex held when a move is stopped, held back for a
+ * synchronised start, or replaced by a jog or home.  The move is not
+ * counted, and the next move is not a retry.
+ */
+void drvAnc350StatsCancel( AXIS_HDL pAxis )
+{
+  pAxis->statPending = 0;
+  pAxis->statLastValid = 0;
+}
+
+/*
+ * Function: drvAnc350StatsPoll
+ *
+ * Parameters: pAxis    - Pointer to motor axis handle
+ *             running  - Non-zero if the controller reports the axis running
+ *             counter  - Raw counter value read by the poller
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called by the poller with the axis mutex held.  Follows the overshoot
+ * of the move in progress and counts the move once the axis has stopped.
+ */
+void drvAnc350StatsPoll( AXIS_HDL pAxis, int running, int counter )
+{
+  epicsTimeStamp now;
+  double past;
+
+  if (!pAxis->statPending) return;
+
+  pAxis->statPolls++;
+  past = (double) pAxis->statDirection * (double)(counter - pAxis->statTarget);
+  if (past > pAxis->statOvershoot) pAxis->statOvershoot = past;
+  if (running) return;
+
+  drvAnc350TimeGetCurrent( &now );
+  pAxis->statPending = 0;
+  pAxis->statMoves++;
+  epicsAtomicIncrSizeT( &pAxis->metricMoves );
+  drvAnc350MetricsAdd( &pAxis->metricMoveTime, epicsTimeDiffInSeconds( &now, &pAxis->statStart ) );
+  pAxis->statHist[ANC350_STAT_KIND_DURATION][anc350StatsBin( ANC350_STAT_KIND_DURATION, epicsTimeDiffInSeconds( &now, &pAxis->statStart ) )]++;
+  pAxis->statHist[ANC350_STAT_KIND_POLLS][anc350StatsBin( ANC350_STAT_KIND_POLLS, (double) pAxis->statPolls )]++;
+  pAxis->statHist[ANC350_STAT_KIND_OVERSHOOT][anc350StatsBin( ANC350_STAT_KIND_OVERSHOOT, pAxis->statOvershoot )]++;
+  pAxis->statHist[ANC350_STAT_KIND_ERROR][anc350StatsBin( ANC350_STAT_KIND_ERROR, fabs( (double)(counter - pAxis->statTarget) ) )]++;
+  pAxis->statHist[ANC350_STAT_KIND_RETRIES][anc350StatsBin( ANC350_STAT_KIND_RETRIES, (double) pAxis->statRetry )]++;
+  anc350StatsPublish( pAxis );
+  drvAnc350StoreChanged();
+}
+
+/*
+ * Function: anc350StatsParamInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Publishes the histograms of every axis to the parameter port.
+ */
+void anc350StatsParamInit( ANC350DRV_ID pDrv )
+{
+  int i;
+
+  for (i = 0; i < pDrv->nAxes; i++){
+    AXIS_HDL pAxis = &pDrv->axis[i];
+
+    epicsMutexLock( pAxis->axisMutex );
+    anc350StatsPublish( pAxis );
+    epicsMutexUnlock( pAxis->axisMutex );
+  }
+}
+
+/*
+ * Function: anc350StatsParamWrite
+ *
+ * Parameters: pDrv    - Pointer to driver structure
+ *             addr    - Asyn address, the axis
+ *             reason  - Parameter written
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Clears the histograms of the axis when ANC350_STAT_RESET is written
+ * non-zero.
+ */
+asynStatus anc350StatsParamWrite( ANC350DRV_ID pDrv, int addr, int reason )
+{
+  AXIS_HDL pAxis;
+  int reset = 0;
+
+  if (pDrv == NULL || addr < 1 || addr > pDrv->nAxes) return asynError;
+  pAxis = &pDrv->axis[addr - 1];
+
+  anc350ParamGetInteger( pDrv, addr, ANC350_STAT_RESET, &reset );
+  if (!reset) return asynSuccess;
+
+  if (epicsMutexLock( pAxis->axisMutex ) != epicsMutexLockOK) return asynError;
+  memset( pAxis->statHist, 0, sizeof( pAxis->statHist ) );
+  pAxis->statMoves = 0;
+  anc350StatsPublish( pAxis );
+  epicsMutexUnlock( pAxis->axisMutex );
+  anc350ParamSetInteger( pDrv, addr, ANC350_STAT_RESET, 0 );
+  drvAnc350StoreChanged();
+  return asynSuccess;
+}
+
+/* Histograms of one axis in the calibration store, ANC350_STORE_STATS_V 1 */
+typedef struct anc350StatsKept
+{
+  epicsInt32 moves;
+  epicsUInt32 hist[ANC350_STAT_KINDS][ANC350_STAT_BINS];
+} anc350StatsKept;
+
+/*
+ * Function: drvAnc350StatsKeep
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             buf     - Buffer for the store payload
+ *             size    - Size of the buffer
+ *
+ * Returns: Payload length, 0 if there is nothing to keep
+ *
+ * Description:
+ *
+ * Called by the calibration store with the axis mutex held.
+ */
+size_t drvAnc350StatsKeep( AXIS_HDL pAxis, void * buf, size_t size )
+{
+  anc350StatsKept kept;
+
+  if (size < sizeof( kept ) || pAxis->statMoves == 0) return 0;
+  kept.moves = pAxis->statMoves;
+  memcpy( kept.hist, pAxis->statHist, sizeof( kept.hist ) );
+  memcpy( buf, &kept, sizeof( kept ) );
+  return sizeof( kept );
+}
+
+/*
+ * Function: drvAnc350StatsRestore
+ *
+ * Parameters: pAxis    - Pointer to motor axis handle
+ *             version  - Payload version it was kept with
+ *             buf      - Payload
+ *             length   - Payload length
+ *
+ * Returns: 0 if the histograms were restored, -1 if the payload was rejected
+ *
+ * Description:
+ *
+ * Called by the calibration store with the axis mutex held.  A change to
+ * the bins needs a new payload version and a conversion here.
+ */
+int drvAnc350StatsRestore( AXIS_HDL pAxis, int version, const void * buf, size_t length )
+{
+  anc350StatsKept kept;
+
+  if (version != ANC350_STORE_STATS_V || length != sizeof( kept )) return -1;
+  memcpy( &kept, buf, sizeof( kept ) );
+  if (kept.moves < 0) return -1;
+  pAxis->statMoves = kept.moves;
+  memcpy( pAxis->statHist, kept.hist, sizeof( pAxis->statHist ) );
+  return 0;
+}
@@ -0,0 +1,578 @@
+/*
+ * File:   anc350Store.c
+ *
+ * Description:
+ *
+ * Persistent calibration store.  What the driver learns about each axis,
+ * the move duration models of anc350Estimate.c and the histograms of
+ * anc350Stats.c, is kept in one binary file so that it survives a restart
+ * without being learned again.
+ *
+ * The file is a header followed by entries, each a section of one axis:
+ *
+ *   header   magic "ANC350CS", byte order mark, container format, number
+ *            of entries, size of the entries and their FNV-1a checksum
+ *   entry    asyn port of the controller, card, axis, section, payload
+ *            version and payload length, then the payload padded to 8
+ *            bytes
+ *
+ * The owner of a section turns its state into a payload and back with the
+ * drvAnc350XxxKeep and drvAnc350XxxRestore functions, so a section can
+ * change its layout by bumping its ANC350_STORE_XXX_V version and
+ * converting older payloads on restore.  Entries are matched to a
+ * controller by its asyn port, so renumbering the cards in the startup
+ * script does not hand one controller's calibration to another.  Entries
+ * of unknown sections, of newer versions and of ports without a
+ * controller are skipped, the rest of the file is still used.
+ *
+ * anc350StoreConfigure maps the file read-only and applies every entry
+ * before the first poll, which takes well under a millisecond per axis.
+ * Owners call drvAnc350StoreChanged when their state changes, a low
+ * priority thread then rewrites the file at most every STORE_SAVE_PERIOD
+ * seconds, and once more when the IOC exits.  The file is written under a
+ * temporary name, synced and renamed over the old one, so a crash leaves
+ * either the old or the new file.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsMutex.h"
+#include "epicsAtomic.h"
+#include "epicsExit.h"
+#include "epicsString.h"
+#include "epicsTypes.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+#define STORE_MAGIC        "ANC350CS"
+#define STORE_BYTE_ORDER   0x01020304
+#define STORE_FORMAT       1
+#define STORE_PORT_SIZE    40
+#define STORE_ALIGN        8
+#define STORE_PAYLOAD_MAX  4096
+#define STORE_SAVE_PERIOD  10.0
+
+typedef struct anc350StoreHeader
+{
+  char magic[8];
+  epicsUInt32 byteOrder;
+  epicsUInt32 format;
+  epicsUInt32 nEntries;
+  epicsUInt32 size;         /* Bytes of entries after the header */
+  epicsUInt32 checksum;     /* FNV-1a of the entries */
+  epicsUInt32 reserved;
+} anc350StoreHeader;
+
+typedef struct anc350StoreEntry
+{
+  char port[STORE_PORT_SIZE];   /* Asyn port of the controller, nul terminated */
+  epicsInt32 card;
+  epicsUInt16 axis;
+  epicsUInt16 section;
+  epicsUInt16 version;
+  epicsUInt16 reserved;
+  epicsUInt32 length;       /* Payload bytes, without the padding */
+  epicsUInt32 reserved2[2]; /* Keeps the payload 8 byte aligned */
+} anc350StoreEntry;
+
+typedef struct anc350StoreSection
+{
+  int id;
+  const char * name;
+  int version;
+  size_t (*keep)( AXIS_HDL pAxis, void * buf, size_t size );
+  int (*restore)( AXIS_HDL pAxis, int version, const void * buf, size_t length );
+} anc350StoreSection;
+
+static const anc350StoreSection storeSections[] =
+{
+  { ANC350_STORE_ESTIMATE, "estimate", ANC350_STORE_ESTIMATE_V, drvAnc350EstimateKeep, drvAnc350EstimateRestore },
+  { ANC350_STORE_STATS,    "stats",    ANC350_STORE_STATS_V,    drvAnc350StatsKeep,    drvAnc350StatsRestore },
+};
+#define STORE_SECTIONS (sizeof( storeSections ) / sizeof( storeSections[0] ))
+
+static char * storeFile = NULL;
+static int storeChanged = 0;
+static int storeSaves = 0;
+static int storeFailures = 0;
+static int storeLoaded = 0;
+static int storeSkipped = 0;
+static double storeLoadTime = 0.0;
+static epicsMutexId storeMutexId = NULL;
+static epicsThreadOnceId storeOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350StoreInitOnce( void * arg )
+{
+  storeMutexId = epicsMutexMustCreate();
+}
+
+static size_t anc350StorePad( size_t length )
+{
+  return (length + STORE_ALIGN - 1) & ~(size_t) (STORE_ALIGN - 1);
+}
+
+static epicsUInt32 anc350StoreChecksum( const unsigned char * p, size_t size )
+{
+  epicsUInt32 hash = 2166136261u;
+
+  while (size-- > 0){
+    hash ^= *p++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static const anc350StoreSection * anc350StoreFindSection( int id )
+{
+  size_t i;
+
+  for (i = 0; i < STORE_SECTIONS; i++){
+    if (storeSections[i].id == id) return &storeSections[i];
+  }
+  return NULL;
+}
+
+/*
+ * Function: anc350StoreFindPort
+ *
+ * Parameters: port   - Port name of an entry
+ *
+ * Returns: Controller on the port, NULL if none
+ *
+ * Description:
+ *
+ * Port names longer than an entry holds are compared as far as they were
+ * kept.
+ */
+static ANC350DRV_ID anc350StoreFindPort( const char * port )
+{
+  ANC350DRV_ID pDrv;
+
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    if (strncmp( pDrv->portName, port, STORE_PORT_SIZE - 1 ) == 0) return pDrv;
+  }
+  return NULL;
+}
+
+/*
+ * Function: drvAnc350StoreChanged
+ *
+ * Parameters: void
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Marks the store as out of date.  Safe to call from any thread, and with
+ * any driver lock held.
+ */
+void drvAnc350StoreChanged( void )
+{
+  epicsAtomicIncrIntT( &storeChanged );
+}
+
+/*
+ * Function: anc350StoreApply
+ *
+ * Parameters: image   - Mapped store file
+ *             size    - Size of the file
+ *
+ * Returns: Number of entries applied, -1 if the file is not a store
+ *
+ * Description:
+ *
+ * Checks the header and the checksum, then hands each entry to the owner
+ * of its section under the axis mutex.
+ */
+static int anc350StoreApply( const unsigned char * image, size_t size )
+{
+  anc350StoreHeader header;
+  const unsigned char * p;
+  const unsigned char * end;
+  int nApplied = 0;
+  epicsUInt32 i;
+
+  if (size < sizeof( header )) return -1;
+  memcpy( &header, image, sizeof( header ) );
+  if (memcmp( header.magic, STORE_MAGIC, sizeof( header.magic ) ) != 0) return -1;
+  if (header.byteOrder != STORE_BYTE_ORDER){
+    printf( "anc350StoreConfigure: store written on a host of other byte order\n" );
+    return -1;
+  }
+  switch (header.format){
+    case STORE_FORMAT:
+      break;
+    default:
+      printf( "anc350StoreConfigure: unknown store format %u\n", (unsigned) header.format );
+      return -1;
+  }
+  if (header.size > size - sizeof( header ) ||
+      anc350StoreChecksum( image + sizeof( header ), header.size ) != header.checksum){
+    printf( "anc350StoreConfigure: store is truncated or corrupt\n" );
+    return -1;
+  }
+
+  p = image + sizeof( header );
+  end = p + header.size;
+  for (i = 0; i < header.nEntries; i++){
+    const anc350StoreSection * pSection;
+    anc350StoreEntry entry;
+    ANC350DRV_ID pDrv;
+    AXIS_HDL pAxis;
+    int status;
+
+    if ((size_t) (end - p) < sizeof( entry )) break;
+    memcpy( &entry, p, sizeof( entry ) );
+    p += sizeof( entry );
+    entry.port[STORE_PORT_SIZE - 1] = 0;
+    pDrv = anc350StoreFindPort( entry.port );
+    if ((size_t) (end - p) < anc350StorePad( entry.length )) break;
+
+    pSection = anc350StoreFindSection( entry.section );
+    if (pSection == NULL || pDrv == NULL || entry.axis < 1 || entry.axis > pDrv->nAxes){
+      storeSkipped++;
+    } else if (entry.version > pSection->version){
+      printf( "anc350StoreConfigure: card %d axis %d %s version %d is newer than %d, skipped\n",
+              (int) entry.card, entry.axis, pSection->name, entry.version, pSection->version );
+      storeSkipped++;
+    } else {
+      pAxis = &pDrv->axis[entry.axis - 1];
+      epicsMutexLock( pAxis->axisMutex );
+      status = pSection->restore( pAxis, entry.version, p, entry.length );
+      epicsMutexUnlock( pAxis->axisMutex );
+      if (status == 0) nApplied++;
+      else storeSkipped++;
+    }
+    p += anc350StorePad( entry.length );
+  }
+  return nApplied;
+}
+
+/*
+ * Function: anc350StoreLoad
+ *
+ * Parameters: fileName   - Store file
+ *
+ * Returns: Number of entries applied, -1 if the file cannot be used
+ *
+ * Description:
+ *
+ * Maps the file read-only and applies it.
+ */
+static int anc350StoreLoad( const char * fileName )
+{
+  struct stat st;
+  void * image;
+  int fd;
+  int nApplied;
+
+  if ((fd = open( fileName, O_RDONLY )) < 0) return -1;
+  if (fstat( fd, &st ) != 0 || st.st_size == 0){
+    close( fd );
+    return -1;
+  }
+  image = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if (image == MAP_FAILED) return -1;
+
+  nApplied = anc350StoreApply( image, (size_t) st.st_size );
+  munmap( image, (size_t) st.st_size );
+  return nApplied;
+}
+
+/*
+ * Function: anc350StoreBuild
+ *
+ * Parameters: pSize   - Returns the size of the image
+ *
+ * Returns: Image of the store file, NULL if out of memory
+ *
+ * Description:
+ *
+ * Collects the payload of every section of every axis, each under its
+ * axis mutex.
+ */
+static unsigned char * anc350StoreBuild( size_t * pSize )
+{
+  anc350StoreHeader header;
+  unsigned char payload[STORE_PAYLOAD_MAX];
+  unsigned char * image;
+  size_t allocated = 4096;
+  size_t used = sizeof( header );
+  ANC350DRV_ID pDrv;
+
+  if ((image = malloc( allocated )) == NULL) return NULL;
+  memset( &header, 0, sizeof( header ) );
+
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    int i;
+
+    for (i = 0; i < pDrv->nAxes; i++){
+      AXIS_HDL pAxis = &pDrv->axis[i];
+      size_t j;
+
+      for (j = 0; j < STORE_SECTIONS; j++){
+        anc350StoreEntry entry;
+        size_t length;
+        size_t need;
+
+        epicsMutexLock( pAxis->axisMutex );
+        length = storeSections[j].keep( pAxis, payload, sizeof( payload ) );
+        epicsMutexUnlock( pAxis->axisMutex );
+        if (length == 0) continue;
+
+        need = used + sizeof( entry ) + anc350StorePad( length );
+        if (need > allocated){
+          unsigned char * larger;
+
+          while (need > allocated) allocated *= 2;
+          if ((larger = realloc( image, allocated )) == NULL){
+            free( image );
+            return NULL;
+          }
+          image = larger;
+        }
+
+        memset( &entry, 0, sizeof( entry ) );
+        strncpy( entry.port, pDrv->portName, STORE_PORT_SIZE - 1 );
+        entry.card = pDrv->card;
+        entry.axis = (epicsUInt16) pAxis->axis;
+        entry.section = (epicsUInt16) storeSections[j].id;
+        entry.version = (epicsUInt16) storeSections[j].version;
+        entry.length = (epicsUInt32) length;
+        memcpy( image + used, &entry, sizeof( entry ) );
+        used += sizeof( entry );
+        memcpy( image + used, payload, length );
+        memset( image + used + length, 0, anc350StorePad( length ) - length );
+        used += anc350StorePad( length );
+        header.nEntries++;
+      }
+    }
+  }
+
+  memcpy( header.magic, STORE_MAGIC, sizeof( header.magic ) );
+  header.byteOrder = STORE_BYTE_ORDER;
+  header.format = STORE_FORMAT;
+  header.size = (epicsUInt32) (used - sizeof( header ));
+  header.checksum = anc350StoreChecksum( image + sizeof( header ), header.size );
+  memcpy( image, &header, sizeof( header ) );
+  *pSize = used;
+  return image;
+}
+
+/*
+ * Function: anc350StoreWrite
+ *
+ * Parameters: void
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Called with the store mutex held.  Writes the image under a temporary
+ * name, syncs it and renames it over the store.  The changes seen before
+ * the image was built are only cleared once it is on disk.
+ */
+static int anc350StoreWrite( void )
+{
+  unsigned char * image;
+  char * tmpName;
+  size_t size = 0;
+  int changed;
+  int status = MOTOR_AXIS_ERROR;
+  int fd;
+
+  changed = epicsAtomicGetIntT( &storeChanged );
+  if ((image = anc350StoreBuild( &size )) == NULL){
+    printf( "anc350StoreSave: out of memory\n" );
+    storeFailures++;
+    return MOTOR_AXIS_ERROR;
+  }
+  if ((tmpName = malloc( strlen( storeFile ) + 5 )) == NULL){
+    free( image );
+    storeFailures++;
+    return MOTOR_AXIS_ERROR;
+  }
+  sprintf( tmpName, "%s.tmp", storeFile );
+
+  if ((fd = open( tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644 )) < 0){
+    printf( "anc350StoreSave: cannot create %s\n", tmpName );
+  } else {
+    size_t done = 0;
+
+    while (done < size){
+      ssize_t n = write( fd, image + done, size - done );
+
+      if (n <= 0) break;
+      done += (size_t) n;
+    }
+    if (done == size && fsync( fd ) == 0 && close( fd ) == 0){
+      if (rename( tmpName, storeFile ) == 0) status = MOTOR_AXIS_OK;
+      else printf( "anc350StoreSave: cannot replace %s\n", storeFile );
+    } else {
+      printf( "anc350StoreSave: cannot write %s\n", tmpName );
+      close( fd );
+    }
+    if (status != MOTOR_AXIS_OK) remove( tmpName );
+  }
+
+  if (status == MOTOR_AXIS_OK){
+    epicsAtomicAddIntT( &storeChanged, -changed );
+    storeSaves++;
+  } else {
+    storeFailures++;
+  }
+  free( tmpName );
+  free( image );
+  return status;
+}
+
+/*
+ * Function: anc350StoreSave
+ *
+ * Parameters: void
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Writes the store now, whether it changed or not.
+ */
+int anc350StoreSave( void )
+{
+  int status;
+
+  epicsThreadOnce( &storeOnceId, anc350StoreInitOnce, NULL );
+  epicsMutexLock( storeMutexId );
+  if (storeFile == NULL){
+    epicsMutexUnlock( storeMutexId );
+    printf( "anc350StoreSave: no store file, see anc350StoreConfigure\n" );
+    return MOTOR_AXIS_ERROR;
+  }
+  status = anc350StoreWrite();
+  epicsMutexUnlock( storeMutexId );
+  return status;
+}
+
+static void anc350StoreTask( void * arg )
+{
+  for (;;){
+    epicsThreadSleep( STORE_SAVE_PERIOD );
+    if (epicsAtomicGetIntT( &storeChanged ) == 0) continue;
+    epicsMutexLock( storeMutexId );
+    anc350StoreWrite();
+    epicsMutexUnlock( storeMutexId );
+  }
+}
+
+static void anc350StoreExit( void * arg )
+{
+  if (epicsAtomicGetIntT( &storeChanged ) == 0) return;
+  epicsMutexLock( storeMutexId );
+  anc350StoreWrite();
+  epicsMutexUnlock( storeMutexId );
+}
+
+/*
+ * Function: anc350StoreConfigure
+ *
+ * Parameters: fileName   - File the calibration store is kept in
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Loads the store from the file, if it exists, and keeps it there from
+ * now on.  Call after the controllers have been created and before
+ * iocInit, so the first poll already works with the restored state.
+ */
+int anc350StoreConfigure( const char * fileName )
+{
+  ANC350DRV_ID pDrv;
+  epicsTimeStamp start;
+  epicsTimeStamp end;
+  int nApplied;
+  int first;
+
+  if (fileName == NULL || fileName[0] == 0){
+    printf( "anc350StoreConfigure: no file name\n" );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  epicsThreadOnce( &storeOnceId, anc350StoreInitOnce, NULL );
+  epicsMutexLock( storeMutexId );
+  first = (storeFile == NULL);
+  free( storeFile );
+  storeFile = epicsStrDup( fileName );
+
+  epicsTimeGetCurrent( &start );
+  nApplied = anc350StoreLoad( fileName );
+  epicsTimeGetCurrent( &end );
+  storeLoadTime = epicsTimeDiffInSeconds( &end, &start );
+  epicsMutexUnlock( storeMutexId );
+
+  if (nApplied < 0){
+    printf( "anc350StoreConfigure: no usable store in %s, starting empty\n", fileName );
+  } else {
+    storeLoaded = nApplied;
+    printf( "anc350StoreConfigure: %d entries restored from %s in %.0f us\n",
+            nApplied, fileName, storeLoadTime * 1e6 );
+  }
+
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    if (pDrv->pParamPort == NULL) continue;
+    anc350EstimateParamInit( pDrv );
+    anc350StatsParamInit( pDrv );
+  }
+
+  if (first){
+    if (epicsThreadCreate( "anc350Store", epicsThreadPriorityLow,
+                           epicsThreadGetStackSize( epicsThreadStackMedium ),
+                           anc350StoreTask, NULL ) == NULL){
+      printf( "anc350StoreConfigure: cannot start the save thread\n" );
+    }
+    epicsAtExit( anc350StoreExit, NULL );
+  }
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: anc350StoreShow
+ *
+ * Parameters: void
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Prints the store file, the sections it holds and how it has been doing.
+ */
+int anc350StoreShow( void )
+{
+  size_t i;
+
+  epicsThreadOnce( &storeOnceId, anc350StoreInitOnce, NULL );
+  epicsMutexLock( storeMutexId );
+  printf( "Store file      %s\n", (storeFile != NULL)? storeFile: "(none)" );
+  printf( "Format          %d\n", STORE_FORMAT );
+  for (i = 0; i < STORE_SECTIONS; i++){
+    printf( "Section %d       %s version %d\n", storeSections[i].id, storeSections[i].name, storeSections[i].version );
+  }
+  printf( "Restored        %d entries in %.0f us, %d skipped\n", storeLoaded, storeLoadTime * 1e6, storeSkipped );
+  printf( "Saves           %d, %d failed\n", storeSaves, storeFailures );
+  printf( "Unsaved changes %d\n", epicsAtomicGetIntT( &storeChanged ) );
+  epicsMutexUnlock( storeMutexId );
+  return MOTOR_AXIS_OK;
+}
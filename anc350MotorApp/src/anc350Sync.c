@@ -0,0 +1,397 @@
+/*
+ * File:   anc350Sync.c
+ *
+ * Description:
+ *
+ * Synchronised motion start across controllers.  Controllers are put in a
+ * synchronisation group with anc350SyncGroupAdd.  While moves are deferred,
+ * either for the group (ANC350_SYNC_DEFER on the crate port) or for one
+ * controller (the motor record DEFER field, motorAxisDeferMoves), a move
+ * writes its target to the controller straight away but holds back the
+ * RUN command.  When the deferral is released the held RUN commands of
+ * every controller in the group are written back-to-back from one thread,
+ * one write per controller, before any acks are read, so the start skew
+ * is limited by the network rather than by command round trips.
+ *
+ * A burst carries at most ANC350_MAX_PIPELINE commands, so a controller
+ * with more held back moves than that is started over several rounds.
+ *
+ * The time between the first and last RUN write is reported as the skew.
+ * Each controller starts some time between its RUN write and its ack, so
+ * the latest ack less the earliest write bounds the real start skew.
+ * Controllers whose write failed did not start and are left out.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsMutex.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+typedef struct anc350SyncGroup
+{
+  int deferred;
+} anc350SyncGroup;
+
+/* RUN commands of one controller, written in one go */
+typedef struct anc350SyncStart
+{
+  ANC350DRV_ID pDrv;
+  int nOps;
+  int failed;
+  epicsTimeStamp sent;
+  anc350Op ops[ANC350_MAX_PIPELINE];
+  AXIS_HDL axes[ANC350_MAX_PIPELINE];
+} anc350SyncStart;
+
+static anc350SyncGroup syncGroups[ANC350_MAX_SYNC_GROUPS + 1];
+static epicsMutexId syncMutexId = NULL;
+static epicsThreadOnceId syncOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350SyncInit( void * arg )
+{
+  syncMutexId = epicsMutexMustCreate();
+}
+
+/*
+ * Function: drvAnc350SyncIsDeferred
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: Non-zero if RUN commands to the controller are held back
+ *
+ * Description:
+ *
+ * Called with syncMutexId held.  A controller in a group is deferred if
+ * the group or any controller of the group is deferred, so that a DEFER on
+ * one motor record port holds back the whole group.
+ */
+static int drvAnc350SyncIsDeferred( ANC350DRV_ID pDrv )
+{
+  ANC350DRV_ID pMember;
+
+  if (pDrv->syncGroup == 0) return pDrv->movesDeferred;
+  if (syncGroups[pDrv->syncGroup].deferred) return 1;
+  for (pMember = drvAnc350First(); pMember != NULL; pMember = pMember->pNext){
+    if (pMember->syncGroup == pDrv->syncGroup && pMember->movesDeferred) return 1;
+  }
+  return 0;
+}
+
+/*
+ * Function: drvAnc350SyncDefer
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             cmd     - RUN command address (ID_ANC_RUN_TARGET or ID_ANC_RUN_RELATIVE)
+ *
+ * Returns: 1 if the command has been held back, 0 if it should be sent now
+ *
+ * Description:
+ *
+ * Called by motorAxisMove after the target has been written.
+ */
+int drvAnc350SyncDefer( AXIS_HDL pAxis, int cmd )
+{
+  int deferred;
+
+  epicsThreadOnce( &syncOnceId, anc350SyncInit, NULL );
+
+  epicsMutexLock( syncMutexId );
+  deferred = drvAnc350SyncIsDeferred( pAxis->pDrv );
+  if (deferred) pAxis->syncCmd = cmd;
+  epicsMutexUnlock( syncMutexId );
+  return deferred;
+}
+
+/*
+ * Function: drvAnc350SyncCancel
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Drops a held back RUN command.  Called when a stop, home or jog
+ * supersedes the deferred move, so the move is not started when the
+ * deferral is released and Done is no longer held at 0 for it.
+ */
+void drvAnc350SyncCancel( AXIS_HDL pAxis )
+{
+  epicsThreadOnce( &syncOnceId, anc350SyncInit, NULL );
+
+  epicsMutexLock( syncMutexId );
+  pAxis->syncCmd = 0;
+  epicsMutexUnlock( syncMutexId );
+}
+
+/*
+ * Function: anc350SyncFire
+ *
+ * Parameters: group   - Synchronisation group, 0 to fire only pDrv
+ *             pDrv    - Controller to fire when group is 0
+ *
+ * Returns: Number of RUN commands fired
+ *
+ * Description:
+ *
+ * Writes the held back RUN commands.  All controllers are written to
+ * before any acks are read, and the write times are used to work out the
+ * skew.  A command stays held back until its write has been made, so the
+ * poller keeps the axis moving in the meantime.  The results are posted
+ * to the group parameters.
+ */
+static int anc350SyncFire( int group, ANC350DRV_ID pDrv )
+{
+  ANC350DRV_ID pMember;
+  anc350SyncStart * starts;
+  epicsTimeStamp first;
+  epicsTimeStamp acked;
+  int haveFirst = 0;
+  int nControllers = 0;
+  int nStarted;
+  int nMoves = 0;
+  int nOk = 0;
+  int more;
+  int i;
+  int j;
+  double skew = 0.0;
+  double skewLimit = 0.0;
+
+  for (pMember = drvAnc350First(); pMember != NULL; pMember = pMember->pNext) nControllers++;
+  if (nControllers == 0) return 0;
+  starts = callocMustSucceed( nControllers, sizeof( anc350SyncStart ), "anc350SyncFire" );
+
+  do {
+    more = 0;
+    nStarted = 0;
+    memset( starts, 0, nControllers * sizeof( anc350SyncStart ) );
+
+    /* Collect the held back commands, one burst per controller */
+    epicsMutexLock( syncMutexId );
+    for (pMember = drvAnc350First(); pMember != NULL; pMember = pMember->pNext){
+      anc350SyncStart * pStart = &starts[nStarted];
+
+      if ((group != 0)? (pMember->syncGroup != group): (pMember != pDrv)) continue;
+      for (i = 0; i < pMember->nAxes; i++){
+        AXIS_HDL pAxis = &pMember->axis[i];
+
+        if (pAxis->syncCmd == 0) continue;
+        if (drvAnc350Inhibited( pAxis )){
+          drvAnc350InhibitRejected( pAxis, "held back move" );
+          pAxis->syncCmd = 0;
+          continue;
+        }
+        /* Burst full, the rest go in the next round */
+        if (pStart->nOps == ANC350_MAX_PIPELINE){
+          more = 1;
+          continue;
+        }
+        pStart->axes[pStart->nOps] = pAxis;
+        drvAnc350OpSet( &pStart->ops[pStart->nOps++], pAxis->syncCmd, pAxis->axis - 1, 1 );
+      }
+      if (pStart->nOps > 0){
+        pStart->pDrv = pMember;
+        nStarted++;
+      }
+    }
+    epicsMutexUnlock( syncMutexId );
+
+    /* Put every RUN on the wire before reading any acks */
+    for (i = 0; i < nStarted; i++){
+      if (drvAnc350BurstStart( starts[i].pDrv, starts[i].ops, starts[i].nOps, starts[i].pDrv->burstTimeout ) != MOTOR_AXIS_OK){
+        starts[i].failed = 1;
+      }
+      drvAnc350TimeGetCurrent( &starts[i].sent );
+      if (!starts[i].failed && !haveFirst){
+        first = starts[i].sent;
+        haveFirst = 1;
+      }
+    }
+
+    /* Release the commands, they are cleared even if the write failed */
+    epicsMutexLock( syncMutexId );
+    for (i = 0; i < nStarted; i++){
+      for (j = 0; j < starts[i].nOps; j++){
+        if (starts[i].axes[j]->syncCmd == starts[i].ops[j].address) starts[i].axes[j]->syncCmd = 0;
+      }
+    }
+    epicsMutexUnlock( syncMutexId );
+
+    for (i = 0; i < nStarted; i++){
+      for (j = 0; j < starts[i].nOps; j++){
+        drvAnc350TraceTelegram( starts[i].axes[j], starts[i].ops[j].address );
+      }
+    }
+
+    for (i = 0; i < nStarted; i++){
+      nMoves += starts[i].nOps;
+      if (starts[i].failed) continue;
+      nOk += drvAnc350BurstFinish( starts[i].pDrv, starts[i].ops, starts[i].nOps, starts[i].pDrv->burstTimeout );
+      drvAnc350TimeGetCurrent( &acked );
+      if (epicsTimeDiffInSeconds( &starts[i].sent, &first ) > skew){
+        skew = epicsTimeDiffInSeconds( &starts[i].sent, &first );
+      }
+      if (epicsTimeDiffInSeconds( &acked, &first ) > skewLimit){
+        skewLimit = epicsTimeDiffInSeconds( &acked, &first );
+      }
+      epicsEventSignal( starts[i].pDrv->pollEventId );
+    }
+  } while (more);
+  free( starts );
+
+  if (nOk != nMoves){
+    printf( "anc350SyncFire: group %d, %d of %d RUN commands were not acknowledged\n", group, nMoves - nOk, nMoves );
+  }
+
+  if (group != 0){
+    anc350ParamSetInteger( NULL, group, ANC350_SYNC_MOVES, nMoves );
+    anc350ParamSetDouble( NULL, group, ANC350_SYNC_SKEW, skew );
+    anc350ParamSetDouble( NULL, group, ANC350_SYNC_SKEW_LIMIT, skewLimit );
+  }
+  return nMoves;
+}
+
+/*
+ * Function: drvAnc350SyncRelease
+ *
+ * Parameters: group   - Synchronisation group, 0 if pDrv is not in a group
+ *             pDrv    - Controller whose deferral has been released
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Fires the held back moves if nothing holds the group (or the single
+ * controller) back any more.
+ */
+static void drvAnc350SyncRelease( int group, ANC350DRV_ID pDrv )
+{
+  int deferred;
+
+  epicsMutexLock( syncMutexId );
+  deferred = drvAnc350SyncIsDeferred( pDrv );
+  epicsMutexUnlock( syncMutexId );
+  if (!deferred) anc350SyncFire( group, pDrv );
+}
+
+/*
+ * Function: drvAnc350SyncDeferMoves
+ *
+ * Parameters: pDrv    - Pointer to driver structure
+ *             defer   - Non-zero to defer moves, zero to start the deferred moves
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Handles motorAxisDeferMoves from the motor record.
+ */
+void drvAnc350SyncDeferMoves( ANC350DRV_ID pDrv, int defer )
+{
+  epicsThreadOnce( &syncOnceId, anc350SyncInit, NULL );
+
+  epicsMutexLock( syncMutexId );
+  pDrv->movesDeferred = (defer != 0);
+  epicsMutexUnlock( syncMutexId );
+  if (!defer) drvAnc350SyncRelease( pDrv->syncGroup, pDrv );
+}
+
+/*
+ * Function: anc350SyncGroupAdd
+ *
+ * Parameters: group   - Synchronisation group (1 to ANC350_MAX_SYNC_GROUPS)
+ *             card    - Number representing the motor controller
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Adds a controller to a synchronisation group.  A controller can be in
+ * one group only.
+ */
+int anc350SyncGroupAdd( int group, int card )
+{
+  ANC350DRV_ID pDrv = drvAnc350FindCard( card );
+
+  if (group < 1 || group > ANC350_MAX_SYNC_GROUPS){
+    printf( "anc350SyncGroupAdd: group must be 1 to %d\n", ANC350_MAX_SYNC_GROUPS );
+    return MOTOR_AXIS_ERROR;
+  }
+  if (pDrv == NULL){
+    printf( "anc350SyncGroupAdd: card %d has not been created\n", card );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  epicsThreadOnce( &syncOnceId, anc350SyncInit, NULL );
+  epicsMutexLock( syncMutexId );
+  pDrv->syncGroup = group;
+  epicsMutexUnlock( syncMutexId );
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: anc350SyncGroupDefer
+ *
+ * Parameters: group   - Synchronisation group
+ *             defer   - Non-zero to defer moves, zero to start the deferred moves
+ *
+ * Returns: Number of RUN commands fired
+ *
+ * Description:
+ *
+ * Defers the moves of every controller in the group, or starts them.
+ */
+int anc350SyncGroupDefer( int group, int defer )
+{
+  ANC350DRV_ID pDrv;
+  int nMoves = 0;
+
+  if (group < 1 || group > ANC350_MAX_SYNC_GROUPS) return 0;
+
+  epicsThreadOnce( &syncOnceId, anc350SyncInit, NULL );
+  epicsMutexLock( syncMutexId );
+  syncGroups[group].deferred = (defer != 0);
+  for (pDrv = drvAnc350First(); pDrv != NULL && pDrv->syncGroup != group; pDrv = pDrv->pNext){}
+  epicsMutexUnlock( syncMutexId );
+
+  if (!defer && pDrv != NULL){
+    int deferred;
+
+    epicsMutexLock( syncMutexId );
+    deferred = drvAnc350SyncIsDeferred( pDrv );
+    epicsMutexUnlock( syncMutexId );
+    if (!deferred) nMoves = anc350SyncFire( group, pDrv );
+    else printf( "anc350SyncGroupDefer: group %d is still deferred by a controller\n", group );
+  }
+  return nMoves;
+}
+
+/*
+ * Function: anc350SyncParamWrite
+ *
+ * Parameters: group   - Crate port address of the write, the group number
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Called in the crate port thread when ANC350_SYNC_DEFER is written.
+ */
+asynStatus anc350SyncParamWrite( int group )
+{
+  int defer = 0;
+
+  anc350ParamGetInteger( NULL, group, ANC350_SYNC_DEFER, &defer );
+  anc350SyncGroupDefer( group, defer );
+  return asynSuccess;
+}
@@ -0,0 +1,493 @@
+/*
+ * File:   anc350Trace.c
+ *
+ * Description:
+ *
+ * Per-move latency tracing.  Every move, home and jog opens a span on its
+ * axis recording when the command was entered, when each telegram was
+ * sent, when the poller first saw RUNNING and then saw it clear, when Done
+ * was published and when the motor record callback returned.  Completed
+ * spans go into a ring buffer shared by all axes.  anc350TraceShow prints
+ * per-phase percentiles for each axis and anc350TraceDump the last spans.
+ *
+ * RUNNING is only seen by the poller, so the running and to-done phases
+ * include up to one poll period of delay.  That delay is one of the things
+ * the breakdown is meant to show.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsMutex.h"
+#include "cantProceed.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+#define TRACE_RING_SIZE 1024
+
+/* Phases reported by anc350TraceShow */
+#define TRACE_PHASE_TELEGRAMS  0
+#define TRACE_PHASE_TO_RUNNING 1
+#define TRACE_PHASE_RUNNING    2
+#define TRACE_PHASE_TO_DONE    3
+#define TRACE_PHASE_CALLBACK   4
+#define TRACE_PHASE_TOTAL      5
+#define TRACE_NUM_PHASES       6
+
+static const char * phaseNames[TRACE_NUM_PHASES] =
+{
+  "telegrams", "to running", "running", "to done", "callback", "total"
+};
+
+static const char * kindNames[] = { "move", "home", "jog" };
+
+static anc350Span traceRing[TRACE_RING_SIZE];
+static int traceNext = 0;
+static int traceCount = 0;
+static int traceEnabled = 1;
+static epicsMutexId traceMutexId = NULL;
+static epicsThreadOnceId traceOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350TraceInit( void * arg )
+{
+  traceMutexId = epicsMutexMustCreate();
+}
+
+/*
+ * Function: anc350TraceClose
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Moves the span of the axis into the ring buffer.  Called with
+ * traceMutexId held.  A span is closed early, with phases missing, if the
+ * next command arrives before it completes.
+ */
+static void anc350TraceClose( AXIS_HDL pAxis )
+{
+  pAxis->span.flags &= ~ANC350_SPAN_OPEN;
+  traceRing[traceNext] = pAxis->span;
+  traceNext = (traceNext + 1) % TRACE_RING_SIZE;
+  if (traceCount < TRACE_RING_SIZE) traceCount++;
+}
+
+/*
+ * Function: drvAnc350TraceStart
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             kind    - ANC350_SPAN_MOVE, ANC350_SPAN_HOME or ANC350_SPAN_JOG
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Opens a span at command entry.
+ */
+void drvAnc350TraceStart( AXIS_HDL pAxis, int kind )
+{
+  epicsTimeStamp now;
+
+  if (!traceEnabled) return;
+  drvAnc350TimeGetCurrent( &now );
+  epicsThreadOnce( &traceOnceId, anc350TraceInit, NULL );
+
+  epicsMutexLock( traceMutexId );
+  if (pAxis->span.flags & ANC350_SPAN_OPEN) anc350TraceClose( pAxis );
+  memset( &pAxis->span, 0, sizeof( anc350Span ) );
+  pAxis->span.card = pAxis->pDrv->card;
+  pAxis->span.axis = pAxis->axis;
+  pAxis->span.kind = kind;
+  pAxis->span.flags = ANC350_SPAN_OPEN;
+  pAxis->span.entry = now;
+  epicsMutexUnlock( traceMutexId );
+}
+
+/*
+ * Function: drvAnc350TraceTelegram
+ *
+ * Parameters: pAxis    - Pointer to motor axis handle
+ *             address  - Register address of the telegram just sent
+ *
+ * Returns: void
+ */
+void drvAnc350TraceTelegram( AXIS_HDL pAxis, int address )
+{
+  epicsTimeStamp now;
+  anc350Span * pSpan = &pAxis->span;
+
+  if (!(pSpan->flags & ANC350_SPAN_OPEN)) return;
+  drvAnc350TimeGetCurrent( &now );
+
+  epicsMutexLock( traceMutexId );
+  if ((pSpan->flags & ANC350_SPAN_OPEN) && !(pSpan->flags & ANC350_SPAN_CLEARED)){
+    if (pSpan->nTelegrams < ANC350_SPAN_TELEGRAMS){
+      pSpan->address[pSpan->nTelegrams] = address;
+      pSpan->sent[pSpan->nTelegrams++] = now;
+    }
+    if (address == ID_ANC_RUN_TARGET || address == ID_ANC_RUN_RELATIVE ||
+        address == ID_ANC_CONT_FWD || address == ID_ANC_CONT_BKWD) pSpan->flags |= ANC350_SPAN_STARTED;
+  }
+  epicsMutexUnlock( traceMutexId );
+}
+
+/*
+ * Function: drvAnc350TraceStatus
+ *
+ * Parameters: pAxis    - Pointer to motor axis handle
+ *             running  - Non-zero if the STATUS just read has RUNNING set
+ *
+ * Returns: void
+ */
+void drvAnc350TraceStatus( AXIS_HDL pAxis, int running )
+{
+  epicsTimeStamp now;
+  anc350Span * pSpan = &pAxis->span;
+
+  if (!(pSpan->flags & ANC350_SPAN_OPEN)) return;
+  drvAnc350TimeGetCurrent( &now );
+
+  epicsMutexLock( traceMutexId );
+  if ((pSpan->flags & ANC350_SPAN_OPEN) && (pSpan->flags & ANC350_SPAN_STARTED)){
+    if (running && !(pSpan->flags & ANC350_SPAN_CLEARED)){
+      if (!(pSpan->flags & ANC350_SPAN_RUNNING)) pSpan->runningSeen = now;
+      pSpan->runningLast = now;
+      pSpan->flags |= ANC350_SPAN_RUNNING;
+    } else if (!running && !(pSpan->flags & ANC350_SPAN_CLEARED)){
+      pSpan->runningCleared = now;
+      pSpan->flags |= ANC350_SPAN_CLEARED;
+    }
+  }
+  epicsMutexUnlock( traceMutexId );
+}
+
+/*
+ * Function: drvAnc350TraceCallback
+ *
+ * Parameters: pAxis    - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called by the poller around the motor record callback: before it with
+ * Done published, then after it returns, which completes the span.
+ */
+void drvAnc350TraceCallback( AXIS_HDL pAxis )
+{
+  epicsTimeStamp now;
+  anc350Span * pSpan = &pAxis->span;
+
+  if (!(pSpan->flags & ANC350_SPAN_CLEARED)) return;
+  drvAnc350TimeGetCurrent( &now );
+
+  epicsMutexLock( traceMutexId );
+  if ((pSpan->flags & ANC350_SPAN_OPEN) && (pSpan->flags & ANC350_SPAN_CLEARED)){
+    if (!(pSpan->flags & ANC350_SPAN_DONE)){
+      pSpan->donePublished = now;
+      pSpan->flags |= ANC350_SPAN_DONE;
+    } else {
+      pSpan->callbackDone = now;
+      pSpan->flags |= ANC350_SPAN_CALLBACK;
+      anc350TraceClose( pAxis );
+    }
+  }
+  epicsMutexUnlock( traceMutexId );
+}
+
+/*
+ * Function: anc350TracePhase
+ *
+ * Parameters: pSpan   - Pointer to a completed span
+ *             phase   - TRACE_PHASE_...
+ *             pValue  - Returns the phase duration (seconds)
+ *
+ * Returns: Non-zero if the span has the phase
+ */
+static int anc350TracePhase( const anc350Span * pSpan, int phase, double * pValue )
+{
+  const epicsTimeStamp * pLastSent = (pSpan->nTelegrams > 0)? &pSpan->sent[pSpan->nTelegrams - 1]: NULL;
+  int flags = pSpan->flags;
+
+  switch (phase){
+    case TRACE_PHASE_TELEGRAMS:
+      if (pLastSent == NULL) return 0;
+      *pValue = epicsTimeDiffInSeconds( pLastSent, &pSpan->entry );
+      return 1;
+    case TRACE_PHASE_TO_RUNNING:
+      if (pLastSent == NULL || !(flags & ANC350_SPAN_RUNNING)) return 0;
+      *pValue = epicsTimeDiffInSeconds( &pSpan->runningSeen, pLastSent );
+      return 1;
+    case TRACE_PHASE_RUNNING:
+      if (!(flags & ANC350_SPAN_RUNNING) || !(flags & ANC350_SPAN_CLEARED)) return 0;
+      *pValue = epicsTimeDiffInSeconds( &pSpan->runningCleared, &pSpan->runningSeen );
+      return 1;
+    case TRACE_PHASE_TO_DONE:
+      if (!(flags & ANC350_SPAN_DONE)) return 0;
+      *pValue = epicsTimeDiffInSeconds( &pSpan->donePublished, &pSpan->runningCleared );
+      return 1;
+    case TRACE_PHASE_CALLBACK:
+      if (!(flags & ANC350_SPAN_CALLBACK)) return 0;
+      *pValue = epicsTimeDiffInSeconds( &pSpan->callbackDone, &pSpan->donePublished );
+      return 1;
+    case TRACE_PHASE_TOTAL:
+      if (!(flags & ANC350_SPAN_CALLBACK)) return 0;
+      *pValue = epicsTimeDiffInSeconds( &pSpan->callbackDone, &pSpan->entry );
+      return 1;
+  }
+  return 0;
+}
+
+static int anc350TraceCompare( const void * a, const void * b )
+{
+  double da = *(const double *) a;
+  double db = *(const double *) b;
+
+  return (da < db)? -1: (da > db)? 1: 0;
+}
+
+/*
+ * Function: anc350TracePercentile
+ *
+ * Parameters: values   - Sorted values
+ *             n        - Number of values
+ *             percent  - Percentile wanted
+ *
+ * Returns: The nearest-rank percentile
+ */
+static double anc350TracePercentile( const double * values, int n, double percent )
+{
+  int rank = (int)(percent / 100.0 * n + 0.999999);
+
+  if (rank < 1) rank = 1;
+  if (rank > n) rank = n;
+  return values[rank - 1];
+}
+
+/*
+ * Function: anc350TraceShow
+ *
+ * Parameters: card   - Controller to show, -1 for all
+ *             axis   - Axis to show (1 based), 0 for all
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Prints the 50th, 90th and 99th percentile and maximum of each phase for
+ * every axis with spans in the ring buffer.
+ */
+int anc350TraceShow( int card, int axis )
+{
+  anc350Span * spans;
+  double * values;
+  ANC350DRV_ID pDrv;
+  int nSpans;
+  int i;
+
+  epicsThreadOnce( &traceOnceId, anc350TraceInit, NULL );
+
+  /* Work on a copy so the poller is not held up while printing */
+  spans = callocMustSucceed( TRACE_RING_SIZE, sizeof( anc350Span ), "anc350TraceShow" );
+  values = callocMustSucceed( TRACE_RING_SIZE, sizeof( double ), "anc350TraceShow" );
+  epicsMutexLock( traceMutexId );
+  nSpans = traceCount;
+  memcpy( spans, traceRing, sizeof( traceRing ) );
+  epicsMutexUnlock( traceMutexId );
+
+  printf( "%d spans in the trace buffer, tracing is %s\n", nSpans, traceEnabled? "on": "off" );
+  for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+    int a;
+
+    if (card >= 0 && pDrv->card != card) continue;
+    for (a = 1; a <= pDrv->nAxes; a++){
+      int phase;
+      int nAxis = 0;
+
+      if (axis > 0 && a != axis) continue;
+      for (i = 0; i < nSpans; i++){
+        if (spans[i].card == pDrv->card && spans[i].axis == a) nAxis++;
+      }
+      if (nAxis == 0) continue;
+
+      printf( "card %d axis %d: %d spans\n", pDrv->card, a, nAxis );
+      printf( "  %-12s %6s %10s %10s %10s %10s  (ms)\n", "phase", "n", "p50", "p90", "p99", "max" );
+      for (phase = 0; phase < TRACE_NUM_PHASES; phase++){
+        int n = 0;
+
+        for (i = 0; i < nSpans; i++){
+          if (spans[i].card == pDrv->card && spans[i].axis == a && anc350TracePhase( &spans[i], phase, &values[n] )) n++;
+        }
+        if (n == 0){
+          printf( "  %-12s %6d\n", phaseNames[phase], 0 );
+          continue;
+        }
+        qsort( values, n, sizeof( double ), anc350TraceCompare );
+        printf( "  %-12s %6d %10.1f %10.1f %10.1f %10.1f\n", phaseNames[phase], n,
+                1000.0 * anc350TracePercentile( values, n, 50.0 ),
+                1000.0 * anc350TracePercentile( values, n, 90.0 ),
+                1000.0 * anc350TracePercentile( values, n, 99.0 ),
+                1000.0 * values[n - 1] );
+      }
+    }
+  }
+  free( values );
+  free( spans );
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: anc350TraceDump
+ *
+ * Parameters: count   - Number of spans to print, most recent last
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Prints the timing of each telegram and phase of the most recent spans,
+ * in milliseconds from command entry.
+ */
+int anc350TraceDump( int count )
+{
+  anc350Span span;
+  int i;
+  int t;
+  int n;
+
+  epicsThreadOnce( &traceOnceId, anc350TraceInit, NULL );
+  if (count <= 0) count = 10;
+
+  epicsMutexLock( traceMutexId );
+  n = (count < traceCount)? count: traceCount;
+  for (i = n; i > 0; i--){
+    span = traceRing[(traceNext - i + TRACE_RING_SIZE) % TRACE_RING_SIZE];
+    epicsMutexUnlock( traceMutexId );
+
+    printf( "card %d axis %d %s:", span.card, span.axis, kindNames[span.kind] );
+    for (t = 0; t < span.nTelegrams; t++){
+      printf( " 0x%04X@%.1f", span.address[t], 1000.0 * epicsTimeDiffInSeconds( &span.sent[t], &span.entry ) );
+    }
+    if (span.flags & ANC350_SPAN_RUNNING) printf( " running@%.1f", 1000.0 * epicsTimeDiffInSeconds( &span.runningSeen, &span.entry ) );
+    if (span.flags & ANC350_SPAN_CLEARED) printf( " stopped@%.1f", 1000.0 * epicsTimeDiffInSeconds( &span.runningCleared, &span.entry ) );
+    if (span.flags & ANC350_SPAN_DONE) printf( " done@%.1f", 1000.0 * epicsTimeDiffInSeconds( &span.donePublished, &span.entry ) );
+    if (span.flags & ANC350_SPAN_CALLBACK) printf( " callback@%.1f", 1000.0 * epicsTimeDiffInSeconds( &span.callbackDone, &span.entry ) );
+    else printf( " (incomplete)" );
+    printf( "\n" );
+
+    epicsMutexLock( traceMutexId );
+  }
+  epicsMutexUnlock( traceMutexId );
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: anc350TraceControl
+ *
+ * Parameters: enable  - Non-zero to record spans
+ *             reset   - Non-zero to empty the ring buffer
+ *
+ * Returns: Integer status value
+ */
+int anc350TraceControl( int enable, int reset )
+{
+  epicsThreadOnce( &traceOnceId, anc350TraceInit, NULL );
+
+  epicsMutexLock( traceMutexId );
+  traceEnabled = (enable != 0);
+  if (reset){
+    traceNext = 0;
+    traceCount = 0;
+  }
+  epicsMutexUnlock( traceMutexId );
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: anc350TraceSession
+ *
+ * Parameters: card      - Controller card
+ *             filename  - File to write
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Writes the completed spans of a controller as a session for the offline
+ * poll strategy simulator, anc350PollSim.  Each span gives a start line at
+ * the telegram that started the axis and a stop line at the first poll
+ * that saw RUNNING clear, in seconds from the first command in the buffer.
+ * The axis stopped some time after the last poll that still saw RUNNING,
+ * which is written after the stop, so the simulator can place the stop
+ * between the two polls rather than at the later one.
+ */
+int anc350TraceSession( int card, const char * filename )
+{
+  anc350Span * spans;
+  epicsTimeStamp origin;
+  FILE * fp;
+  int nSpans;
+  int first = 1;
+  int written = 0;
+  int i;
+
+  epicsThreadOnce( &traceOnceId, anc350TraceInit, NULL );
+  if (filename == NULL || *filename == '\0'){
+    printf( "anc350TraceSession: no file name\n" );
+    return MOTOR_AXIS_ERROR;
+  }
+
+  spans = callocMustSucceed( TRACE_RING_SIZE, sizeof( anc350Span ), "anc350TraceSession" );
+  memset( &origin, 0, sizeof( origin ) );
+  epicsMutexLock( traceMutexId );
+  nSpans = traceCount;
+  for (i = 0; i < nSpans; i++){
+    spans[i] = traceRing[(traceNext - nSpans + i + TRACE_RING_SIZE) % TRACE_RING_SIZE];
+  }
+  epicsMutexUnlock( traceMutexId );
+
+  for (i = 0; i < nSpans; i++){
+    if (spans[i].card != card) continue;
+    if (first || epicsTimeLessThan( &spans[i].entry, &origin )) origin = spans[i].entry;
+    first = 0;
+  }
+
+  if ((fp = fopen( filename, "w" )) == NULL){
+    printf( "anc350TraceSession: cannot open %s\n", filename );
+    free( spans );
+    return MOTOR_AXIS_ERROR;
+  }
+  fprintf( fp, "# anc350 session, card %d\n# seconds axis start kind\n# seconds axis stop lastRunningSeconds\n", card );
+  for (i = 0; i < nSpans; i++){
+    anc350Span * pSpan = &spans[i];
+    epicsTimeStamp start = pSpan->entry;
+    int t;
+
+    if (pSpan->card != card || !(pSpan->flags & ANC350_SPAN_CLEARED)) continue;
+    for (t = 0; t < pSpan->nTelegrams; t++){
+      if (pSpan->address[t] == ID_ANC_RUN_TARGET || pSpan->address[t] == ID_ANC_RUN_RELATIVE ||
+          pSpan->address[t] == ID_ANC_CONT_FWD || pSpan->address[t] == ID_ANC_CONT_BKWD) start = pSpan->sent[t];
+    }
+    fprintf( fp, "%.6f %d start %s\n", epicsTimeDiffInSeconds( &start, &origin ), pSpan->axis, kindNames[pSpan->kind] );
+    if (pSpan->flags & ANC350_SPAN_RUNNING){
+      fprintf( fp, "%.6f %d stop %.6f\n", epicsTimeDiffInSeconds( &pSpan->runningCleared, &origin ), pSpan->axis,
+               epicsTimeDiffInSeconds( &pSpan->runningLast, &origin ) );
+    } else {
+      fprintf( fp, "%.6f %d stop\n", epicsTimeDiffInSeconds( &pSpan->runningCleared, &origin ), pSpan->axis );
+    }
+    written++;
+  }
+  fclose( fp );
+  free( spans );
+
+  printf( "anc350TraceSession: %d moves of card %d written to %s\n", written, card, filename );
+  return MOTOR_AXIS_OK;
+}
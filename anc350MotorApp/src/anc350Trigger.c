@@ -0,0 +1,194 @@
+/*
+ * File:   anc350Trigger.c
+ *
+ * Description:
+ *
+ * In-position trigger output for step scans.  With the trigger enabled on
+ * an axis, every move programs one of the controller's trigger outputs
+ * with a window around the target before the move is started, so the
+ * output switches as soon as the stage enters the window instead of after
+ * the next poll reports the move done.  The axis, polarity and hysteresis
+ * (TRG_AXIS, TRG_POL, TRG_EPS) are only written after they change, so a
+ * move normally costs two extra telegrams, TRG_LOW and TRG_HIGH, sent in
+ * one burst.
+ *
+ * Trigger thresholds use the units of the assigned axis scaled by 1000,
+ * the same raw counts as TARGET and COUNTER.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "epicsMutex.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+
+#define TRIGGER_DEFAULT_WINDOW 100.0
+#define TRIGGER_DEFAULT_EPS 10.0
+
+/*
+ * Function: drvAnc350TriggerInit
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Sets the default trigger settings.  The trigger starts disabled, using
+ * the trigger output with the same index as the axis.
+ */
+void drvAnc350TriggerInit( AXIS_HDL pAxis )
+{
+  pAxis->trigEnable = 0;
+  pAxis->trigOutput = pAxis->axis - 1;
+  pAxis->trigWindow = TRIGGER_DEFAULT_WINDOW;
+  pAxis->trigEps = TRIGGER_DEFAULT_EPS;
+  pAxis->trigPol = 0;
+  pAxis->trigConfigured = 0;
+}
+
+/*
+ * Function: drvAnc350TriggerArm
+ *
+ * Parameters: pAxis   - Pointer to motor axis handle
+ *             target  - Raw target position of the move about to start
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Called by motorAxisMove with the axis mutex held, before the target is
+ * written.  Does nothing if the trigger is disabled.
+ *
+ * The window edge on the side the window moves to is written first, so
+ * that the low threshold is never above the high one between the writes.
+ */
+int drvAnc350TriggerArm( AXIS_HDL pAxis, int target )
+{
+  ANC350DRV_ID pDrv = pAxis->pDrv;
+  anc350Op ops[5];
+  int nOps = 0;
+  int low;
+  int high;
+
+  if (!pAxis->trigEnable) return MOTOR_AXIS_OK;
+
+  low = target - (int) pAxis->trigWindow;
+  high = target + (int) pAxis->trigWindow;
+
+  if (!pAxis->trigConfigured){
+    drvAnc350OpSet( &ops[nOps++], ID_ANC_TRG_AXIS, pAxis->trigOutput, pAxis->axis - 1 );
+    drvAnc350OpSet( &ops[nOps++], ID_ANC_TRG_POL, pAxis->trigOutput, pAxis->trigPol );
+    drvAnc350OpSet( &ops[nOps++], ID_ANC_TRG_EPS, pAxis->trigOutput, (int) pAxis->trigEps );
+  }
+  if (pAxis->trigConfigured && high > pAxis->trigHigh){
+    drvAnc350OpSet( &ops[nOps++], ID_ANC_TRG_HIGH, pAxis->trigOutput, high );
+    drvAnc350OpSet( &ops[nOps++], ID_ANC_TRG_LOW, pAxis->trigOutput, low );
+  } else {
+    drvAnc350OpSet( &ops[nOps++], ID_ANC_TRG_LOW, pAxis->trigOutput, low );
+    drvAnc350OpSet( &ops[nOps++], ID_ANC_TRG_HIGH, pAxis->trigOutput, high );
+  }
+
+  if (drvAnc350Burst( pDrv, ops, nOps, pDrv->burstTimeout ) != nOps){
+    asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+               "drvAnc350TriggerArm: card %d axis %d trigger %d not acknowledged\n",
+               pDrv->card, pAxis->axis, pAxis->trigOutput );
+    /* Write everything again next time */
+    pAxis->trigConfigured = 0;
+    return MOTOR_AXIS_ERROR;
+  }
+
+  pAxis->trigConfigured = 1;
+  pAxis->trigLow = low;
+  pAxis->trigHigh = high;
+  pAxis->trigArmed++;
+  anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_TRIG_ARMED, pAxis->trigArmed );
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: anc350TriggerParamInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Publishes the trigger settings of every axis to the parameter port.
+ */
+void anc350TriggerParamInit( ANC350DRV_ID pDrv )
+{
+  int i;
+
+  for (i = 0; i < pDrv->nAxes; i++){
+    AXIS_HDL pAxis = &pDrv->axis[i];
+
+    anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_TRIG, pAxis->trigEnable );
+    anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_TRIG_OUTPUT, pAxis->trigOutput );
+    anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_TRIG_WINDOW, pAxis->trigWindow );
+    anc350ParamSetDouble( pDrv, pAxis->axis, ANC350_TRIG_EPS, pAxis->trigEps );
+    anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_TRIG_POL, pAxis->trigPol );
+    anc350ParamSetInteger( pDrv, pAxis->axis, ANC350_TRIG_ARMED, pAxis->trigArmed );
+  }
+}
+
+/*
+ * Function: anc350TriggerParamWrite
+ *
+ * Parameters: pDrv    - Pointer to driver structure
+ *             addr    - Asyn address, the axis
+ *             reason  - Parameter written
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Applies a change to the trigger settings.  They are written to the
+ * controller with the next move.
+ */
+asynStatus anc350TriggerParamWrite( ANC350DRV_ID pDrv, int addr, int reason )
+{
+  AXIS_HDL pAxis;
+  int ival = 0;
+  double dval = 0.0;
+
+  if (pDrv == NULL || addr < 1 || addr > pDrv->nAxes) return asynError;
+  pAxis = &pDrv->axis[addr - 1];
+
+  if (epicsMutexLock( pAxis->axisMutex ) != epicsMutexLockOK) return asynError;
+  switch (reason){
+    case ANC350_TRIG:
+      anc350ParamGetInteger( pDrv, addr, reason, &ival );
+      if (ival && !pAxis->trigEnable){
+        pAxis->trigArmed = 0;
+        anc350ParamSetInteger( pDrv, addr, ANC350_TRIG_ARMED, 0 );
+      }
+      pAxis->trigEnable = (ival != 0);
+      break;
+    case ANC350_TRIG_OUTPUT:
+      anc350ParamGetInteger( pDrv, addr, reason, &ival );
+      pAxis->trigOutput = (ival < 0)? 0: ival;
+      break;
+    case ANC350_TRIG_WINDOW:
+      anc350ParamGetDouble( pDrv, addr, reason, &dval );
+      pAxis->trigWindow = fabs( dval );
+      break;
+    case ANC350_TRIG_EPS:
+      anc350ParamGetDouble( pDrv, addr, reason, &dval );
+      pAxis->trigEps = fabs( dval );
+      break;
+    case ANC350_TRIG_POL:
+      anc350ParamGetInteger( pDrv, addr, reason, &ival );
+      pAxis->trigPol = (ival != 0);
+      break;
+  }
+  pAxis->trigConfigured = 0;
+  epicsMutexUnlock( pAxis->axisMutex );
+  return asynSuccess;
+}
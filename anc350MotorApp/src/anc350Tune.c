@@ -0,0 +1,294 @@
+/*
+ * File:   anc350Tune.c
+ *
+ * Description:
+ *
+ * Runtime tuning of the poller and the telegram handling.  The poll
+ * periods, the timeouts of single telegrams and of the driver's bursts,
+ * the number of failed reads before a comms error, the burst pipeline
+ * depth and the direction deadband of each axis are parameters of the
+ * parameter port, see db/anc350Tune.template.
+ *
+ * A value is checked against the range in tunables before it is used.
+ * Out of range values are rejected with asynError, counted in
+ * ANC350_TUNE_REJECTS and the parameter goes back to the value in use.
+ * Accepted values take effect with the next telegram or poll; a change of
+ * a poll period wakes the poller so that it does not first sit out the
+ * old period.  Writing ANC350_TUNE_DEFAULTS puts every value of the
+ * controller and its axes back to the defaults below.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "epicsThread.h"
+#include "epicsMutex.h"
+#include "epicsEvent.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+
+/* Defaults, the values the driver was built with before they were tunable */
+#define TUNE_MOVING_POLL    0.5
+#define TUNE_IDLE_POLL      1.0
+#define TUNE_GET_TIMEOUT    0.1
+#define TUNE_SET_TIMEOUT    0.5
+#define TUNE_BURST_TIMEOUT  0.5
+#define TUNE_COMM_ERRORS    200
+#define TUNE_DIRECTION      500.0
+
+typedef struct anc350Tunable
+{
+  int reason;
+  const char * name;
+  double min;
+  double max;
+  double def;
+} anc350Tunable;
+
+static const anc350Tunable tunables[] =
+{
+  { ANC350_TUNE_MOVING_POLL,    "moving poll period",  0.01,  10.0,                 TUNE_MOVING_POLL },
+  { ANC350_TUNE_IDLE_POLL,      "idle poll period",    0.01,  60.0,                 TUNE_IDLE_POLL },
+  { ANC350_TUNE_GET_TIMEOUT,    "GET timeout",         0.01,  5.0,                  TUNE_GET_TIMEOUT },
+  { ANC350_TUNE_SET_TIMEOUT,    "SET timeout",         0.01,  5.0,                  TUNE_SET_TIMEOUT },
+  { ANC350_TUNE_BURST_TIMEOUT,  "burst timeout",       0.05,  5.0,                  TUNE_BURST_TIMEOUT },
+  { ANC350_TUNE_COMM_ERRORS,    "comms error limit",   1.0,   100000.0,             TUNE_COMM_ERRORS },
+  { ANC350_TUNE_PIPELINE,       "pipeline depth",      1.0,   ANC350_MAX_PIPELINE,  ANC350_DEFAULT_PIPELINE },
+  { ANC350_TUNE_DIRECTION,      "direction deadband",  0.0,   1.0e6,                TUNE_DIRECTION },
+};
+#define TUNABLES (sizeof( tunables ) / sizeof( tunables[0] ))
+
+static const anc350Tunable * anc350TuneFind( int reason )
+{
+  size_t i;
+
+  for (i = 0; i < TUNABLES; i++){
+    if (tunables[i].reason == reason) return &tunables[i];
+  }
+  return NULL;
+}
+
+/*
+ * Function: anc350TuneGet
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             addr     - Asyn address, 0 for the controller or the axis
+ *             reason   - Tuning parameter
+ *
+ * Returns: Value in use
+ */
+static double anc350TuneGet( ANC350DRV_ID pDrv, int addr, int reason )
+{
+  double value = 0.0;
+
+  switch (reason){
+    case ANC350_TUNE_MOVING_POLL:
+      epicsMutexLock( pDrv->controllerMutexId );
+      value = pDrv->movingPollPeriod;
+      epicsMutexUnlock( pDrv->controllerMutexId );
+      break;
+    case ANC350_TUNE_IDLE_POLL:
+      epicsMutexLock( pDrv->controllerMutexId );
+      value = pDrv->idlePollPeriod;
+      epicsMutexUnlock( pDrv->controllerMutexId );
+      break;
+    case ANC350_TUNE_GET_TIMEOUT:   value = pDrv->getTimeout; break;
+    case ANC350_TUNE_SET_TIMEOUT:   value = pDrv->setTimeout; break;
+    case ANC350_TUNE_BURST_TIMEOUT: value = pDrv->burstTimeout; break;
+    case ANC350_TUNE_COMM_ERRORS:   value = pDrv->commErrorLimit; break;
+    case ANC350_TUNE_PIPELINE:      value = pDrv->pipelineDepth; break;
+    case ANC350_TUNE_DIRECTION:     value = pDrv->axis[addr - 1].directionDeadband; break;
+  }
+  return value;
+}
+
+/*
+ * Function: anc350TuneSet
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             addr     - Asyn address, 0 for the controller or the axis
+ *             reason   - Tuning parameter
+ *             value    - New value, already checked
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * The poll periods are guarded by the controller mutex, the direction
+ * deadband by the axis mutex.  The other values are read once per
+ * telegram or burst, so a plain store is enough.
+ */
+static void anc350TuneSet( ANC350DRV_ID pDrv, int addr, int reason, double value )
+{
+  AXIS_HDL pAxis;
+
+  switch (reason){
+    case ANC350_TUNE_MOVING_POLL:
+      epicsMutexLock( pDrv->controllerMutexId );
+      pDrv->movingPollPeriod = value;
+      epicsMutexUnlock( pDrv->controllerMutexId );
+      break;
+    case ANC350_TUNE_IDLE_POLL:
+      epicsMutexLock( pDrv->controllerMutexId );
+      pDrv->idlePollPeriod = value;
+      epicsMutexUnlock( pDrv->controllerMutexId );
+      break;
+    case ANC350_TUNE_GET_TIMEOUT:   pDrv->getTimeout = value; break;
+    case ANC350_TUNE_SET_TIMEOUT:   pDrv->setTimeout = value; break;
+    case ANC350_TUNE_BURST_TIMEOUT: pDrv->burstTimeout = value; break;
+    case ANC350_TUNE_COMM_ERRORS:   pDrv->commErrorLimit = (int) value; break;
+    case ANC350_TUNE_PIPELINE:      pDrv->pipelineDepth = (int) value; break;
+    case ANC350_TUNE_DIRECTION:
+      pAxis = &pDrv->axis[addr - 1];
+      epicsMutexLock( pAxis->axisMutex );
+      pAxis->directionDeadband = value;
+      epicsMutexUnlock( pAxis->axisMutex );
+      break;
+  }
+}
+
+/*
+ * Function: drvAnc350TuneInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Sets the defaults of the controller and of all its axes.  Called before
+ * the axis mutexes exist, so the fields are set directly.
+ */
+void drvAnc350TuneInit( ANC350DRV_ID pDrv )
+{
+  int i;
+
+  pDrv->movingPollPeriod = TUNE_MOVING_POLL;
+  pDrv->idlePollPeriod = TUNE_IDLE_POLL;
+  pDrv->getTimeout = TUNE_GET_TIMEOUT;
+  pDrv->setTimeout = TUNE_SET_TIMEOUT;
+  pDrv->burstTimeout = TUNE_BURST_TIMEOUT;
+  pDrv->commErrorLimit = TUNE_COMM_ERRORS;
+  pDrv->pipelineDepth = ANC350_DEFAULT_PIPELINE;
+  pDrv->commErrors = 0;
+  pDrv->tuneRejects = 0;
+  for (i = 0; i < pDrv->nAxes; i++) pDrv->axis[i].directionDeadband = TUNE_DIRECTION;
+}
+
+/*
+ * Function: anc350TuneParamInit
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Publishes the values in use to the parameter port.
+ */
+void anc350TuneParamInit( ANC350DRV_ID pDrv )
+{
+  int i;
+
+  anc350ParamSetDouble( pDrv, 0, ANC350_TUNE_MOVING_POLL, anc350TuneGet( pDrv, 0, ANC350_TUNE_MOVING_POLL ) );
+  anc350ParamSetDouble( pDrv, 0, ANC350_TUNE_IDLE_POLL, anc350TuneGet( pDrv, 0, ANC350_TUNE_IDLE_POLL ) );
+  anc350ParamSetDouble( pDrv, 0, ANC350_TUNE_GET_TIMEOUT, pDrv->getTimeout );
+  anc350ParamSetDouble( pDrv, 0, ANC350_TUNE_SET_TIMEOUT, pDrv->setTimeout );
+  anc350ParamSetDouble( pDrv, 0, ANC350_TUNE_BURST_TIMEOUT, pDrv->burstTimeout );
+  anc350ParamSetInteger( pDrv, 0, ANC350_TUNE_COMM_ERRORS, pDrv->commErrorLimit );
+  anc350ParamSetInteger( pDrv, 0, ANC350_TUNE_PIPELINE, pDrv->pipelineDepth );
+  anc350ParamSetInteger( pDrv, 0, ANC350_TUNE_DEFAULTS, 0 );
+  anc350ParamSetInteger( pDrv, 0, ANC350_TUNE_REJECTS, pDrv->tuneRejects );
+  for (i = 1; i <= pDrv->nAxes; i++){
+    anc350ParamSetDouble( pDrv, i, ANC350_TUNE_DIRECTION, anc350TuneGet( pDrv, i, ANC350_TUNE_DIRECTION ) );
+  }
+}
+
+/*
+ * Function: anc350TuneRestore
+ *
+ * Parameters: pDrv     - Pointer to driver structure
+ *             addr     - Asyn address, 0 for the controller or the axis
+ *             reason   - Tuning parameter
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Puts the value in use back into the parameter after a rejected write.
+ */
+static void anc350TuneRestore( ANC350DRV_ID pDrv, int addr, int reason )
+{
+  double value = anc350TuneGet( pDrv, addr, reason );
+
+  if (reason == ANC350_TUNE_COMM_ERRORS || reason == ANC350_TUNE_PIPELINE){
+    anc350ParamSetInteger( pDrv, addr, reason, (int) value );
+  } else {
+    anc350ParamSetDouble( pDrv, addr, reason, value );
+  }
+}
+
+/*
+ * Function: anc350TuneParamWrite
+ *
+ * Parameters: pDrv    - Pointer to driver structure
+ *             addr    - Asyn address, 0 for the controller or the axis
+ *             reason  - Parameter written
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Checks a new value and applies it.  The idle poll period may not be
+ * shorter than the moving one.
+ */
+asynStatus anc350TuneParamWrite( ANC350DRV_ID pDrv, int addr, int reason )
+{
+  const anc350Tunable * pTunable;
+  double value = 0.0;
+  int ival = 0;
+  int i;
+
+  if (pDrv == NULL || addr < 0 || addr > pDrv->nAxes) return asynError;
+
+  if (reason == ANC350_TUNE_DEFAULTS){
+    anc350ParamGetInteger( pDrv, 0, reason, &ival );
+    if (ival == 0) return asynSuccess;
+    for (i = 0; i < (int) TUNABLES; i++){
+      if (tunables[i].reason != ANC350_TUNE_DIRECTION) anc350TuneSet( pDrv, 0, tunables[i].reason, tunables[i].def );
+    }
+    for (i = 1; i <= pDrv->nAxes; i++) anc350TuneSet( pDrv, i, ANC350_TUNE_DIRECTION, TUNE_DIRECTION );
+    asynPrint( pDrv->pasynUser, ASYN_TRACE_WARNING, "anc350Tune: card %d back to the defaults\n", pDrv->card );
+    anc350TuneParamInit( pDrv );
+    epicsEventSignal( pDrv->pollEventId );
+    return asynSuccess;
+  }
+
+  if ((pTunable = anc350TuneFind( reason )) == NULL) return asynError;
+  if (reason == ANC350_TUNE_DIRECTION && addr < 1) return asynError;
+  if (reason == ANC350_TUNE_COMM_ERRORS || reason == ANC350_TUNE_PIPELINE){
+    anc350ParamGetInteger( pDrv, addr, reason, &ival );
+    value = ival;
+  } else {
+    anc350ParamGetDouble( pDrv, addr, reason, &value );
+  }
+
+  if (!(value >= pTunable->min && value <= pTunable->max) ||
+      (reason == ANC350_TUNE_MOVING_POLL && value > anc350TuneGet( pDrv, 0, ANC350_TUNE_IDLE_POLL )) ||
+      (reason == ANC350_TUNE_IDLE_POLL && value < anc350TuneGet( pDrv, 0, ANC350_TUNE_MOVING_POLL ))){
+    asynPrint( pDrv->pasynUser, ASYN_TRACE_ERROR,
+               "anc350Tune: card %d %s %g rejected, range %g to %g\n",
+               pDrv->card, pTunable->name, value, pTunable->min, pTunable->max );
+    pDrv->tuneRejects++;
+    anc350ParamSetInteger( pDrv, 0, ANC350_TUNE_REJECTS, pDrv->tuneRejects );
+    anc350TuneRestore( pDrv, addr, reason );
+    return asynError;
+  }
+
+  anc350TuneSet( pDrv, addr, reason, value );
+  if (reason == ANC350_TUNE_MOVING_POLL || reason == ANC350_TUNE_IDLE_POLL) epicsEventSignal( pDrv->pollEventId );
+  return asynSuccess;
+}
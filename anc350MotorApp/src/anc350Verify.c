@@ -0,0 +1,393 @@
+/*
+ * File:   anc350Verify.c
+ *
+ * Description:
+ *
+ * Background verification of the controller configuration.  The driver
+ * keeps a copy of the configuration registers of every axis (the axis
+ * registers of anc350Registers.c, less the status and position registers
+ * that change on their own and the registers the driver writes itself:
+ * the output switches of the idle handling, the bank registers and the
+ * hump detection and speed control set by every move).  While
+ * verification is running
+ * (ANC350_VERIFY_RATE on the crate port, or anc350VerifyStart) one thread
+ * walks those registers round robin, reading at most the given number of
+ * registers per second from each controller, in one burst per controller
+ * per tick.
+ *
+ * The first pass fills the copy.  SETs the driver makes, single or in a
+ * burst, update the copy once they have been sent, and a read that
+ * raced such a SET is discarded.  After that a register that reads back a
+ * different value has been changed behind the IOC, from the vendor
+ * software or the front panel, or by a devAnc350 record.  The change is
+ * counted, reported with ASYN_TRACE_WARNING and in ANC350_VERIFY_LAST,
+ * and the copy updated.
+ *
+ * The amplitude and frequency of each axis are read too but, being bank
+ * registers, never reported as changed.  They are published from the
+ * copy, so records that only display them need not poll the controller.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsEvent.h"
+#include "epicsMutex.h"
+#include "epicsStdio.h"
+#include "cantProceed.h"
+#include "asynDriver.h"
+
+#include "ucprotocol.h"
+#include "anc350.h"
+#include "drvAnc350.h"
+#include "anc350AsynMotor.h"
+
+#define VERIFY_TICK 1.0
+#define VERIFY_MAX_RATE ((double) ANC350_MAX_PIPELINE / VERIFY_TICK)
+
+/* Result of reading one register */
+#define VERIFY_SAME     0
+#define VERIFY_FILLED   1
+#define VERIFY_DIVERGED 2
+
+/* Registers published from the copy */
+typedef struct anc350VerifyParam
+{
+  int address;
+  int reason;
+  double scale;
+} anc350VerifyParam;
+
+static const anc350VerifyParam verifyParams[] =
+{
+  { ID_ANC_AMPL,       ANC350_CFG_AMPLITUDE, 0.001 },
+  { ID_ANC_FAST_FREQ,  ANC350_CFG_FREQUENCY, 1.0 },
+};
+
+/* Verification state of one controller, cache, valid, fresh and written under verifyCacheMutexId */
+typedef struct anc350Verify
+{
+  int * cache;          /* nAxes * verifyNumRegs register values */
+  char * valid;
+  char * fresh;         /* Written by the driver and not yet published */
+  unsigned * written;   /* Count of driver SETs, to discard reads that raced one */
+  int cursor;           /* Next register to read, axis * verifyNumRegs + register */
+  double credit;        /* Reads owed by the rate, carried over between ticks */
+  int sweeps;
+  int diverged;
+} anc350Verify;
+
+static double verifyRate = 0.0;
+static int * verifyRegs = NULL;         /* anc350Registers indices of the verified registers */
+static int verifyNumRegs = 0;
+static epicsEventId verifyEventId = NULL;
+static epicsMutexId verifyMutexId = NULL;
+static epicsMutexId verifyCacheMutexId = NULL;
+static epicsThreadId verifyThreadId = NULL;
+static epicsThreadOnceId verifyOnceId = EPICS_THREAD_ONCE_INIT;
+
+static void anc350VerifyInit( void * arg )
+{
+  int i;
+
+  verifyMutexId = epicsMutexMustCreate();
+  verifyCacheMutexId = epicsMutexMustCreate();
+  verifyEventId = epicsEventMustCreate( epicsEventEmpty );
+
+  verifyRegs = callocMustSucceed( anc350NumRegisters, sizeof( int ), "anc350VerifyInit" );
+  for (i = 0; i < anc350NumRegisters; i++){
+    switch (anc350Registers[i].address){
+      case ID_ANC_STATUS:
+      case ID_ANC_COUNTER:
+      case ID_ANC_REFCOUNTER:
+      case ID_ANC_TARGET:
+      case ID_ANC_CAP_VALUE:
+      case ID_ANC_ACT_AMPL:
+      case ID_ANC_RELAIS:
+      case ID_ANC_INT_EN:
+      case ID_ANC_MAX_AMP:
+      case ID_ANC_SPD_GAIN:
+      case ID_ANC_STOP_EN:
+      case ID_ANC_REGSPD_SELSP:
+        continue;
+    }
+    if (anc350Registers[i].scope == ANC350_REG_AXIS) verifyRegs[verifyNumRegs++] = i;
+  }
+}
+
+/*
+ * Function: anc350VerifyCompared
+ *
+ * Parameters: address   - Register address
+ *
+ * Returns: Non-zero if a change of the register is reported
+ *
+ * Description:
+ *
+ * The bank registers are read for publishing only, a bank recall changes
+ * them.
+ */
+static int anc350VerifyCompared( int address )
+{
+  return (address != ID_ANC_AMPL && address != ID_ANC_FAST_FREQ);
+}
+
+/*
+ * Function: drvAnc350VerifyNote
+ *
+ * Parameters: pDrv      - Pointer to driver structure
+ *             index     - Axis (0 based)
+ *             address   - Register address
+ *             value     - Value written
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Called for every SET the driver has sent, so the copy follows
+ * the driver's own writes.  Any thread, any locks held.
+ */
+void drvAnc350VerifyNote( ANC350DRV_ID pDrv, int index, int address, int value )
+{
+  anc350Verify * pVerify = pDrv->pVerify;
+  int i;
+
+  if (pVerify == NULL || index < 0 || index >= pDrv->nAxes) return;
+
+  for (i = 0; i < verifyNumRegs; i++){
+    if (anc350Registers[verifyRegs[i]].address == address){
+      int entry = index * verifyNumRegs + i;
+
+      epicsMutexLock( verifyCacheMutexId );
+      pVerify->cache[entry] = value;
+      pVerify->valid[entry] = 1;
+      pVerify->fresh[entry] = 1;
+      pVerify->written[entry]++;
+      epicsMutexUnlock( verifyCacheMutexId );
+      return;
+    }
+  }
+}
+
+/*
+ * Function: anc350VerifyPublish
+ *
+ * Parameters: pDrv      - Pointer to driver structure
+ *             axis      - Axis (1 based)
+ *             address   - Register address
+ *             value     - Register value
+ *
+ * Returns: void
+ */
+static void anc350VerifyPublish( ANC350DRV_ID pDrv, int axis, int address, int value )
+{
+  int i;
+
+  for (i = 0; i < (int)(sizeof( verifyParams ) / sizeof( verifyParams[0] )); i++){
+    if (verifyParams[i].address == address){
+      anc350ParamSetDouble( pDrv, axis, verifyParams[i].reason, (double) value * verifyParams[i].scale );
+    }
+  }
+}
+
+/*
+ * Function: anc350VerifyController
+ *
+ * Parameters: pDrv   - Pointer to driver structure
+ *             rate   - Registers per second
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Reads the registers owed by the rate since the last tick, in one burst.
+ */
+static void anc350VerifyController( ANC350DRV_ID pDrv, double rate )
+{
+  anc350Verify * pVerify = pDrv->pVerify;
+  anc350Op ops[ANC350_MAX_PIPELINE];
+  int cursors[ANC350_MAX_PIPELINE];
+  unsigned written[ANC350_MAX_PIPELINE];
+  int previous[ANC350_MAX_PIPELINE];
+  char outcome[ANC350_MAX_PIPELINE];
+  int maxOps = (pDrv->pipelineDepth < ANC350_MAX_PIPELINE)? pDrv->pipelineDepth: ANC350_MAX_PIPELINE;
+  int total = pDrv->nAxes * verifyNumRegs;
+  int nOps;
+  int i;
+
+  if (total == 0) return;
+  if (pVerify == NULL){
+    pVerify = callocMustSucceed( 1, sizeof( anc350Verify ), "anc350VerifyController" );
+    pVerify->cache = callocMustSucceed( total, sizeof( int ), "anc350VerifyController" );
+    pVerify->valid = callocMustSucceed( total, sizeof( char ), "anc350VerifyController" );
+    pVerify->fresh = callocMustSucceed( total, sizeof( char ), "anc350VerifyController" );
+    pVerify->written = callocMustSucceed( total, sizeof( unsigned ), "anc350VerifyController" );
+    epicsMutexLock( verifyCacheMutexId );
+    pDrv->pVerify = pVerify;
+    epicsMutexUnlock( verifyCacheMutexId );
+  }
+
+  pVerify->credit += rate * VERIFY_TICK;
+  /* A controller that fell behind does not catch up in one go */
+  if (pVerify->credit > (double) maxOps) pVerify->credit = (double) maxOps;
+  nOps = (int) pVerify->credit;
+  if (nOps > total) nOps = total;
+  if (nOps <= 0) return;
+  pVerify->credit -= (double) nOps;
+
+  for (i = 0; i < nOps; i++){
+    cursors[i] = pVerify->cursor;
+    drvAnc350OpGet( &ops[i], anc350Registers[verifyRegs[cursors[i] % verifyNumRegs]].address,
+                    cursors[i] / verifyNumRegs );
+    pVerify->cursor = (pVerify->cursor + 1) % total;
+    if (pVerify->cursor == 0){
+      pVerify->sweeps++;
+      anc350ParamSetInteger( pDrv, 0, ANC350_VERIFY_SWEEPS, pVerify->sweeps );
+    }
+  }
+
+  epicsMutexLock( verifyCacheMutexId );
+  for (i = 0; i < nOps; i++) written[i] = pVerify->written[cursors[i]];
+  epicsMutexUnlock( verifyCacheMutexId );
+
+  drvAnc350Burst( pDrv, ops, nOps, pDrv->burstTimeout );
+
+  /* Update the copy under the lock, report outside it */
+  epicsMutexLock( verifyCacheMutexId );
+  for (i = 0; i < nOps; i++){
+    int entry = cursors[i];
+
+    outcome[i] = VERIFY_SAME;
+    if (ops[i].status != asynSuccess) continue;
+    /* A driver SET went out since the read was queued, the copy has the value */
+    if (pVerify->written[entry] != written[i]) continue;
+    if (!pVerify->valid[entry]){
+      pVerify->valid[entry] = 1;
+      outcome[i] = VERIFY_FILLED;
+    } else if (pVerify->cache[entry] != ops[i].value){
+      outcome[i] = anc350VerifyCompared( ops[i].address )? VERIFY_DIVERGED: VERIFY_FILLED;
+    } else if (pVerify->fresh[entry]){
+      outcome[i] = VERIFY_FILLED;
+    } else {
+      continue;
+    }
+    previous[i] = pVerify->cache[entry];
+    pVerify->cache[entry] = ops[i].value;
+    pVerify->fresh[entry] = 0;
+  }
+  epicsMutexUnlock( verifyCacheMutexId );
+
+  for (i = 0; i < nOps; i++){
+    const anc350Register * pReg = &anc350Registers[verifyRegs[cursors[i] % verifyNumRegs]];
+    int axis = cursors[i] / verifyNumRegs + 1;
+
+    if (outcome[i] == VERIFY_SAME) continue;
+    if (outcome[i] == VERIFY_DIVERGED){
+      char last[80];
+
+      pVerify->diverged++;
+      epicsSnprintf( last, sizeof( last ), "axis %d %s %d -> %d", axis, pReg->name,
+                     previous[i], ops[i].value );
+      asynPrint( pDrv->pasynUser, ASYN_TRACE_WARNING, "anc350Verify: card %d %s\n", pDrv->card, last );
+      anc350ParamSetString( pDrv, 0, ANC350_VERIFY_LAST, last );
+      anc350ParamSetInteger( pDrv, 0, ANC350_VERIFY_DIVERGED, pVerify->diverged );
+    }
+    anc350VerifyPublish( pDrv, axis, pReg->address, ops[i].value );
+  }
+}
+
+/*
+ * Function: anc350VerifyTask
+ *
+ * Parameters: arg   - Unused
+ *
+ * Returns: void
+ *
+ * Description:
+ *
+ * Verification thread.  Sleeps while the rate is 0.
+ */
+static void anc350VerifyTask( void * arg )
+{
+  while (1){
+    ANC350DRV_ID pDrv;
+    double rate;
+
+    epicsMutexLock( verifyMutexId );
+    rate = verifyRate;
+    epicsMutexUnlock( verifyMutexId );
+
+    if (rate <= 0.0){
+      epicsEventMustWait( verifyEventId );
+      continue;
+    }
+
+    for (pDrv = drvAnc350First(); pDrv != NULL; pDrv = pDrv->pNext){
+      if (!pDrv->virtualTime) anc350VerifyController( pDrv, rate );
+    }
+    epicsEventWaitWithTimeout( verifyEventId, VERIFY_TICK );
+  }
+}
+
+/*
+ * Function: anc350VerifyStart
+ *
+ * Parameters: rate   - Registers read per second from each controller,
+ *                      0 to stop verification
+ *
+ * Returns: Integer status value
+ *
+ * Description:
+ *
+ * Starts, changes or stops the verification sweep.
+ */
+int anc350VerifyStart( double rate )
+{
+  epicsThreadOnce( &verifyOnceId, anc350VerifyInit, NULL );
+
+  if (rate > VERIFY_MAX_RATE){
+    printf( "anc350VerifyStart: rate lowered to the maximum of %g registers/s\n", VERIFY_MAX_RATE );
+    rate = VERIFY_MAX_RATE;
+  }
+  if (rate < 0.0) rate = 0.0;
+
+  epicsMutexLock( verifyMutexId );
+  verifyRate = rate;
+  if (verifyThreadId == NULL && rate > 0.0){
+    verifyThreadId = epicsThreadCreate( "anc350Verify", epicsThreadPriorityLow,
+                                        epicsThreadGetStackSize( epicsThreadStackMedium ),
+                                        anc350VerifyTask, NULL );
+    if (verifyThreadId == NULL){
+      verifyRate = 0.0;
+      epicsMutexUnlock( verifyMutexId );
+      printf( "anc350VerifyStart: cannot start the verification thread\n" );
+      return MOTOR_AXIS_ERROR;
+    }
+  }
+  epicsMutexUnlock( verifyMutexId );
+
+  epicsEventSignal( verifyEventId );
+  return MOTOR_AXIS_OK;
+}
+
+/*
+ * Function: anc350VerifyParamWrite
+ *
+ * Parameters: None
+ *
+ * Returns: asynStatus
+ *
+ * Description:
+ *
+ * Called in the crate port thread when ANC350_VERIFY_RATE is written.
+ */
+asynStatus anc350VerifyParamWrite( void )
+{
+  double rate = 0.0;
+
+  anc350ParamGetDouble( NULL, 0, ANC350_VERIFY_RATE, &rate );
+  return (anc350VerifyStart( rate ) == MOTOR_AXIS_OK)? asynSuccess: asynError;
+}
@@ -0,0 +1,580 @@
+/*
+ * File:   drvAnc350.h
+ *
+ * Description:
+ *
+ * Private definitions shared between the source files of the ANC350 asyn
+ * motor driver.  The controller and axis structures, the pipelined telegram
+ * burst interface and the driver parameter port are declared here.  This
+ * header is not installed; the public interface is anc350AsynMotor.h.
+ */
+#ifndef DRV_ANC350_H
+#define DRV_ANC350_H
+
+#include "epicsTypes.h"
+#include "epicsTime.h"
+#include "epicsThread.h"
+#include "epicsEvent.h"
+#include "epicsMutex.h"
+#include "asynDriver.h"
+#include "asynOctet.h"
+#include "paramLib.h"
+#include "motor_interface.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of telegrams written back-to-back before the acks are collected. */
+#define ANC350_MAX_PIPELINE 32
+/* Default number of telegrams per pipelined burst. */
+#define ANC350_DEFAULT_PIPELINE 16
+/* Number of synchronisation groups, addresses 1 to ANC350_MAX_SYNC_GROUPS of the crate port. */
+#define ANC350_MAX_SYNC_GROUPS 8
+
+struct anc350ParamPort;
+struct anc350BatchQueue;
+struct anc350CallbackQueue;
+struct anc350Verify;
+
+/* Temperature parameter banks, see anc350Bank.c */
+#define ANC350_BANKS        2
+#define ANC350_BANK_WARM    0
+#define ANC350_BANK_COLD    1
+#define ANC350_BANK_REGS    4   /* Frequency, amplitude, maximum amplitude, speed gain */
+
+/* Sections of the calibration store and their payload versions, see anc350Store.c */
+#define ANC350_STORE_ESTIMATE     1   /* Move duration models, anc350Estimate.c */
+#define ANC350_STORE_ESTIMATE_V   1
+#define ANC350_STORE_STATS        2   /* Motion statistics histograms, anc350Stats.c */
+#define ANC350_STORE_STATS_V      1
+
+/* Round trip time histogram buckets of anc350Metrics, see anc350Metrics.c */
+#define ANC350_RTT_BUCKETS 10
+
+/*
+ * Link and poller counters of one controller.  Only changed with the
+ * epicsAtomic functions, so that the metrics server can read them without
+ * taking any driver lock.  Times are in microseconds, in 64 bit totals
+ * changed with drvAnc350MetricsAdd only, as a size_t would wrap after 71
+ * minutes on a 32 bit target.
+ */
+typedef struct anc350Metrics
+{
+    size_t telegramsSent;
+    size_t telegramsReceived;
+    size_t timeouts;              /* Telegrams whose ack never arrived */
+    size_t mismatches;            /* Acks that matched no telegram in flight */
+    size_t rtt[ANC350_RTT_BUCKETS];
+    size_t rttCount;
+    epicsUInt64 rttSum;
+    size_t polls;
+    size_t pollLast;              /* Duration of the last poll */
+    epicsUInt64 pollSum;
+    epicsTimeStamp lastWrite;     /* Time of the last burst write, port locked */
+} anc350Metrics;
+
+typedef struct drvAnc350 * ANC350DRV_ID;
+typedef struct drvAnc350
+{
+    ANC350DRV_ID pNext;
+    asynUser * pasynUser;
+    int card;
+    int nAxes;
+    AXIS_HDL axis;
+    epicsThreadId motorThread;
+    epicsTimeStamp now;
+    int movesDeferred;
+    double movingPollPeriod;
+    double idlePollPeriod;
+    epicsEventId pollEventId;
+    epicsMutexId controllerMutexId;
+    char * portName;
+    asynUser * pasynUserBurst;    /* Used with the port locked for pipelined bursts */
+    asynOctet * pOctet;
+    void * octetPvt;
+    int pipelineDepth;
+    struct anc350ParamPort * pParamPort;
+    struct anc350BatchQueue * pBatchQueue;  /* Created on the first anc350BatchSubmit */
+    int syncGroup;                /* Synchronisation group (1 based), 0 if none */
+    double * pollSkips;           /* Per axis idle poll countdown, see drvAnc350Poll */
+    double pollSkipGlobal;
+    epicsUInt32 globalStatus;
+    int virtualTime;              /* Simulated on virtual time, polled by anc350SimRun */
+    struct anc350CallbackQueue * pCallbackQueue;  /* NULL to deliver updates in the poller */
+    struct anc350Verify * pVerify;  /* Configuration copy, created by the first verification sweep */
+    anc350Metrics metrics;
+    int bank;                     /* ANC350_BANK_... in use, -1 until the first temperature */
+    double bankTemperature;       /* Last temperature written (K) */
+    double bankColdBelow;         /* Switch to the cold bank below this temperature (K) */
+    double bankWarmAbove;         /* Switch to the warm bank above this temperature (K) */
+    int bankSwitches;
+    int bankPending;              /* Registers of the bank in use left unwritten by a failure */
+    epicsMutexId priorityMutex;   /* Guards pPriorityOps, see drvAnc350BurstPriority */
+    struct anc350Op * pPriorityOps;  /* Operations to send ahead of the next burst group */
+    int nPriorityOps;
+    double priorityTimeout;
+    int inhibit;                  /* Controller inhibit input, see anc350Inhibit.c */
+    epicsEventId inhibitEvent;
+    epicsThreadId inhibitThread;
+    int inhibitRejects;
+    int inhibitStops;
+    double inhibitLatencyMax;
+    double getTimeout;            /* Ack timeout of a single GET (s), see anc350Tune.c */
+    double setTimeout;            /* Write timeout of a single SET (s) */
+    double burstTimeout;          /* Ack timeout of the driver's bursts (s) */
+    int commErrorLimit;           /* Failed GETs in a row before the axes report a comms error */
+    int commErrors;               /* Failed GETs in a row */
+    int tuneRejects;              /* Tuning values rejected as out of range */
+} drvAnc350_t;
+
+/* Number of telegram send times kept in a latency span */
+#define ANC350_SPAN_TELEGRAMS 6
+
+/*
+ * Latency span of one move, home or jog, see anc350Trace.c.  Times are
+ * only valid if the matching ANC350_SPAN_... bit is set in flags.
+ */
+typedef struct anc350Span
+{
+    int card;
+    int axis;
+    int kind;                     /* ANC350_SPAN_MOVE, _HOME or _JOG */
+    int flags;
+    epicsTimeStamp entry;         /* Command entry */
+    int nTelegrams;
+    int address[ANC350_SPAN_TELEGRAMS];
+    epicsTimeStamp sent[ANC350_SPAN_TELEGRAMS];
+    epicsTimeStamp runningSeen;   /* First poll that saw RUNNING */
+    epicsTimeStamp runningLast;   /* Last poll that saw RUNNING, valid with runningSeen */
+    epicsTimeStamp runningCleared;/* First poll that saw RUNNING clear */
+    epicsTimeStamp donePublished; /* Done set in the motor parameters */
+    epicsTimeStamp callbackDone;  /* Motor record callback returned */
+} anc350Span;
+
+#define ANC350_SPAN_MOVE 0
+#define ANC350_SPAN_HOME 1
+#define ANC350_SPAN_JOG  2
+
+#define ANC350_SPAN_OPEN      0x01
+#define ANC350_SPAN_RUNNING   0x02
+#define ANC350_SPAN_CLEARED   0x04
+#define ANC350_SPAN_DONE      0x08
+#define ANC350_SPAN_CALLBACK  0x10
+#define ANC350_SPAN_STARTED   0x20  /* RUN or jog sent, earlier polls are ignored */
+
+/* Number of terms of a move duration model, see anc350Estimate.c */
+#define ANC350_EST_TERMS 3
+
+/* Recursive least squares fit of move duration against distance */
+typedef struct anc350EstModel
+{
+    int n;                        /* Moves learned */
+    double theta[ANC350_EST_TERMS];
+    double p[ANC350_EST_TERMS][ANC350_EST_TERMS];
+} anc350EstModel;
+
+/* Motion statistics histograms, see anc350Stats.c */
+#define ANC350_STAT_KIND_DURATION  0
+#define ANC350_STAT_KIND_POLLS     1
+#define ANC350_STAT_KIND_OVERSHOOT 2
+#define ANC350_STAT_KIND_ERROR     3
+#define ANC350_STAT_KIND_RETRIES   4
+#define ANC350_STAT_KINDS          5
+#define ANC350_STAT_BINS           24
+
+/* Fields of an anc350Update that are set */
+#define ANC350_UPDATE_DONE       0x1
+#define ANC350_UPDATE_HOMED      0x2
+#define ANC350_UPDATE_POSITION   0x4
+#define ANC350_UPDATE_LIMITS     0x8
+#define ANC350_UPDATE_PROBLEM    0x10
+
+/* Axis status read by the poller, delivered to the motor record by anc350Callback.c */
+typedef struct anc350Update
+{
+    int axis;
+    int generation;               /* cbGeneration of the axis when it was read */
+    unsigned int set;             /* ANC350_UPDATE_... */
+    int done;
+    int homed;                    /* Also the home signal */
+    int direction;
+    double position;              /* Also the encoder position */
+    int highLimit;
+    int lowLimit;
+    int problem;
+    int commError;
+    epicsTimeStamp posted;
+} anc350Update;
+
+typedef struct motorAxisHandle
+{
+    ANC350DRV_ID pDrv;
+    int axis;
+    asynUser * pasynUser;
+    PARAMS params;
+    motorAxisLogFunc print;
+    void * logParam;
+    epicsMutexId axisMutex;
+    epicsMutexId paramMutex;      /* Guards params, never held by the poller */
+    int pollDone;                 /* Done as last read by the poller or set by a command */
+    int commError;                /* Comms error state for the next update */
+    int cbGeneration;             /* Bumped by commands that publish Done, see anc350Callback.c */
+    int scale;
+    double previous_position;
+    double previous_direction;
+    double directionDeadband;     /* Counts moved between polls before the direction changes */
+    double reference_position;
+    int reference_search;
+    double amplitude;
+    int syncCmd;                  /* RUN command held back while moves are deferred, 0 if none */
+    int stopPending;              /* Stop sent, standstill not yet seen */
+    epicsTimeStamp stopStart;     /* When the stop was sent */
+    double stopTime;              /* Stop to standstill time of the last stop (seconds) */
+    int holdEnable;               /* Correct drift while idle */
+    double holdDeadband;          /* Drift allowed before a correction (counts) */
+    double holdInterval;          /* Minimum time between corrections (seconds) */
+    int holdValid;                /* holdTarget is set */
+    int holdActive;               /* A correction is running, not reported as motion */
+    int holdTarget;               /* Raw counter value to hold */
+    int holdCorrections;
+    double holdMaxDrift;
+    epicsTimeStamp holdLast;      /* Time of the last correction */
+    anc350Span span;              /* Latency span of the command in progress */
+    int trigEnable;               /* Program the trigger output around each move target */
+    int trigOutput;               /* Trigger number (0 based) */
+    double trigWindow;            /* Half width of the window around the target (counts) */
+    double trigEps;               /* Trigger hysteresis (counts) */
+    int trigPol;                  /* Trigger polarity */
+    int trigConfigured;           /* Axis, polarity and hysteresis have been written */
+    int trigLow;                  /* Thresholds last written */
+    int trigHigh;
+    int trigArmed;                /* Moves the trigger was armed for since it was enabled */
+    anc350EstModel estModel[2];   /* Move duration models, backward and forward */
+    int estPending;               /* A move is being timed */
+    double estDistance;           /* Distance of the move being timed (counts) */
+    double estPredicted;          /* Predicted duration of that move (seconds), -1 if unknown */
+    epicsTimeStamp estStart;      /* When its RUN command was acknowledged */
+    epicsTimeStamp estRunning;    /* Last poll that read it running, estStart before the first */
+    epicsUInt32 statHist[ANC350_STAT_KINDS][ANC350_STAT_BINS];
+    int statMoves;                /* Moves counted in the histograms */
+    int statPending;              /* A move is being followed */
+    epicsTimeStamp statStart;     /* When its RUN command was sent */
+    int statTarget;               /* Raw target of that move */
+    int statDirection;            /* 1 forward, -1 backward */
+    int statPolls;                /* Polls of the move so far */
+    double statOvershoot;         /* Peak travel past the target so far (counts) */
+    int statRetry;                /* Moves to the same target before this one */
+    int statLastValid;            /* statLastTarget is set */
+    int statLastTarget;           /* Raw target of the previous move */
+    size_t metricMoves;           /* Moves counted, changed with epicsAtomic only */
+    epicsUInt64 metricMoveTime;   /* Their total duration (microseconds), see drvAnc350MetricsAdd */
+    double idleTime;              /* Idle time before the outputs are switched off (seconds), 0 never */
+    int idleOff;                  /* Outputs switched off by the driver */
+    int idleRelais;               /* ID_ANC_RELAIS and ID_ANC_INT_EN before they were switched off */
+    int idleIntEn;
+    int idleSwitches;             /* Times the outputs were switched off */
+    epicsTimeStamp idleSince;     /* Last time the axis was seen busy */
+    double bankValue[ANC350_BANKS][ANC350_BANK_REGS];  /* Bank settings, 0 leaves the register alone */
+    int bankWritten[ANC350_BANK_REGS];  /* Raw values last written from a bank */
+    int bankWrittenMask;          /* Bits of the bankWritten entries that are set */
+    int inhibit;                  /* Axis inhibit input */
+    int inhibitPending;           /* Inhibited, stop not yet sent by the inhibit thread */
+    epicsTimeStamp inhibitStart;  /* Inhibit written */
+    epicsTimeStamp commandSent;   /* Last motion command sent, with the axis mutex held */
+} motorAxis;
+
+/* Operations drvAnc350IdleWake adds ahead of a motion command */
+#define ANC350_IDLE_OPS 2
+
+/* Axis states of a homing job, ANC350_HOME_STATE */
+#define ANC350_HOME_STATE_IDLE        0   /* Not part of a job, or aborted before starting */
+#define ANC350_HOME_STATE_WAITING     1   /* Waiting for a free search slot */
+#define ANC350_HOME_STATE_SEARCHING   2
+#define ANC350_HOME_STATE_DONE        3   /* Reference found */
+#define ANC350_HOME_STATE_FAILED      4   /* No reference found, timed out or aborted */
+#define ANC350_HOME_STATE_SKIPPED     5   /* Already had a valid reference */
+
+/* Controller problems in drvAnc350.globalStatus, see drvAnc350GetGlobalStatus */
+#define ANC350_GLOBAL_COMMS     0x1   /* Controller registers not acknowledged */
+#define ANC350_GLOBAL_OVERTEMP  0x2   /* Temperature status reports overtemperature */
+
+/*
+ * A single GET or SET on one controller register.  The caller fills in
+ * opcode, address, index and (for a SET) value; drvAnc350Burst fills in
+ * the rest.  For a GET the value read back is returned in value.
+ */
+typedef struct anc350Op
+{
+    int opcode;     /* UC_GET or UC_SET */
+    int address;    /* ID_ANC_... register address */
+    int index;      /* Axis (0 based) or trigger index */
+    int value;
+    int reason;     /* UC_REASON_... from the ack, -1 if no ack arrived */
+    int mid;        /* Correlation number used for the telegram */
+    asynStatus status;
+} anc350Op;
+
+/* anc350AsynMotor.c */
+ANC350DRV_ID drvAnc350First( void );
+ANC350DRV_ID drvAnc350FindCard( int card );
+ANC350DRV_ID drvAnc350FindPort( const char * port );
+int drvAnc350NextMid( void );
+void drvAnc350Poll( ANC350DRV_ID pDrv, int forced );
+double drvAnc350StopWait( ANC350DRV_ID pDrv, double timeout );
+
+/* anc350Burst.c */
+int drvAnc350BurstConnect( ANC350DRV_ID pDrv, const char * port, int addr );
+int drvAnc350Burst( ANC350DRV_ID pDrv, anc350Op * ops, int nOps, double timeout );
+int drvAnc350BurstStart( ANC350DRV_ID pDrv, anc350Op * ops, int nOps, double timeout );
+int drvAnc350BurstPriority( ANC350DRV_ID pDrv, anc350Op * ops, int nOps, double timeout );
+int drvAnc350BurstFinish( ANC350DRV_ID pDrv, anc350Op * ops, int nOps, double timeout );
+void drvAnc350OpGet( anc350Op * op, int address, int index );
+void drvAnc350OpSet( anc350Op * op, int address, int index, int value );
+
+/* anc350Registers.c */
+#define ANC350_REG_AXIS     0   /* One value per axis, index is the axis */
+#define ANC350_REG_GLOBAL   1   /* Controller wide, index 0 only */
+#define ANC350_REG_TRIGGER  2   /* One value per trigger, index is the trigger */
+
+typedef struct anc350Register
+{
+    const char * name;
+    int address;
+    int scope;
+} anc350Register;
+
+extern const anc350Register anc350Registers[];
+extern const int anc350NumRegisters;
+const anc350Register * anc350FindRegister( const char * name );
+
+/* anc350ParamPort.c */
+typedef enum
+{
+    ANC350_SNAPSHOT,            /* Write 1 to capture a crate-wide register snapshot */
+    ANC350_SNAPSHOT_DIR,        /* Directory snapshot files are written to */
+    ANC350_SNAPSHOT_REF,        /* Reference snapshot file to diff against, may be empty */
+    ANC350_SNAPSHOT_FILE,       /* Name of the last snapshot file written */
+    ANC350_SNAPSHOT_DIFFS,      /* Differences found against the reference */
+    ANC350_SNAPSHOT_TIME,       /* Seconds taken by the last capture */
+    ANC350_SYNC_DEFER,          /* Hold back the RUN commands of the group, 0 fires them */
+    ANC350_SYNC_MOVES,          /* Number of RUN commands fired last time */
+    ANC350_SYNC_SKEW,           /* Seconds between the first and last RUN write */
+    ANC350_SYNC_SKEW_LIMIT,     /* Upper bound on the start skew from the ack times (seconds) */
+    ANC350_STOP_TIME,           /* Axis: stop to standstill time of the last stop (seconds) */
+    ANC350_HOLD,                /* Axis: hold the position while idle */
+    ANC350_HOLD_DEADBAND,       /* Axis: drift allowed before a correction (counts) */
+    ANC350_HOLD_INTERVAL,       /* Axis: minimum time between corrections (seconds) */
+    ANC350_HOLD_CORRECTIONS,    /* Axis: corrections made since hold was enabled */
+    ANC350_HOLD_DRIFT,          /* Axis: drift seen at the last idle poll (counts) */
+    ANC350_HOLD_MAX_DRIFT,      /* Axis: largest drift seen since hold was enabled (counts) */
+    ANC350_TRIG,                /* Axis: arm the trigger output around each move target */
+    ANC350_TRIG_OUTPUT,         /* Axis: trigger number to use (0 based) */
+    ANC350_TRIG_WINDOW,         /* Axis: half width of the trigger window (counts) */
+    ANC350_TRIG_EPS,            /* Axis: trigger hysteresis (counts) */
+    ANC350_TRIG_POL,            /* Axis: trigger polarity */
+    ANC350_TRIG_ARMED,          /* Axis: moves the trigger was armed for since it was enabled */
+    ANC350_SAMPLE_PERIOD,       /* Crate-wide sampling period (seconds), 0 stops sampling */
+    ANC350_SAMPLE_POSITIONS,    /* Positions of every axis at the last tick (waveform) */
+    ANC350_SAMPLE_STATUS,       /* Status words of every axis at the last tick (waveform) */
+    ANC350_SAMPLE_COUNT,        /* Ticks since sampling was started */
+    ANC350_SAMPLE_MISSED,       /* Ticks skipped because the previous one overran */
+    ANC350_SAMPLE_SKEW,         /* Seconds between the first and last controller write of the last tick */
+    ANC350_SAMPLE_SKEW_MAX,     /* Largest skew since sampling was started */
+    ANC350_SAMPLE_OFFSET,       /* Controller: offset of its write from the first of the last tick (seconds) */
+    ANC350_SAMPLE_OFFSET_MAX,   /* Controller: largest offset seen */
+    ANC350_GLOBAL_STATUS,       /* Controller: ANC350_GLOBAL_... problem bits, applied to every axis */
+    ANC350_TEMP_STATUS,         /* Controller: temperature status, 1 ok, 0 overtemperature */
+    ANC350_SENSOR_VOLT,         /* Controller: resistive sensor reference voltage (V) */
+    ANC350_EST_DISTANCE,        /* Axis: move distance to predict the duration of (counts) */
+    ANC350_EST_DURATION,        /* Axis: predicted duration of a move of ANC350_EST_DISTANCE (seconds) */
+    ANC350_EST_PREDICTED,       /* Axis: predicted duration of the move in progress (seconds) */
+    ANC350_EST_LAST,            /* Axis: measured duration of the last learned move (seconds) */
+    ANC350_EST_ERROR,           /* Axis: measured less predicted duration of the last learned move */
+    ANC350_EST_MOVES,           /* Axis: moves learned in both directions */
+    ANC350_STAT_DURATION,       /* Axis: histogram of move durations (waveform) */
+    ANC350_STAT_POLLS,          /* Axis: histogram of polls to Done (waveform) */
+    ANC350_STAT_OVERSHOOT,      /* Axis: histogram of peak overshoot past the target (waveform) */
+    ANC350_STAT_ERROR,          /* Axis: histogram of final error against the target (waveform) */
+    ANC350_STAT_RETRIES,        /* Axis: histogram of retries before each move (waveform) */
+    ANC350_STAT_MOVES,          /* Axis: moves counted in the histograms */
+    ANC350_STAT_RESET,          /* Axis: write 1 to clear the histograms */
+    ANC350_CB_LAG,              /* Controller: age of the oldest update in the last callback pass (seconds) */
+    ANC350_CB_DROPPED,          /* Controller: updates dropped because the callback ring was full */
+    ANC350_VERIFY_RATE,         /* Configuration registers verified per second per controller, 0 stops */
+    ANC350_VERIFY_SWEEPS,       /* Controller: completed verification sweeps */
+    ANC350_VERIFY_DIVERGED,     /* Controller: registers found changed behind the IOC */
+    ANC350_VERIFY_LAST,         /* Controller: the last change found */
+    ANC350_CFG_AMPLITUDE,       /* Axis: amplitude from the verified configuration (V) */
+    ANC350_CFG_FREQUENCY,       /* Axis: frequency from the verified configuration (Hz) */
+    ANC350_HOME_ALL,            /* Write 1 to home every controller, 0 to abort; 1 while a job runs */
+    ANC350_HOME_DIR,            /* Search forwards first if non-zero */
+    ANC350_HOME_LIMIT,          /* Searches at once per controller, 0 for every axis */
+    ANC350_HOME_TIMEOUT,        /* Time allowed for each axis (seconds), 0 for the default */
+    ANC350_HOME_ACTIVE,         /* Searches running */
+    ANC350_HOME_REMAINING,      /* Axes waiting or searching */
+    ANC350_HOME_FAILED,         /* Axes that found no reference */
+    ANC350_HOME_TIME,           /* Seconds since the job started */
+    ANC350_HOME_STATE,          /* Axis: ANC350_HOME_STATE_... */
+    ANC350_HOME_ELAPSED,        /* Axis: search time (seconds) */
+    ANC350_IDLE_TIME,           /* Axis: idle time before the outputs are switched off (seconds), 0 never */
+    ANC350_IDLE_OFF,            /* Axis: outputs switched off while idle */
+    ANC350_IDLE_SWITCHES,       /* Axis: times the outputs were switched off */
+    ANC350_TEMPERATURE,         /* Controller: positioner temperature (K), from an external PV */
+    ANC350_BANK_COLD_BELOW,     /* Controller: use the cold bank below this temperature (K) */
+    ANC350_BANK_WARM_ABOVE,     /* Controller: use the warm bank above this temperature (K) */
+    ANC350_BANK,                /* Controller: bank in use, 0 none, 1 warm, 2 cold */
+    ANC350_BANK_SWITCHES,       /* Controller: bank switches since start */
+    ANC350_BANK_LAST,           /* Controller: the last switch */
+    ANC350_BANK_WARM_FREQ,      /* Axis: warm bank frequency (Hz) */
+    ANC350_BANK_WARM_AMPL,      /* Axis: warm bank amplitude (V) */
+    ANC350_BANK_WARM_MAX_AMPL,  /* Axis: warm bank maximum amplitude (V) */
+    ANC350_BANK_WARM_SPD_GAIN,  /* Axis: warm bank speed gain (1/s) */
+    ANC350_BANK_COLD_FREQ,      /* Axis: cold bank frequency (Hz) */
+    ANC350_BANK_COLD_AMPL,      /* Axis: cold bank amplitude (V) */
+    ANC350_BANK_COLD_MAX_AMPL,  /* Axis: cold bank maximum amplitude (V) */
+    ANC350_BANK_COLD_SPD_GAIN,  /* Axis: cold bank speed gain (1/s) */
+    ANC350_INHIBIT,             /* Axis: inhibit input, stops the axis and rejects commands */
+    ANC350_INHIBIT_ALL,         /* Controller: inhibit input for every axis */
+    ANC350_INHIBITED,           /* Axis: inhibited by either input */
+    ANC350_INHIBIT_LATENCY,     /* Controller: inhibit to stop acknowledged, last (s) */
+    ANC350_INHIBIT_LATENCY_MAX, /* Controller: inhibit to stop acknowledged, maximum (s) */
+    ANC350_INHIBIT_REJECTS,     /* Controller: commands rejected while inhibited */
+    ANC350_INHIBIT_STOPS,       /* Controller: axes stopped by an inhibit */
+    ANC350_TUNE_MOVING_POLL,    /* Controller: poll period while an axis moves (s) */
+    ANC350_TUNE_IDLE_POLL,      /* Controller: poll period of idle axes and the global status (s) */
+    ANC350_TUNE_GET_TIMEOUT,    /* Controller: ack timeout of a single GET (s) */
+    ANC350_TUNE_SET_TIMEOUT,    /* Controller: write timeout of a single SET (s) */
+    ANC350_TUNE_BURST_TIMEOUT,  /* Controller: ack timeout of the stop, wake and global status bursts (s) */
+    ANC350_TUNE_COMM_ERRORS,    /* Controller: failed GETs in a row before a comms error */
+    ANC350_TUNE_PIPELINE,       /* Controller: telegrams in flight in a burst */
+    ANC350_TUNE_DEFAULTS,       /* Controller: write 1 to restore every tuning value of the controller */
+    ANC350_TUNE_REJECTS,        /* Controller: tuning values rejected as out of range */
+    ANC350_TUNE_DIRECTION,      /* Axis: counts moved between polls before the direction changes */
+    ANC350_NUM_PARAMS
+} anc350Param_t;
+
+void anc350ParamSetInteger( ANC350DRV_ID pDrv, int addr, int reason, int value );
+void anc350ParamSetDouble( ANC350DRV_ID pDrv, int addr, int reason, double value );
+void anc350ParamSetString( ANC350DRV_ID pDrv, int addr, int reason, const char * value );
+void anc350ParamSetDoubleArray( ANC350DRV_ID pDrv, int addr, int reason, const double * value, size_t nElements,
+                                const epicsTimeStamp * pTime );
+int anc350ParamGetInteger( ANC350DRV_ID pDrv, int addr, int reason, int * value );
+int anc350ParamGetDouble( ANC350DRV_ID pDrv, int addr, int reason, double * value );
+int anc350ParamGetString( ANC350DRV_ID pDrv, int addr, int reason, char * value, size_t maxChars );
+
+/* anc350Snapshot.c */
+asynStatus anc350SnapshotParamWrite( void );
+
+/* anc350Hold.c */
+void drvAnc350HoldInit( AXIS_HDL pAxis );
+void drvAnc350HoldSet( AXIS_HDL pAxis, int valid, int target );
+int drvAnc350HoldCheck( AXIS_HDL pAxis, int running, int counter );
+void anc350HoldParamInit( ANC350DRV_ID pDrv );
+asynStatus anc350HoldParamWrite( ANC350DRV_ID pDrv, int addr, int reason );
+
+/* anc350Trigger.c */
+void drvAnc350TriggerInit( AXIS_HDL pAxis );
+int drvAnc350TriggerArm( AXIS_HDL pAxis, int target );
+void anc350TriggerParamInit( ANC350DRV_ID pDrv );
+asynStatus anc350TriggerParamWrite( ANC350DRV_ID pDrv, int addr, int reason );
+
+/* anc350Estimate.c */
+void drvAnc350EstimateInit( AXIS_HDL pAxis );
+double drvAnc350EstimatePredict( AXIS_HDL pAxis, double distance );
+void drvAnc350EstimateStart( AXIS_HDL pAxis, double distance );
+void drvAnc350EstimateCancel( AXIS_HDL pAxis );
+void drvAnc350EstimateRunning( AXIS_HDL pAxis );
+void drvAnc350EstimateDone( AXIS_HDL pAxis, int hump );
+double drvAnc350EstimateWait( ANC350DRV_ID pDrv, double timeout );
+void anc350EstimateParamInit( ANC350DRV_ID pDrv );
+asynStatus anc350EstimateParamWrite( ANC350DRV_ID pDrv, int addr, int reason );
+size_t drvAnc350EstimateKeep( AXIS_HDL pAxis, void * buf, size_t size );
+int drvAnc350EstimateRestore( AXIS_HDL pAxis, int version, const void * buf, size_t length );
+
+/* anc350Stats.c */
+void drvAnc350StatsInit( AXIS_HDL pAxis );
+void drvAnc350StatsStart( AXIS_HDL pAxis, int target );
+void drvAnc350StatsCancel( AXIS_HDL pAxis );
+void drvAnc350StatsPoll( AXIS_HDL pAxis, int running, int counter );
+void anc350StatsParamInit( ANC350DRV_ID pDrv );
+asynStatus anc350StatsParamWrite( ANC350DRV_ID pDrv, int addr, int reason );
+size_t drvAnc350StatsKeep( AXIS_HDL pAxis, void * buf, size_t size );
+int drvAnc350StatsRestore( AXIS_HDL pAxis, int version, const void * buf, size_t length );
+
+/* anc350Store.c */
+void drvAnc350StoreChanged( void );
+
+/* anc350Callback.c */
+int drvAnc350CallbackCreate( ANC350DRV_ID pDrv );
+void drvAnc350CallbackPost( AXIS_HDL pAxis, anc350Update * pUpdate );
+void drvAnc350CallbackCommand( AXIS_HDL pAxis, int done );
+
+/* anc350Metrics.c */
+typedef struct anc350MetricsText    /* Response under construction */
+{
+    char * buf;
+    size_t len;
+    size_t size;
+} anc350MetricsText;
+
+void drvAnc350MetricsRtt( ANC350DRV_ID pDrv, const epicsTimeStamp * pStart );
+void drvAnc350MetricsAdd( epicsUInt64 * pCounter, double seconds );
+void drvAnc350MetricsRender( anc350MetricsText * pText );
+
+/* anc350Idle.c */
+void drvAnc350IdleInit( AXIS_HDL pAxis );
+int drvAnc350IdleWake( AXIS_HDL pAxis, anc350Op * ops );
+void drvAnc350IdleWoken( AXIS_HDL pAxis, const anc350Op * ops, int nOps );
+void drvAnc350IdleCheck( AXIS_HDL pAxis, int running );
+void anc350IdleParamInit( ANC350DRV_ID pDrv );
+asynStatus anc350IdleParamWrite( ANC350DRV_ID pDrv, int addr, int reason );
+
+/* anc350Inhibit.c */
+void drvAnc350InhibitInit( ANC350DRV_ID pDrv );
+int drvAnc350Inhibited( AXIS_HDL pAxis );
+void drvAnc350InhibitRejected( AXIS_HDL pAxis, const char * what );
+void anc350InhibitParamInit( ANC350DRV_ID pDrv );
+asynStatus anc350InhibitParamWrite( ANC350DRV_ID pDrv, int addr, int reason );
+
+/* anc350Tune.c */
+void drvAnc350TuneInit( ANC350DRV_ID pDrv );
+void anc350TuneParamInit( ANC350DRV_ID pDrv );
+asynStatus anc350TuneParamWrite( ANC350DRV_ID pDrv, int addr, int reason );
+
+/* anc350Bank.c */
+void drvAnc350BankInit( ANC350DRV_ID pDrv );
+void anc350BankParamInit( ANC350DRV_ID pDrv );
+asynStatus anc350BankParamWrite( ANC350DRV_ID pDrv, int addr, int reason );
+
+/* anc350Home.c */
+asynStatus anc350HomeParamWrite( void );
+
+/* anc350Verify.c */
+void drvAnc350VerifyNote( ANC350DRV_ID pDrv, int index, int address, int value );
+asynStatus anc350VerifyParamWrite( void );
+
+/* anc350Sim.c */
+void drvAnc350TimeGetCurrent( epicsTimeStamp * pNow );
+void drvAnc350Sleep( double seconds );
+int drvAnc350SimIsVirtual( const char * port );
+
+/* anc350Trace.c */
+void drvAnc350TraceStart( AXIS_HDL pAxis, int kind );
+void drvAnc350TraceTelegram( AXIS_HDL pAxis, int address );
+void drvAnc350TraceStatus( AXIS_HDL pAxis, int running );
+void drvAnc350TraceCallback( AXIS_HDL pAxis );
+
+/* anc350Sync.c */
+int drvAnc350SyncDefer( AXIS_HDL pAxis, int cmd );
+void drvAnc350SyncCancel( AXIS_HDL pAxis );
+void drvAnc350SyncDeferMoves( ANC350DRV_ID pDrv, int defer );
+asynStatus anc350SyncParamWrite( int group );
+
+/* anc350Sample.c */
+asynStatus anc350SampleParamWrite( void );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
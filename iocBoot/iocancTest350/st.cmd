@@ -10,6 +10,8 @@ ancTest350_registerRecordDeviceDriver(pdbbase)
 
 #drvAsynIPPortConfigure("IP1","172.27.13.14",0,0,0)
 drvAsynIPPortConfigure("IP1","localhost:2101",0,0,0)
+# Native transport, writes held up to 1 ms to be sent together
+#anc350IPConfigure("IP1","172.27.13.14:2101","0.001")
 
 #=========================================================================
 #  int anc350AsynMotorCreate(
@@ -32,9 +34,50 @@ anc350AsynMotorCreate("IP1","0","0","4")
 drvAsynMotorConfigure("ANC1", "anc350AsynMotor","0","4")
 #drvAsynMotorConfigure("ANC1", "drvANC150Asyn","0","1")
 
+#=========================================================================
+#  int anc350ParamPortConfigure(
+#           char portName, /* Name of the asyn parameter port to create */
+#           int  card,     /* Controller card, -1 for the crate wide port */ )
+##=========================================================================
+
+#anc350ParamPortConfigure("ANCP0","0")
+#anc350ParamPortConfigure("ANCCRATE","-1")
+
+## Start the moves of cards 0 and 1 together, see db/anc350SyncGroup.template
+#anc350SyncGroupAdd("1","0")
+#anc350SyncGroupAdd("1","1")
+
+## Keep move duration models and motion statistics in the calibration store
+#anc350StoreConfigure("/tmp/anc350Store.bin")
+
+## Check the controller configuration in the background, 2 registers/s
+#anc350VerifyStart("2")
+
+## After a power cycle: reference search of every axis of cards 0 and 1,
+## forwards first, at most 3 searches at once per controller
+#anc350HomeAll("0,1","1","3","120")
+
+## Save the traced moves of card 0 for the offline poll strategy simulator,
+## bin/<host>/anc350PollSim -m 0.2 -i 2 /tmp/anc350Session.txt
+#anc350TraceSession("0","/tmp/anc350Session.txt")
+
+## Driver health for the site monitoring, http://127.0.0.1:9350/metrics
+#anc350MetricsConfigure("127.0.0.1:9350")
+
+## Poller harness: a simulated controller on virtual time, run for an hour
+## of virtual time with 2000 count moves and a home every 50 commands
+#anc350SimConfigure("SIM1","4","1","10000","0.0005")
+#anc350AsynMotorCreate("SIM1","0","9","4")
+#anc350SimRun("9","3600","2000","1.0","50","0.6")
+
 ## Load record instances
 dbLoadRecords("db/ancTest.db", "")
 #dbLoadRecords("db/SIOC-DMP1-MC11-motor.db","")
+#dbLoadRecords("db/anc350Crate.template","P=T1:ANC,PORT=ANCCRATE,DIR=/tmp")
+#dbLoadRecords("db/anc350SyncGroup.template","P=T1:ANC,PORT=ANCCRATE,GROUP=1")
+#dbLoadRecords("db/anc350Controller.template","P=T1:ANC0,PORT=ANCP0")
+#dbLoadRecords("db/anc350Axis.template","P=T1:M1,PORT=ANCP0,AXIS=1")
+#dbLoadRecords("db/anc350Tune.template","P=T1:ANC0,PORT=ANCP0")
 #dbLoadRecords("db/asynRecord.db","P=T1:M1:,R=ASYN,PORT=IP1,ADDR=0,IMAX=200,OMAX=200")
 #cd ${TOP}/iocBoot/${IOC}
 iocInit()